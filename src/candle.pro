@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       = core gui opengl serialport
+QT       = core gui opengl serialport concurrent network
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 win32: {
@@ -49,12 +49,36 @@ SOURCES += main.cpp\
     drawers/shaderdrawable.cpp \
     drawers/tooldrawer.cpp \
     drawers/selectiondrawer.cpp \
+    parser/aircuteliminator.cpp \
+    parser/arcfitter.cpp \
     parser/arcproperties.cpp \
+    parser/gcodecompactor.cpp \
     parser/gcodeparser.cpp \
     parser/gcodepreprocessorutils.cpp \
+    parser/gcodevalidator.cpp \
     parser/gcodeviewparse.cpp \
+    parser/heightmapcompensator.cpp \
     parser/linesegment.cpp \
+    parser/modalstate.cpp \
     parser/pointsegment.cpp \
+    parser/rastergenerator.cpp \
+    parser/retractoptimizer.cpp \
+    parser/toolpathsimplifier.cpp \
+    parser/traveloptimizer.cpp \
+    remote/controlserver.cpp \
+    serial/grbljog.cpp \
+    serial/errorpolicy.cpp \
+    serial/grbloverrides.cpp \
+    serial/grblstatusparser.cpp \
+    serial/grblstreamer.cpp \
+    serial/recordingdevice.cpp \
+    serial/replaydevice.cpp \
+    serial/serialportdevice.cpp \
+    serial/serialworker.cpp \
+    serial/streamermetrics.cpp \
+    serial/streamjob.cpp \
+    serial/trafficlog.cpp \
+    serial/wirebuffer.cpp \
     tables/gcodetablemodel.cpp \
     tables/heightmaptablemodel.cpp \
     widgets/colorpicker.cpp \
@@ -75,15 +99,43 @@ HEADERS  += frmmain.h \
     drawers/origindrawer.h \
     drawers/shaderdrawable.h \
     drawers/tooldrawer.h \
+    parser/aircuteliminator.h \
+    parser/arcfitter.h \
     parser/arcproperties.h \
+    parser/gcodecompactor.h \
     parser/gcodeparser.h \
     parser/gcodepreprocessorutils.h \
+    parser/gcodevalidator.h \
     parser/gcodeviewparse.h \
+    parser/heightmapcompensator.h \
     parser/linesegment.h \
+    parser/modalstate.h \
     parser/pointsegment.h \
+    parser/rastergenerator.h \
+    parser/retractoptimizer.h \
+    parser/toolpathsimplifier.h \
+    parser/traveloptimizer.h \
+    remote/controlserver.h \
+    serial/bytedevice.h \
+    serial/grbljog.h \
+    serial/errorpolicy.h \
+    serial/grbloverrides.h \
+    serial/grblstatusparser.h \
+    serial/grblstreamer.h \
+    serial/machinestate.h \
+    serial/recordingdevice.h \
+    serial/replaydevice.h \
+    serial/serialportdevice.h \
+    serial/serialworker.h \
+    serial/streamermetrics.h \
+    serial/streamjob.h \
+    serial/trafficlog.h \
+    serial/wirebuffer.h \
     tables/gcodetablemodel.h \
     tables/heightmaptablemodel.h \
+    utils/histogram.h \
     utils/interpolation.h \
+    utils/spscqueue.h \
     utils/util.h \
     widgets/colorpicker.h \
     widgets/combobox.h \
@@ -31,6 +31,16 @@ void GcodeDrawer::update(QList<int> indexes)
     m_indexes += indexes;
 }
 
+void GcodeDrawer::setDrawnBefore(int lineNumber)
+{
+    QList<LineSegment*> *list = m_viewParser->getLines();
+
+    for (int i = 0; i < list->count(); i++) list->at(i)->setDrawn(list->at(i)->getLineNumber() < lineNumber);
+
+    // Whole geometry is rebuilt once instead of updating every segment vertices
+    update();
+}
+
 bool GcodeDrawer::updateData()
 {
     switch (m_drawMode) {
@@ -21,6 +21,7 @@ public:
 
     void update();
     void update(QList<int> indexes);
+    void setDrawnBefore(int lineNumber);
     bool updateData();
 
     QVector3D getSizes();
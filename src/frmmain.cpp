@@ -13,10 +13,14 @@
 #define QUEUE 6
 #define CHECK 7
 #define DOOR 8
+#define JOG 9
+#define SLEEP 10
 
 #define PROGRESSMINLINES 10000
 #define PROGRESSSTEP     1000
 
+#define PROGRAMCHECKCHUNK 10000
+
 #include <QFileDialog>
 #include <QTextStream>
 #include <QDebug>
@@ -30,17 +34,49 @@
 #include <QAction>
 #include <QLayout>
 #include <QMimeData>
+#include <QtConcurrent>
+#include <QInputDialog>
 #include "frmmain.h"
 #include "ui_frmmain.h"
 
+// Program part checked by one pool thread, items list is shared
+struct ProgramCheckChunk {
+    QList<GCodeItem> items;
+    int first;
+    int last;
+    GcodeValidator validator;
+};
+
+static QList<GcodeValidator::Error> checkProgramChunk(const ProgramCheckChunk &chunk)
+{
+    QList<GcodeValidator::Error> errors;
+    GcodeValidator validator = chunk.validator;
+
+    validator.setState(chunk.items.at(chunk.first).modal);
+
+    for (int i = chunk.first; i < chunk.last; i++) {
+        const GCodeItem &item = chunk.items.at(i);
+        int code = validator.checkLine(item.command, item.args);
+
+        if (code != GcodeValidator::NoError) {
+            GcodeValidator::Error error = {i, code};
+            errors.append(error);
+        }
+    }
+
+    return errors;
+}
+
 frmMain::frmMain(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::frmMain)
 {
-    m_status << "Unknown" << "Idle" << "Alarm" << "Run" << "Home" << "Hold" << "Queue" << "Check" << "Door";
-    m_statusCaptions << tr("Unknown") << tr("Idle") << tr("Alarm") << tr("Run") << tr("Home") << tr("Hold") << tr("Queue") << tr("Check") << tr("Door");
-    m_statusBackColors << "red" << "palette(button)" << "red" << "lime" << "lime" << "yellow" << "yellow" << "palette(button)" << "red";
-    m_statusForeColors << "white" << "palette(text)" << "white" << "black" << "black" << "black" << "black" << "palette(text)" << "white";
+    m_statusCaptions << tr("Unknown") << tr("Idle") << tr("Alarm") << tr("Run") << tr("Home") << tr("Hold") << tr("Queue") << tr("Check") << tr("Door")
+                     << tr("Jog") << tr("Sleep");
+    m_statusBackColors << "red" << "palette(button)" << "red" << "lime" << "lime" << "yellow" << "yellow" << "palette(button)" << "red"
+                       << "cyan" << "palette(button)";
+    m_statusForeColors << "white" << "palette(text)" << "white" << "black" << "black" << "black" << "black" << "palette(text)" << "white"
+                       << "black" << "palette(text)";
 
     // Loading settings
     m_settingsFileName = qApp->applicationDirPath() + "/settings.ini";
@@ -67,6 +103,8 @@ frmMain::frmMain(QWidget *parent) :
     m_cellChanged = false;
     m_programLoading = false;
     m_currentModel = &m_programModel;
+    m_activeMachine = -1;
+    ui->cboMachine->setVisible(false);
     m_transferCompleted = true;
 
     ui->txtJogStep->setLocale(QLocale::C);
@@ -107,6 +145,9 @@ frmMain::frmMain(QWidget *parent) :
     m_probeDrawer = new GcodeDrawer();
     m_probeDrawer->setViewParser(&m_probeParser);
     m_probeDrawer->setVisible(false);
+    m_previewDrawer = new GcodeDrawer();
+    m_previewDrawer->setViewParser(&m_previewParser);
+    m_previewDrawer->setVisible(false);
     m_heightMapGridDrawer.setModel(&m_heightMapModel);
     m_currentDrawer = m_codeDrawer;
     m_toolDrawer.setToolPosition(QVector3D(0, 0, 0));
@@ -124,6 +165,7 @@ frmMain::frmMain(QWidget *parent) :
     ui->glwVisualizer->addDrawable(m_originDrawer);
     ui->glwVisualizer->addDrawable(m_codeDrawer);
     ui->glwVisualizer->addDrawable(m_probeDrawer);
+    ui->glwVisualizer->addDrawable(m_previewDrawer);
     ui->glwVisualizer->addDrawable(&m_toolDrawer);
     ui->glwVisualizer->addDrawable(&m_heightMapBorderDrawer);
     ui->glwVisualizer->addDrawable(&m_heightMapGridDrawer);
@@ -151,6 +193,21 @@ frmMain::frmMain(QWidget *parent) :
     m_senderErrorBox = new QMessageBox(QMessageBox::Warning, qApp->applicationDisplayName(), QString(),
                                        QMessageBox::Ignore | QMessageBox::Abort, this);
     m_senderErrorBox->setCheckBox(new QCheckBox(tr("Don't show again")));
+    m_senderErrorBox->setWindowModality(Qt::NonModal);
+    connect(m_senderErrorBox, SIGNAL(finished(int)), this, SLOT(onSenderErrorBoxFinished(int)));
+
+    connect(&m_programCheck, SIGNAL(finished()), this, SLOT(onProgramCheckFinished()));
+
+    connect(&m_controlServer, SIGNAL(requestReceived(int,QString,QString)), this, SLOT(onControlRequest(int,QString,QString)));
+
+    // Serial port lives in its own thread
+    m_serialWorker = new SerialWorker();
+    m_serialWorker->moveToThread(&m_serialThread);
+    connect(&m_serialThread, SIGNAL(started()), m_serialWorker, SLOT(initialize()));
+    connect(&m_serialThread, SIGNAL(finished()), m_serialWorker, SLOT(deleteLater()));
+    connect(m_serialWorker, SIGNAL(portError(QString)), this, SLOT(onSerialPortError(QString)));
+    connect(m_serialWorker, SIGNAL(replayFinished()), this, SLOT(onReplayFinished()));
+    m_serialThread.start(QThread::HighPriority);
 
     // Loading settings
     loadSettings();
@@ -159,18 +216,7 @@ frmMain::frmMain(QWidget *parent) :
 //    ui->tblProgram->showColumn(4);
 
     // Setup serial port
-    m_serialPort.setParity(QSerialPort::NoParity);
-    m_serialPort.setDataBits(QSerialPort::Data8);
-    m_serialPort.setFlowControl(QSerialPort::NoFlowControl);
-    m_serialPort.setStopBits(QSerialPort::OneStop);
-
-    if (m_settings->port() != "") {
-        m_serialPort.setPortName(m_settings->port());
-        m_serialPort.setBaudRate(m_settings->baud());
-    }
-
-    connect(&m_serialPort, SIGNAL(readyRead()), this, SLOT(onSerialPortReadyRead()), Qt::QueuedConnection);
-    connect(&m_serialPort, SIGNAL(error(QSerialPort::SerialPortError)), this, SLOT(onSerialPortError(QSerialPort::SerialPortError)));
+    if (m_settings->port() != "") m_serialWorker->setPort(m_settings->port(), m_settings->baud());
 
     // Apply settings
     foreach (StyledToolButton* button, ui->grpJog->findChildren<StyledToolButton*>(QRegExp("cmdJogStep\\d")))
@@ -180,6 +226,7 @@ frmMain::frmMain(QWidget *parent) :
     }
 
     updateControlsState();
+    setRealtimeOverrides(false);
 
     this->installEventFilter(this);
     ui->tblProgram->installEventFilter(this);
@@ -187,9 +234,9 @@ frmMain::frmMain(QWidget *parent) :
     ui->splitPanels->installEventFilter(this);
 
     connect(&m_timerConnection, SIGNAL(timeout()), this, SLOT(onTimerConnection()));
-    connect(&m_timerStateQuery, SIGNAL(timeout()), this, SLOT(onTimerStateQuery()));
+    connect(&m_timerSerialUpdate, SIGNAL(timeout()), this, SLOT(onTimerSerialUpdate()));
     m_timerConnection.start(1000);
-    m_timerStateQuery.start();
+    m_timerSerialUpdate.start();
 
     // Handle file drop
     if (qApp->arguments().count() > 1 && isGCodeFile(qApp->arguments().last())) {
@@ -201,6 +248,15 @@ frmMain::~frmMain()
 {
     saveSettings();
 
+    m_serialThread.quit();
+    m_serialThread.wait();
+
+    foreach (Machine *machine, m_machines) {
+        machine->thread.quit();
+        machine->thread.wait();
+        delete machine;
+    }
+
     delete m_senderErrorBox;
     delete ui;
 }
@@ -247,8 +303,18 @@ void frmMain::loadSettings()
     m_settings->setFontSize(set.value("fontSize", 8).toInt());
     m_settings->setPort(set.value("port").toString());
     m_settings->setBaud(set.value("baud").toInt());
-    m_settings->setIgnoreErrors(set.value("ignoreErrors", false).toBool());
+    m_settings->setErrorPolicy(set.value("errorPolicy", set.value("ignoreErrors", false).toBool()
+                                         ? ErrorPolicy::SkipAndLog : ErrorPolicy::HoldAndAsk).toInt());
+    m_settings->setCheckProgram(set.value("checkProgram", true).toBool());
     m_settings->setAutoLine(set.value("autoLine", true).toBool());
+    m_settings->setRxBufferSize(set.value("rxBufferSize", 0).toInt());
+    m_settings->setPlannerThrottle(set.value("plannerThrottle", false).toBool());
+    m_settings->setCompactProgram(set.value("compactProgram", true).toBool());
+    m_settings->setCompactDecimals(set.value("compactDecimals", -1).toInt());
+    m_settings->setMetricsFile(set.value("metricsFile", "").toString());
+    m_settings->setTrafficFile(set.value("trafficFile", "").toString());
+    m_settings->setControlSocket(set.value("controlSocket", "").toString());
+    m_settings->setMachines(set.value("machines", "").toString());
     m_settings->setToolDiameter(set.value("toolDiameter", 3).toDouble());
     m_settings->setToolLength(set.value("toolLength", 15).toDouble());
     m_settings->setAntialiasing(set.value("antialiasing", true).toBool());
@@ -274,6 +340,9 @@ void frmMain::loadSettings()
     m_settings->setSpindleSpeedMax(set.value("spindleSpeedMax", 100).toInt());
     m_settings->setLaserPowerMin(set.value("laserPowerMin", 0).toInt());
     m_settings->setLaserPowerMax(set.value("laserPowerMax", 100).toInt());
+    m_settings->setStockClearance(set.value("stockClearance", 0.5).toDouble());
+    m_settings->setAirMoveFeed(set.value("airMoveFeed", 0).toInt());
+    m_settings->setJogFeed(set.value("jogFeed", 1000).toInt());
     m_settings->setRapidSpeed(set.value("rapidSpeed", 0).toInt());
     m_settings->setHeightmapProbingFeed(set.value("heightmapProbingFeed", 0).toInt());
     m_settings->setAcceleration(set.value("acceleration", 10).toInt());
@@ -295,6 +364,8 @@ void frmMain::loadSettings()
     ui->txtSpindleSpeed->setValue(set.value("spindleSpeed", 100).toInt());
     ui->chkFeedOverride->setChecked(set.value("feedOverride", false).toBool());
     ui->sliFeed->setValue(set.value("feed", 100).toInt());
+    ui->cboRapidOverride->setCurrentIndex(set.value("rapidOverride", 0).toInt());
+    ui->txtSpindleOverride->setValue(set.value("spindleOverride", 100).toInt());
     m_settings->setUnits(set.value("units", 0).toInt());
     m_storedX = set.value("storedX", 0).toDouble();
     m_storedY = set.value("storedY", 0).toDouble();
@@ -305,6 +376,12 @@ void frmMain::loadSettings()
     m_recentFiles = set.value("recentFiles", QStringList()).toStringList();
     m_recentHeightmaps = set.value("recentHeightmaps", QStringList()).toStringList();
     m_lastFolder = set.value("lastFolder", QDir::homePath()).toString();
+    m_simplifyTolerance = set.value("simplifyTolerance", 0.01).toDouble();
+    m_arcFitTolerance = set.value("arcFitTolerance", 0.01).toDouble();
+    m_stockTop = set.value("stockTop", 0).toDouble();
+    m_rasterResolution = set.value("rasterResolution", 254).toDouble();
+    m_rasterFeed = set.value("rasterFeed", 1000).toInt();
+    m_rasterDithering = set.value("rasterDithering", 0).toInt();
 
     this->restoreGeometry(set.value("formGeometry", QByteArray()).toByteArray());
     m_settings->resize(set.value("formSettingsSize", m_settings->size()).toSize());
@@ -369,6 +446,7 @@ void frmMain::loadSettings()
     ui->grpSpindle->setChecked(set.value("spindlePanel", true).toBool());
     ui->grpFeed->setChecked(set.value("feedPanel", true).toBool());
     ui->grpJog->setChecked(set.value("jogPanel", true).toBool());
+    ui->grpMetrics->setChecked(set.value("metricsPanel", false).toBool());
 
     // Restore last commands list
     ui->cboCommand->addItems(set.value("recentCommands", QStringList()).toStringList());
@@ -384,8 +462,17 @@ void frmMain::saveSettings()
 
     set.setValue("port", m_settings->port());
     set.setValue("baud", m_settings->baud());
-    set.setValue("ignoreErrors", m_settings->ignoreErrors());
+    set.setValue("errorPolicy", m_settings->errorPolicy());
+    set.setValue("checkProgram", m_settings->checkProgram());
     set.setValue("autoLine", m_settings->autoLine());
+    set.setValue("rxBufferSize", m_settings->rxBufferSize());
+    set.setValue("plannerThrottle", m_settings->plannerThrottle());
+    set.setValue("compactProgram", m_settings->compactProgram());
+    set.setValue("compactDecimals", m_settings->compactDecimals());
+    set.setValue("metricsFile", m_settings->metricsFile());
+    set.setValue("trafficFile", m_settings->trafficFile());
+    set.setValue("controlSocket", m_settings->controlSocket());
+    set.setValue("machines", m_settings->machines());
     set.setValue("toolDiameter", m_settings->toolDiameter());
     set.setValue("toolLength", m_settings->toolLength());
     set.setValue("antialiasing", m_settings->antialiasing());
@@ -409,6 +496,9 @@ void frmMain::saveSettings()
     set.setValue("spindleSpeedMax", m_settings->spindleSpeedMax());
     set.setValue("laserPowerMin", m_settings->laserPowerMin());
     set.setValue("laserPowerMax", m_settings->laserPowerMax());
+    set.setValue("stockClearance", m_settings->stockClearance());
+    set.setValue("airMoveFeed", m_settings->airMoveFeed());
+    set.setValue("jogFeed", m_settings->jogFeed());
     set.setValue("moveOnRestore", m_settings->moveOnRestore());
     set.setValue("restoreMode", m_settings->restoreMode());
     set.setValue("rapidSpeed", m_settings->rapidSpeed());
@@ -426,11 +516,14 @@ void frmMain::saveSettings()
     set.setValue("spindleSpeed", ui->txtSpindleSpeed->value());
     set.setValue("feedOverride", ui->chkFeedOverride->isChecked());
     set.setValue("feed", ui->txtFeed->value());
+    set.setValue("rapidOverride", ui->cboRapidOverride->currentIndex());
+    set.setValue("spindleOverride", ui->txtSpindleOverride->value());
     set.setValue("userCommandsPanel", ui->grpUserCommands->isChecked());
     set.setValue("heightmapPanel", ui->grpHeightMap->isChecked());
     set.setValue("spindlePanel", ui->grpSpindle->isChecked());
     set.setValue("feedPanel", ui->grpFeed->isChecked());
     set.setValue("jogPanel", ui->grpJog->isChecked());
+    set.setValue("metricsPanel", ui->grpMetrics->isChecked());
     set.setValue("keyboardControl", ui->chkKeyboardControl->isChecked());
     set.setValue("autoCompletion", m_settings->autoCompletion());
     set.setValue("units", m_settings->units());
@@ -440,6 +533,12 @@ void frmMain::saveSettings()
     set.setValue("recentFiles", m_recentFiles);
     set.setValue("recentHeightmaps", m_recentHeightmaps);
     set.setValue("lastFolder", m_lastFolder);
+    set.setValue("simplifyTolerance", m_simplifyTolerance);
+    set.setValue("arcFitTolerance", m_arcFitTolerance);
+    set.setValue("stockTop", m_stockTop);
+    set.setValue("rasterResolution", m_rasterResolution);
+    set.setValue("rasterFeed", m_rasterFeed);
+    set.setValue("rasterDithering", m_rasterDithering);
     set.setValue("touchCommand", m_settings->touchCommand());
     set.setValue("safePositionCommand", m_settings->safePositionCommand());
     set.setValue("panelUserCommandsVisible", m_settings->panelUserCommands());
@@ -510,7 +609,7 @@ bool frmMain::saveChanges(bool heightMapMode)
 }
 
 void frmMain::updateControlsState() {
-    bool portOpened = m_serialPort.isOpen();
+    bool portOpened = m_serialWorker->isOpen();
 
     ui->grpState->setEnabled(portOpened);
     ui->grpControl->setEnabled(portOpened);
@@ -544,16 +643,30 @@ void frmMain::updateControlsState() {
                                                       || (m_recentHeightmaps.count() > 0 && m_heightMapMode)));
     ui->actFileSave->setEnabled(m_programModel.rowCount() > 1);
     ui->actFileSaveAs->setEnabled(m_programModel.rowCount() > 1);
+    ui->mnuProgram->setEnabled(!m_processingFile && !m_heightMapMode && m_programModel.rowCount() > 1);
 
     ui->tblProgram->setEditTriggers(m_processingFile ? QAbstractItemView::NoEditTriggers :
                                                          QAbstractItemView::DoubleClicked | QAbstractItemView::SelectedClicked
                                                          | QAbstractItemView::EditKeyPressed | QAbstractItemView::AnyKeyPressed);
 
-    if (!portOpened) {
+    if (!portOpened && m_activeMachine == -1) {
         ui->txtStatus->setText(tr("Not connected"));
         ui->txtStatus->setStyleSheet(QString("background-color: palette(button); color: palette(text);"));
     }
 
+    // File buttons control job of selected other machine
+    if (m_activeMachine != -1) {
+        bool streaming = m_machines.at(m_activeMachine)->streaming;
+
+        ui->cmdFileSend->setEnabled(!streaming && !m_heightMapMode && m_programModel.rowCount() > 1);
+        ui->cmdFilePause->setEnabled(streaming);
+        ui->cmdFileAbort->setEnabled(streaming);
+        updateMachineView();
+    }
+
+    // Controls above are overwritten, reapply state on next status
+    invalidateStatusView();
+
     this->setWindowTitle(m_programFileName.isEmpty() ? qApp->applicationDisplayName()
                                                      : m_programFileName.mid(m_programFileName.lastIndexOf("/") + 1) + " - " + qApp->applicationDisplayName());
 
@@ -611,36 +724,36 @@ void frmMain::updateControlsState() {
 
 void frmMain::openPort()
 {
-    if (m_serialPort.open(QIODevice::ReadWrite)) {
+    QMetaObject::invokeMethod(m_serialWorker, "openPort", Qt::BlockingQueuedConnection);
+
+    if (m_serialWorker->isOpen()) {
         ui->txtStatus->setText(tr("Port opened"));
         ui->txtStatus->setStyleSheet(QString("background-color: palette(button); color: palette(text);"));
+        invalidateStatusView();
 //        updateControlsState();
         grblReset();
     }
 }
 
-void frmMain::sendCommand(QString command, int tableIndex, bool showInConsole)
+bool frmMain::sendCommand(QString command, int type, bool showInConsole, int tableIndex)
 {
-    if (!m_serialPort.isOpen() || !m_resetCompleted) return;
+    if (!m_serialWorker->isOpen() || !m_resetCompleted) return false;
 
     command = command.toUpper();
 
-    // Commands queue
-    if ((bufferLength() + command.length() + 1) > BUFFERLENGTH) {
-//        qDebug() << "queue:" << command;
-
-        CommandQueue cq;
+    CommandAttributes ca;
 
-        cq.command = command;
-        cq.tableIndex = tableIndex;
-        cq.showInConsole = showInConsole;
+    ca.id = m_serialWorker->sendCommand(command, type == CommandAttributes::Program ? SerialCommand::Program
+                                                                                  : SerialCommand::Interactive);
 
-        m_queue.append(cq);
-        return;
+    // Program lines are sent again later, others are given up
+    if (ca.id == -1) {
+        if (type != CommandAttributes::Program && type != CommandAttributes::Jog) {
+            ui->txtConsole->appendPlainText(tr("Command queue is full, command isn't sent: ") + command);
+        }
+        return false;
     }
 
-    CommandAttributes ca;
-
 //    if (!(command == "$G" && tableIndex < -1) && !(command == "$#" && tableIndex < -1)
 //            && (!m_transferringFile || (m_transferringFile && m_showAllCommands) || tableIndex < 0)) {
     if (showInConsole) {
@@ -651,14 +764,14 @@ void frmMain::sendCommand(QString command, int tableIndex, bool showInConsole)
     }
 
     ca.command = command;
-    ca.length = command.length() + 1;
+    ca.type = type;
     ca.tableIndex = tableIndex;
 
     m_commands.append(ca);
 
     // Processing spindle speed only from g-code program
     QRegExp s("[Ss]0*(\\d+)");
-    if (s.indexIn(command) != -1 && ca.tableIndex > -2) {
+    if (s.indexIn(command) != -1 && ca.type != CommandAttributes::SpindleSpeed) {
         int speed = s.cap(1).toInt();
         if (ui->txtSpindleSpeed->value() != speed) {
             ui->txtSpindleSpeed->setValue(speed);
@@ -671,16 +784,13 @@ void frmMain::sendCommand(QString command, int tableIndex, bool showInConsole)
         m_fileEndSent = true;
     }
 
-    m_serialPort.write((command + "\r").toLatin1());
+    return true;
 }
 
 void frmMain::grblReset()
 {
     qDebug() << "grbl reset";
 
-    m_serialPort.write(QByteArray(1, (char)24));
-//    m_serialPort.flush();
-
     m_processingFile = false;
     m_transferCompleted = true;
     m_fileCommandIndex = 0;
@@ -690,559 +800,670 @@ void frmMain::grblReset()
     m_resetCompleted = false;
     m_updateSpindleSpeed = true;
     m_lastGrblStatus = -1;
-    m_statusReceived = true;
+
+    m_jog.stop();
+    m_jogRestart = false;
+
+    // Pending error decisions are obsolete
+    m_senderErrorBox->hide();
+    m_senderErrors.clear();
+    m_errorHolding = false;
+    m_errorRetrying = false;
+    m_errorRetryIndex = -1;
+    m_errorRetryId = -1;
 
     // Drop all remaining commands in buffer
     m_commands.clear();
-    m_queue.clear();
 
     // Prepare reset response catch
     CommandAttributes ca;
     ca.command = "[CTRL+X]";
     if (m_settings->showUICommands()) ui->txtConsole->appendPlainText(ca.command);
     ca.consoleIndex = m_settings->showUICommands() ? ui->txtConsole->blockCount() - 1 : -1;
+    ca.type = CommandAttributes::Reset;
     ca.tableIndex = -1;
-    ca.length = ca.command.length() + 1;
+    ca.id = m_serialWorker->reset();
     m_commands.append(ca);
 
     updateControlsState();
 }
 
-int frmMain::bufferLength()
+void frmMain::onTimerSerialUpdate()
 {
-    int length = 0;
+    SerialResponse response;
+    bool statusReceived = false;
 
-    foreach (CommandAttributes ca, m_commands) {
-        length += ca.length;
+    // Responses are processed in order, status only by last received
+    while (m_serialWorker->takeResponse(response)) {
+        if (response.type == SerialResponse::Response) processResponse(response.id, response.data);
+        else processFloatingResponse(response.data);
     }
 
-    return length;
-}
+    while (m_serialWorker->takeStatus(m_machineState)) statusReceived = true;
+    if (statusReceived) {
+        if (m_activeMachine == -1) updateStatusView();
+        processStatus();
+
+        // Control server keeps last snapshot
+        if (m_controlServer.isListening()) {
+            ControlServer::Job job;
+            job.fileName = m_programFileName;
+            job.processing = m_processingFile;
+            job.processedLines = m_processingFile ? m_fileProcessedCommandIndex + 1 : 0;
+            job.totalLines = m_currentModel->rowCount() - 1;
+            job.elapsed = m_processingFile ? m_startTime.elapsed() : 0;
+            m_controlServer.setState(m_machineState, job);
+        }
+    }
 
-void frmMain::onSerialPortReadyRead()
-{
-    while (m_serialPort.canReadLine()) {
-        QString data = m_serialPort.readLine().trimmed();
+    updateSpendTimeView();
 
-        // Filter prereset responses
-        if (m_reseting) {
-            qDebug() << "reseting filter:" << data;
-            if (!dataIsReset(data)) continue;
-            else {
-                m_reseting = false;
-                m_timerStateQuery.setInterval(m_settings->queryStateTime());
-            }
+    // Metrics are sampled by worker once a second
+    bool metricsReceived = false;
+    while (m_serialWorker->takeMetrics(m_metrics)) metricsReceived = true;
+    if (metricsReceived) {
+        updateMetricsView();
+        if (m_controlServer.isListening()) m_controlServer.setMetrics(m_metrics);
+    }
+
+    // Additional machines, only selected one is shown
+    bool machineStatusReceived = false;
+    for (int i = 0; i < m_machines.count(); i++) {
+        while (m_machines.at(i)->job->takeStatus(m_machines.at(i)->state)) {
+            if (i == m_activeMachine) machineStatusReceived = true;
         }
+    }
+    if (machineStatusReceived) updateMachineView();
 
-        // Status response
-        if (data[0] == '<') {
-            int status = -1;
+    if (m_activeMachine != -1) return;
 
-            m_statusReceived = true;
+    // Update buffer state
+    int bufferLength = m_serialWorker->bufferLength();
+    int queueLength = m_serialWorker->queueLength();
 
-            // Update machine coordinates
-            QRegExp mpx("MPos:([^,]*),([^,]*),([^,^>]*)");
-            if (mpx.indexIn(data) != -1) {
-                ui->txtMPosX->setText(mpx.cap(1));
-                ui->txtMPosY->setText(mpx.cap(2));
-                ui->txtMPosZ->setText(mpx.cap(3));
-            }
+    if (bufferLength != m_displayedState.bufferLength || queueLength != m_displayedState.queueLength) {
+        ui->glwVisualizer->setBufferState(QString(tr("Buffer: %1 / %2")).arg(bufferLength).arg(queueLength));
+        m_displayedState.bufferLength = bufferLength;
+        m_displayedState.queueLength = queueLength;
+    }
+}
+
+void frmMain::invalidateStatusView()
+{
+    for (int i = 0; i < 3; i++) {
+        m_displayedState.machinePosition[i] = qQNaN();
+        m_displayedState.workPosition[i] = qQNaN();
+    }
+    m_displayedState.status = -1;
+    m_displayedState.processingFile = !m_processingFile;
+    m_displayedState.spendTime = -1;
+    m_displayedState.bufferLength = -1;
+    m_displayedState.queueLength = -1;
+    m_displayedState.feedOverride = -1;
+    m_displayedState.rapidOverride = -1;
+    m_displayedState.spindleOverride = -1;
+}
+
+void frmMain::updateStatusView()
+{
+    // Coordinates
+    QLineEdit *machinePosition[] = {ui->txtMPosX, ui->txtMPosY, ui->txtMPosZ};
+    QLineEdit *workPosition[] = {ui->txtWPosX, ui->txtWPosY, ui->txtWPosZ};
+
+    for (int i = 0; i < 3; i++) {
+        if (m_machineState.machinePosition[i] != m_displayedState.machinePosition[i]) {
+            machinePosition[i]->setText(QString::number(m_machineState.machinePosition[i], 'f', 3));
+            m_displayedState.machinePosition[i] = m_machineState.machinePosition[i];
+        }
+        if (m_machineState.workPosition[i] != m_displayedState.workPosition[i]) {
+            workPosition[i]->setText(QString::number(m_machineState.workPosition[i], 'f', 3));
+            m_displayedState.workPosition[i] = m_machineState.workPosition[i];
+        }
+    }
 
-            // Status
-            QRegExp stx("<([^,^>]*)");
-            if (stx.indexIn(data) != -1) {
-                status = m_status.indexOf(stx.cap(1));
+    // Overrides read back, values differ from set ones until controller applies them
+    if (m_realtimeOverrides && (m_machineState.feedOverride != m_displayedState.feedOverride
+                                || m_machineState.rapidOverride != m_displayedState.rapidOverride
+                                || m_machineState.spindleOverride != m_displayedState.spindleOverride)) {
+        int feed = ui->chkFeedOverride->isChecked() ? qBound(10, ui->txtFeed->value(), 200) : 100;
+        int rapid = ui->chkFeedOverride->isChecked() ? (100 >> ui->cboRapidOverride->currentIndex()) : 100;
+        int spindle = ui->chkFeedOverride->isChecked() ? ui->txtSpindleOverride->value() : 100;
+
+        ui->txtFeed->setStyleSheet(m_machineState.feedOverride == feed ? "color: palette(text);" : "color: red;");
+        ui->cboRapidOverride->setStyleSheet(m_machineState.rapidOverride == rapid ? "color: palette(text);" : "color: red;");
+        ui->txtSpindleOverride->setStyleSheet(m_machineState.spindleOverride == spindle ? "color: palette(text);" : "color: red;");
+        ui->grpFeed->setToolTip(QString(tr("Feed: %1%, rapid: %2%, spindle: %3%")).arg(m_machineState.feedOverride)
+                                .arg(m_machineState.rapidOverride).arg(m_machineState.spindleOverride));
+
+        m_displayedState.feedOverride = m_machineState.feedOverride;
+        m_displayedState.rapidOverride = m_machineState.rapidOverride;
+        m_displayedState.spindleOverride = m_machineState.spindleOverride;
+    }
 
-                // Undetermined status
-                if (status == -1) status = 0;
+    int status = m_machineState.status;
 
-                // Update status
-                if (status != m_lastGrblStatus) {
-                    ui->txtStatus->setText(m_statusCaptions[status]);
-                    ui->txtStatus->setStyleSheet(QString("background-color: %1; color: %2;")
-                                                 .arg(m_statusBackColors[status]).arg(m_statusForeColors[status]));
-                }
+    if (status == m_displayedState.status && m_processingFile == m_displayedState.processingFile) return;
+
+    // Status
+    if (status != m_displayedState.status) {
+        ui->txtStatus->setText(m_statusCaptions[status]);
+        ui->txtStatus->setStyleSheet(QString("background-color: %1; color: %2;")
+                                     .arg(m_statusBackColors[status]).arg(m_statusForeColors[status]));
+    }
 
-                // Update controls
-                ui->cmdRestoreOrigin->setEnabled(status == IDLE);
-                ui->cmdSafePosition->setEnabled(status == IDLE);
-                ui->cmdZeroXY->setEnabled(status == IDLE);
-                ui->cmdZeroZ->setEnabled(status == IDLE);
-                ui->chkTestMode->setEnabled(status != RUN && !m_processingFile);
-                ui->chkTestMode->setChecked(status == CHECK);
-                ui->cmdFilePause->setChecked(status == HOLD || status == QUEUE);
+    // Controls
+    ui->cmdRestoreOrigin->setEnabled(status == IDLE);
+    ui->cmdSafePosition->setEnabled(status == IDLE);
+    ui->cmdZeroXY->setEnabled(status == IDLE);
+    ui->cmdZeroZ->setEnabled(status == IDLE);
+    ui->chkTestMode->setEnabled(status != RUN && !m_processingFile);
+    ui->chkTestMode->setChecked(status == CHECK);
+    ui->cmdFilePause->setChecked(status == HOLD || status == QUEUE);
 #ifdef WINDOWS
-                if (QSysInfo::windowsVersion() >= QSysInfo::WV_WINDOWS7) {
-                    if (m_taskBarProgress) m_taskBarProgress->setPaused(status == HOLD || status == QUEUE);
-                }
+    if (QSysInfo::windowsVersion() >= QSysInfo::WV_WINDOWS7) {
+        if (m_taskBarProgress) m_taskBarProgress->setPaused(status == HOLD || status == QUEUE);
+    }
 #endif
 
-                // Update "elapsed time" timer
-                if (m_processingFile) {
-                    QTime time(0, 0, 0);
-                    int elapsed = m_startTime.elapsed();
-                    ui->glwVisualizer->setSpendTime(time.addMSecs(elapsed));
-                }
+    m_displayedState.status = status;
+    m_displayedState.processingFile = m_processingFile;
+}
 
-                // Test for job complete
-                if (m_processingFile && m_transferCompleted &&
-                        ((status == IDLE && m_lastGrblStatus == RUN) || status == CHECK)) {
-                    qDebug() << "job completed:" << m_fileCommandIndex << m_currentModel->rowCount() - 1;
-
-                    // Shadow last segment
-                    GcodeViewParse *parser = m_currentDrawer->viewParser();
-                    QList<LineSegment*> list = parser->getLineSegmentList();
-                    if (m_lastDrawnLineIndex < list.count()) {
-                        list[m_lastDrawnLineIndex]->setDrawn(true);
-                        m_currentDrawer->update(QList<int>() << m_lastDrawnLineIndex);
-                    }
+void frmMain::updateMetricsView()
+{
+    if (!ui->grpMetrics->isChecked()) return;
+
+    ui->lblMetrics->setText(QString(tr("Lines: %1 /s, bytes: %2 /s\n"
+                                       "Buffer: %3 / %4, planner free: %5\n"
+                                       "Sent: %6, errors: %7, underruns: %8\n"
+                                       "Latency: %9 / %10 / %11 ms\n"
+                                       "Status: %12 ms, jitter: %13 ms"))
+                            .arg(m_metrics.linesPerSecond, 0, 'f', 1).arg(m_metrics.bytesPerSecond, 0, 'f', 0)
+                            .arg(m_metrics.bufferLength).arg(m_metrics.bufferSize)
+                            .arg(m_metrics.plannerBlocks == -1 ? QString("-") : QString::number(m_metrics.plannerBlocks))
+                            .arg(m_metrics.linesSent).arg(m_metrics.errors).arg(m_metrics.underruns)
+                            .arg(m_metrics.latency.percentile(0.5), 0, 'f', 0).arg(m_metrics.latency.percentile(0.99), 0, 'f', 0)
+                            .arg(m_metrics.latency.max(), 0, 'f', 0)
+                            .arg(m_metrics.statusInterval.percentile(0.5), 0, 'f', 0)
+                            .arg(m_metrics.statusJitter.percentile(0.99), 0, 'f', 0));
+    ui->lblMetrics->setToolTip(tr("Latency: median / 99th percentile / maximum\nJitter: 99th percentile"));
+}
 
-                    // Update state
-                    m_processingFile = false;
-                    m_fileProcessedCommandIndex = 0;
-                    m_lastDrawnLineIndex = 0;
-                    m_storedParserStatus.clear();
+void frmMain::updateSpendTimeView()
+{
+    if (!m_processingFile) return;
 
-                    updateControlsState();
+    // Visualizer shows whole seconds
+    int elapsed = m_startTime.elapsed() / 1000;
 
-                    qApp->beep();
+    if (elapsed != m_displayedState.spendTime) {
+        ui->glwVisualizer->setSpendTime(QTime(0, 0, 0).addSecs(elapsed));
+        m_displayedState.spendTime = elapsed;
+    }
+}
 
-                    m_timerStateQuery.stop();
-                    m_timerConnection.stop();
+void frmMain::processStatus()
+{
+    int status = m_machineState.status;
 
-                    QMessageBox::information(this, qApp->applicationDisplayName(), tr("Job done.\nTime elapsed: %1")
-                                             .arg(ui->glwVisualizer->spendTime().toString("hh:mm:ss")));
+    // Firmware reports overrides, so it accepts realtime override commands
+    if (!m_realtimeOverrides && (m_machineState.fields & MachineState::OverridesField)) setRealtimeOverrides(true);
 
-                    m_timerStateQuery.setInterval(m_settings->queryStateTime());
-                    m_timerConnection.start();
-                    m_timerStateQuery.start();
-                }
+    // Jog direction changed, new moves are sent after cancelled ones are flushed
+    if (m_jogRestart && status == IDLE) {
+        m_jogRestart = false;
+        startJog();
+    }
 
-                // Store status
-                if (status != m_lastGrblStatus) m_lastGrblStatus = status;
-
-                // Abort
-                static double x = sNan;
-                static double y = sNan;
-                static double z = sNan;
-
-                if (m_aborting) {
-                    switch (status) {
-                    case IDLE: // Idle
-                        if (!m_processingFile && m_resetCompleted) {
-                            m_aborting = false;
-                            restoreOffsets();
-                            restoreParserState();
-                            return;
-                        }
-                        break;
-                    case HOLD: // Hold
-                    case QUEUE:
-                        if (!m_reseting && compareCoordinates(x, y, z)) {
-                            x = sNan;
-                            y = sNan;
-                            z = sNan;
-                            grblReset();
-                        } else {
-                            x = ui->txtMPosX->text().toDouble();
-                            y = ui->txtMPosY->text().toDouble();
-                            z = ui->txtMPosZ->text().toDouble();
-                        }
-                        break;
-                    }
-                }
-            }
+    // Streaming goes on from refused line when machine stops, alarm needs user
+    if (m_errorRetrying && status == ALARM) {
+        m_errorRetrying = false;
+        holdAndAsk(m_errorRetryMessage);
+    } else if (m_errorRetrying && (status == IDLE || status == CHECK)) {
+        m_errorRetrying = false;
+        if (m_processingFile) sendNextFileCommands();
+    }
 
-            // Update work coordinates
-            QRegExp wpx("WPos:([^,]*),([^,]*),([^,^>]*)");
-            if (wpx.indexIn(data) != -1)
-            {
-                ui->txtWPosX->setText(wpx.cap(1));
-                ui->txtWPosY->setText(wpx.cap(2));
-                ui->txtWPosZ->setText(wpx.cap(3));
-                QVector3D toolPosition;
-
-                // Update tool position
-                if (!(status == CHECK && m_fileProcessedCommandIndex < m_currentModel->rowCount() - 1)) {
-                    toolPosition = QVector3D(toMetric(ui->txtWPosX->text().toDouble()),
-                                             toMetric(ui->txtWPosY->text().toDouble()),
-                                             toMetric(ui->txtWPosZ->text().toDouble()));
-                    m_toolDrawer.setToolPosition(m_codeDrawer->getIgnoreZ() ? QVector3D(toolPosition.x(), toolPosition.y(), 0) : toolPosition);
-                }
+    // Test for job complete
+    if (m_processingFile && m_transferCompleted &&
+            ((status == IDLE && m_lastGrblStatus == RUN) || status == CHECK)) {
+        qDebug() << "job completed:" << m_fileCommandIndex << m_currentModel->rowCount() - 1;
 
+        // Shadow last segment
+        GcodeViewParse *parser = m_currentDrawer->viewParser();
+        QList<LineSegment*> list = parser->getLineSegmentList();
+        if (m_lastDrawnLineIndex < list.count()) {
+            list[m_lastDrawnLineIndex]->setDrawn(true);
+            m_currentDrawer->update(QList<int>() << m_lastDrawnLineIndex);
+        }
 
-                // toolpath shadowing
-                if (m_processingFile && status != CHECK) {
-                    GcodeViewParse *parser = m_currentDrawer->viewParser();
+        // Update state
+        m_processingFile = false;
+        m_fileProcessedCommandIndex = 0;
+        m_lastDrawnLineIndex = 0;
+        m_storedParserStatus.clear();
 
-                    bool toolOntoolpath = false;
+        updateControlsState();
 
-                    QList<int> drawnLines;
-                    QList<LineSegment*> list = parser->getLineSegmentList();
+        qApp->beep();
 
-                    for (int i = m_lastDrawnLineIndex; i < list.count()
-                         && list.at(i)->getLineNumber()
-                         <= (m_currentModel->data(m_currentModel->index(m_fileProcessedCommandIndex, 4)).toInt() + 1); i++) {
-                        if (list.at(i)->contains(toolPosition)) {
-                            toolOntoolpath = true;
-                            m_lastDrawnLineIndex = i;
-                            break;
-                        }
-                        drawnLines << i;
-                    }
+        m_timerSerialUpdate.stop();
+        m_timerConnection.stop();
 
-                    if (toolOntoolpath) {
-                        foreach (int i, drawnLines) {
-                            list.at(i)->setDrawn(true);
-                        }
-                        if (!drawnLines.isEmpty()) m_currentDrawer->update(drawnLines);
-                    } else if (m_lastDrawnLineIndex < list.count()) {
-                        qDebug() << "tool missed:" << list.at(m_lastDrawnLineIndex)->getLineNumber()
-                                 << m_currentModel->data(m_currentModel->index(m_fileProcessedCommandIndex, 4)).toInt()
-                                 << m_fileProcessedCommandIndex;
-                    }
-                }
+        QMessageBox::information(this, qApp->applicationDisplayName(), tr("Job done.\nTime elapsed: %1")
+                                 .arg(ui->glwVisualizer->spendTime().toString("hh:mm:ss")));
+
+        m_timerConnection.start();
+        m_timerSerialUpdate.start();
+    }
+
+    // Store status
+    if (status != m_lastGrblStatus) m_lastGrblStatus = status;
+
+    // Abort
+    static double x = sNan;
+    static double y = sNan;
+    static double z = sNan;
+
+    if (m_aborting) {
+        switch (status) {
+        case IDLE: // Idle
+            if (!m_processingFile && m_resetCompleted) {
+                m_aborting = false;
+                restoreOffsets();
+                restoreParserState();
+                return;
+            }
+            break;
+        case HOLD: // Hold
+        case QUEUE:
+            if (!m_reseting && compareCoordinates(x, y, z)) {
+                x = sNan;
+                y = sNan;
+                z = sNan;
+                grblReset();
+            } else {
+                x = m_machineState.machinePosition[0];
+                y = m_machineState.machinePosition[1];
+                z = m_machineState.machinePosition[2];
             }
+            break;
+        }
+    }
 
-        } else if (data.length() > 0) {
+    QVector3D toolPosition;
 
-            // Processed commands
-            if (m_commands.length() > 0 && !dataIsFloating(data)
-                    && !(m_commands[0].command != "[CTRL+X]" && dataIsReset(data))) {
+    // Update tool position, unless other machine is shown
+    if (m_activeMachine == -1 && !(status == CHECK && m_fileProcessedCommandIndex < m_currentModel->rowCount() - 1)) {
+        toolPosition = QVector3D(toMetric(m_machineState.workPosition[0]),
+                                 toMetric(m_machineState.workPosition[1]),
+                                 toMetric(m_machineState.workPosition[2]));
+        m_toolDrawer.setToolPosition(m_codeDrawer->getIgnoreZ() ? QVector3D(toolPosition.x(), toolPosition.y(), 0) : toolPosition);
+    }
 
-                static QString response; // Full response string
 
-                if ((m_commands[0].command != "[CTRL+X]" && dataIsEnd(data))
-                        || (m_commands[0].command == "[CTRL+X]" && dataIsReset(data))) {
+    // toolpath shadowing
+    if (m_processingFile && status != CHECK) {
+        GcodeViewParse *parser = m_currentDrawer->viewParser();
 
-                    response.append(data);
+        bool toolOntoolpath = false;
 
-                    // Take command from buffer
-                    CommandAttributes ca = m_commands.takeFirst();
-                    QTextBlock tb = ui->txtConsole->document()->findBlockByNumber(ca.consoleIndex);
-                    QTextCursor tc(tb);
+        QList<int> drawnLines;
+        QList<LineSegment*> list = parser->getLineSegmentList();
 
-                    // Restore absolute/relative coordinate system after jog
-                    if (ca.command.toUpper() == "$G" && ca.tableIndex == -2) {
-                        if (ui->chkKeyboardControl->isChecked()) m_absoluteCoordinates = response.contains("G90");
-                        else if (response.contains("G90")) sendCommand("G90", -1, m_settings->showUICommands());
-                    }
+        for (int i = m_lastDrawnLineIndex; i < list.count()
+             && list.at(i)->getLineNumber()
+             <= (m_currentModel->data(m_currentModel->index(m_fileProcessedCommandIndex, 4)).toInt() + 1); i++) {
+            if (list.at(i)->contains(toolPosition)) {
+                toolOntoolpath = true;
+                m_lastDrawnLineIndex = i;
+                break;
+            }
+            drawnLines << i;
+        }
 
-                    // Process parser status
-                    if (ca.command.toUpper() == "$G" && ca.tableIndex == -3) {
-                        // Update status in visualizer window
-                        ui->glwVisualizer->setParserStatus(response.left(response.indexOf("; ")));
+        if (toolOntoolpath) {
+            foreach (int i, drawnLines) {
+                list.at(i)->setDrawn(true);
+            }
+            if (!drawnLines.isEmpty()) m_currentDrawer->update(drawnLines);
+        } else if (m_lastDrawnLineIndex < list.count()) {
+            qDebug() << "tool missed:" << list.at(m_lastDrawnLineIndex)->getLineNumber()
+                     << m_currentModel->data(m_currentModel->index(m_fileProcessedCommandIndex, 4)).toInt()
+                     << m_fileProcessedCommandIndex;
+        }
+    }
+}
 
-                        // Store parser status
-                        if (m_processingFile) storeParserState();
+bool frmMain::takeCommand(int id, CommandAttributes &ca)
+{
+    int i = 0;
 
-                        // Process spindle state
-                        if (!response.contains("M5")) {
-                            m_spindleCW = response.contains("M3");
-                            m_timerToolAnimation.start(25, this);
-                            ui->cmdSpindle->setChecked(true);
-                        } else {
-                            m_timerToolAnimation.stop();
-                            ui->cmdSpindle->setChecked(false);
-                        }
+    while (i < m_commands.count() && m_commands.at(i).id != id) i++;
+    if (i == m_commands.count()) return false;
 
-                        // Spindle speed
-                        QRegExp rx(".*S([\\d\\.]+)");
-                        if (rx.indexIn(response) != -1) {
-                            double speed = toMetric(rx.cap(1).toDouble()); //RPM in imperial?
-                            if (fabs(ui->txtSpindleSpeed->value() - speed) < 2.54) ui->txtSpindleSpeed->setStyleSheet("color: palette(text);");
-                        }
+    // Lanes keep own order, so older commands of same lane were dropped by sender
+    bool program = m_commands.at(i).type == CommandAttributes::Program;
 
-                        // Feed
-                        rx.setPattern(".*F([\\d\\.]+)");
-                        if (rx.indexIn(response) != -1) {
-                            double feed = toMetric(rx.cap(1).toDouble());
-                            double set = ui->chkFeedOverride->isChecked() ? m_originalFeed / 100 * ui->txtFeed->value()
-                                                                          : m_originalFeed;
-                            if (response.contains("G20")) set *= 25.4;
-                            if (fabs(feed - set) < 2.54) ui->txtFeed->setStyleSheet("color: palette(text);");
-                        }
+    for (int j = i - 1; j >= 0; j--) {
+        if ((m_commands.at(j).type == CommandAttributes::Program) == program) {
+            m_commands.removeAt(j);
+            i--;
+        }
+    }
 
-                        m_updateParserStatus = true;
-                    }
+    ca = m_commands.takeAt(i);
 
-                    // Store origin
-                    if (ca.command == "$#" && ca.tableIndex == -2) {
-                        qDebug() << "Received offsets:" << response;
-                        QRegExp rx(".*G92:([^,]*),([^,]*),([^\\]]*)");
-
-                        if (rx.indexIn(response) != -1) {
-                            if (m_settingZeroXY) {
-                                m_settingZeroXY = false;
-                                m_storedX = toMetric(rx.cap(1).toDouble());
-                                m_storedY = toMetric(rx.cap(2).toDouble());
-                            } else if (m_settingZeroZ) {
-                                m_settingZeroZ = false;
-                                m_storedZ = toMetric(rx.cap(3).toDouble());
-                            }
-                            ui->cmdRestoreOrigin->setToolTip(QString(tr("Restore origin:\n%1, %2, %3")).arg(m_storedX).arg(m_storedY).arg(m_storedZ));
-                        }
-                    }
+    return true;
+}
 
-                    // Homing response
-                    if ((ca.command.toUpper() == "$H" || ca.command.toUpper() == "$T") && m_homing) m_homing = false;
+void frmMain::processResponse(int id, QString response)
+{
 
-                    // Reset complete
-                    if (ca.command == "[CTRL+X]") {
-                        m_resetCompleted = true;
-                        m_updateParserStatus = true;
-                    }
+    // Take command from buffer, skip responses to commands dropped by reset
+    CommandAttributes ca;
+    if (!takeCommand(id, ca)) return;
+    QTextBlock tb = ui->txtConsole->document()->findBlockByNumber(ca.consoleIndex);
+    QTextCursor tc(tb);
+
+    // Keep continuous jog moves queued
+    if (ca.type == CommandAttributes::Jog) {
+        if (response.contains("error")) {
+            stopJog();
+        } else {
+            m_jog.processed(ca.id);
+            sendJogCommands();
+        }
+    }
 
-                    // Clear command buffer on "M2" & "M30" command (old firmwares)
-                    if ((ca.command.contains("M2") || ca.command.contains("M30")) && response.contains("ok") && !response.contains("[Pgm End]")) {
-                        m_commands.clear();
-                        m_queue.clear();
-                    }
+    // Restore absolute/relative coordinate system after jog
+    if (ca.type == CommandAttributes::CoordinateSystem) {
+        if (ui->chkKeyboardControl->isChecked()) m_absoluteCoordinates = response.contains("G90");
+        else if (response.contains("G90")) sendCommand("G90", CommandAttributes::User, m_settings->showUICommands());
+    }
 
-                    // Process probing on heightmap mode only from table commands
-                    if (ca.command.contains("G38.2") && m_heightMapMode && ca.tableIndex > -1) {
-                        // Get probe Z coordinate
-                        // "[PRB:0.000,0.000,0.000:0];ok"
-                        QRegExp rx(".*PRB:([^,]*),([^,]*),([^]^:]*)");
-                        double z = qQNaN();
-                        if (rx.indexIn(response) != -1) {
-                            qDebug() << "probing coordinates:" << rx.cap(1) << rx.cap(2) << rx.cap(3);
-                            z = toMetric(rx.cap(3).toDouble());
-                        }
+    // Process parser status
+    if (ca.type == CommandAttributes::ParserPoll) {
+        // Update status in visualizer window
+        ui->glwVisualizer->setParserStatus(response.left(response.indexOf("; ")));
 
-                        static double firstZ;
-                        if (m_probeIndex == -1) {
-                            firstZ = z;
-                            z = 0;
-                        } else {
-                            // Calculate delta Z
-                            z -= firstZ;
-
-                            // Calculate table indexes
-                            int row = trunc(m_probeIndex / m_heightMapModel.columnCount());
-                            int column = m_probeIndex - row * m_heightMapModel.columnCount();
-                            if (row % 2) column = m_heightMapModel.columnCount() - 1 - column;
-
-                            // Store Z in table
-                            m_heightMapModel.setData(m_heightMapModel.index(row, column), z, Qt::UserRole);
-                            ui->tblHeightMap->update(m_heightMapModel.index(m_heightMapModel.rowCount() - 1 - row, column));
-                            updateHeightMapInterpolationDrawer();
-                        }
+        // Store parser status
+        if (m_processingFile) storeParserState();
 
-                        m_probeIndex++;
-                    }
+        // Process spindle state
+        if (!response.contains("M5")) {
+            m_spindleCW = response.contains("M3");
+            m_timerToolAnimation.start(25, this);
+            ui->cmdSpindle->setChecked(true);
+        } else {
+            m_timerToolAnimation.stop();
+            ui->cmdSpindle->setChecked(false);
+        }
 
-                    // Change state query time on check mode on
-                    if (ca.command.contains(QRegExp("$[cC]"))) {
-                        m_timerStateQuery.setInterval(response.contains("Enable") ? 1000 : m_settings->queryStateTime());
-                    }
+        // Spindle speed
+        QRegExp rx(".*S([\\d\\.]+)");
+        if (rx.indexIn(response) != -1) {
+            double speed = toMetric(rx.cap(1).toDouble()); //RPM in imperial?
+            if (fabs(ui->txtSpindleSpeed->value() - speed) < 2.54) ui->txtSpindleSpeed->setStyleSheet("color: palette(text);");
+        }
 
-                    // Add response to console
-                    if (tb.isValid() && tb.text() == ca.command) {
+        // Feed
+        rx.setPattern(".*F([\\d\\.]+)");
+        if (!m_realtimeOverrides && rx.indexIn(response) != -1) {
+            double feed = toMetric(rx.cap(1).toDouble());
+            double set = ui->chkFeedOverride->isChecked() ? m_originalFeed / 100 * ui->txtFeed->value()
+                                                          : m_originalFeed;
+            if (response.contains("G20")) set *= 25.4;
+            if (fabs(feed - set) < 2.54) ui->txtFeed->setStyleSheet("color: palette(text);");
+        }
 
-                        bool scrolledDown = ui->txtConsole->verticalScrollBar()->value() == ui->txtConsole->verticalScrollBar()->maximum();
+        m_updateParserStatus = true;
+    }
 
-                        // Update text block numbers
-                        int blocksAdded = response.count("; ");
+    // Store origin
+    if (ca.type == CommandAttributes::Offsets) {
+        qDebug() << "Received offsets:" << response;
+        QRegExp rx(".*G92:([^,]*),([^,]*),([^\\]]*)");
+
+        if (rx.indexIn(response) != -1) {
+            if (m_settingZeroXY) {
+                m_settingZeroXY = false;
+                m_storedX = toMetric(rx.cap(1).toDouble());
+                m_storedY = toMetric(rx.cap(2).toDouble());
+            } else if (m_settingZeroZ) {
+                m_settingZeroZ = false;
+                m_storedZ = toMetric(rx.cap(3).toDouble());
+            }
+            ui->cmdRestoreOrigin->setToolTip(QString(tr("Restore origin:\n%1, %2, %3")).arg(m_storedX).arg(m_storedY).arg(m_storedZ));
+        }
+    }
 
-                        if (blocksAdded > 0) for (int i = 0; i < m_commands.count(); i++) {
-                            if (m_commands[i].consoleIndex != -1) m_commands[i].consoleIndex += blocksAdded;
-                        }
+    // Homing response
+    if (ca.type == CommandAttributes::Homing) m_homing = false;
 
-                        tc.beginEditBlock();
-                        tc.movePosition(QTextCursor::EndOfBlock);
+    // Reset complete
+    if (ca.type == CommandAttributes::Reset) {
+        m_reseting = false;
+        m_resetCompleted = true;
+        m_updateParserStatus = true;
 
-                        tc.insertText(" < " + QString(response).replace("; ", "\r\n"));
-                        tc.endEditBlock();
+        // Realtime overrides since grbl 1.1
+        setRealtimeOverrides(GrblStreamer::firmwareVersion(response) >= 0x0101);
 
-                        if (scrolledDown) ui->txtConsole->verticalScrollBar()->setValue(ui->txtConsole->verticalScrollBar()->maximum());
-                    }
+        // Build info gives receive buffer size
+        if (m_settings->rxBufferSize() == 0) sendCommand("$I", CommandAttributes::BuildInfo, m_settings->showUICommands());
 
-                    // Check queue
-                    if (m_queue.length() > 0) {
-                        CommandQueue cq = m_queue.takeFirst();
-                        while ((bufferLength() + cq.command.length() + 1) <= BUFFERLENGTH) {
-                            sendCommand(cq.command, cq.tableIndex, cq.showInConsole);
-                            if (m_queue.isEmpty()) break; else cq = m_queue.takeFirst();
-                        }
-                    }
+        // Machine settings give soft limits for program check
+        sendCommand("$$", CommandAttributes::MachineSettings, m_settings->showUICommands());
+    }
 
-                    // Add response to table, send next program commands
-                    if (m_processingFile) {
+    if (ca.type == CommandAttributes::MachineSettings) processMachineSettings(response);
 
-                        // Only if command from table
-                        if (ca.tableIndex > -1) {
-                            m_currentModel->setData(m_currentModel->index(ca.tableIndex, 2), GCodeItem::Processed);
-                            m_currentModel->setData(m_currentModel->index(ca.tableIndex, 3), response);
+    // Clear command buffer on "M2" & "M30" command (old firmwares)
+    if ((ca.command.contains("M2") || ca.command.contains("M30")) && response.contains("ok") && !response.contains("[Pgm End]")) {
+        m_commands.clear();
+    }
 
-                            m_fileProcessedCommandIndex = ca.tableIndex;
+    // Process probing on heightmap mode only from table commands
+    if (ca.type == CommandAttributes::Program && m_heightMapMode && ca.command.contains("G38.2")) {
+        // Get probe Z coordinate
+        // "[PRB:0.000,0.000,0.000:0];ok"
+        QRegExp rx(".*PRB:([^,]*),([^,]*),([^]^:]*)");
+        double z = qQNaN();
+        if (rx.indexIn(response) != -1) {
+            qDebug() << "probing coordinates:" << rx.cap(1) << rx.cap(2) << rx.cap(3);
+            z = toMetric(rx.cap(3).toDouble());
+        }
 
-                            if (ui->chkAutoScroll->isChecked() && ca.tableIndex != -1) {
-                                ui->tblProgram->scrollTo(m_currentModel->index(ca.tableIndex + 1, 0));
-                                ui->tblProgram->setCurrentIndex(m_currentModel->index(ca.tableIndex, 1));
-                            }
-                        }
+        static double firstZ;
+        if (m_probeIndex == -1) {
+            firstZ = z;
+            z = 0;
+        } else {
+            // Calculate delta Z
+            z -= firstZ;
+
+            // Calculate table indexes
+            int row = trunc(m_probeIndex / m_heightMapModel.columnCount());
+            int column = m_probeIndex - row * m_heightMapModel.columnCount();
+            if (row % 2) column = m_heightMapModel.columnCount() - 1 - column;
+
+            // Store Z in table
+            m_heightMapModel.setData(m_heightMapModel.index(row, column), z, Qt::UserRole);
+            ui->tblHeightMap->update(m_heightMapModel.index(m_heightMapModel.rowCount() - 1 - row, column));
+            updateHeightMapInterpolationDrawer();
+        }
 
-                        // Update taskbar progress
-#ifdef WINDOWS
-                        if (QSysInfo::windowsVersion() >= QSysInfo::WV_WINDOWS7) {
-                            if (m_taskBarProgress) m_taskBarProgress->setValue(m_fileProcessedCommandIndex);
-                        }
-#endif
-                        // Process error messages
-                        static bool holding = false;
-                        static QString errors;
+        m_probeIndex++;
+    }
 
-                        if (ca.tableIndex > -1 && response.toUpper().contains("ERROR") && !m_settings->ignoreErrors()) {
-                            errors.append(QString::number(ca.tableIndex + 1) + ": " + ca.command
-                                          + " < " + response + "\n");
+    // Change state query time on check mode on
+    if (ca.type == CommandAttributes::CheckMode) {
+        QMetaObject::invokeMethod(m_serialWorker, "setStatusInterval", Qt::QueuedConnection,
+                                  Q_ARG(int, response.contains("Enable") ? 1000 : m_settings->queryStateTime()));
+    }
 
-                            m_senderErrorBox->setText(tr("Error message(s) received:\n") + errors);
+    // Add response to console
+    if (tb.isValid() && tb.text() == ca.command) {
 
-                            if (!holding) {
-                                holding = true;         // Hold transmit while messagebox is visible
-                                response.clear();
+        bool scrolledDown = ui->txtConsole->verticalScrollBar()->value() == ui->txtConsole->verticalScrollBar()->maximum();
 
-                                m_serialPort.write("!");
-                                m_senderErrorBox->checkBox()->setChecked(false);
-                                qApp->beep();
-                                int result = m_senderErrorBox->exec();
+        // Update text block numbers
+        int blocksAdded = response.count("; ");
 
-                                holding = false;
-                                errors.clear();
-                                if (m_senderErrorBox->checkBox()->isChecked()) m_settings->setIgnoreErrors(true);
-                                if (result == QMessageBox::Ignore) m_serialPort.write("~"); else on_cmdFileAbort_clicked();
-                            }
-                        }
+        if (blocksAdded > 0) for (int i = 0; i < m_commands.count(); i++) {
+            if (m_commands[i].consoleIndex != -1) m_commands[i].consoleIndex += blocksAdded;
+        }
 
-                        // Check transfer complete (last row always blank, last command row = rowcount - 2)
-                        if (m_fileProcessedCommandIndex == m_currentModel->rowCount() - 2
-                                || ca.command.contains(QRegExp("M0*2|M30"))) m_transferCompleted = true;
-                        // Send next program commands
-                        else if (!m_fileEndSent && (m_fileCommandIndex < m_currentModel->rowCount()) && !holding) sendNextFileCommands();
-                    }
+        tc.beginEditBlock();
+        tc.movePosition(QTextCursor::EndOfBlock);
 
-                    // Scroll to first line on "M30" command
-                    if (ca.command.contains("M30")) ui->tblProgram->setCurrentIndex(m_currentModel->index(0, 1));
+        tc.insertText(" < " + QString(response).replace("; ", "\r\n"));
+        tc.endEditBlock();
 
-                    // Toolpath shadowing on check mode
-                    if (m_statusCaptions.indexOf(ui->txtStatus->text()) == CHECK) {
-                        GcodeViewParse *parser = m_currentDrawer->viewParser();
-                        QList<LineSegment*> list = parser->getLineSegmentList();
+        if (scrolledDown) ui->txtConsole->verticalScrollBar()->setValue(ui->txtConsole->verticalScrollBar()->maximum());
+    }
 
-                        if (!m_transferCompleted && m_fileProcessedCommandIndex < m_currentModel->rowCount() - 1) {
-                            int i;
-                            QList<int> drawnLines;
+    // Add response to table, send next program commands
+    if (m_processingFile) {
 
-                            for (i = m_lastDrawnLineIndex; i < list.count()
-                                 && list.at(i)->getLineNumber()
-                                 <= (m_currentModel->data(m_currentModel->index(m_fileProcessedCommandIndex, 4)).toInt()); i++) {
-                                drawnLines << i;
-                            }
+        // Lines sent after refused one are resent, their responses are obsolete
+        if (ca.type == CommandAttributes::Program && ca.id < m_errorRetryId && ca.tableIndex > m_errorRetryIndex) {
+            if (!response.toUpper().contains("ERROR")) ui->txtConsole->appendPlainText(
+                        tr("Line executed ahead of resent one, ") + QString::number(ca.tableIndex + 1) + ": " + ca.command);
+            return;
+        }
 
-                            if (!drawnLines.isEmpty() && (i < list.count())) {
-                                m_lastDrawnLineIndex = i;
-                                QVector3D vec = list.at(i)->getEnd();
-                                m_toolDrawer.setToolPosition(vec);
-                            }
+        // Only if command from table
+        if (ca.type == CommandAttributes::Program) {
+            m_currentModel->setData(m_currentModel->index(ca.tableIndex, 2), GCodeItem::Processed);
+            m_currentModel->setData(m_currentModel->index(ca.tableIndex, 3), response);
 
-                            foreach (int i, drawnLines) {
-                                list.at(i)->setDrawn(true);
-                            }
-                            if (!drawnLines.isEmpty()) m_currentDrawer->update(drawnLines);
-                        } else {
-                            foreach (LineSegment* s, list) {
-                                if (!qIsNaN(s->getEnd().length())) {
-                                    m_toolDrawer.setToolPosition(s->getEnd());
-                                    break;
-                                }
-                            }
-                        }
-                    }
+            m_fileProcessedCommandIndex = ca.tableIndex;
 
-                    response.clear();
-                } else {
-                    response.append(data + "; ");
-                }
+            if (ui->chkAutoScroll->isChecked()) {
+                ui->tblProgram->scrollTo(m_currentModel->index(ca.tableIndex + 1, 0));
+                ui->tblProgram->setCurrentIndex(m_currentModel->index(ca.tableIndex, 1));
+            }
+        }
 
-            } else {
-                // Unprocessed responses
-                qDebug() << "floating response:" << data;
+        // Update taskbar progress
+#ifdef WINDOWS
+        if (QSysInfo::windowsVersion() >= QSysInfo::WV_WINDOWS7) {
+            if (m_taskBarProgress) m_taskBarProgress->setValue(m_fileProcessedCommandIndex);
+        }
+#endif
+        // Process error messages
+        if (ca.type == CommandAttributes::Program && response.toUpper().contains("ERROR")) processError(ca, response);
+
+        // Check transfer complete (last row always blank, last command row = rowcount - 2)
+        if (m_fileProcessedCommandIndex == m_currentModel->rowCount() - 2
+                || ca.command.contains(QRegExp("M0*2|M30"))) m_transferCompleted = true;
+        // Send next program commands
+        else if (!m_fileEndSent && (m_fileCommandIndex < m_currentModel->rowCount())
+                 && !m_errorHolding && !m_errorRetrying) sendNextFileCommands();
+    }
 
-                // Handle hardware reset
-                if (dataIsReset(data)) {
-                    qDebug() << "hardware reset";
+    // Scroll to first line on "M30" command
+    if (ca.command.contains("M30")) ui->tblProgram->setCurrentIndex(m_currentModel->index(0, 1));
 
-                    m_processingFile = false;
-                    m_transferCompleted = true;
-                    m_fileCommandIndex = 0;
+    // Toolpath shadowing on check mode
+    if (m_machineState.status == CHECK) {
+        GcodeViewParse *parser = m_currentDrawer->viewParser();
+        QList<LineSegment*> list = parser->getLineSegmentList();
 
-                    m_reseting = false;
-                    m_homing = false;
-                    m_lastGrblStatus = -1;
+        if (!m_transferCompleted && m_fileProcessedCommandIndex < m_currentModel->rowCount() - 1) {
+            int i;
+            QList<int> drawnLines;
 
-                    m_updateParserStatus = true;
-                    m_statusReceived = true;
+            for (i = m_lastDrawnLineIndex; i < list.count()
+                 && list.at(i)->getLineNumber()
+                 <= (m_currentModel->data(m_currentModel->index(m_fileProcessedCommandIndex, 4)).toInt()); i++) {
+                drawnLines << i;
+            }
 
-                    m_commands.clear();
-                    m_queue.clear();
+            if (!drawnLines.isEmpty() && (i < list.count())) {
+                m_lastDrawnLineIndex = i;
+                QVector3D vec = list.at(i)->getEnd();
+                m_toolDrawer.setToolPosition(vec);
+            }
 
-                    updateControlsState();
-                }
-                ui->txtConsole->appendPlainText(data);
+            foreach (int i, drawnLines) {
+                list.at(i)->setDrawn(true);
             }
+            if (!drawnLines.isEmpty()) m_currentDrawer->update(drawnLines);
         } else {
-            // Blank response
-//            ui->txtConsole->appendPlainText(data);
+            foreach (LineSegment* s, list) {
+                if (!qIsNaN(s->getEnd().length())) {
+                    m_toolDrawer.setToolPosition(s->getEnd());
+                    break;
+                }
+            }
         }
     }
 }
 
-void frmMain::onSerialPortError(QSerialPort::SerialPortError error)
+void frmMain::processFloatingResponse(QString data)
 {
-    static QSerialPort::SerialPortError previousError;
+    qDebug() << "floating response:" << data;
 
-    if (error != QSerialPort::NoError && error != previousError) {
-        previousError = error;
-        ui->txtConsole->appendPlainText(tr("Serial port error ") + QString::number(error) + ": " + m_serialPort.errorString());
-        if (m_serialPort.isOpen()) {
-            m_serialPort.close();
-            updateControlsState();
-        }
+
+    // Handle hardware reset
+    if (GrblStreamer::dataIsReset(data)) {
+        qDebug() << "hardware reset";
+
+        setRealtimeOverrides(GrblStreamer::firmwareVersion(data) >= 0x0101);
+
+        m_processingFile = false;
+        m_transferCompleted = true;
+        m_fileCommandIndex = 0;
+
+        m_reseting = false;
+        m_homing = false;
+        m_lastGrblStatus = -1;
+
+        m_updateParserStatus = true;
+
+        m_commands.clear();
+
+        updateControlsState();
     }
+    ui->txtConsole->appendPlainText(data);
+}
+
+void frmMain::onSerialPortError(QString message)
+{
+    ui->txtConsole->appendPlainText(message);
+    updateControlsState();
+}
+
+void frmMain::onReplayFinished()
+{
+    ui->txtConsole->appendPlainText(tr("Replay finished"));
+    updateControlsState();
 }
 
 void frmMain::onTimerConnection()
 {
-    if (!m_serialPort.isOpen()) {
+    if (!m_serialWorker->isOpen()) {
         openPort();
-    } else if (!m_homing/* && !m_reseting*/ && !ui->cmdFilePause->isChecked() && m_queue.length() == 0) {
+    } else if (!m_homing/* && !m_reseting*/ && !ui->cmdFilePause->isChecked()) {
         if (m_updateSpindleSpeed) {
             m_updateSpindleSpeed = false;
-            sendCommand(QString("S%1").arg(ui->txtSpindleSpeed->value()), -2, m_settings->showUICommands());
+            sendCommand(QString("S%1").arg(ui->txtSpindleSpeed->value()), CommandAttributes::SpindleSpeed, m_settings->showUICommands());
         }
         if (m_updateParserStatus) {
             m_updateParserStatus = false;
-            sendCommand("$G", -3, false);
+            sendCommand("$G", CommandAttributes::ParserPoll, false);
         }
         if (m_updateFeed) {
             m_updateFeed = false;
             sendCommand(QString("F%1").arg(ui->chkFeedOverride->isChecked() ?
-                m_originalFeed / 100 * ui->txtFeed->value() : m_originalFeed), -1, m_settings->showUICommands());
+                m_originalFeed / 100 * ui->txtFeed->value() : m_originalFeed), CommandAttributes::User, m_settings->showUICommands());
         }
     }
 }
 
-void frmMain::onTimerStateQuery()
-{
-    if (m_serialPort.isOpen() && m_resetCompleted && m_statusReceived) {
-        m_serialPort.write(QByteArray(1, '?'));
-        m_statusReceived = false;
-    }
-
-    ui->glwVisualizer->setBufferState(QString(tr("Buffer: %1 / %2")).arg(bufferLength()).arg(m_queue.length()));
-}
-
 void frmMain::onCmdJogStepClicked()
 {
     ui->txtJogStep->setValue(static_cast<QPushButton*>(sender())->text().toDouble());
@@ -1397,11 +1618,8 @@ void frmMain::closeEvent(QCloseEvent *ce)
         return;
     }
 
-    if (m_serialPort.isOpen()) m_serialPort.close();
-    if (m_queue.length() > 0) {
-        m_commands.clear();
-        m_queue.clear();
-    }
+    QMetaObject::invokeMethod(m_serialWorker, "closePort", Qt::BlockingQueuedConnection);
+    m_commands.clear();
 }
 
 void frmMain::dragEnterEvent(QDragEnterEvent *dee)
@@ -1545,6 +1763,7 @@ void frmMain::loadFile(QList<QString> data)
     // Prepare model
     m_programModel.data().clear();
     m_programModel.data().reserve(data.count());
+    m_programModel.setHighlightedRows(QSet<int>());
 
     QProgressDialog progress(tr("Opening file..."), tr("Abort"), 0, data.count(), this);
     progress.setWindowModality(Qt::WindowModal);
@@ -1566,6 +1785,9 @@ void frmMain::loadFile(QList<QString> data)
             stripped = GcodePreprocessorUtils::removeComment(command);
             args = GcodePreprocessorUtils::splitCommand(stripped);
 
+            // State before line is kept for resume from it
+            item.modal = gp.getModalState();
+
             PointSegment *ps = gp.addCommand(args);
 
     //        if (ps && (qIsNaN(ps->point()->x()) || qIsNaN(ps->point()->y()) || qIsNaN(ps->point()->z())))
@@ -1611,6 +1833,8 @@ void frmMain::loadFile(QList<QString> data)
 
     resetHeightmap();
     updateControlsState();
+
+    checkProgram();
 }
 
 void frmMain::loadFile(QString fileName)
@@ -1637,6 +1861,20 @@ void frmMain::loadFile(QString fileName)
 }
 
 QTime frmMain::updateProgramEstimatedTime(QList<LineSegment*> lines)
+{
+    QTime t;
+
+    t.setHMS(0, 0, 0);
+    t = t.addSecs(programDuration(lines));
+
+    ui->glwVisualizer->setSpendTime(QTime(0, 0, 0));
+    ui->glwVisualizer->setEstimatedTime(t);
+
+    return t;
+}
+
+// Seconds, with feed override applied
+double frmMain::programDuration(QList<LineSegment*> lines)
 {
     double time = 0;
 
@@ -1657,17 +1895,7 @@ QTime frmMain::updateProgramEstimatedTime(QList<LineSegment*> lines)
 //        if (qIsNaN(ls->getSpeed())) qDebug() << "speed nan:" << ls->getSpeed();
     }
 
-    time *= 60;
-
-    QTime t;
-
-    t.setHMS(0, 0, 0);
-    t = t.addSecs(time);
-
-    ui->glwVisualizer->setSpendTime(QTime(0, 0, 0));
-    ui->glwVisualizer->setEstimatedTime(t);
-
-    return t;
+    return time * 60;
 }
 
 void frmMain::clearTable()
@@ -1685,6 +1913,29 @@ void frmMain::on_cmdFileSend_clicked()
 {
     if (m_currentModel->rowCount() == 1) return;
 
+    // Other machine gets program as is, buffer data is shared with its thread
+    if (m_activeMachine != -1) {
+        Machine *machine = m_machines.at(m_activeMachine);
+        if (machine->streaming || m_heightMapMode) return;
+
+        if (!m_processingFile) updateWireBuffer();
+
+        // Job objects live in machine thread
+        QMetaObject::invokeMethod(machine->job, "setPort", Qt::BlockingQueuedConnection,
+                                  Q_ARG(QString, machine->port), Q_ARG(int, m_settings->baud()));
+        QMetaObject::invokeMethod(machine->job, "setBufferOptions", Qt::BlockingQueuedConnection,
+                                  Q_ARG(int, m_settings->rxBufferSize()), Q_ARG(bool, m_settings->plannerThrottle()));
+        QMetaObject::invokeMethod(machine->job, "setStatusInterval", Qt::BlockingQueuedConnection,
+                                  Q_ARG(int, m_settings->queryStateTime()));
+        QMetaObject::invokeMethod(machine->job, "setProgram", Qt::BlockingQueuedConnection,
+                                  Q_ARG(WireBuffer, m_wireBuffer));
+        machine->streaming = true;
+        QMetaObject::invokeMethod(machine->job, "start", Qt::QueuedConnection);
+
+        updateControlsState();
+        return;
+    }
+
     on_cmdFileReset_clicked();
 
     m_startTime.start();
@@ -1692,6 +1943,8 @@ void frmMain::on_cmdFileSend_clicked()
     m_transferCompleted = false;
     m_processingFile = true;
     m_fileEndSent = false;
+    updateWireBuffer();
+    m_errorPolicy.clear();
     m_storedKeyboardControl = ui->chkKeyboardControl->isChecked();
     ui->chkKeyboardControl->setChecked(false);
 
@@ -1723,38 +1976,10 @@ void frmMain::onActSendFromLineTriggered()
 
     // Set parser state
     if (m_settings->autoLine()) {
-        GcodeViewParse *parser = m_currentDrawer->viewParser();
-        QList<LineSegment*> list = parser->getLineSegmentList();
-        QVector<QList<int>> lineIndexes = parser->getLinesIndexes();
-
-        int lineNumber = m_currentModel->data(m_currentModel->index(commandIndex, 4)).toInt();
-        LineSegment* firstSegment = list.at(lineIndexes.at(lineNumber).first());
-        LineSegment* lastSegment = list.at(lineIndexes.at(lineNumber).last());
-        LineSegment* feedSegment = lastSegment;
-        int segmentIndex = list.indexOf(feedSegment);
-        while (feedSegment->isFastTraverse() && segmentIndex > 0) feedSegment = list.at(--segmentIndex);
+        ModalState state = m_currentModel->data().at(commandIndex).modal;
+        if (state.spindleSpeed == 0) state.spindleSpeed = ui->txtSpindleSpeed->value();
 
-        QStringList commands;
-
-        commands.append(QString("M3 S%1").arg(qMax<double>(lastSegment->getSpindleSpeed(), ui->txtSpindleSpeed->value())));
-
-        commands.append(QString("G21 G90 G0 X%1 Y%2")
-                        .arg(firstSegment->getStart().x())
-                        .arg(firstSegment->getStart().y()));
-        commands.append(QString("G1 Z%1 F%2")
-                        .arg(firstSegment->getStart().z())
-                        .arg(feedSegment->getSpeed()));
-
-        commands.append(QString("%1 %2 %3 F%4")
-                        .arg(lastSegment->isMetric() ? "G21" : "G20")
-                        .arg(lastSegment->isAbsolute() ? "G90" : "G91")
-                        .arg(lastSegment->isFastTraverse() ? "G0" : "G1")
-                        .arg(lastSegment->isMetric() ? feedSegment->getSpeed() : feedSegment->getSpeed() / 25.4));
-
-        if (lastSegment->isArc()) {
-            commands.append(lastSegment->plane() == PointSegment::XY ? "G17"
-            : lastSegment->plane() == PointSegment::ZX ? "G18" : "G19");
-        }
+        QStringList commands = state.commands();
 
         QMessageBox box(this);
         box.setIcon(QMessageBox::Information);
@@ -1767,7 +1992,7 @@ void frmMain::onActSendFromLineTriggered()
         if (res == QMessageBox::Cancel) return;
         else if (res == QMessageBox::Ok) {
             foreach (QString command, commands) {
-                sendCommand(command, -1, m_settings->showUICommands());
+                sendCommand(command, CommandAttributes::User, m_settings->showUICommands());
             }
         }
     }
@@ -1777,29 +2002,17 @@ void frmMain::onActSendFromLineTriggered()
     m_lastDrawnLineIndex = 0;
     m_probeIndex = -1;
 
-    QList<LineSegment*> list = m_viewParser.getLineSegmentList();
-
-    QList<int> indexes;
-    for (int i = 0; i < list.count(); i++) {
-        list[i]->setDrawn(list.at(i)->getLineNumber() < m_currentModel->data().at(commandIndex).line);
-        indexes.append(i);
-    }
-    m_codeDrawer->update(indexes);
-
-    ui->tblProgram->setUpdatesEnabled(false);
-
-    for (int i = 0; i < m_currentModel->data().count() - 1; i++) {
-        m_currentModel->data()[i].state = i < commandIndex ? GCodeItem::Skipped : GCodeItem::InQueue;
-        m_currentModel->data()[i].response = QString();
-    }
-    ui->tblProgram->setUpdatesEnabled(true);
-    ui->glwVisualizer->setSpendTime(QTime(0, 0, 0));
+    m_currentDrawer->setDrawnBefore(m_currentModel->data().at(commandIndex).line);
+    m_currentModel->resetStates(commandIndex);
+    ui->glwVisualizer->setSpendTime(QTime(0, 0, 0));
 
     m_startTime.start();
 
     m_transferCompleted = false;
     m_processingFile = true;
     m_fileEndSent = false;
+    updateWireBuffer(commandIndex);
+    m_errorPolicy.clear();
     m_storedKeyboardControl = ui->chkKeyboardControl->isChecked();
     ui->chkKeyboardControl->setChecked(false);
 
@@ -1826,9 +2039,14 @@ void frmMain::onActSendFromLineTriggered()
 
 void frmMain::on_cmdFileAbort_clicked()
 {
+    if (m_activeMachine != -1) {
+        QMetaObject::invokeMethod(m_machines.at(m_activeMachine)->job, "abort", Qt::QueuedConnection);
+        return;
+    }
+
     m_aborting = true;
     if (!ui->chkTestMode->isChecked()) {
-        m_serialPort.write("!");
+        m_serialWorker->sendRealtime('!');
     } else {
         grblReset();
     }
@@ -1842,37 +2060,422 @@ void frmMain::storeParserState()
 
 void frmMain::restoreParserState()
 {
-    if (!m_storedParserStatus.isEmpty()) sendCommand(m_storedParserStatus, -1, m_settings->showUICommands());
+    if (!m_storedParserStatus.isEmpty()) sendCommand(m_storedParserStatus, CommandAttributes::User, m_settings->showUICommands());
 }
 
 void frmMain::storeOffsets()
 {
-//    sendCommand("$#", -2, m_settings->showUICommands());
+//    sendCommand("$#", CommandAttributes::Offsets, m_settings->showUICommands());
 }
 
 void frmMain::restoreOffsets()
 {
     // Still have pre-reset working position
-    sendCommand(QString("G21G53G90X%1Y%2Z%3").arg(toMetric(ui->txtMPosX->text().toDouble()))
-                                       .arg(toMetric(ui->txtMPosY->text().toDouble()))
-                                       .arg(toMetric(ui->txtMPosZ->text().toDouble())), -1, m_settings->showUICommands());
-    sendCommand(QString("G21G92X%1Y%2Z%3").arg(toMetric(ui->txtWPosX->text().toDouble()))
-                                       .arg(toMetric(ui->txtWPosY->text().toDouble()))
-                                       .arg(toMetric(ui->txtWPosZ->text().toDouble())), -1, m_settings->showUICommands());
+    sendCommand(QString("G21G53G90X%1Y%2Z%3").arg(toMetric(m_machineState.machinePosition[0]))
+                                       .arg(toMetric(m_machineState.machinePosition[1]))
+                                       .arg(toMetric(m_machineState.machinePosition[2])), CommandAttributes::User, m_settings->showUICommands());
+    sendCommand(QString("G21G92X%1Y%2Z%3").arg(toMetric(m_machineState.workPosition[0]))
+                                       .arg(toMetric(m_machineState.workPosition[1]))
+                                       .arg(toMetric(m_machineState.workPosition[2])), CommandAttributes::User, m_settings->showUICommands());
 }
 
 void frmMain::sendNextFileCommands() {
-    if (m_queue.length() > 0) return;
+    // Keep sender queue filled ahead, so worker thread can refill controller buffer without waiting for UI
+    if (m_serialWorker->programQueueLength() >= PROGRAMLOOKAHEAD / 2) return;
+
+    // Legacy feed override rewrites commands while sending
+    bool rewrite = !m_realtimeOverrides && !ui->cmdHeightMapMode->isChecked() && ui->chkFeedOverride->isChecked();
+
+    while (m_serialWorker->programQueueLength() < PROGRAMLOOKAHEAD
+           && m_fileCommandIndex < m_currentModel->rowCount() - 1 && !m_fileEndSent) {
+        bool sent = rewrite ? sendCommand(feedOverride(m_currentModel->data().at(m_fileCommandIndex).command),
+                                          CommandAttributes::Program, m_settings->showProgramCommands(), m_fileCommandIndex)
+                            : sendFileCommand(m_fileCommandIndex);
 
-    QString command = feedOverride(m_currentModel->data(m_currentModel->index(m_fileCommandIndex, 1)).toString());
+        // Queue is full, line is sent on next call
+        if (!sent) break;
 
-    while ((bufferLength() + command.length() + 1) <= BUFFERLENGTH
-           && m_fileCommandIndex < m_currentModel->rowCount() - 1
-           && !(!m_commands.isEmpty() && m_commands.last().command.contains(QRegExp("M0*2|M30")))) {
         m_currentModel->setData(m_currentModel->index(m_fileCommandIndex, 2), GCodeItem::Sent);
-        sendCommand(command, m_fileCommandIndex, m_settings->showProgramCommands());
         m_fileCommandIndex++;
-        command = feedOverride(m_currentModel->data(m_currentModel->index(m_fileCommandIndex, 1)).toString());
+    }
+}
+
+bool frmMain::sendFileCommand(int index)
+{
+    if (!m_serialWorker->isOpen() || !m_resetCompleted) return false;
+
+    const WireBuffer::Line &line = m_wireBuffer.line(index);
+    CommandAttributes ca;
+
+    // Program buffer is shared with serial worker
+    ca.id = m_serialWorker->sendCommand(m_wireBuffer.data(), line.offset, line.length);
+    if (ca.id == -1) return false;
+
+    ca.command = m_wireBuffer.command(index);
+    ca.type = CommandAttributes::Program;
+    ca.tableIndex = index;
+
+    if (m_settings->showProgramCommands()) {
+        ui->txtConsole->appendPlainText(ca.command);
+        ca.consoleIndex = ui->txtConsole->blockCount() - 1;
+    } else {
+        ca.consoleIndex = -1;
+    }
+
+    m_commands.append(ca);
+
+    // Same as sendCommand() does by command text
+    if ((line.flags & WireBuffer::SpindleSpeed) && ui->txtSpindleSpeed->value() != line.spindleSpeed) {
+        ui->txtSpindleSpeed->setValue(line.spindleSpeed);
+        ui->sliSpindleSpeed->setValue(line.spindleSpeed / 100);
+    }
+    if (line.flags & WireBuffer::FeedRate) m_originalFeed = line.feedRate;
+    if (line.flags & WireBuffer::ProgramEnd) m_fileEndSent = true;
+
+    return true;
+}
+
+void frmMain::processError(const CommandAttributes &ca, const QString &response)
+{
+    QString error = QString::number(ca.tableIndex + 1) + ": " + ca.command + " < " + response;
+
+    switch (m_errorPolicy.action(ca.tableIndex, response)) {
+    case ErrorPolicy::Skip:
+        ui->txtConsole->appendPlainText(tr("Error skipped, line ") + error);
+        break;
+    case ErrorPolicy::Abort:
+        ui->txtConsole->appendPlainText(tr("Job aborted on error, line ") + error);
+        on_cmdFileAbort_clicked();
+        break;
+    case ErrorPolicy::Retry:
+        // Lines are locked out until alarm is cleared by user
+        if (m_machineState.status == ALARM) {
+            holdAndAsk(error);
+            break;
+        }
+
+        // Queued lines are dropped, streaming goes on from refused line when machine stops
+        ui->txtConsole->appendPlainText(tr("Line will be resent, ") + error);
+
+        m_errorRetryId = m_serialWorker->dropProgramCommands();
+        m_errorRetryIndex = ca.tableIndex;
+        m_errorRetryMessage = error;
+        m_errorRetrying = true;
+
+        for (int i = ca.tableIndex; i < m_fileCommandIndex; i++) m_currentModel->setData(m_currentModel->index(i, 2), GCodeItem::InQueue);
+        m_fileCommandIndex = ca.tableIndex;
+        m_fileEndSent = false;
+        break;
+    default:
+        holdAndAsk(error);
+    }
+}
+
+void frmMain::holdAndAsk(const QString &error)
+{
+    m_senderErrors.append(error + "\n");
+    m_senderErrorBox->setText(tr("Error message(s) received:\n") + m_senderErrors);
+
+    // Hold transmit while messagebox is visible, serial data is still processed
+    if (!m_errorHolding) {
+        m_errorHolding = true;
+        m_serialWorker->sendRealtime('!');
+        m_senderErrorBox->checkBox()->setChecked(false);
+        qApp->beep();
+        m_senderErrorBox->show();
+    }
+}
+
+void frmMain::onSenderErrorBoxFinished(int result)
+{
+    if (!m_errorHolding) return;
+
+    m_errorHolding = false;
+    m_senderErrors.clear();
+
+    if (m_senderErrorBox->checkBox()->isChecked()) {
+        m_settings->setErrorPolicy(ErrorPolicy::SkipAndLog);
+        m_errorPolicy.setPolicy(ErrorPolicy::SkipAndLog);
+    }
+
+    if (result == QMessageBox::Ignore) {
+        m_serialWorker->sendRealtime('~');
+        if (m_processingFile && !m_transferCompleted && !m_fileEndSent) sendNextFileCommands();
+    } else {
+        on_cmdFileAbort_clicked();
+    }
+}
+
+void frmMain::checkProgram()
+{
+    m_programCheck.cancel();
+
+    if (!m_settings->checkProgram() || m_currentModel->rowCount() < 2) return;
+
+    GcodeValidator validator;
+
+    // Soft limits are checked with offset of current coordinate system only,
+    // grbl machine space is negative. Parser status could be not polled yet after reset.
+    if (m_softLimits) {
+        QRegExp rx("G5([4-9])");
+        int coordinateSystem = rx.indexIn(ui->glwVisualizer->parserStatus()) != -1 ? 50 + rx.cap(1).toInt() : 54;
+        QVector3D offset;
+
+        for (int i = 0; i < 3; i++) offset[i] = toMetric(m_machineState.machinePosition[i] - m_machineState.workPosition[i]);
+
+        validator.setSoftLimits(-m_travel, QVector3D());
+        validator.setWorkOffset(coordinateSystem, offset);
+    }
+
+    // Chunks start from stored modal state, last row is blank
+    const QList<GCodeItem> &items = m_currentModel->data();
+    QList<ProgramCheckChunk> chunks;
+
+    for (int first = 0; first < items.count() - 1; first += PROGRAMCHECKCHUNK) {
+        ProgramCheckChunk chunk;
+        chunk.items = items;
+        chunk.first = first;
+        chunk.last = qMin(first + PROGRAMCHECKCHUNK, items.count() - 1);
+        chunk.validator = validator;
+        chunks.append(chunk);
+    }
+
+    m_checkedModel = m_currentModel;
+    m_programCheck.setFuture(QtConcurrent::mapped(chunks, checkProgramChunk));
+}
+
+void frmMain::onProgramCheckFinished()
+{
+    if (m_programCheck.isCanceled() || m_processingFile || m_checkedModel != m_currentModel) return;
+
+    QList<GcodeValidator::Error> errors;
+    foreach (const QList<GcodeValidator::Error> &chunkErrors, m_programCheck.future().results()) errors.append(chunkErrors);
+
+    // Results of previous check are replaced
+    QList<GCodeItem> &items = m_currentModel->data();
+    QString prefix = tr("Check: ");
+
+    for (int i = 0; i < items.count(); i++) {
+        if (items.at(i).response.startsWith(prefix)) items[i].response.clear();
+    }
+
+    foreach (const GcodeValidator::Error &error, errors) {
+        if (error.row < items.count()) items[error.row].response = prefix + GcodeValidator::errorText(error.code);
+    }
+    ui->tblProgram->viewport()->update();
+
+    if (errors.isEmpty()) {
+        ui->txtConsole->appendPlainText(tr("Program check passed"));
+    } else {
+        const GcodeValidator::Error &first = errors.first();
+        ui->txtConsole->appendPlainText(tr("Program check: %1 error(s), first at line %2: %3 < %4")
+                                        .arg(errors.count()).arg(first.row + 1).arg(items.at(first.row).command)
+                                        .arg(GcodeValidator::errorText(first.code)));
+    }
+}
+
+void frmMain::onControlRequest(int client, const QString &command, const QString &argument)
+{
+    // Same conditions as for form buttons, dialogs are not shown
+    QString error;
+
+    if (command == "load") {
+        if (m_processingFile || m_heightMapMode) error = "Program can't be loaded now";
+        else if (m_fileChanged) error = "Program has unsaved changes";
+        else if (!QFile::exists(argument)) error = "File not found";
+        else {
+            addRecentFile(argument);
+            updateRecentFilesMenu();
+            loadFile(argument);
+        }
+    } else if (command == "start") {
+        if (!ui->cmdFileSend->isEnabled()) error = "Program can't be started now";
+        else on_cmdFileSend_clicked();
+    } else if (command == "pause" || command == "resume") {
+        bool pause = command == "pause";
+
+        if (!ui->cmdFilePause->isEnabled() || ui->cmdFilePause->isChecked() == pause) error = "Program is not " + QString(pause ? "running" : "paused");
+        else {
+            ui->cmdFilePause->setChecked(pause);
+            on_cmdFilePause_clicked(pause);
+        }
+    } else if (command == "abort") {
+        if (!ui->cmdFileAbort->isEnabled()) error = "Program is not running";
+        else on_cmdFileAbort_clicked();
+    }
+
+    m_controlServer.reply(client, command, error);
+}
+
+void frmMain::onMachineMessage(QString text)
+{
+    Machine *machine = findMachine(sender());
+    if (machine) ui->txtConsole->appendPlainText(machine->name + ": " + text);
+}
+
+void frmMain::onMachineFinished(int result)
+{
+    Q_UNUSED(result)
+
+    Machine *machine = findMachine(sender());
+    if (!machine) return;
+
+    machine->streaming = false;
+    updateControlsState();
+}
+
+void frmMain::on_cboMachine_currentIndexChanged(int index)
+{
+    m_activeMachine = index - 1;
+    updateControlsState();
+
+    if (m_activeMachine == -1) {
+        m_toolDrawer.setToolPosition(QVector3D(toMetric(m_machineState.workPosition[0]),
+                                               toMetric(m_machineState.workPosition[1]),
+                                               toMetric(m_machineState.workPosition[2])));
+    }
+}
+
+Machine *frmMain::findMachine(QObject *job)
+{
+    foreach (Machine *machine, m_machines) if (machine->job == job) return machine;
+
+    return NULL;
+}
+
+void frmMain::updateMachines()
+{
+    if (m_settings->machines() == m_machinesSetting) return;
+
+    foreach (Machine *machine, m_machines) {
+        if (machine->streaming) {
+            ui->txtConsole->appendPlainText(tr("Machines list can't be changed while streaming"));
+            return;
+        }
+    }
+
+    foreach (Machine *machine, m_machines) {
+        machine->thread.quit();
+        machine->thread.wait();
+        delete machine;
+    }
+    m_machines.clear();
+
+    // "Router 2=COM4, Router 3=COM5"
+    foreach (QString item, m_settings->machines().split(",", QString::SkipEmptyParts)) {
+        QStringList parts = item.split("=");
+
+        if (parts.count() != 2 || parts.at(0).trimmed().isEmpty() || parts.at(1).trimmed().isEmpty()) {
+            ui->txtConsole->appendPlainText(tr("Wrong machine: ") + item.trimmed());
+            continue;
+        }
+
+        Machine *machine = new Machine;
+        machine->name = parts.at(0).trimmed();
+        machine->port = parts.at(1).trimmed();
+        machine->streaming = false;
+        machine->job = new StreamJob();
+        machine->job->setReportInterval(0);
+        machine->job->moveToThread(&machine->thread);
+
+        connect(&machine->thread, SIGNAL(finished()), machine->job, SLOT(deleteLater()));
+        connect(machine->job, SIGNAL(message(QString)), this, SLOT(onMachineMessage(QString)));
+        connect(machine->job, SIGNAL(finished(int)), this, SLOT(onMachineFinished(int)));
+
+        machine->thread.start();
+        m_machines.append(machine);
+    }
+
+    m_machinesSetting = m_settings->machines();
+    m_activeMachine = -1;
+
+    ui->cboMachine->blockSignals(true);
+    ui->cboMachine->clear();
+    ui->cboMachine->addItem(tr("Main"));
+    foreach (Machine *machine, m_machines) ui->cboMachine->addItem(machine->name);
+    ui->cboMachine->blockSignals(false);
+    ui->cboMachine->setVisible(!m_machines.isEmpty());
+
+    updateControlsState();
+}
+
+void frmMain::updateMachineView()
+{
+    Machine *machine = m_machines.at(m_activeMachine);
+    const MachineState &state = machine->state;
+
+    // Status is kept after job end, port is closed then
+    QLineEdit *machinePosition[] = {ui->txtMPosX, ui->txtMPosY, ui->txtMPosZ};
+    QLineEdit *workPosition[] = {ui->txtWPosX, ui->txtWPosY, ui->txtWPosZ};
+
+    for (int i = 0; i < 3; i++) {
+        machinePosition[i]->setText(QString::number(state.machinePosition[i], 'f', 3));
+        workPosition[i]->setText(QString::number(state.workPosition[i], 'f', 3));
+    }
+
+    if (machine->streaming) {
+        ui->txtStatus->setText(m_statusCaptions[state.status]);
+        ui->txtStatus->setStyleSheet(QString("background-color: %1; color: %2;")
+                                     .arg(m_statusBackColors[state.status]).arg(m_statusForeColors[state.status]));
+    } else {
+        ui->txtStatus->setText(tr("Not connected"));
+        ui->txtStatus->setStyleSheet(QString("background-color: palette(button); color: palette(text);"));
+    }
+    ui->cmdFilePause->setChecked(state.status == HOLD || state.status == QUEUE);
+
+    QVector3D toolPosition(toMetric(state.workPosition[0]), toMetric(state.workPosition[1]), toMetric(state.workPosition[2]));
+    m_toolDrawer.setToolPosition(m_codeDrawer->getIgnoreZ() ? QVector3D(toolPosition.x(), toolPosition.y(), 0) : toolPosition);
+
+    ui->glwVisualizer->setBufferState(QString(tr("%1: %2 / %3 lines")).arg(machine->name)
+                                      .arg(machine->job->processedLines()).arg(machine->job->programLines()));
+}
+
+void frmMain::processMachineSettings(const QString &response)
+{
+    // "$20=1; $130=200.000; ..."
+    QRegExp rx("\\$(\\d+)=([\\d\\.]+)");
+    int position = 0;
+
+    while ((position = rx.indexIn(response, position)) != -1) {
+        int number = rx.cap(1).toInt();
+
+        if (number == 20) m_softLimits = rx.cap(2).toDouble() != 0;
+        else if (number >= 130 && number <= 132) m_travel[number - 130] = rx.cap(2).toDouble();
+
+        position += rx.matchedLength();
+    }
+
+    checkProgram();
+}
+
+void frmMain::updateWireBuffer(int from)
+{
+    const QList<GCodeItem> &items = m_currentModel->data();
+    int bytes = 0;
+
+    foreach (const GCodeItem &item, items) bytes += item.command.length() + 1;
+
+    m_wireBuffer.clear();
+    m_wireBuffer.reserve(items.count(), bytes);
+
+    if (!m_settings->compactProgram()) {
+        foreach (const GCodeItem &item, items) m_wireBuffer.append(item.command);
+        return;
+    }
+
+    // Lines stay one to one with table rows. Machine state is unknown at first sent line,
+    // so compaction starts there.
+    GcodeCompactor compactor;
+    compactor.setPrecision(m_settings->compactDecimals());
+
+    for (int i = 0; i < items.count(); i++) {
+        m_wireBuffer.append(i < from ? items.at(i).command : compactor.compact(items.at(i).command));
+    }
+
+    if (compactor.bytesBefore() > 0) {
+        ui->txtConsole->appendPlainText(QString(tr("Program compacted: %1 -> %2 bytes, %3% saved"))
+                                        .arg(compactor.bytesBefore()).arg(compactor.bytesAfter())
+                                        .arg((compactor.bytesBefore() - compactor.bytesAfter()) * 100.0 / compactor.bytesBefore(), 0, 'f', 1));
     }
 }
 
@@ -1894,131 +2497,511 @@ void frmMain::onTableCellChanged(QModelIndex i1, QModelIndex i2)
         m_tableModel.removeRow(i1.row());
     }*/
 
-    if (!m_programLoading) {
+    if (!m_programLoading) {
+
+        // Clear cached args
+        model->setData(model->index(i1.row(), 5), QVariant());
+
+        // Drop heightmap cache
+        if (m_currentModel == &m_programModel) m_programHeightmapModel.clear();
+
+        // Update visualizer
+        updateParser();
+
+        // Hightlight w/o current cell changed event (double hightlight on current cell changed)
+        QList<LineSegment*> list = m_viewParser.getLineSegmentList();
+        for (int i = 0; i < list.count() && list[i]->getLineNumber() <= m_currentModel->data(m_currentModel->index(i1.row(), 4)).toInt(); i++) {
+            list[i]->setIsHightlight(true);
+        }
+    }
+}
+
+void frmMain::onTableCurrentChanged(QModelIndex idx1, QModelIndex idx2)
+{
+    // Update toolpath hightlighting
+    if (idx1.row() > m_currentModel->rowCount() - 2) idx1 = m_currentModel->index(m_currentModel->rowCount() - 2, 0);
+    if (idx2.row() > m_currentModel->rowCount() - 2) idx2 = m_currentModel->index(m_currentModel->rowCount() - 2, 0);
+
+    GcodeViewParse *parser = m_currentDrawer->viewParser();
+    QList<LineSegment*> list = parser->getLineSegmentList();
+    QVector<QList<int>> lineIndexes = parser->getLinesIndexes();
+
+    // Update linesegments on cell changed
+    if (!m_currentDrawer->geometryUpdated()) {
+        for (int i = 0; i < list.count(); i++) {
+            list.at(i)->setIsHightlight(list.at(i)->getLineNumber() <= m_currentModel->data(m_currentModel->index(idx1.row(), 4)).toInt());
+        }
+    // Update vertices on current cell changed
+    } else {
+
+        int lineFirst = m_currentModel->data(m_currentModel->index(idx1.row(), 4)).toInt();
+        int lineLast = m_currentModel->data(m_currentModel->index(idx2.row(), 4)).toInt();
+        if (lineLast < lineFirst) qSwap(lineLast, lineFirst);
+//        qDebug() << "table current changed" << idx1.row() << idx2.row() << lineFirst << lineLast;
+
+        QList<int> indexes;
+        for (int i = lineFirst + 1; i <= lineLast; i++) {
+            foreach (int l, lineIndexes.at(i)) {
+                list.at(l)->setIsHightlight(idx1.row() > idx2.row());
+                indexes.append(l);
+            }
+        }
+
+        m_selectionDrawer.setEndPosition(indexes.isEmpty() ? QVector3D(sNan, sNan, sNan) :
+            (m_codeDrawer->getIgnoreZ() ? QVector3D(list.at(indexes.last())->getEnd().x(), list.at(indexes.last())->getEnd().y(), 0)
+                                        : list.at(indexes.last())->getEnd()));
+        m_selectionDrawer.update();
+
+        if (!indexes.isEmpty()) m_currentDrawer->update(indexes);
+    }
+
+    // Update selection marker
+    int line = m_currentModel->data(m_currentModel->index(idx1.row(), 4)).toInt();
+    if (line > 0 && !lineIndexes.at(line).isEmpty()) {
+        QVector3D pos = list.at(lineIndexes.at(line).last())->getEnd();
+        m_selectionDrawer.setEndPosition(m_codeDrawer->getIgnoreZ() ? QVector3D(pos.x(), pos.y(), 0) : pos);
+    } else {
+        m_selectionDrawer.setEndPosition(QVector3D(sNan, sNan, sNan));
+    }
+    m_selectionDrawer.update();
+}
+
+void frmMain::onTableInsertLine()
+{
+    if (ui->tblProgram->selectionModel()->selectedRows().count() == 0 || m_processingFile) return;
+
+    int row = ui->tblProgram->selectionModel()->selectedRows()[0].row();
+
+    m_currentModel->insertRow(row);
+    m_currentModel->setData(m_currentModel->index(row, 2), GCodeItem::InQueue);
+
+    updateParser();
+    m_cellChanged = true;
+    ui->tblProgram->selectRow(row);
+}
+
+void frmMain::onTableDeleteLines()
+{
+    if (ui->tblProgram->selectionModel()->selectedRows().count() == 0 || m_processingFile ||
+            QMessageBox::warning(this, this->windowTitle(), tr("Delete lines?"), QMessageBox::Yes | QMessageBox::No) == QMessageBox::No) return;
+
+    QModelIndex firstRow = ui->tblProgram->selectionModel()->selectedRows()[0];
+    int rowsCount = ui->tblProgram->selectionModel()->selectedRows().count();
+    if (ui->tblProgram->selectionModel()->selectedRows().last().row() == m_currentModel->rowCount() - 1) rowsCount--;
+
+    qDebug() << "deleting lines" << firstRow.row() << rowsCount;
+
+    if (firstRow.row() != m_currentModel->rowCount() - 1) {
+        m_currentModel->removeRows(firstRow.row(), rowsCount);
+    } else return;
+
+    // Drop heightmap cache
+    if (m_currentModel == &m_programModel) m_programHeightmapModel.clear();
+
+    updateParser();
+    m_cellChanged = true;
+    ui->tblProgram->selectRow(firstRow.row());
+}
+
+void frmMain::on_actServiceSettings_triggered()
+{
+    if (m_settings->exec()) {
+        qDebug() << "Applying settings";
+        qDebug() << "Port:" << m_settings->port() << "Baud:" << m_settings->baud();
+
+        if (m_settings->port() != "" && (m_settings->port() != m_serialWorker->portName() ||
+                                           m_settings->baud() != m_serialWorker->baudRate())) {
+            QMetaObject::invokeMethod(m_serialWorker, "closePort", Qt::BlockingQueuedConnection);
+            m_serialWorker->setPort(m_settings->port(), m_settings->baud());
+            openPort();
+        }
+
+        updateControlsState();
+        applySettings();
+    } else {
+        m_settings->undo();
+    }
+}
+
+void frmMain::on_actServiceReplay_triggered()
+{
+    if (m_processingFile) return;
+
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Replay"), m_lastFolder, tr("Traffic logs (*.trf)"));
+    if (fileName.isEmpty()) return;
+
+    bool ok;
+    double speed = QInputDialog::getDouble(this, tr("Replay"), tr("Speed factor, 0 to replay without delays:"), 1, 0, 1000, 1, &ok);
+    if (!ok) return;
+
+    // Replaces serial port until log ends
+    QMetaObject::invokeMethod(m_serialWorker, "openReplay", Qt::BlockingQueuedConnection,
+                              Q_ARG(QString, fileName), Q_ARG(double, speed));
+
+    if (m_serialWorker->isOpen()) {
+        ui->txtStatus->setText(tr("Replay"));
+        ui->txtStatus->setStyleSheet(QString("background-color: palette(button); color: palette(text);"));
+        invalidateStatusView();
+        grblReset();
+    }
+}
+
+void frmMain::on_actProgramSimplify_triggered()
+{
+    if (!canTransformProgram()) return;
+
+    bool ok;
+    double tolerance = QInputDialog::getDouble(this, tr("Simplify toolpath"), tr("Tolerance, mm:"),
+                                               m_simplifyTolerance, 0.001, 10, 3, &ok);
+    if (!ok) return;
+
+    m_simplifyTolerance = tolerance;
+
+    ToolpathSimplifier simplifier;
+    simplifier.setTolerance(tolerance);
+
+    for (int i = 0; i < m_currentModel->rowCount() - 1; i++) {
+        const GCodeItem &item = m_currentModel->data().at(i);
+        simplifier.addLine(item.command, item.args, item.line);
+    }
+
+    QStringList commands = simplifier.simplify(m_currentDrawer->viewParser()->getLineSegmentList());
+
+    if (simplifier.removedLines() == 0) {
+        QMessageBox::information(this, qApp->applicationDisplayName(), tr("No moves can be removed with given tolerance"));
+        return;
+    }
+
+    if (confirmProgram(tr("Simplify toolpath"), QString(tr("Moves removed: %1")).arg(simplifier.removedLines()), commands)) {
+        replaceProgram(commands);
+    }
+}
+
+void frmMain::on_actProgramFitArcs_triggered()
+{
+    if (!canTransformProgram()) return;
+
+    bool ok;
+    double tolerance = QInputDialog::getDouble(this, tr("Fit arcs"), tr("Tolerance, mm:"),
+                                               m_arcFitTolerance, 0.001, 1, 3, &ok);
+    if (!ok) return;
+
+    m_arcFitTolerance = tolerance;
+
+    ArcFitter fitter;
+    fitter.setTolerance(tolerance);
+
+    qint64 bytesBefore = 0;
+    for (int i = 0; i < m_currentModel->rowCount() - 1; i++) {
+        const GCodeItem &item = m_currentModel->data().at(i);
+        fitter.addLine(item.command, item.args, item.line);
+        bytesBefore += item.command.length() + 1;
+    }
+
+    QStringList commands = fitter.fit(m_currentDrawer->viewParser()->getLineSegmentList());
+
+    if (fitter.fittedArcs() == 0) {
+        QMessageBox::information(this, qApp->applicationDisplayName(), tr("No arcs can be fitted with given tolerance"));
+        return;
+    }
+
+    qint64 bytesAfter = 0;
+    foreach (const QString &command, commands) bytesAfter += command.length() + 1;
+
+    if (confirmProgram(tr("Fit arcs"), QString(tr("Arcs fitted: %1, moves removed: %2\nBytes: %3 -> %4"))
+                       .arg(fitter.fittedArcs()).arg(fitter.removedLines()).arg(bytesBefore).arg(bytesAfter), commands)) {
+        replaceProgram(commands);
+    }
+}
+
+void frmMain::on_actProgramOptimizeTravel_triggered()
+{
+    if (!canTransformProgram()) return;
+
+    QList<LineSegment*> segments = m_currentDrawer->viewParser()->getLineSegmentList();
+    double safeHeight = TravelOptimizer::findSafeHeight(segments);
+
+    if (qIsNaN(safeHeight)) {
+        QMessageBox::information(this, qApp->applicationDisplayName(), tr("Program has no rapid retracts above feed moves"));
+        return;
+    }
+
+    bool ok;
+    safeHeight = QInputDialog::getDouble(this, tr("Optimize travel"), tr("Safe travel height, mm:"),
+                                         safeHeight, -10000, 10000, 3, &ok);
+    if (!ok) return;
+
+    TravelOptimizer optimizer;
+    optimizer.setSafeHeight(safeHeight);
+
+    for (int i = 0; i < m_currentModel->rowCount() - 1; i++) {
+        const GCodeItem &item = m_currentModel->data().at(i);
+        optimizer.addLine(item.command, item.args, item.line, item.modal);
+    }
+
+    QStringList commands = optimizer.optimize(segments);
+
+    if (optimizer.flexibleIslands() > 0 && QMessageBox::question(this, tr("Optimize travel"),
+            QString(tr("%1 flat cuts can be started from other end or vertex. Open cuts are reversed then, "
+                       "so climb and conventional milling are swapped.\n\nAllow changing start of cuts?"))
+            .arg(optimizer.flexibleIslands()), QMessageBox::Yes | QMessageBox::No, QMessageBox::No) == QMessageBox::Yes) {
+        optimizer.setChangeEntries(true);
+        commands = optimizer.optimize(segments);
+    }
+
+    if (optimizer.movedIslands() == 0 || optimizer.travelAfter() >= optimizer.travelBefore()) {
+        QMessageBox::information(this, qApp->applicationDisplayName(), tr("Travel between cutting islands can't be shortened"));
+        return;
+    }
+
+    QString details = QString(tr("Islands: %1, reordered or changed: %2\nRapid travel: %3 -> %4 mm"))
+            .arg(optimizer.islands()).arg(optimizer.movedIslands())
+            .arg(optimizer.travelBefore(), 0, 'f', 0).arg(optimizer.travelAfter(), 0, 'f', 0);
+
+    // Rapid speed is unknown until set
+    if (m_settings->rapidSpeed() > 0) {
+        details += QString(tr(", %1 s saved")).arg((optimizer.travelBefore() - optimizer.travelAfter()) / m_settings->rapidSpeed() * 60, 0, 'f', 0);
+    }
+
+    if (confirmProgram(tr("Optimize travel"), details, commands)) {
+        replaceProgram(commands);
+    }
+}
+
+void frmMain::on_actProgramAirMoves_triggered()
+{
+    if (!canTransformProgram()) return;
+
+    // Probed surface is stock top then
+    bool probed = heightMapProbed();
+
+    bool ok;
+    double stockTop = QInputDialog::getDouble(this, tr("Speed up air moves"),
+                                              probed ? tr("Stock top above probed surface, mm:") : tr("Stock top Z, mm:"),
+                                              m_stockTop, -10000, 10000, 3, &ok);
+    if (!ok) return;
+
+    m_stockTop = stockTop;
+
+    HeightMapCompensator compensator;
+    compensator.setHeightMap(borderRectFromTextboxes(), &m_heightMapModel,
+                             ui->txtHeightMapInterpolationStepX->value(), ui->txtHeightMapInterpolationStepY->value());
+
+    AirCutEliminator eliminator;
+    eliminator.setStockTop(stockTop);
+    eliminator.setClearance(m_settings->stockClearance());
+    eliminator.setFeed(m_settings->airMoveFeed());
+    if (probed) eliminator.setSurface(&compensator);
+
+    for (int i = 0; i < m_currentModel->rowCount() - 1; i++) {
+        const GCodeItem &item = m_currentModel->data().at(i);
+        eliminator.addLine(item.command, item.args, item.line, item.modal);
+    }
+
+    QStringList commands = eliminator.eliminate(m_currentDrawer->viewParser()->getLineSegmentList());
+
+    if (eliminator.convertedMoves() == 0) {
+        QMessageBox::information(this, qApp->applicationDisplayName(), tr("No feed moves above stock found"));
+        return;
+    }
+
+    QString target = m_settings->airMoveFeed() > 0 ? QString(tr("feed %1")).arg(m_settings->airMoveFeed()) : tr("rapids");
+
+    if (confirmProgram(tr("Speed up air moves"), QString(tr("Moves turned into %1: %2, %3 mm"))
+                       .arg(target).arg(eliminator.convertedMoves()).arg(eliminator.convertedLength(), 0, 'f', 0), commands)) {
+        replaceProgram(commands);
+        m_programModel.setHighlightedRows(eliminator.changedLines().toSet());
+    }
+}
+
+void frmMain::on_actProgramRetracts_triggered()
+{
+    if (!canTransformProgram()) return;
+
+    // Probed surface is stock top then
+    bool probed = heightMapProbed();
 
-        // Clear cached args
-        model->setData(model->index(i1.row(), 5), QVariant());
+    bool ok;
+    double stockTop = QInputDialog::getDouble(this, tr("Lower retracts"),
+                                              probed ? tr("Stock top above probed surface, mm:") : tr("Stock top Z, mm:"),
+                                              m_stockTop, -10000, 10000, 3, &ok);
+    if (!ok) return;
 
-        // Drop heightmap cache
-        if (m_currentModel == &m_programModel) m_programHeightmapModel.clear();
+    m_stockTop = stockTop;
 
-        // Update visualizer
-        updateParser();
+    HeightMapCompensator compensator;
+    compensator.setHeightMap(borderRectFromTextboxes(), &m_heightMapModel,
+                             ui->txtHeightMapInterpolationStepX->value(), ui->txtHeightMapInterpolationStepY->value());
 
-        // Hightlight w/o current cell changed event (double hightlight on current cell changed)
-        QList<LineSegment*> list = m_viewParser.getLineSegmentList();
-        for (int i = 0; i < list.count() && list[i]->getLineNumber() <= m_currentModel->data(m_currentModel->index(i1.row(), 4)).toInt(); i++) {
-            list[i]->setIsHightlight(true);
-        }
+    RetractOptimizer optimizer;
+    optimizer.setStockTop(stockTop);
+    optimizer.setClearance(m_settings->stockClearance());
+    optimizer.setToolDiameter(m_settings->toolDiameter());
+    if (probed) optimizer.setSurface(&compensator);
+
+    for (int i = 0; i < m_currentModel->rowCount() - 1; i++) {
+        const GCodeItem &item = m_currentModel->data().at(i);
+        optimizer.addLine(item.command, item.args, item.line);
+    }
+
+    QStringList commands = optimizer.optimize(m_currentDrawer->viewParser()->getLineSegmentList());
+
+    if (optimizer.loweredRetracts() == 0) {
+        QMessageBox::information(this, qApp->applicationDisplayName(), tr("No retracts can be lowered"));
+        return;
+    }
+
+    if (confirmProgram(tr("Lower retracts"), QString(tr("Retracts lowered: %1 of %2\nZ travel: %3 -> %4 mm"))
+                       .arg(optimizer.loweredRetracts()).arg(optimizer.retracts())
+                       .arg(optimizer.zTravelBefore(), 0, 'f', 0).arg(optimizer.zTravelAfter(), 0, 'f', 0), commands)) {
+        replaceProgram(commands);
     }
 }
 
-void frmMain::onTableCurrentChanged(QModelIndex idx1, QModelIndex idx2)
+void frmMain::on_actFileImportRaster_triggered()
 {
-    // Update toolpath hightlighting
-    if (idx1.row() > m_currentModel->rowCount() - 2) idx1 = m_currentModel->index(m_currentModel->rowCount() - 2, 0);
-    if (idx2.row() > m_currentModel->rowCount() - 2) idx2 = m_currentModel->index(m_currentModel->rowCount() - 2, 0);
+    if (m_processingFile || m_heightMapMode || !saveChanges(false)) return;
 
-    GcodeViewParse *parser = m_currentDrawer->viewParser();
-    QList<LineSegment*> list = parser->getLineSegmentList();
-    QVector<QList<int>> lineIndexes = parser->getLinesIndexes();
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Import raster image"), m_lastFolder,
+                                                    tr("Images (*.png *.jpg *.jpeg *.bmp *.gif);;All files (*.*)"));
+    if (fileName.isEmpty()) return;
 
-    // Update linesegments on cell changed
-    if (!m_currentDrawer->geometryUpdated()) {
-        for (int i = 0; i < list.count(); i++) {
-            list.at(i)->setIsHightlight(list.at(i)->getLineNumber() <= m_currentModel->data(m_currentModel->index(idx1.row(), 4)).toInt());
-        }
-    // Update vertices on current cell changed
-    } else {
+    m_lastFolder = fileName.left(fileName.lastIndexOf(QRegExp("[/\\\\]+")));
 
-        int lineFirst = m_currentModel->data(m_currentModel->index(idx1.row(), 4)).toInt();
-        int lineLast = m_currentModel->data(m_currentModel->index(idx2.row(), 4)).toInt();
-        if (lineLast < lineFirst) qSwap(lineLast, lineFirst);
-//        qDebug() << "table current changed" << idx1.row() << idx2.row() << lineFirst << lineLast;
+    QImage image(fileName);
+    if (image.isNull()) {
+        QMessageBox::critical(this, this->windowTitle(), tr("Can't open image:\n") + fileName);
+        return;
+    }
 
-        QList<int> indexes;
-        for (int i = lineFirst + 1; i <= lineLast; i++) {
-            foreach (int l, lineIndexes.at(i)) {
-                list.at(l)->setIsHightlight(idx1.row() > idx2.row());
-                indexes.append(l);
-            }
-        }
+    bool ok;
+    double resolution = QInputDialog::getDouble(this, tr("Import raster image"), tr("Resolution, DPI:"),
+                                                m_rasterResolution, 1, 2540, 0, &ok);
+    if (!ok) return;
 
-        m_selectionDrawer.setEndPosition(indexes.isEmpty() ? QVector3D(sNan, sNan, sNan) :
-            (m_codeDrawer->getIgnoreZ() ? QVector3D(list.at(indexes.last())->getEnd().x(), list.at(indexes.last())->getEnd().y(), 0)
-                                        : list.at(indexes.last())->getEnd()));
-        m_selectionDrawer.update();
+    int feed = QInputDialog::getInt(this, tr("Import raster image"), tr("Feed, mm/min:"), m_rasterFeed, 1, 100000, 100, &ok);
+    if (!ok) return;
 
-        if (!indexes.isEmpty()) m_currentDrawer->update(indexes);
+    // Index is stored in settings
+    QStringList ditherings;
+    ditherings << tr("Floyd-Steinberg dithering") << tr("Jarvis dithering") << tr("Grayscale, 16 power levels");
+
+    QString dithering = QInputDialog::getItem(this, tr("Import raster image"), tr("Shades:"), ditherings,
+                                              qBound(0, m_rasterDithering, ditherings.count() - 1), false, &ok);
+    if (!ok) return;
+
+    m_rasterResolution = resolution;
+    m_rasterFeed = feed;
+    m_rasterDithering = ditherings.indexOf(dithering);
+
+    RasterGenerator generator;
+    generator.setImage(image);
+    generator.setResolution(resolution);
+    generator.setFeed(feed);
+    generator.setPowerRange(m_settings->laserPowerMin(), m_settings->laserPowerMax());
+
+    switch (m_rasterDithering) {
+    case 0:
+        generator.setDithering(RasterGenerator::FloydSteinberg);
+        break;
+    case 1:
+        generator.setDithering(RasterGenerator::Jarvis);
+        break;
+    default:
+        generator.setDithering(RasterGenerator::NoDithering);
+        generator.setLevels(16);
     }
 
-    // Update selection marker
-    int line = m_currentModel->data(m_currentModel->index(idx1.row(), 4)).toInt();
-    if (line > 0 && !lineIndexes.at(line).isEmpty()) {
-        QVector3D pos = list.at(lineIndexes.at(line).last())->getEnd();
-        m_selectionDrawer.setEndPosition(m_codeDrawer->getIgnoreZ() ? QVector3D(pos.x(), pos.y(), 0) : pos);
-    } else {
-        m_selectionDrawer.setEndPosition(QVector3D(sNan, sNan, sNan));
+    QStringList commands = generator.generate();
+
+    if (generator.pixels() == 0) {
+        QMessageBox::information(this, qApp->applicationDisplayName(), tr("Image has nothing to engrave"));
+        return;
     }
-    m_selectionDrawer.update();
+
+    loadFile(commands);
+    m_programFileName.clear();
+    m_fileChanged = true;
 }
 
-void frmMain::onTableInsertLine()
+void frmMain::onPreviewOriginalToggled(bool checked)
 {
-    if (ui->tblProgram->selectionModel()->selectedRows().count() == 0 || m_processingFile) return;
+    m_codeDrawer->setVisible(checked);
+    m_previewDrawer->setVisible(!checked);
+}
 
-    int row = ui->tblProgram->selectionModel()->selectedRows()[0].row();
+bool frmMain::canTransformProgram()
+{
+    if (m_processingFile || m_heightMapMode || m_currentModel->rowCount() <= 1) return false;
 
-    m_currentModel->insertRow(row);
-    m_currentModel->setData(m_currentModel->index(row, 2), GCodeItem::InQueue);
+    // Parsed segments are flattened then
+    if (m_codeDrawer->getIgnoreZ()) {
+        QMessageBox::information(this, qApp->applicationDisplayName(), tr("Program can't be transformed while Z coordinates are ignored by grayscale or raster drawing"));
+        return false;
+    }
 
-    updateParser();
-    m_cellChanged = true;
-    ui->tblProgram->selectRow(row);
+    return true;
 }
 
-void frmMain::onTableDeleteLines()
+// Heightmap without unprobed points
+bool frmMain::heightMapProbed()
 {
-    if (ui->tblProgram->selectionModel()->selectedRows().count() == 0 || m_processingFile ||
-            QMessageBox::warning(this, this->windowTitle(), tr("Delete lines?"), QMessageBox::Yes | QMessageBox::No) == QMessageBox::No) return;
+    if (m_heightMapModel.rowCount() == 0) return false;
 
-    QModelIndex firstRow = ui->tblProgram->selectionModel()->selectedRows()[0];
-    int rowsCount = ui->tblProgram->selectionModel()->selectedRows().count();
-    if (ui->tblProgram->selectionModel()->selectedRows().last().row() == m_currentModel->rowCount() - 1) rowsCount--;
+    for (int i = 0; i < m_heightMapModel.rowCount(); i++)
+        for (int j = 0; j < m_heightMapModel.columnCount(); j++)
+            if (qIsNaN(m_heightMapModel.data(m_heightMapModel.index(i, j), Qt::UserRole).toDouble())) return false;
 
-    qDebug() << "deleting lines" << firstRow.row() << rowsCount;
+    return true;
+}
 
-    if (firstRow.row() != m_currentModel->rowCount() - 1) {
-        m_currentModel->removeRows(firstRow.row(), rowsCount);
-    } else return;
+// Transformed program is shown instead of current one until answer
+bool frmMain::confirmProgram(const QString &title, const QString &details, const QStringList &commands)
+{
+    GcodeParser gp;
+    gp.setTraverseSpeed(m_settings->rapidSpeed());
+    if (m_codeDrawer->getIgnoreZ()) gp.reset(QVector3D(qQNaN(), qQNaN(), 0));
 
-    // Drop heightmap cache
-    if (m_currentModel == &m_programModel) m_programHeightmapModel.clear();
+    foreach (const QString &command, commands) {
+        gp.addCommand(GcodePreprocessorUtils::splitCommand(GcodePreprocessorUtils::removeComment(command)));
+    }
 
-    updateParser();
-    m_cellChanged = true;
-    ui->tblProgram->selectRow(firstRow.row());
-}
+    m_previewParser.reset();
+    QList<LineSegment*> lines = m_previewParser.getLinesFromParser(&gp, m_settings->arcPrecision(), m_settings->arcDegreeMode());
 
-void frmMain::on_actServiceSettings_triggered()
-{
-    if (m_settings->exec()) {
-        qDebug() << "Applying settings";
-        qDebug() << "Port:" << m_settings->port() << "Baud:" << m_settings->baud();
+    QTime zero(0, 0, 0);
+    QString text = QString(tr("%1\n\nLines: %2 -> %3\nEstimated time: %4 -> %5\n\nReplace program?"))
+            .arg(details).arg(m_currentModel->rowCount() - 1).arg(commands.count())
+            .arg(zero.addSecs(programDuration(m_currentDrawer->viewParser()->getLineSegmentList())).toString("hh:mm:ss"))
+            .arg(zero.addSecs(programDuration(lines)).toString("hh:mm:ss"));
 
-        if (m_settings->port() != "" && (m_settings->port() != m_serialPort.portName() ||
-                                           m_settings->baud() != m_serialPort.baudRate())) {
-            if (m_serialPort.isOpen()) m_serialPort.close();
-            m_serialPort.setPortName(m_settings->port());
-            m_serialPort.setBaudRate(m_settings->baud());
-            openPort();
-        }
+    m_previewDrawer->update();
+    m_previewDrawer->setVisible(true);
+    m_codeDrawer->setVisible(false);
 
-        updateControlsState();
-        applySettings();
-    } else {
-        m_settings->undo();
-    }
+    QMessageBox box(this);
+    box.setIcon(QMessageBox::Question);
+    box.setWindowTitle(title);
+    box.setText(text);
+    box.setStandardButtons(QMessageBox::Yes | QMessageBox::No);
+    box.setWindowModality(Qt::WindowModal);
+    box.setCheckBox(new QCheckBox(tr("Show original")));
+    connect(box.checkBox(), SIGNAL(toggled(bool)), this, SLOT(onPreviewOriginalToggled(bool)));
+
+    bool accepted = box.exec() == QMessageBox::Yes;
+
+    m_codeDrawer->setVisible(true);
+    m_previewDrawer->setVisible(false);
+    m_previewParser.reset();
+    m_previewDrawer->update();
+
+    return accepted;
+}
+
+void frmMain::replaceProgram(const QStringList &commands)
+{
+    loadFile(commands);
+    m_fileChanged = true;
 }
 
 bool buttonLessThan(StyledToolButton *b1, StyledToolButton *b2)
@@ -2036,7 +3019,23 @@ void frmMain::applySettings() {
     m_heightMapGridDrawer.setLineWidth(0.1);
     m_heightMapInterpolationDrawer.setLineWidth(m_settings->lineWidth());
     ui->glwVisualizer->setLineWidth(m_settings->lineWidth());
-    m_timerStateQuery.setInterval(m_settings->queryStateTime());
+    QMetaObject::invokeMethod(m_serialWorker, "setStatusInterval", Qt::QueuedConnection, Q_ARG(int, m_settings->queryStateTime()));
+    QMetaObject::invokeMethod(m_serialWorker, "setBufferOptions", Qt::QueuedConnection, Q_ARG(int, m_settings->rxBufferSize()),
+                              Q_ARG(bool, m_settings->plannerThrottle()));
+    QMetaObject::invokeMethod(m_serialWorker, "setMetricsFile", Qt::QueuedConnection, Q_ARG(QString, m_settings->metricsFile()));
+    QMetaObject::invokeMethod(m_serialWorker, "setTrafficFile", Qt::QueuedConnection, Q_ARG(QString, m_settings->trafficFile()));
+    m_timerSerialUpdate.setInterval(1000 / m_settings->fps());
+    m_jog.setFeed(m_settings->jogFeed());
+    m_jog.setAcceleration(m_settings->acceleration());
+    m_errorPolicy.setPolicy(m_settings->errorPolicy());
+    updateMachines();
+
+    if (m_controlServer.serverName() != m_settings->controlSocket()) {
+        m_controlServer.close();
+        if (!m_settings->controlSocket().isEmpty() && !m_controlServer.listen(m_settings->controlSocket())) {
+            ui->txtConsole->appendPlainText(tr("Can't open control socket: ") + m_controlServer.errorString());
+        }
+    }
 
     m_toolDrawer.setToolAngle(m_settings->toolType() == 0 ? 180 : m_settings->toolAngle());
     m_toolDrawer.setColor(m_settings->colors("Tool"));
@@ -2074,6 +3073,12 @@ void frmMain::applySettings() {
     m_codeDrawer->setColorZMovement(m_settings->colors("ToolpathZMovement"));
     m_codeDrawer->setColorStart(m_settings->colors("ToolpathStart"));
     m_codeDrawer->setColorEnd(m_settings->colors("ToolpathEnd"));
+    m_previewDrawer->setLineWidth(m_settings->lineWidth());
+    m_previewDrawer->setColorNormal(m_settings->colors("ToolpathNormal"));
+    m_previewDrawer->setColorHighlight(m_settings->colors("ToolpathHighlight"));
+    m_previewDrawer->setColorZMovement(m_settings->colors("ToolpathZMovement"));
+    m_previewDrawer->setColorStart(m_settings->colors("ToolpathStart"));
+    m_previewDrawer->setColorEnd(m_settings->colors("ToolpathEnd"));
     m_codeDrawer->setIgnoreZ(m_settings->grayscaleSegments() || !m_settings->drawModeVectors());
     m_codeDrawer->setGrayscaleSegments(m_settings->grayscaleSegments());
     m_codeDrawer->setGrayscaleCode(m_settings->grayscaleSCode() ? GcodeDrawer::S : GcodeDrawer::Z);
@@ -2164,6 +3169,7 @@ void frmMain::updateParser()
         }
 
         // Add command to parser
+        m_currentModel->data()[i].modal = gp.getModalState();
         gp.addCommand(args);
 
         // Update table model
@@ -2190,17 +3196,19 @@ void frmMain::updateParser()
 
     if (m_currentModel == &m_programModel) m_fileChanged = true;
 
+    checkProgram();
+
     qDebug() << "Update parser time: " << time.elapsed();
 }
 
 void frmMain::on_cmdCommandSend_clicked()
 {
     QString command = ui->cboCommand->currentText();
-    if (command.isEmpty()) return;
+    if (command.isEmpty() || !consoleCommandAllowed(command)) return;
 
     ui->cboCommand->storeText();
     ui->cboCommand->setCurrentText("");
-    sendCommand(command, -1);
+    sendCommand(command);
 }
 
 void frmMain::on_actFileOpen_triggered()
@@ -2212,7 +3220,7 @@ void frmMain::on_cmdHome_clicked()
 {
     m_homing = true;
     m_updateSpindleSpeed = true;
-    sendCommand("$H", -1, m_settings->showUICommands());
+    sendCommand("$H", CommandAttributes::Homing, m_settings->showUICommands());
 }
 
 void frmMain::on_cmdTouch_clicked()
@@ -2222,42 +3230,42 @@ void frmMain::on_cmdTouch_clicked()
     QStringList list = m_settings->touchCommand().split(";");
 
     foreach (QString cmd, list) {
-        sendCommand(cmd.trimmed(), -1, m_settings->showUICommands());
+        sendCommand(cmd.trimmed(), CommandAttributes::User, m_settings->showUICommands());
     }
 }
 
 void frmMain::on_cmdZeroXY_clicked()
 {
     m_settingZeroXY = true;
-    sendCommand("G92X0Y0", -1, m_settings->showUICommands());
-    sendCommand("$#", -2, m_settings->showUICommands());
+    sendCommand("G92X0Y0", CommandAttributes::User, m_settings->showUICommands());
+    sendCommand("$#", CommandAttributes::Offsets, m_settings->showUICommands());
 }
 
 void frmMain::on_cmdZeroZ_clicked()
 {
     m_settingZeroZ = true;
-    sendCommand("G92Z0", -1, m_settings->showUICommands());
-    sendCommand("$#", -2, m_settings->showUICommands());
+    sendCommand("G92Z0", CommandAttributes::User, m_settings->showUICommands());
+    sendCommand("$#", CommandAttributes::Offsets, m_settings->showUICommands());
 }
 
 void frmMain::on_cmdRestoreOrigin_clicked()
 {
     // Restore offset
-    sendCommand(QString("G21"), -1, m_settings->showUICommands());
-    sendCommand(QString("G53G90G0X%1Y%2Z%3").arg(toMetric(ui->txtMPosX->text().toDouble()))
-                                            .arg(toMetric(ui->txtMPosY->text().toDouble()))
-                                            .arg(toMetric(ui->txtMPosZ->text().toDouble())), -1, m_settings->showUICommands());
-    sendCommand(QString("G92X%1Y%2Z%3").arg(toMetric(ui->txtMPosX->text().toDouble()) - m_storedX)
-                                        .arg(toMetric(ui->txtMPosY->text().toDouble()) - m_storedY)
-                                        .arg(toMetric(ui->txtMPosZ->text().toDouble()) - m_storedZ), -1, m_settings->showUICommands());
+    sendCommand(QString("G21"), CommandAttributes::User, m_settings->showUICommands());
+    sendCommand(QString("G53G90G0X%1Y%2Z%3").arg(toMetric(m_machineState.machinePosition[0]))
+                                            .arg(toMetric(m_machineState.machinePosition[1]))
+                                            .arg(toMetric(m_machineState.machinePosition[2])), CommandAttributes::User, m_settings->showUICommands());
+    sendCommand(QString("G92X%1Y%2Z%3").arg(toMetric(m_machineState.machinePosition[0]) - m_storedX)
+                                        .arg(toMetric(m_machineState.machinePosition[1]) - m_storedY)
+                                        .arg(toMetric(m_machineState.machinePosition[2]) - m_storedZ), CommandAttributes::User, m_settings->showUICommands());
 
     // Move tool
     if (m_settings->moveOnRestore()) switch (m_settings->restoreMode()) {
     case 0:
-        sendCommand("G0X0Y0", -1, m_settings->showUICommands());
+        sendCommand("G0X0Y0", CommandAttributes::User, m_settings->showUICommands());
         break;
     case 1:
-        sendCommand("G0X0Y0Z0", -1, m_settings->showUICommands());
+        sendCommand("G0X0Y0Z0", CommandAttributes::User, m_settings->showUICommands());
         break;
     }
 }
@@ -2270,7 +3278,7 @@ void frmMain::on_cmdReset_clicked()
 void frmMain::on_cmdUnlock_clicked()
 {
     m_updateSpindleSpeed = true;
-    sendCommand("$X", -1, m_settings->showUICommands());
+    sendCommand("$X", CommandAttributes::User, m_settings->showUICommands());
 }
 
 void frmMain::on_cmdSafePosition_clicked()
@@ -2278,7 +3286,7 @@ void frmMain::on_cmdSafePosition_clicked()
     QStringList list = m_settings->safePositionCommand().split(";");
 
     foreach (QString cmd, list) {
-        sendCommand(cmd.trimmed(), -1, m_settings->showUICommands());
+        sendCommand(cmd.trimmed(), CommandAttributes::User, m_settings->showUICommands());
     }
 }
 
@@ -2297,7 +3305,7 @@ void frmMain::on_cmdSpindle_toggled(bool checked)
 
 void frmMain::on_cmdSpindle_clicked(bool checked)
 {
-    sendCommand(checked ? QString("M3 S%1").arg(ui->txtSpindleSpeed->text()) : "M5", -1, m_settings->showUICommands());
+    sendCommand(checked ? QString("M3 S%1").arg(ui->txtSpindleSpeed->text()) : "M5", CommandAttributes::User, m_settings->showUICommands());
 }
 
 void frmMain::on_txtSpindleSpeed_editingFinished()
@@ -2325,39 +3333,94 @@ void frmMain::on_sliSpindleSpeed_actionTriggered(int action)
 
 void frmMain::on_cmdYPlus_clicked()
 {
-    // Query parser state to restore coordinate system, hide from table and console
-    sendCommand("$G", -2, m_settings->showUICommands());
-    sendCommand("G91G0Y" + ui->txtJogStep->text(), -1, m_settings->showUICommands());
+    jogStep(QVector3D(0, 1, 0));
 }
 
 void frmMain::on_cmdYMinus_clicked()
 {
-    sendCommand("$G", -2, m_settings->showUICommands());
-    sendCommand("G91G0Y-" + ui->txtJogStep->text(), -1, m_settings->showUICommands());
+    jogStep(QVector3D(0, -1, 0));
 }
 
 void frmMain::on_cmdXPlus_clicked()
 {
-    sendCommand("$G", -2, m_settings->showUICommands());
-    sendCommand("G91G0X" + ui->txtJogStep->text(), -1, m_settings->showUICommands());
+    jogStep(QVector3D(1, 0, 0));
 }
 
 void frmMain::on_cmdXMinus_clicked()
 {
-    sendCommand("$G", -2, m_settings->showUICommands());
-    sendCommand("G91G0X-" + ui->txtJogStep->text(), -1, m_settings->showUICommands());
+    jogStep(QVector3D(-1, 0, 0));
 }
 
 void frmMain::on_cmdZPlus_clicked()
 {
-    sendCommand("$G", -2, m_settings->showUICommands());
-    sendCommand("G91G0Z" + ui->txtJogStep->text(), -1, m_settings->showUICommands());
+    jogStep(QVector3D(0, 0, 1));
 }
 
 void frmMain::on_cmdZMinus_clicked()
 {
-    sendCommand("$G", -2, m_settings->showUICommands());
-    sendCommand("G91G0Z-" + ui->txtJogStep->text(), -1, m_settings->showUICommands());
+    jogStep(QVector3D(0, 0, -1));
+}
+
+void frmMain::jogStep(const QVector3D &direction)
+{
+    // Jog motion doesn't change parser state since grbl 1.1
+    if (m_realtimeOverrides) {
+        if (!jogFeedSet()) return;
+        sendCommand(m_jog.stepCommand(direction, ui->txtJogStep->value()), CommandAttributes::Jog, m_settings->showUICommands());
+        return;
+    }
+
+    QString command = "G91G0";
+
+    if (direction.x() != 0) command += (direction.x() > 0 ? "X" : "X-") + ui->txtJogStep->text();
+    if (direction.y() != 0) command += (direction.y() > 0 ? "Y" : "Y-") + ui->txtJogStep->text();
+    if (direction.z() != 0) command += (direction.z() > 0 ? "Z" : "Z-") + ui->txtJogStep->text();
+
+    // Query parser state to restore coordinate system, hide from table and console
+    sendCommand("$G", CommandAttributes::CoordinateSystem, m_settings->showUICommands());
+    sendCommand(command, CommandAttributes::User, m_settings->showUICommands());
+}
+
+void frmMain::startJog()
+{
+    QVector3D direction;
+
+    foreach (int key, m_jogKeys) direction += keyDirection(key);
+
+    if (!jogFeedSet()) return;
+
+    m_jog.start(direction);
+    sendJogCommands();
+}
+
+// Grbl refuses jog moves without feed
+bool frmMain::jogFeedSet()
+{
+    if (m_settings->jogFeed() > 0) return true;
+
+    ui->txtConsole->appendPlainText(tr("Jog feed isn't set in settings, jogging is disabled"));
+    return false;
+}
+
+void frmMain::stopJog()
+{
+    m_jogRestart = false;
+
+    if (!m_jog.isActive()) return;
+
+    // Controller flushes queued jog moves, worker drops unsent ones
+    m_jog.stop();
+    m_serialWorker->sendRealtime((char)GrblJog::JogCancel);
+}
+
+void frmMain::sendJogCommands()
+{
+    if (!m_serialWorker->isOpen() || !m_resetCompleted) return;
+
+    // Next moves are sent on answers if queue is full
+    while (m_jog.canSend() && sendCommand(m_jog.command(), CommandAttributes::Jog, false)) {
+        m_jog.sent(m_commands.last().id);
+    }
 }
 
 void frmMain::on_chkTestMode_clicked(bool checked)
@@ -2365,7 +3428,7 @@ void frmMain::on_chkTestMode_clicked(bool checked)
     if (checked) {
         storeOffsets();
         storeParserState();
-        sendCommand("$C", -1, m_settings->showUICommands());
+        sendCommand("$C", CommandAttributes::CheckMode, m_settings->showUICommands());
     } else {
         m_aborting = true;
         grblReset();
@@ -2374,7 +3437,12 @@ void frmMain::on_chkTestMode_clicked(bool checked)
 
 void frmMain::on_cmdFilePause_clicked(bool checked)
 {
-    m_serialPort.write(checked ? "!" : "~");
+    if (m_activeMachine != -1) {
+        QMetaObject::invokeMethod(m_machines.at(m_activeMachine)->job, checked ? "pause" : "resume", Qt::QueuedConnection);
+        return;
+    }
+
+    m_serialWorker->sendRealtime(checked ? '!' : '~');
 }
 
 void frmMain::on_cmdFileReset_clicked()
@@ -2596,49 +3664,11 @@ void frmMain::on_actAbout_triggered()
     m_frmAbout.exec();
 }
 
-bool frmMain::dataIsEnd(QString data) {
-    QStringList ends;
-
-    ends << "ok";
-    ends << "error";
-//    ends << "Reset to continue";
-//    ends << "'$' for help";
-//    ends << "'$H'|'$X' to unlock";
-//    ends << "Caution: Unlocked";
-//    ends << "Enabled";
-//    ends << "Disabled";
-//    ends << "Check Door";
-//    ends << "Pgm End";
-
-    foreach (QString str, ends) {
-        if (data.contains(str)) return true;
-    }
-
-    return false;
-}
-
-bool frmMain::dataIsFloating(QString data) {
-    QStringList ends;
-
-    ends << "Reset to continue";
-    ends << "'$H'|'$X' to unlock";
-    ends << "ALARM: Soft limit";
-    ends << "ALARM: Hard limit";
-    ends << "Check Door";
-
-    foreach (QString str, ends) {
-        if (data.contains(str)) return true;
-    }
-
-    return false;
-}
-
-bool frmMain::dataIsReset(QString data) {
-    return QRegExp("^GRBL|GCARVIN\\s\\d\\.\\d.").indexIn(data.toUpper()) != -1;
-}
-
 QString frmMain::feedOverride(QString command)
 {
+    // Controller applies realtime overrides itself
+    if (m_realtimeOverrides) return command;
+
     // Feed override if not in heightmap probing mode
     if (!ui->cmdHeightMapMode->isChecked()) command = GcodePreprocessorUtils::overrideSpeed(command, ui->chkFeedOverride->isChecked() ?
         ui->txtFeed->value() : 100, &m_originalFeed);
@@ -2655,7 +3685,9 @@ void frmMain::on_sliFeed_valueChanged(int value)
 {
     ui->txtFeed->setValue(value);
     updateProgramEstimatedTime(m_currentDrawer->viewParser()->getLineSegmentList());
-    if (m_processingFile && ui->chkFeedOverride->isChecked()) {
+    if (m_realtimeOverrides) {
+        updateOverrides();
+    } else if (m_processingFile && ui->chkFeedOverride->isChecked()) {
         ui->txtFeed->setStyleSheet("color: red;");
         m_updateFeed = true;
     }
@@ -2667,12 +3699,52 @@ void frmMain::on_chkFeedOverride_toggled(bool checked)
     style()->unpolish(ui->grpFeed);
     ui->grpFeed->ensurePolished();
     updateProgramEstimatedTime(m_currentDrawer->viewParser()->getLineSegmentList());
-    if (m_processingFile) {
+    if (m_realtimeOverrides) {
+        updateOverrides();
+    } else if (m_processingFile) {
         ui->txtFeed->setStyleSheet("color: red;");
         m_updateFeed = true;
     }
 }
 
+void frmMain::on_cboRapidOverride_currentIndexChanged(int index)
+{
+    Q_UNUSED(index)
+
+    if (m_realtimeOverrides) updateOverrides();
+}
+
+void frmMain::on_txtSpindleOverride_valueChanged(int value)
+{
+    Q_UNUSED(value)
+
+    if (m_realtimeOverrides) updateOverrides();
+}
+
+void frmMain::updateOverrides()
+{
+    bool checked = ui->chkFeedOverride->isChecked();
+
+    // Slider steps are converted to coarse and fine override commands by serial worker
+    m_serialWorker->setOverrides(checked ? ui->txtFeed->value() : 100,
+                                 checked ? (100 >> ui->cboRapidOverride->currentIndex()) : 100,
+                                 checked ? ui->txtSpindleOverride->value() : 100);
+
+    m_displayedState.feedOverride = -1;
+}
+
+void frmMain::setRealtimeOverrides(bool enabled)
+{
+    m_realtimeOverrides = enabled;
+
+    ui->widgetRealtimeOverrides->setVisible(enabled);
+    ui->grpFeed->setToolTip(QString());
+    ui->txtFeed->setStyleSheet("color: palette(text);");
+
+    if (enabled) updateOverrides();
+    else m_serialWorker->setOverrides(-1, -1, -1);
+}
+
 void frmMain::on_grpFeed_toggled(bool checked)
 {
     if (checked) {
@@ -2709,6 +3781,14 @@ void frmMain::on_grpJog_toggled(bool checked)
     ui->widgetJog->setVisible(checked);
 }
 
+void frmMain::on_grpMetrics_toggled(bool checked)
+{
+    updateLayouts();
+
+    ui->widgetMetrics->setVisible(checked);
+    if (checked) updateMetricsView();
+}
+
 void frmMain::on_grpUserCommands_toggled(bool checked)
 {
     ui->widgetUserCommands->setVisible(checked);
@@ -2751,28 +3831,42 @@ bool frmMain::eventFilter(QObject *obj, QEvent *event)
             }
 
             if (!m_processingFile && ui->chkKeyboardControl->isChecked()) {
+                // Key press makes jog step, held key jogs continuously until release
+                if (keyIsMovement(keyEvent->key()) && m_realtimeOverrides) {
+                    if (!keyEvent->isAutoRepeat()) {
+                        if (!m_jogKeys.contains(keyEvent->key())) m_jogKeys.append(keyEvent->key());
+                        if (m_jog.isActive()) {
+                            stopJog();
+                            m_jogRestart = true;
+                        } else {
+                            jogStep(keyDirection(keyEvent->key()));
+                        }
+                    } else if (!m_jog.isActive() && !m_jogRestart) {
+                        startJog();
+                    }
+                }
                 // Block only autorepeated keypresses
-                if (keyIsMovement(keyEvent->key()) && !(m_jogBlock && keyEvent->isAutoRepeat())) {
+                else if (keyIsMovement(keyEvent->key()) && !(m_jogBlock && keyEvent->isAutoRepeat())) {
                     blockJogForRapidMovement(keyEvent->isAutoRepeat());
 
                     switch (keyEvent->key()) {
                     case Qt::Key_4:
-                        sendCommand("G91G0X-" + ui->txtJogStep->text(), -1, m_settings->showUICommands());
+                        sendCommand("G91G0X-" + ui->txtJogStep->text(), CommandAttributes::User, m_settings->showUICommands());
                         break;
                     case Qt::Key_6:
-                        sendCommand("G91G0X" + ui->txtJogStep->text(), -1, m_settings->showUICommands());
+                        sendCommand("G91G0X" + ui->txtJogStep->text(), CommandAttributes::User, m_settings->showUICommands());
                         break;
                     case Qt::Key_8:
-                        sendCommand("G91G0Y" + ui->txtJogStep->text(), -1, m_settings->showUICommands());
+                        sendCommand("G91G0Y" + ui->txtJogStep->text(), CommandAttributes::User, m_settings->showUICommands());
                         break;
                     case Qt::Key_2:
-                        sendCommand("G91G0Y-" + ui->txtJogStep->text(), -1, m_settings->showUICommands());
+                        sendCommand("G91G0Y-" + ui->txtJogStep->text(), CommandAttributes::User, m_settings->showUICommands());
                         break;
                     case Qt::Key_9:
-                        sendCommand("G91G0Z" + ui->txtJogStep->text(), -1, m_settings->showUICommands());
+                        sendCommand("G91G0Z" + ui->txtJogStep->text(), CommandAttributes::User, m_settings->showUICommands());
                         break;
                     case Qt::Key_3:
-                        sendCommand("G91G0Z-" + ui->txtJogStep->text(), -1, m_settings->showUICommands());
+                        sendCommand("G91G0Z-" + ui->txtJogStep->text(), CommandAttributes::User, m_settings->showUICommands());
                         break;
                     }
                 }
@@ -2815,6 +3909,20 @@ bool frmMain::eventFilter(QObject *obj, QEvent *event)
                     ui->chkAutoScroll->setChecked(false);
                 }
             }
+        } else if (event->type() == QEvent::KeyRelease) {
+            QKeyEvent *keyEvent = static_cast<QKeyEvent*>(event);
+
+            // Released key stops continuous jog, other held keys continue it
+            if (keyIsMovement(keyEvent->key()) && !keyEvent->isAutoRepeat() && m_jogKeys.removeAll(keyEvent->key())) {
+                if (m_jog.isActive() || m_jogRestart) {
+                    stopJog();
+                    m_jogRestart = !m_jogKeys.isEmpty();
+                }
+            }
+        } else if (event->type() == QEvent::WindowDeactivate) {
+            // Key releases won't come to inactive window
+            m_jogKeys.clear();
+            stopJog();
         }
 
     // Splitter events
@@ -2894,18 +4002,36 @@ bool frmMain::keyIsMovement(int key)
     return key == Qt::Key_4 || key == Qt::Key_6 || key == Qt::Key_8 || key == Qt::Key_2 || key == Qt::Key_9 || key == Qt::Key_3;
 }
 
+QVector3D frmMain::keyDirection(int key)
+{
+    switch (key) {
+    case Qt::Key_4: return QVector3D(-1, 0, 0);
+    case Qt::Key_6: return QVector3D(1, 0, 0);
+    case Qt::Key_8: return QVector3D(0, 1, 0);
+    case Qt::Key_2: return QVector3D(0, -1, 0);
+    case Qt::Key_9: return QVector3D(0, 0, 1);
+    case Qt::Key_3: return QVector3D(0, 0, -1);
+    default: return QVector3D();
+    }
+}
+
 void frmMain::on_chkKeyboardControl_toggled(bool checked)
 {
     ui->grpJog->setProperty("overrided", checked);
     style()->unpolish(ui->grpJog);
     ui->grpJog->ensurePolished();
 
+    if (!checked) {
+        m_jogKeys.clear();
+        stopJog();
+    }
+
     // Store/restore coordinate system
     if (checked) {
-        sendCommand("$G", -2, m_settings->showUICommands());
+        sendCommand("$G", CommandAttributes::CoordinateSystem, m_settings->showUICommands());
         if (!ui->grpJog->isChecked()) ui->grpJog->setTitle(tr("Jog") + QString(tr(" (%1)")).arg(ui->txtJogStep->text()));
     } else {
-        if (m_absoluteCoordinates) sendCommand("G90", -1, m_settings->showUICommands());
+        if (m_absoluteCoordinates) sendCommand("G90", CommandAttributes::User, m_settings->showUICommands());
         ui->grpJog->setTitle(tr("Jog"));
     }
 
@@ -2983,10 +4109,19 @@ void frmMain::onActRecentFileTriggered()
 void frmMain::onCboCommandReturnPressed()
 {
     QString command = ui->cboCommand->currentText();
-    if (command.isEmpty()) return;
+    if (command.isEmpty() || !consoleCommandAllowed(command)) return;
 
     ui->cboCommand->setCurrentText("");
-    sendCommand(command, -1);
+    sendCommand(command);
+}
+
+// Compacted program lines rely on modal state and position left by previous ones
+bool frmMain::consoleCommandAllowed(const QString &command)
+{
+    if (!m_processingFile || !m_settings->compactProgram() || command.trimmed().startsWith('$')) return true;
+
+    ui->txtConsole->appendPlainText(tr("G-code can't be sent while compacted program is running: ") + command);
+    return false;
 }
 
 void frmMain::updateRecentFilesMenu()
@@ -3491,9 +4626,10 @@ void frmMain::on_chkHeightMapUse_clicked(bool checked)
 
             // Modifying linesegments
             QList<LineSegment*> *list = m_viewParser.getLines();
-            QRectF borderRect = borderRectFromTextboxes();
+            HeightMapCompensator compensator;
+            compensator.setHeightMap(borderRectFromTextboxes(), &m_heightMapModel,
+                                     ui->txtHeightMapInterpolationStepX->value(), ui->txtHeightMapInterpolationStepY->value());
             double x, y, z;
-            QVector3D point;
 
             progress.setLabelText(tr("Subdividing segments..."));
             progress.setMaximum(list->count() - 1);
@@ -3501,7 +4637,7 @@ void frmMain::on_chkHeightMapUse_clicked(bool checked)
 
             for (int i = 0; i < list->count(); i++) {
                 if (!list->at(i)->isZMovement()) {
-                    QList<LineSegment*> subSegments = subdivideSegment(list->at(i));
+                    QList<LineSegment*> subSegments = compensator.subdivideSegment(list->at(i));
 
                     if (subSegments.count() > 0) {
                         delete list->at(i);
@@ -3529,13 +4665,13 @@ void frmMain::on_chkHeightMapUse_clicked(bool checked)
                 if (i == 0) {
                     x = list->at(i)->getStart().x();
                     y = list->at(i)->getStart().y();
-                    z = list->at(i)->getStart().z() + Interpolation::bicubicInterpolate(borderRect, &m_heightMapModel, x, y);
+                    z = list->at(i)->getStart().z() + compensator.height(x, y);
                     list->at(i)->setStart(QVector3D(x, y, z));
                 } else list->at(i)->setStart(list->at(i - 1)->getEnd());
 
                 x = list->at(i)->getEnd().x();
                 y = list->at(i)->getEnd().y();
-                z = list->at(i)->getEnd().z() + Interpolation::bicubicInterpolate(borderRect, &m_heightMapModel, x, y);
+                z = list->at(i)->getEnd().z() + compensator.height(x, y);
                 list->at(i)->setEnd(QVector3D(x, y, z));
 
                 if (progress.isVisible() && (i % PROGRESSSTEP == 0)) {
@@ -3552,101 +4688,18 @@ void frmMain::on_chkHeightMapUse_clicked(bool checked)
             time.start();
 
             // Modifying g-code program
-            QString command;
-            QStringList args;
-            int line;
-            QString newCommand;
             GCodeItem item;
-            int lastSegmentIndex = 0;
-            int lastCommandIndex = -1;
-
-            // Search strings
-            QString coords("XxYyZzIiJjKkRr");
-            QString g("Gg");
-            QString m("Mm");
 
-            char codeChar;          // Single code char G1 -> G
-            float codeNum;          // Code number      G1 -> 1
-
-            QString lastCode;
-            bool isLinearMove;
-            bool hasCommand;
+            compensator.startProgram(list);
 
             m_programLoading = true;
             for (int i = 0; i < m_programModel.rowCount() - 1; i++) {
-                command = m_programModel.data().at(i).command;
-                line = m_programModel.data().at(i).line;
-                isLinearMove = false;
-                hasCommand = false;
+                const GCodeItem &source = m_programModel.data().at(i);
 
-                if (line < 0 || line == lastCommandIndex || lastSegmentIndex == list->count() - 1) {
+                foreach (const QString &command, compensator.programCommands(source.command, source.args, source.line)) {
                     item.command = command;
                     m_programHeightmapModel.data().append(item);
-                } else {
-                    // Get commands args
-                    args = m_programModel.data().at(i).args;
-                    newCommand.clear();
-
-                    // Parse command args
-                    foreach (QString arg, args) {                   // arg examples: G1, G2, M3, X100...
-                        codeChar = arg.at(0).toLatin1();            // codeChar: G, M, X...
-                        if (!coords.contains(codeChar)) {           // Not parameter
-                            codeNum = arg.mid(1).toDouble();
-                            if (g.contains(codeChar)) {             // 'G'-command
-                                // Store 'G0' & 'G1'
-                                if (codeNum == 0.0f || codeNum == 1.0f) {
-                                    lastCode = arg;
-                                    isLinearMove = true;            // Store linear move
-                                }
-
-                                // Replace 'G2' & 'G3' with 'G1'
-                                if (codeNum == 2.0f || codeNum == 3.0f) {
-                                    newCommand.append("G1");
-                                    isLinearMove = true;
-                                // Drop plane command for arcs
-                                } else if (codeNum != 17.0f && codeNum != 18.0f && codeNum != 19.0f) {
-                                    newCommand.append(arg);
-                                }
-
-                                hasCommand = true;                  // Command has 'G'
-                            } else {
-                                if (m.contains(codeChar))
-                                    hasCommand = true;              // Command has 'M'
-                                newCommand.append(arg);       // Other commands
-                            }
-                        }
-                    }
-
-                    // Find first linesegment by command index
-                    for (int j = lastSegmentIndex; j < list->count(); j++) {
-                        if (list->at(j)->getLineNumber() == line) {
-                            if (!qIsNaN(list->at(j)->getEnd().length()) && (isLinearMove || (!hasCommand && !lastCode.isEmpty()))) {
-                                // Create new commands for each linesegment with given command index
-                                while ((j < list->count()) && (list->at(j)->getLineNumber() == line)) {
-
-                                    point = list->at(j)->getEnd();
-                                    if (!list->at(j)->isAbsolute()) point -= list->at(j)->getStart();
-                                    if (!list->at(j)->isMetric()) point /= 25.4;
-
-                                    item.command = newCommand + QString("X%1Y%2Z%3")
-                                            .arg(point.x(), 0, 'f', 3).arg(point.y(), 0, 'f', 3).arg(point.z(), 0, 'f', 3);
-                                    m_programHeightmapModel.data().append(item);
-
-                                    if (!newCommand.isEmpty()) newCommand.clear();
-                                    j++;
-                                }
-                            // Copy original command if not G0 or G1
-                            } else {
-                                item.command = command;
-                                m_programHeightmapModel.data().append(item);
-                            }
-
-                            lastSegmentIndex = j;
-                            break;
-                        }
-                    }
                 }
-                lastCommandIndex = line;
 
                 if (progress.isVisible() && (i % PROGRESSSTEP == 0)) {
                     progress.setValue(i);
@@ -3717,53 +4770,6 @@ void frmMain::on_chkHeightMapUse_clicked(bool checked)
     ui->actFileSaveTransformedAs->setVisible(checked);
 }
 
-QList<LineSegment*> frmMain::subdivideSegment(LineSegment* segment)
-{
-    QList<LineSegment*> list;
-
-    QRectF borderRect = borderRectFromTextboxes();
-
-    double interpolationStepX = borderRect.width() / (ui->txtHeightMapInterpolationStepX->value() - 1);
-    double interpolationStepY = borderRect.height() / (ui->txtHeightMapInterpolationStepY->value() - 1);
-
-    double length;
-
-    QVector3D vec = segment->getEnd() - segment->getStart();
-
-    if (qIsNaN(vec.length())) return QList<LineSegment*>();
-
-    if (fabs(vec.x()) / fabs(vec.y()) < interpolationStepX / interpolationStepY) length = interpolationStepY / (vec.y() / vec.length());
-    else length = interpolationStepX / (vec.x() / vec.length());
-
-    length = fabs(length);
-
-    if (qIsNaN(length)) {
-        qDebug() << "ERROR length:" << segment->getStart() << segment->getEnd();
-        return QList<LineSegment*>();
-    }
-
-    QVector3D seg = vec.normalized() * length;
-    int count = trunc(vec.length() / length);
-
-    if (count == 0) return QList<LineSegment*>();
-
-    for (int i = 0; i < count; i++) {
-        LineSegment* line = new LineSegment(segment);
-        line->setStart(i == 0 ? segment->getStart() : list[i - 1]->getEnd());
-        line->setEnd(line->getStart() + seg);
-        list.append(line);
-    }
-
-    if (list.count() > 0 && list.last()->getEnd() != segment->getEnd()) {
-        LineSegment* line = new LineSegment(segment);
-        line->setStart(list.last()->getEnd());
-        line->setEnd(segment->getEnd());
-        list.append(line);
-    }
-
-    return list;
-}
-
 void frmMain::on_cmdHeightMapCreate_clicked()
 {
     ui->cmdHeightMapMode->setChecked(true);
@@ -3784,7 +4790,7 @@ void frmMain::on_cmdHeightMapBorderAuto_clicked()
 
 bool frmMain::compareCoordinates(double x, double y, double z)
 {
-    return ui->txtMPosX->text().toDouble() == x && ui->txtMPosY->text().toDouble() == y && ui->txtMPosZ->text().toDouble() == z;
+    return m_machineState.machinePosition[0] == x && m_machineState.machinePosition[1] == y && m_machineState.machinePosition[2] == z;
 }
 
 void frmMain::onCmdUserClicked(bool checked)
@@ -3794,6 +4800,6 @@ void frmMain::onCmdUserClicked(bool checked)
     QStringList list = m_settings->userCommands(i).split(";");
 
     foreach (QString cmd, list) {
-        sendCommand(cmd.trimmed(), -1, m_settings->showUICommands());
+        sendCommand(cmd.trimmed(), CommandAttributes::User, m_settings->showUICommands());
     }
 }
@@ -8,6 +8,7 @@
 #include <QtSerialPort/QSerialPort>
 #include <QSettings>
 #include <QTimer>
+#include <QThread>
 #include <QBasicTimer>
 #include <QStringList>
 #include <QList>
@@ -16,9 +17,19 @@
 #include <QDragEnterEvent>
 #include <QDropEvent>
 #include <QProgressDialog>
+#include <QFutureWatcher>
 #include <exception>
 
 #include "parser/gcodeviewparse.h"
+#include "parser/gcodevalidator.h"
+#include "parser/gcodecompactor.h"
+#include "parser/toolpathsimplifier.h"
+#include "parser/arcfitter.h"
+#include "parser/traveloptimizer.h"
+#include "parser/aircuteliminator.h"
+#include "parser/retractoptimizer.h"
+#include "parser/rastergenerator.h"
+#include "parser/heightmapcompensator.h"
 
 #include "drawers/origindrawer.h"
 #include "drawers/gcodedrawer.h"
@@ -34,6 +45,14 @@
 
 #include "utils/interpolation.h"
 
+#include "serial/serialworker.h"
+#include "serial/wirebuffer.h"
+#include "serial/grbljog.h"
+#include "serial/errorpolicy.h"
+#include "serial/streamjob.h"
+
+#include "remote/controlserver.h"
+
 #include "widgets/styledtoolbutton.h"
 
 #include "frmsettings.h"
@@ -49,16 +68,52 @@ class frmMain;
 }
 
 struct CommandAttributes {
-    int length;
+    // What response is routed to
+    enum Types {
+        Program,                        // Line of program table
+        User,                           // Console, buttons and other UI commands
+        Reset,                          // Soft reset marker
+        ParserPoll,                     // "$G" updating parser status
+        CoordinateSystem,               // "$G" storing absolute/relative mode
+        Offsets,                        // "$#"
+        BuildInfo,                      // "$I"
+        SpindleSpeed,                   // Spindle speed restore, not taken as new speed
+        Jog,                            // "$J=" move
+        Homing,
+        CheckMode,
+        MachineSettings                 // "$$" giving soft limits
+    };
+
+    int id;
+    int type;
     int consoleIndex;
-    int tableIndex;
+    int tableIndex;                     // Program table row, -1 for UI commands
     QString command;
 };
 
-struct CommandQueue {
-    QString command;
-    int tableIndex;
-    bool showInConsole;
+// Values currently shown on form, to apply only changed ones
+struct DisplayedState {
+    double machinePosition[3];
+    double workPosition[3];
+    int status;
+    bool processingFile;
+    int spendTime;
+    int bufferLength;
+    int queueLength;
+    int feedOverride;
+    int rapidOverride;
+    int spindleOverride;
+};
+
+// Additional controller, streams program in own thread. Jog, console and other
+// controls belong to main connection only.
+struct Machine {
+    QString name;
+    QString port;
+    QThread thread;
+    StreamJob *job;
+    MachineState state;
+    bool streaming;                     // UI thread, cleared by job finish
 };
 
 class CancelException : public std::exception {
@@ -88,10 +143,15 @@ private slots:
     void updateHeightMapInterpolationDrawer(bool reset = false);
     void placeVisualizerButtons();
 
-    void onSerialPortReadyRead();
-    void onSerialPortError(QSerialPort::SerialPortError);
+    void onSerialPortError(QString message);
+    void onReplayFinished();
+    void onSenderErrorBoxFinished(int result);
+    void onProgramCheckFinished();
+    void onControlRequest(int client, const QString &command, const QString &argument);
+    void onMachineMessage(QString text);
+    void onMachineFinished(int result);
     void onTimerConnection();
-    void onTimerStateQuery();
+    void onTimerSerialUpdate();
     void onCmdJogStepClicked();
     void onVisualizatorRotationChanged();
     void onScroolBarAction(int action);
@@ -112,6 +172,14 @@ private slots:
     void on_cmdFileSend_clicked();
     void onTableCellChanged(QModelIndex i1, QModelIndex i2);
     void on_actServiceSettings_triggered();
+    void on_actServiceReplay_triggered();
+    void on_actProgramSimplify_triggered();
+    void on_actProgramFitArcs_triggered();
+    void on_actProgramOptimizeTravel_triggered();
+    void on_actProgramAirMoves_triggered();
+    void on_actProgramRetracts_triggered();
+    void on_actFileImportRaster_triggered();
+    void onPreviewOriginalToggled(bool checked);
     void on_actFileOpen_triggered();
     void on_cmdCommandSend_clicked();
     void on_cmdHome_clicked();
@@ -147,9 +215,13 @@ private slots:
     void on_txtFeed_editingFinished();
     void on_sliFeed_valueChanged(int value);
     void on_chkFeedOverride_toggled(bool checked);
+    void on_cboRapidOverride_currentIndexChanged(int index);
+    void on_cboMachine_currentIndexChanged(int index);
+    void on_txtSpindleOverride_valueChanged(int value);
     void on_grpFeed_toggled(bool checked);
     void on_grpSpindle_toggled(bool checked);
     void on_grpJog_toggled(bool checked);
+    void on_grpMetrics_toggled(bool checked);
     void on_grpUserCommands_toggled(bool checked);
     void on_chkKeyboardControl_toggled(bool checked);
     void on_tblProgram_customContextMenuRequested(const QPoint &pos);
@@ -188,16 +260,18 @@ protected:
     void dropEvent(QDropEvent *de);
 
 private:
-    const int BUFFERLENGTH = 127;
+    const int PROGRAMLOOKAHEAD = 256;
 
     Ui::frmMain *ui;
     GcodeViewParse m_viewParser;
     GcodeViewParse m_probeParser;
+    GcodeViewParse m_previewParser;
 
     OriginDrawer *m_originDrawer;
 
     GcodeDrawer *m_codeDrawer;    
     GcodeDrawer *m_probeDrawer;
+    GcodeDrawer *m_previewDrawer;       // Transformed program before it replaces current one
     GcodeDrawer *m_currentDrawer;
 
     ToolDrawer m_toolDrawer;
@@ -216,7 +290,8 @@ private:
     bool m_programLoading;
     bool m_settingsLoading;
 
-    QSerialPort m_serialPort;
+    SerialWorker *m_serialWorker;
+    QThread m_serialThread;
 
     frmSettings *m_settings;
     frmAbout m_frmAbout;
@@ -225,15 +300,20 @@ private:
     QString m_programFileName;
     QString m_heightMapFileName;
     QString m_lastFolder;
+    double m_simplifyTolerance;
+    double m_arcFitTolerance;
+    double m_stockTop;
+    double m_rasterResolution;
+    int m_rasterFeed;
+    int m_rasterDithering;
 
     bool m_fileChanged = false;
     bool m_heightMapChanged = false;
 
     QTimer m_timerConnection;
-    QTimer m_timerStateQuery;
+    QTimer m_timerSerialUpdate;
     QBasicTimer m_timerToolAnimation;
 
-    QStringList m_status;
     QStringList m_statusCaptions;
     QStringList m_statusBackColors;
     QStringList m_statusForeColors;
@@ -245,11 +325,20 @@ private:
 
     QMenu *m_tableMenu;
     QList<CommandAttributes> m_commands;
-    QList<CommandQueue> m_queue;
+    WireBuffer m_wireBuffer;
+    MachineState m_machineState;
+    DisplayedState m_displayedState;
+    StreamerMetrics m_metrics;
     QTime m_startTime;
 
     QMessageBox* m_senderErrorBox;
 
+    ControlServer m_controlServer;
+
+    QList<Machine*> m_machines;
+    QString m_machinesSetting;          // Machines are created again on setting change
+    int m_activeMachine;                // Index in machines list, -1 for main connection
+
     // Stored origin
     double m_storedX = 0;
     double m_storedY = 0;
@@ -272,12 +361,13 @@ private:
     bool m_reseting = false;
     bool m_resetCompleted = true;
     bool m_aborting = false;
-    bool m_statusReceived = false;
 
     bool m_processingFile = false;
     bool m_transferCompleted = false;
     bool m_fileEndSent = false;
 
+    bool m_realtimeOverrides = false;
+
     bool m_heightMapMode;
     bool m_cellChanged;
 
@@ -294,6 +384,25 @@ private:
     // Keyboard
     bool m_keyPressed = false;
     bool m_jogBlock = false;
+    bool m_jogRestart = false;          // Continue jog after cancel is completed
+    QList<int> m_jogKeys;               // Held movement keys
+    GrblJog m_jog;
+
+    // Error responses
+    ErrorPolicy m_errorPolicy;
+    QString m_senderErrors;             // Shown in message box while holding
+    bool m_errorHolding = false;
+    bool m_errorRetrying = false;       // Waiting for machine stop to resend from refused line
+    int m_errorRetryIndex = -1;         // Refused line, lines sent after it are resent too
+    int m_errorRetryId = -1;            // Program lines with lower ids were sent before resend
+    QString m_errorRetryMessage;
+
+    // Program check
+    QFutureWatcher<QList<GcodeValidator::Error> > m_programCheck;
+    GCodeTableModel *m_checkedModel = NULL;
+    bool m_softLimits = false;          // $20
+    QVector3D m_travel;                 // $130 - $132, mm
+
     bool m_absoluteCoordinates;
     bool m_storedKeyboardControl;
 
@@ -313,23 +422,50 @@ private:
     bool saveChanges(bool heightMapMode);
     void updateControlsState();
     void openPort();
-    void sendCommand(QString command, int tableIndex = -1, bool showInConsole = true);
+    bool sendCommand(QString command, int type = CommandAttributes::User, bool showInConsole = true, int tableIndex = -1);
     void grblReset();
-    int bufferLength();
     void sendNextFileCommands();
+    bool sendFileCommand(int index);
+    void processError(const CommandAttributes &ca, const QString &response);
+    void holdAndAsk(const QString &error);
+    void checkProgram();
+    void processMachineSettings(const QString &response);
+    void updateWireBuffer(int from = 0);
+    void updateMachines();
+    void updateMachineView();
+    Machine *findMachine(QObject *job);
     void applySettings();
     void updateParser();
-    bool dataIsFloating(QString data);
-    bool dataIsEnd(QString data);
-    bool dataIsReset(QString data);
+    void processStatus();
+    void invalidateStatusView();
+    void updateStatusView();
+    void updateSpendTimeView();
+    void updateOverrides();
+    void updateMetricsView();
+    void setRealtimeOverrides(bool enabled);
+    bool takeCommand(int id, CommandAttributes &ca);
+    void processResponse(int id, QString response);
+    void processFloatingResponse(QString data);
 
     QTime updateProgramEstimatedTime(QList<LineSegment *> lines);
+    double programDuration(QList<LineSegment *> lines);
+    bool canTransformProgram();
+    bool heightMapProbed();
+    bool confirmProgram(const QString &title, const QString &details, const QStringList &commands);
+    void replaceProgram(const QStringList &commands);
     bool saveProgramToFile(QString fileName, GCodeTableModel *model);
     QString feedOverride(QString command);
 
     bool eventFilter(QObject *obj, QEvent *event);
     void blockJogForRapidMovement(bool repeated = false);
     bool keyIsMovement(int key);
+    QVector3D keyDirection(int key);
+    void jogStep(const QVector3D &direction);
+    void startJog();
+    void stopJog();
+    bool jogFeedSet();
+    bool consoleCommandAllowed(const QString &command);
+    void sendJogCommands();
     void resizeCheckBoxes();
     void updateLayouts();
     void updateRecentFilesMenu();
@@ -345,7 +481,6 @@ private:
     bool saveHeightMap(QString fileName);
 
     GCodeTableModel *m_currentModel;
-    QList<LineSegment *> subdivideSegment(LineSegment *segment);
     void resizeTableHeightMapSections();
     void updateHeightMapGrid(double arg1);
     void resetHeightmap();
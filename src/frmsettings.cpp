@@ -310,6 +310,36 @@ void frmSettings::setLaserPowerMax(int value)
     ui->txtLaserPowerMax->setValue(value);
 }
 
+double frmSettings::stockClearance()
+{
+    return ui->txtStockClearance->value();
+}
+
+void frmSettings::setStockClearance(double value)
+{
+    ui->txtStockClearance->setValue(value);
+}
+
+int frmSettings::airMoveFeed()
+{
+    return ui->txtAirMoveFeed->value();
+}
+
+void frmSettings::setAirMoveFeed(int value)
+{
+    ui->txtAirMoveFeed->setValue(value);
+}
+
+int frmSettings::jogFeed()
+{
+    return ui->txtJogFeed->value();
+}
+
+void frmSettings::setJogFeed(int value)
+{
+    ui->txtJogFeed->setValue(value);
+}
+
 int frmSettings::rapidSpeed()
 {
     return ui->txtRapidSpeed->value();
@@ -563,14 +593,24 @@ void frmSettings::setUserCommands(int index, QString commands)
     this->findChild<QLineEdit*>(QString("txtUserCommand%1").arg(index))->setText(commands);
 }
 
-bool frmSettings::ignoreErrors()
+int frmSettings::errorPolicy()
 {
-    return ui->chkIgnoreErrors->isChecked();
+    return ui->cboErrorPolicy->currentIndex();
 }
 
-void frmSettings::setIgnoreErrors(bool value)
+void frmSettings::setErrorPolicy(int errorPolicy)
 {
-    ui->chkIgnoreErrors->setChecked(value);
+    ui->cboErrorPolicy->setCurrentIndex(errorPolicy);
+}
+
+bool frmSettings::checkProgram()
+{
+    return ui->chkCheckProgram->isChecked();
+}
+
+void frmSettings::setCheckProgram(bool value)
+{
+    ui->chkCheckProgram->setChecked(value);
 }
 
 bool frmSettings::autoLine()
@@ -583,6 +623,86 @@ void frmSettings::setAutoLine(bool value)
     ui->chkAutoLine->setChecked(value);
 }
 
+int frmSettings::rxBufferSize()
+{
+    return ui->txtRxBufferSize->value();
+}
+
+void frmSettings::setRxBufferSize(int value)
+{
+    ui->txtRxBufferSize->setValue(value);
+}
+
+bool frmSettings::plannerThrottle()
+{
+    return ui->chkPlannerThrottle->isChecked();
+}
+
+void frmSettings::setPlannerThrottle(bool value)
+{
+    ui->chkPlannerThrottle->setChecked(value);
+}
+
+bool frmSettings::compactProgram()
+{
+    return ui->chkCompactProgram->isChecked();
+}
+
+void frmSettings::setCompactProgram(bool value)
+{
+    ui->chkCompactProgram->setChecked(value);
+}
+
+int frmSettings::compactDecimals()
+{
+    return ui->txtCompactDecimals->value();
+}
+
+void frmSettings::setCompactDecimals(int value)
+{
+    ui->txtCompactDecimals->setValue(value);
+}
+
+QString frmSettings::metricsFile()
+{
+    return ui->txtMetricsFile->text();
+}
+
+void frmSettings::setMetricsFile(QString value)
+{
+    ui->txtMetricsFile->setText(value);
+}
+
+QString frmSettings::trafficFile()
+{
+    return ui->txtTrafficFile->text();
+}
+
+void frmSettings::setTrafficFile(QString value)
+{
+    ui->txtTrafficFile->setText(value);
+}
+
+QString frmSettings::controlSocket()
+{
+    return ui->txtControlSocket->text();
+}
+
+void frmSettings::setControlSocket(QString value)
+{
+    ui->txtControlSocket->setText(value);
+}
+
+QString frmSettings::machines()
+{
+    return ui->txtMachines->text();
+}
+
+void frmSettings::setMachines(QString value)
+{
+    ui->txtMachines->setText(value);
+}
+
 void frmSettings::showEvent(QShowEvent *se)
 {
     Q_UNUSED(se)
@@ -629,7 +749,16 @@ void frmSettings::on_cmdDefaults_clicked()
     setPort("");
     setBaud(115200);
 
-    setIgnoreErrors(false);
+    setErrorPolicy(0);
+    setCheckProgram(true);
+    setRxBufferSize(0);
+    setPlannerThrottle(false);
+    setCompactProgram(true);
+    setCompactDecimals(-1);
+    setMetricsFile("");
+    setTrafficFile("");
+    setControlSocket("");
+    setMachines("");
 
     setQueryStateTime(40);
     setRapidSpeed(2000);
@@ -638,6 +767,9 @@ void frmSettings::on_cmdDefaults_clicked()
     setSpindleSpeedMax(10000);
     setLaserPowerMin(0);
     setLaserPowerMax(100);
+    setStockClearance(0.5);
+    setAirMoveFeed(0);
+    setJogFeed(1000);
     setTouchCommand("G21G91G38.2Z-30F100; G0Z1; G38.2Z-2F10");
     setSafePositionCommand("G21G90; G53G0Z0");
     setMoveOnRestore(false);
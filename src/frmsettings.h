@@ -63,6 +63,12 @@ public:
     void setLaserPowerMin(int value);
     int laserPowerMax();
     void setLaserPowerMax(int value);
+    double stockClearance();
+    void setStockClearance(double value);
+    int airMoveFeed();
+    void setAirMoveFeed(int value);
+    int jogFeed();
+    void setJogFeed(int value);
     int rapidSpeed();
     void setRapidSpeed(int rapidSpeed);
     int heightmapProbingFeed();
@@ -113,10 +119,28 @@ public:
     void setDrawModeVectors(bool value);
     QString userCommands(int index);
     void setUserCommands(int index, QString commands);
-    bool ignoreErrors();
-    void setIgnoreErrors(bool value);
+    int errorPolicy();
+    void setErrorPolicy(int errorPolicy);
+    bool checkProgram();
+    void setCheckProgram(bool value);
     bool autoLine();
     void setAutoLine(bool value);
+    int rxBufferSize();
+    void setRxBufferSize(int value);
+    bool plannerThrottle();
+    void setPlannerThrottle(bool value);
+    bool compactProgram();
+    void setCompactProgram(bool value);
+    int compactDecimals();
+    void setCompactDecimals(int value);
+    QString metricsFile();
+    void setMetricsFile(QString value);
+    QString trafficFile();
+    void setTrafficFile(QString value);
+    QString controlSocket();
+    void setControlSocket(QString value);
+    QString machines();
+    void setMachines(QString value);
 
 protected:
     void showEvent(QShowEvent *se);
@@ -0,0 +1,205 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QFile>
+#include <QTextStream>
+#include <QRegExp>
+#include <algorithm>
+#include "benchmark.h"
+
+Benchmark::Benchmark(GrblSimulator *simulator, const QString &portName, QObject *parent) : QObject(parent)
+{
+    m_simulator = simulator;
+
+    m_port.setPortName(portName);
+    m_port.setBaudRate(115200);
+    m_port.setParity(QSerialPort::NoParity);
+    m_port.setDataBits(QSerialPort::Data8);
+    m_port.setFlowControl(QSerialPort::NoFlowControl);
+    m_port.setStopBits(QSerialPort::OneStop);
+
+    m_portDevice = new SerialPortDevice(&m_port);
+    m_device.setDevice(m_portDevice);
+    m_device.setRecorder(&m_recorder);
+    m_streamer.setDevice(&m_device);
+
+    m_sentIndex = 0;
+    m_processedCount = 0;
+    m_errors = 0;
+    m_result = 1;
+    m_streaming = false;
+    m_startTime = 0;
+    m_transferTime = 0;
+
+    connect(&m_port, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    connect(&m_timerStatus, SIGNAL(timeout()), this, SLOT(onTimerStatus()));
+    connect(&m_timerIdle, SIGNAL(timeout()), this, SLOT(onTimerIdle()));
+}
+
+Benchmark::~Benchmark()
+{
+    delete m_portDevice;
+}
+
+void Benchmark::setBufferOptions(int bufferSize, bool plannerThrottle)
+{
+    // Zero size means detection, as in Candle
+    m_streamer.setAutoBufferSize(bufferSize == 0);
+    m_streamer.setBufferSize(bufferSize > 0 ? bufferSize : GrblStreamer::DefaultBufferSize);
+    m_streamer.setPlannerThrottle(plannerThrottle);
+}
+
+bool Benchmark::setTrafficFile(const QString &fileName)
+{
+    return m_recorder.open(fileName);
+}
+
+bool Benchmark::load(const QString &fileName)
+{
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    QTextStream textStream(&file);
+
+    // Strip comments and blank lines the way Candle sends them
+    while (!textStream.atEnd()) {
+        QString line = textStream.readLine();
+        line.remove(QRegExp("\\([^\\)]*\\)"));
+        if (line.contains(';')) line = line.left(line.indexOf(';'));
+        line = line.trimmed().toUpper();
+        if (!line.isEmpty()) m_lines.append(line);
+    }
+
+    m_sentTime.fill(0, m_lines.count());
+    m_latencies.reserve(m_lines.count());
+
+    return !m_lines.isEmpty();
+}
+
+bool Benchmark::start()
+{
+    if (!m_port.open(QIODevice::ReadWrite)) return false;
+
+    m_clock.start();
+    m_streamer.reset(-1);
+    m_timerStatus.start(250);
+
+    return true;
+}
+
+int Benchmark::result() const
+{
+    return m_result;
+}
+
+void Benchmark::onReadyRead()
+{
+    SerialResponse response;
+    bool dropQueue;
+    bool programEnd = false;
+
+    while (m_device.canReadLine()) {
+        QByteArray line = m_device.readLine();
+
+        if (line.startsWith('<')) {
+            m_streamer.processStatus(line.constData(), line.length(), m_state);
+            continue;
+        }
+
+        QString data = QString::fromLatin1(line).trimmed();
+
+        if (!m_streamer.processLine(data, response, &dropQueue)) continue;
+        if (dropQueue) programEnd = true;
+        if (response.type != SerialResponse::Response) continue;
+
+        // Reset completed, build info gives buffer sizes
+        if (response.id == -1) {
+            m_streamer.send(-2, "$I");
+            m_streamer.flush();
+        } else if (response.id == -2) {
+            m_simulator->resetStatistics();
+            m_startTime = m_clock.nsecsElapsed();
+            m_streaming = true;
+        } else {
+            m_latencies.append((m_clock.nsecsElapsed() - m_sentTime.at(response.id)) / 1e6);
+            if (response.data.contains("error")) m_errors++;
+            m_processedCount++;
+        }
+    }
+
+    if (!m_streaming) return;
+
+    // Commands after program end are dropped
+    if (m_processedCount == m_lines.count() || programEnd) {
+        m_streaming = false;
+        m_transferTime = m_clock.nsecsElapsed();
+        m_timerIdle.start(1);
+    } else {
+        sendCommands();
+    }
+}
+
+void Benchmark::onTimerStatus()
+{
+    m_streamer.queryStatus();
+}
+
+void Benchmark::onTimerIdle()
+{
+    if (!m_simulator->isIdle()) return;
+
+    m_timerIdle.stop();
+    m_timerStatus.stop();
+
+    report(m_clock.nsecsElapsed());
+    m_port.close();
+    m_recorder.close();
+
+    m_result = m_errors > 0 || m_simulator->overflows() > 0 ? 1 : 0;
+    emit finished(m_result);
+}
+
+void Benchmark::sendCommands()
+{
+    while (m_sentIndex < m_lines.count()) {
+        QByteArray command = m_lines.at(m_sentIndex).toLatin1();
+
+        m_sentTime[m_sentIndex] = m_clock.nsecsElapsed();
+        if (!m_streamer.send(m_sentIndex, command)) break;
+
+        m_sentIndex++;
+    }
+
+    m_streamer.flush();
+}
+
+void Benchmark::report(qint64 endTime)
+{
+    QTextStream out(stdout);
+
+    double transfer = (m_transferTime - m_startTime) / 1e9;
+    double total = (endTime - m_startTime) / 1e9;
+
+    std::sort(m_latencies.begin(), m_latencies.end());
+
+    int count = m_latencies.count();
+    double p50 = count ? m_latencies.at(count * 50 / 100) : 0;
+    double p90 = count ? m_latencies.at(count * 90 / 100) : 0;
+    double p99 = count ? m_latencies.at(qMin(count - 1, count * 99 / 100)) : 0;
+    double max = count ? m_latencies.last() : 0;
+
+    out << "lines:          " << m_processedCount << " (" << m_errors << " errors)\n";
+    out << "transfer time:  " << QString::number(transfer, 'f', 3) << " s\n";
+    out << "total time:     " << QString::number(total, 'f', 3) << " s\n";
+    out << "throughput:     " << QString::number(transfer > 0 ? m_processedCount / transfer : 0, 'f', 1) << " lines/s\n";
+    out << "underrun time:  " << QString::number(m_simulator->underrunTime(), 'f', 0) << " ms ("
+        << QString::number(total > 0 ? m_simulator->underrunTime() / 10 / total : 0, 'f', 1) << "%)\n";
+    out << "latency p50:    " << QString::number(p50, 'f', 2) << " ms\n";
+    out << "latency p90:    " << QString::number(p90, 'f', 2) << " ms\n";
+    out << "latency p99:    " << QString::number(p99, 'f', 2) << " ms\n";
+    out << "latency max:    " << QString::number(max, 'f', 2) << " ms\n";
+    out << "rx overflows:   " << m_simulator->overflows() << "\n";
+    out << "sender buffer:  " << m_streamer.bufferSize() << " bytes"
+        << (m_streamer.plannerThrottle() ? ", planner throttle" : "") << "\n";
+}
@@ -0,0 +1,72 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QObject>
+#include <QtSerialPort/QSerialPort>
+#include <QStringList>
+#include <QVector>
+#include <QTimer>
+#include <QElapsedTimer>
+
+#include "serial/grblstreamer.h"
+#include "serial/serialportdevice.h"
+#include "serial/recordingdevice.h"
+#include "grblsimulator.h"
+
+// Streams g-code corpus through pty to simulator using the same streamer
+// as Candle does, and reports throughput figures.
+class Benchmark : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Benchmark(GrblSimulator *simulator, const QString &portName, QObject *parent = 0);
+    ~Benchmark();
+
+    void setBufferOptions(int bufferSize, bool plannerThrottle);
+    bool setTrafficFile(const QString &fileName);
+    bool load(const QString &fileName);
+    bool start();
+    int result() const;
+
+signals:
+    void finished(int result);
+
+private slots:
+    void onReadyRead();
+    void onTimerStatus();
+    void onTimerIdle();
+
+private:
+    GrblSimulator *m_simulator;
+    QSerialPort m_port;
+    SerialPortDevice *m_portDevice;
+    RecordingDevice m_device;
+    TrafficRecorder m_recorder;
+    GrblStreamer m_streamer;
+    MachineState m_state;
+
+    QStringList m_lines;
+    int m_sentIndex;
+    int m_processedCount;
+    int m_errors;
+    int m_result;
+    bool m_streaming;
+
+    QVector<qint64> m_sentTime;
+    QVector<double> m_latencies;
+
+    QElapsedTimer m_clock;
+    qint64 m_startTime;
+    qint64 m_transferTime;
+
+    QTimer m_timerStatus;
+    QTimer m_timerIdle;
+
+    void sendCommands();
+    void report(qint64 endTime);
+};
+
+#endif // BENCHMARK_H
@@ -0,0 +1,42 @@
+#-------------------------------------------------
+#
+# Grbl simulator on pseudo-terminal, for streaming tests without machine
+#
+#-------------------------------------------------
+
+QT       = core serialport
+
+TARGET = grblsim
+TEMPLATE = app
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+INCLUDEPATH += ..
+
+SOURCES += main.cpp \
+    benchmark.cpp \
+    grblsimulator.cpp \
+    ptyport.cpp \
+    replay.cpp \
+    ../serial/grblstatusparser.cpp \
+    ../serial/grblstreamer.cpp \
+    ../serial/recordingdevice.cpp \
+    ../serial/replaydevice.cpp \
+    ../serial/serialportdevice.cpp \
+    ../serial/streamermetrics.cpp \
+    ../serial/trafficlog.cpp
+
+HEADERS += benchmark.h \
+    grblsimulator.h \
+    ptyport.h \
+    replay.h \
+    ../serial/bytedevice.h \
+    ../serial/grblstatusparser.h \
+    ../serial/grblstreamer.h \
+    ../serial/machinestate.h \
+    ../serial/recordingdevice.h \
+    ../serial/replaydevice.h \
+    ../serial/serialportdevice.h \
+    ../serial/streamermetrics.h \
+    ../serial/trafficlog.h \
+    ../utils/histogram.h
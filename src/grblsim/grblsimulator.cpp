@@ -0,0 +1,534 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QRegExp>
+#include <QStringList>
+#include <math.h>
+#include "grblsimulator.h"
+
+GrblSimulator::GrblSimulator(QObject *parent) : QObject(parent)
+{
+    m_rxBufferSize = 127;
+    m_plannerSize = 15;
+    m_speedFactor = 1.0;
+    m_rapidRate = 5000;
+    m_legacyStatus = false;
+
+    for (int i = 0; i < 3; i++) {
+        m_position[i] = 0;
+        m_offset[i] = 0;
+        m_probe[i] = 0;
+    }
+    m_probeSucceeded = false;
+
+    m_clock.start();
+    m_lastTick = 0;
+
+    resetStatistics();
+    reset();
+
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(onTimer()));
+    m_timer.start(1);
+}
+
+int GrblSimulator::rxBufferSize() const
+{
+    return m_rxBufferSize;
+}
+
+void GrblSimulator::setRxBufferSize(int rxBufferSize)
+{
+    m_rxBufferSize = rxBufferSize;
+}
+
+int GrblSimulator::plannerSize() const
+{
+    return m_plannerSize;
+}
+
+void GrblSimulator::setPlannerSize(int plannerSize)
+{
+    m_plannerSize = plannerSize;
+}
+
+double GrblSimulator::speedFactor() const
+{
+    return m_speedFactor;
+}
+
+void GrblSimulator::setSpeedFactor(double speedFactor)
+{
+    m_speedFactor = speedFactor;
+}
+
+double GrblSimulator::rapidRate() const
+{
+    return m_rapidRate;
+}
+
+void GrblSimulator::setRapidRate(double rapidRate)
+{
+    m_rapidRate = rapidRate;
+}
+
+bool GrblSimulator::legacyStatus() const
+{
+    return m_legacyStatus;
+}
+
+void GrblSimulator::setLegacyStatus(bool legacyStatus)
+{
+    m_legacyStatus = legacyStatus;
+}
+
+int GrblSimulator::state() const
+{
+    if (m_checkMode) return Check;
+    if (m_planner.isEmpty()) return Idle;
+    if (m_hold) return Hold;
+    if (m_planner.first().jog) return Jog;
+    return Run;
+}
+
+bool GrblSimulator::isIdle() const
+{
+    return m_planner.isEmpty() && !m_rx.contains('\r') && !m_rx.contains('\n');
+}
+
+void GrblSimulator::resetStatistics()
+{
+    m_executed = false;
+    m_emptySince = m_clock.elapsed();
+    m_underrunTime = 0;
+    m_processedLines = 0;
+    m_overflows = 0;
+}
+
+double GrblSimulator::underrunTime() const
+{
+    return m_underrunTime;
+}
+
+int GrblSimulator::processedLines() const
+{
+    return m_processedLines;
+}
+
+int GrblSimulator::overflows() const
+{
+    return m_overflows;
+}
+
+void GrblSimulator::input(const QByteArray &data)
+{
+    foreach (char c, data) {
+        unsigned char byte = (unsigned char)c;
+
+        if (byte == '?' || byte == '!' || byte == '~' || byte == 0x18 || byte >= 0x80) {
+            processRealtime(byte);
+        } else if (m_rx.length() >= m_rxBufferSize) {
+            // Receive buffer overflow, byte is lost
+            m_overflows++;
+        } else {
+            m_rx.append(c);
+        }
+    }
+
+    processRx();
+}
+
+void GrblSimulator::reset()
+{
+    // Motion stops, machine position is kept
+    currentPosition(m_position);
+
+    m_rx.clear();
+    m_planner.clear();
+
+    m_feed = 0;
+    m_spindleSpeed = 0;
+    m_motion = 0;
+    m_absolute = true;
+    m_metric = true;
+    m_checkMode = false;
+    m_hold = false;
+    m_spindleState = 5;
+    m_coolantState = 9;
+    m_toolNumber = 0;
+
+    m_feedOverride = 100;
+    m_rapidOverride = 100;
+    m_spindleOverride = 100;
+
+    m_statusCount = 0;
+    m_emptySince = m_clock.elapsed();
+
+    emit output("\r\nGrbl 1.1f ['$' for help]\r\n");
+}
+
+void GrblSimulator::onTimer()
+{
+    qint64 now = m_clock.elapsed();
+
+    execute(now - m_lastTick);
+    m_lastTick = now;
+
+    processRx();
+}
+
+void GrblSimulator::processRealtime(unsigned char byte)
+{
+    switch (byte) {
+    case '?':
+        emit output(statusReport().toLatin1());
+        break;
+    case '!':
+        if (state() == Jog) {
+            // Feed hold cancels jog
+            currentPosition(m_position);
+            m_planner.clear();
+        } else if (!m_planner.isEmpty()) {
+            m_hold = true;
+        }
+        break;
+    case '~':
+        m_hold = false;
+        break;
+    case 0x18:
+        reset();
+        break;
+    case 0x85:
+        if (state() == Jog) {
+            currentPosition(m_position);
+            m_planner.clear();
+        }
+        break;
+    case 0x90: m_feedOverride = 100; break;
+    case 0x91: m_feedOverride += 10; break;
+    case 0x92: m_feedOverride -= 10; break;
+    case 0x93: m_feedOverride += 1; break;
+    case 0x94: m_feedOverride -= 1; break;
+    case 0x95: m_rapidOverride = 100; break;
+    case 0x96: m_rapidOverride = 50; break;
+    case 0x97: m_rapidOverride = 25; break;
+    case 0x99: m_spindleOverride = 100; break;
+    case 0x9A: m_spindleOverride += 10; break;
+    case 0x9B: m_spindleOverride -= 10; break;
+    case 0x9C: m_spindleOverride += 1; break;
+    case 0x9D: m_spindleOverride -= 1; break;
+    }
+
+    m_feedOverride = qBound(10, m_feedOverride, 200);
+    m_spindleOverride = qBound(10, m_spindleOverride, 200);
+}
+
+void GrblSimulator::processRx()
+{
+    // Lines are taken from receive buffer only while planner has free blocks
+    while (m_planner.count() < m_plannerSize) {
+        int end = -1;
+        for (int i = 0; i < m_rx.length(); i++) if (m_rx.at(i) == '\r' || m_rx.at(i) == '\n') {
+            end = i;
+            break;
+        }
+        if (end == -1) break;
+
+        QString line = QString::fromLatin1(m_rx.left(end));
+        m_rx.remove(0, end + 1);
+
+        QString response = processLine(line);
+        m_processedLines++;
+
+        emit output(response.toLatin1());
+    }
+}
+
+QString GrblSimulator::processLine(QString line)
+{
+    // Strip comments and spaces
+    line.remove(QRegExp("\\([^\\)]*\\)"));
+    if (line.contains(';')) line = line.left(line.indexOf(';'));
+    line = line.remove(' ').remove('\t').toUpper();
+
+    if (line.isEmpty()) return "ok\r\n";
+
+    if (line.startsWith('$')) return processSystemCommand(line);
+
+    return processGcode(line, false);
+}
+
+QString GrblSimulator::processSystemCommand(const QString &line)
+{
+    if (line == "$") {
+        return "[HLP:$$ $# $G $I $N $x=val $Nx=line $J=line $SLP $C $X $H ~ ! ? ctrl-x]\r\nok\r\n";
+    } else if (line == "$$") {
+        return QString("$0=10\r\n$1=25\r\n$2=0\r\n$3=0\r\n$10=1\r\n$11=0.010\r\n$12=0.002\r\n$13=0\r\n"
+                       "$20=0\r\n$21=0\r\n$22=0\r\n$30=1000\r\n$31=0\r\n$32=0\r\n"
+                       "$100=250.000\r\n$101=250.000\r\n$102=250.000\r\n"
+                       "$110=%1\r\n$111=%1\r\n$112=%1\r\nok\r\n").arg(m_rapidRate, 0, 'f', 3);
+    } else if (line == "$#") {
+        return offsets() + "ok\r\n";
+    } else if (line == "$G") {
+        return parserState() + "ok\r\n";
+    } else if (line == "$I") {
+        return QString("[VER:1.1f.20170801:]\r\n[OPT:V,%1,%2]\r\nok\r\n").arg(m_plannerSize).arg(m_rxBufferSize + 1);
+    } else if (line == "$C") {
+        m_checkMode = !m_checkMode;
+        return m_checkMode ? "[MSG:Enabled]\r\nok\r\n" : "[MSG:Disabled]\r\nok\r\n";
+    } else if (line == "$X") {
+        return "[MSG:Caution: Unlocked]\r\nok\r\n";
+    } else if (line == "$H") {
+        if (!m_planner.isEmpty()) return "error:8\r\n";
+        for (int i = 0; i < 3; i++) m_position[i] = 0;
+        return "ok\r\n";
+    } else if (line.startsWith("$J=")) {
+        if (state() != Idle && state() != Jog) return "error:8\r\n";
+        return processGcode(line.mid(3), true);
+    } else if (line.startsWith("$N") || QRegExp("^\\$\\d+=[-\\d\\.]+$").exactMatch(line)) {
+        return "ok\r\n";
+    }
+
+    return "error:3\r\n";
+}
+
+QString GrblSimulator::processGcode(const QString &line, bool jog)
+{
+    QRegExp rx("([A-Z])([-+]?(\\d+\\.?\\d*|\\.\\d+))");
+    double factor = m_metric ? 1.0 : 25.4;
+    double words[3];
+    bool axes[3] = {false, false, false};
+    bool absolute = m_absolute;
+    bool machine = false;
+    bool setOffset = false;
+    bool probe = false;
+    bool home = false;
+    bool programEnd = false;
+    double dwell = -1;
+    int motion = jog ? 1 : m_motion;
+    int pos = 0;
+
+    while (pos < line.length()) {
+        if (rx.indexIn(line, pos) != pos) return "error:1\r\n";
+        pos += rx.matchedLength();
+
+        QChar letter = rx.cap(1).at(0);
+        double value = rx.cap(2).toDouble();
+
+        switch (letter.toLatin1()) {
+        case 'G':
+            if (value == 0 || value == 1 || value == 2 || value == 3) motion = (int)value;
+            else if (value == 4) dwell = 0;
+            else if (value == 20) { m_metric = false; factor = 25.4; }
+            else if (value == 21) { m_metric = true; factor = 1.0; }
+            else if (value == 28 || value == 30) home = true;
+            else if (value == 38.2 || value == 38.3 || value == 38.4 || value == 38.5) { probe = true; motion = 1; }
+            else if (value == 53) machine = true;
+            else if (value == 80) motion = -1;
+            else if (value == 90) absolute = true;
+            else if (value == 91) absolute = false;
+            else if (value == 92) setOffset = true;
+            else if (value == 92.1) { for (int i = 0; i < 3; i++) m_offset[i] = 0; }
+            else if (!(value == 17 || value == 18 || value == 19 || value == 40 || value == 43.1 || value == 49
+                       || (value >= 54 && value <= 59) || value == 61 || value == 91.1 || value == 93 || value == 94)) {
+                return "error:20\r\n";
+            }
+            break;
+        case 'M':
+            if (value == 0 || value == 1) {}
+            else if (value == 2 || value == 30) programEnd = true;
+            else if (value == 3 || value == 4 || value == 5) m_spindleState = (int)value;
+            else if (value == 7 || value == 8 || value == 9) m_coolantState = (int)value;
+            else return "error:20\r\n";
+            break;
+        case 'X': words[0] = value; axes[0] = true; break;
+        case 'Y': words[1] = value; axes[1] = true; break;
+        case 'Z': words[2] = value; axes[2] = true; break;
+        case 'F': m_feed = value * factor; break;
+        case 'S': m_spindleSpeed = value; break;
+        case 'P': if (dwell == 0) dwell = value; break;
+        case 'T': m_toolNumber = (int)value; break;
+        case 'I': case 'J': case 'K': case 'R': case 'N': case 'L': break;
+        default: return "error:20\r\n";
+        }
+    }
+
+    // Grbl program mode is G90 after jog, jog modal state isn't stored
+    if (!jog) {
+        m_absolute = absolute;
+        if (motion >= 0) m_motion = motion;
+    }
+
+    bool hasAxes = axes[0] || axes[1] || axes[2];
+    QString response;
+
+    if (setOffset) {
+        for (int i = 0; i < 3; i++) if (axes[i]) m_offset[i] = m_position[i] - words[i] * factor;
+    } else if (dwell > 0) {
+        if (!m_checkMode) addBlock(Dwell, m_position, 0, dwell * 1000, false);
+    } else if (home || (hasAxes && motion >= 0)) {
+        double target[3];
+
+        for (int i = 0; i < 3; i++) {
+            if (home) target[i] = 0;
+            else if (!axes[i]) target[i] = m_position[i];
+            else if (machine) target[i] = words[i] * factor;
+            else if (absolute) target[i] = words[i] * factor + m_offset[i];
+            else target[i] = m_position[i] + words[i] * factor;
+        }
+
+        if (motion != 0 && !home && m_feed == 0) return "error:22\r\n";
+
+        if (!m_checkMode) {
+            double rate = (motion == 0 || home) ? m_rapidRate : m_feed;
+            double distance = sqrt(pow(target[0] - m_position[0], 2) + pow(target[1] - m_position[1], 2)
+                                   + pow(target[2] - m_position[2], 2));
+
+            // Arcs are executed with chord length, close enough for buffer timing
+            if (distance > 0) addBlock((motion == 0 || home) ? Rapid : Feed, target, rate, distance / rate * 60000, jog);
+
+            if (probe) {
+                for (int i = 0; i < 3; i++) m_probe[i] = target[i];
+                m_probeSucceeded = true;
+                response.append(QString("[PRB:%1,%2,%3:1]\r\n").arg(m_probe[0], 0, 'f', 3)
+                        .arg(m_probe[1], 0, 'f', 3).arg(m_probe[2], 0, 'f', 3));
+            }
+        }
+
+        for (int i = 0; i < 3; i++) m_position[i] = target[i];
+    }
+
+    if (programEnd) {
+        m_motion = 1;
+        m_absolute = true;
+        m_spindleState = 5;
+        m_coolantState = 9;
+        response.append("[MSG:Pgm End]\r\n");
+    }
+
+    return response + "ok\r\n";
+}
+
+void GrblSimulator::addBlock(int type, const double *target, double rate, double duration, bool jog)
+{
+    Block block;
+
+    block.type = type;
+    block.jog = jog;
+    block.rate = rate;
+    block.duration = duration;
+    block.elapsed = 0;
+    for (int i = 0; i < 3; i++) {
+        block.start[i] = m_planner.isEmpty() ? m_position[i] : m_planner.last().target[i];
+        block.target[i] = target[i];
+    }
+
+    // Planner was starved while program is running
+    if (m_planner.isEmpty() && m_executed) m_underrunTime += m_clock.elapsed() - m_emptySince;
+
+    m_planner.append(block);
+}
+
+void GrblSimulator::execute(double elapsed)
+{
+    if (m_hold) return;
+
+    while (elapsed > 0 && !m_planner.isEmpty()) {
+        Block &block = m_planner.first();
+
+        double scale = m_speedFactor;
+        if (block.type == Feed) scale *= m_feedOverride / 100.0;
+        else if (block.type == Rapid) scale *= m_rapidOverride / 100.0;
+
+        double remaining = (block.duration - block.elapsed) / scale;
+
+        if (elapsed >= remaining) {
+            elapsed -= remaining;
+            m_planner.removeFirst();
+
+            if (m_planner.isEmpty()) {
+                m_executed = true;
+                m_emptySince = m_clock.elapsed() - elapsed;
+            }
+        } else {
+            block.elapsed += elapsed * scale;
+            elapsed = 0;
+        }
+    }
+}
+
+void GrblSimulator::currentPosition(double *position) const
+{
+    if (m_planner.isEmpty()) {
+        for (int i = 0; i < 3; i++) position[i] = m_position[i];
+        return;
+    }
+
+    const Block &block = m_planner.first();
+    double k = block.duration > 0 ? block.elapsed / block.duration : 1.0;
+
+    for (int i = 0; i < 3; i++) position[i] = block.start[i] + (block.target[i] - block.start[i]) * k;
+}
+
+QString GrblSimulator::statusReport()
+{
+    static const char *states[] = {"Idle", "Run", "Hold:0", "Jog", "Check"};
+    static const char *legacyStates[] = {"Idle", "Run", "Hold", "Run", "Check"};
+
+    double position[3];
+    currentPosition(position);
+
+    QString mpos = QString("%1,%2,%3").arg(position[0], 0, 'f', 3).arg(position[1], 0, 'f', 3).arg(position[2], 0, 'f', 3);
+
+    if (m_legacyStatus) {
+        return QString("<%1,MPos:%2,WPos:%3,%4,%5>\r\n").arg(legacyStates[state()]).arg(mpos)
+                .arg(position[0] - m_offset[0], 0, 'f', 3).arg(position[1] - m_offset[1], 0, 'f', 3)
+                .arg(position[2] - m_offset[2], 0, 'f', 3);
+    }
+
+    double feed = 0;
+    if (!m_planner.isEmpty() && !m_hold) {
+        const Block &block = m_planner.first();
+        if (block.type == Feed) feed = block.rate * m_feedOverride / 100;
+        else if (block.type == Rapid) feed = block.rate * m_rapidOverride / 100;
+    }
+
+    QString status = QString("<%1|MPos:%2|Bf:%3,%4|FS:%5,%6").arg(states[state()]).arg(mpos)
+            .arg(m_plannerSize - m_planner.count()).arg(m_rxBufferSize + 1 - m_rx.length())
+            .arg(feed, 0, 'f', 0).arg(m_spindleState == 5 ? 0 : m_spindleSpeed * m_spindleOverride / 100, 0, 'f', 0);
+
+    // Work offset and overrides are sent periodically, like grbl does
+    if (m_statusCount % 10 == 0) {
+        status.append(QString("|WCO:%1,%2,%3").arg(m_offset[0], 0, 'f', 3).arg(m_offset[1], 0, 'f', 3).arg(m_offset[2], 0, 'f', 3));
+    } else if (m_statusCount % 10 == 1) {
+        status.append(QString("|Ov:%1,%2,%3").arg(m_feedOverride).arg(m_rapidOverride).arg(m_spindleOverride));
+    }
+    m_statusCount++;
+
+    return status + ">\r\n";
+}
+
+QString GrblSimulator::parserState()
+{
+    QString state = QString("G%1 G54 G17 %2 %3 G94 M%4 M%5 T%6 F%7 S%8").arg(m_motion)
+            .arg(m_metric ? "G21" : "G20").arg(m_absolute ? "G90" : "G91")
+            .arg(m_spindleState).arg(m_coolantState).arg(m_toolNumber)
+            .arg(m_feed / (m_metric ? 1.0 : 25.4)).arg(m_spindleSpeed);
+
+    return m_legacyStatus ? "[" + state + "]\r\n" : "[GC:" + state + "]\r\n";
+}
+
+QString GrblSimulator::offsets()
+{
+    QString result;
+
+    foreach (QString cs, QStringList() << "G54" << "G55" << "G56" << "G57" << "G58" << "G59" << "G28" << "G30") {
+        result.append(QString("[%1:0.000,0.000,0.000]\r\n").arg(cs));
+    }
+    result.append(QString("[G92:%1,%2,%3]\r\n").arg(m_offset[0], 0, 'f', 3).arg(m_offset[1], 0, 'f', 3).arg(m_offset[2], 0, 'f', 3));
+    result.append("[TLO:0.000]\r\n");
+    result.append(QString("[PRB:%1,%2,%3:%4]\r\n").arg(m_probe[0], 0, 'f', 3).arg(m_probe[1], 0, 'f', 3)
+                  .arg(m_probe[2], 0, 'f', 3).arg(m_probeSucceeded ? 1 : 0));
+
+    return result;
+}
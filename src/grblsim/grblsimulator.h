@@ -0,0 +1,126 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef GRBLSIMULATOR_H
+#define GRBLSIMULATOR_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QList>
+#include <QByteArray>
+
+// Grbl 1.1 protocol model. Receive buffer and planner buffer have grbl sizes,
+// planner blocks are executed in real time with configurable speed factor.
+class GrblSimulator : public QObject
+{
+    Q_OBJECT
+public:
+    enum States { Idle, Run, Hold, Jog, Check };
+
+    explicit GrblSimulator(QObject *parent = 0);
+
+    int rxBufferSize() const;
+    void setRxBufferSize(int rxBufferSize);
+
+    int plannerSize() const;
+    void setPlannerSize(int plannerSize);
+
+    double speedFactor() const;
+    void setSpeedFactor(double speedFactor);
+
+    double rapidRate() const;
+    void setRapidRate(double rapidRate);
+
+    bool legacyStatus() const;
+    void setLegacyStatus(bool legacyStatus);
+
+    int state() const;
+    bool isIdle() const;
+
+    // Statistics
+    void resetStatistics();
+    double underrunTime() const;
+    int processedLines() const;
+    int overflows() const;
+
+signals:
+    void output(QByteArray data);
+
+public slots:
+    void input(const QByteArray &data);
+    void reset();
+
+private slots:
+    void onTimer();
+
+private:
+    enum BlockTypes { Feed, Rapid, Dwell };
+
+    struct Block {
+        int type;
+        bool jog;
+        double start[3];
+        double target[3];
+        double rate;
+        double duration;
+        double elapsed;
+    };
+
+    int m_rxBufferSize;
+    int m_plannerSize;
+    double m_speedFactor;
+    double m_rapidRate;
+    bool m_legacyStatus;
+
+    QByteArray m_rx;
+    QList<Block> m_planner;
+
+    // Parser state
+    double m_position[3];
+    double m_offset[3];
+    double m_feed;
+    double m_spindleSpeed;
+    int m_motion;
+    bool m_absolute;
+    bool m_metric;
+    bool m_checkMode;
+    bool m_hold;
+    int m_spindleState;
+    int m_coolantState;
+    int m_toolNumber;
+    double m_probe[3];
+    bool m_probeSucceeded;
+
+    // Overrides
+    int m_feedOverride;
+    int m_rapidOverride;
+    int m_spindleOverride;
+
+    int m_statusCount;
+
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    qint64 m_lastTick;
+
+    // Statistics
+    bool m_executed;
+    qint64 m_emptySince;
+    double m_underrunTime;
+    int m_processedLines;
+    int m_overflows;
+
+    void processRealtime(unsigned char byte);
+    void processRx();
+    QString processLine(QString line);
+    QString processSystemCommand(const QString &line);
+    QString processGcode(const QString &line, bool jog);
+    void addBlock(int type, const double *target, double rate, double duration, bool jog);
+    void execute(double elapsed);
+    void currentPosition(double *position) const;
+    QString statusReport();
+    QString parserState();
+    QString offsets();
+};
+
+#endif // GRBLSIMULATOR_H
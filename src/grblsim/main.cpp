@@ -0,0 +1,125 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QFile>
+#include <unistd.h>
+
+#include "ptyport.h"
+#include "grblsimulator.h"
+#include "benchmark.h"
+#include "replay.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("grblsim");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Grbl simulator on pseudo-terminal");
+    parser.addHelpOption();
+
+    QCommandLineOption rxBufferOption("rx-buffer", "Receive buffer size, bytes.", "size", "127");
+    QCommandLineOption plannerOption("planner", "Planner buffer size, blocks.", "blocks", "15");
+    QCommandLineOption speedOption("speed", "Execution or replay speed factor, 0 for instant execution.", "factor", "1");
+    QCommandLineOption rapidOption("rapid", "Rapid rate, mm/min.", "rate", "5000");
+    QCommandLineOption legacyOption("legacy", "Report status in grbl 0.9 format.");
+    QCommandLineOption linkOption("link", "Create symbolic link to slave device.", "path");
+    QCommandLineOption senderBufferOption("sender-buffer", "Sender buffer size for benchmark, 0 to detect.", "size", "0");
+    QCommandLineOption plannerThrottleOption("planner-throttle", "Limit benchmark sender by free planner blocks.");
+    QCommandLineOption benchOption("bench", "Stream file to simulator and report throughput.", "file");
+    QCommandLineOption recordOption("record", "Record benchmark traffic log.", "file");
+    QCommandLineOption replayOption("replay", "Feed traffic log to sender and report processing time.", "file");
+
+    parser.addOption(rxBufferOption);
+    parser.addOption(plannerOption);
+    parser.addOption(speedOption);
+    parser.addOption(rapidOption);
+    parser.addOption(legacyOption);
+    parser.addOption(linkOption);
+    parser.addOption(senderBufferOption);
+    parser.addOption(plannerThrottleOption);
+    parser.addOption(benchOption);
+    parser.addOption(recordOption);
+    parser.addOption(replayOption);
+    parser.process(a);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    // Replay doesn't need simulator
+    if (parser.isSet(replayOption)) {
+        Replay replay;
+        replay.setBufferOptions(parser.value(senderBufferOption).toInt(), parser.isSet(plannerThrottleOption));
+        replay.setSpeed(parser.value(speedOption).toDouble());
+
+        if (!replay.load(parser.value(replayOption)) || !replay.start()) {
+            err << "Can't load traffic log: " << parser.value(replayOption) << "\n";
+            return 1;
+        }
+
+        QObject::connect(&replay, SIGNAL(finished(int)), &a, SLOT(quit()));
+        a.exec();
+
+        return replay.result();
+    }
+
+    GrblSimulator simulator;
+    simulator.setRxBufferSize(parser.value(rxBufferOption).toInt());
+    simulator.setPlannerSize(parser.value(plannerOption).toInt());
+    simulator.setRapidRate(parser.value(rapidOption).toDouble());
+    simulator.setLegacyStatus(parser.isSet(legacyOption));
+
+    // Zero speed factor means no execution time at all
+    double speed = parser.value(speedOption).toDouble();
+    simulator.setSpeedFactor(speed > 0 ? speed : 1e9);
+
+    PtyPort pty;
+    if (!pty.open()) {
+        err << "Can't open pseudo-terminal: " << pty.errorString() << "\n";
+        return 1;
+    }
+
+    QObject::connect(&pty, SIGNAL(dataReceived(QByteArray)), &simulator, SLOT(input(QByteArray)));
+    QObject::connect(&simulator, SIGNAL(output(QByteArray)), &pty, SLOT(write(QByteArray)));
+
+    QString portName = pty.slaveName();
+
+    if (parser.isSet(linkOption)) {
+        QString link = parser.value(linkOption);
+        QFile::remove(link);
+        if (symlink(portName.toLocal8Bit().constData(), link.toLocal8Bit().constData()) == 0) portName = link;
+        else err << "Can't create link: " << link << "\n";
+    }
+
+    if (!parser.isSet(benchOption)) {
+        out << "Grbl simulator ready on " << portName << "\n";
+        out.flush();
+        return a.exec();
+    }
+
+    Benchmark benchmark(&simulator, pty.slaveName());
+    benchmark.setBufferOptions(parser.value(senderBufferOption).toInt(), parser.isSet(plannerThrottleOption));
+
+    if (parser.isSet(recordOption) && !benchmark.setTrafficFile(parser.value(recordOption))) {
+        err << "Can't create traffic log: " << parser.value(recordOption) << "\n";
+        return 1;
+    }
+
+    if (!benchmark.load(parser.value(benchOption))) {
+        err << "Can't load file: " << parser.value(benchOption) << "\n";
+        return 1;
+    }
+
+    if (!benchmark.start()) {
+        err << "Can't open port: " << pty.slaveName() << "\n";
+        return 1;
+    }
+
+    QObject::connect(&benchmark, SIGNAL(finished(int)), &a, SLOT(quit()));
+    a.exec();
+
+    return benchmark.result();
+}
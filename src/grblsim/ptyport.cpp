@@ -0,0 +1,109 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include "ptyport.h"
+
+PtyPort::PtyPort(QObject *parent) : QObject(parent)
+{
+    m_master = -1;
+    m_slave = -1;
+    m_notifier = NULL;
+}
+
+PtyPort::~PtyPort()
+{
+    close();
+}
+
+bool PtyPort::open()
+{
+    m_master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (m_master == -1 || grantpt(m_master) == -1 || unlockpt(m_master) == -1) {
+        m_errorString = strerror(errno);
+        close();
+        return false;
+    }
+
+    m_slaveName = ptsname(m_master);
+
+    // Raw mode, no echo and no line editing
+    termios tio;
+    tcgetattr(m_master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(m_master, TCSANOW, &tio);
+
+    fcntl(m_master, F_SETFL, fcntl(m_master, F_GETFL) | O_NONBLOCK);
+
+    // Keep slave opened, otherwise master reads fail with EIO while no client connected
+    m_slave = ::open(m_slaveName.toLocal8Bit().constData(), O_RDWR | O_NOCTTY);
+
+    m_notifier = new QSocketNotifier(m_master, QSocketNotifier::Read, this);
+    connect(m_notifier, SIGNAL(activated(int)), this, SLOT(onActivated()));
+
+    return true;
+}
+
+void PtyPort::close()
+{
+    delete m_notifier;
+    m_notifier = NULL;
+
+    if (m_slave != -1) ::close(m_slave);
+    if (m_master != -1) ::close(m_master);
+    m_slave = -1;
+    m_master = -1;
+}
+
+bool PtyPort::isOpen() const
+{
+    return m_master != -1;
+}
+
+QString PtyPort::slaveName() const
+{
+    return m_slaveName;
+}
+
+QString PtyPort::errorString() const
+{
+    return m_errorString;
+}
+
+void PtyPort::write(const QByteArray &data)
+{
+    if (m_master == -1) return;
+
+    const char *p = data.constData();
+    int left = data.length();
+    int retries = 100;
+
+    // Output is dropped if nobody reads slave side
+    while (left > 0 && retries > 0) {
+        ssize_t written = ::write(m_master, p, left);
+        if (written > 0) {
+            p += written;
+            left -= written;
+        } else if (written == -1 && errno == EAGAIN) {
+            usleep(100);
+            retries--;
+        } else {
+            break;
+        }
+    }
+}
+
+void PtyPort::onActivated()
+{
+    char buffer[1024];
+    ssize_t count;
+
+    while ((count = ::read(m_master, buffer, sizeof(buffer))) > 0) {
+        emit dataReceived(QByteArray(buffer, count));
+    }
+}
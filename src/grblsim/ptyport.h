@@ -0,0 +1,42 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef PTYPORT_H
+#define PTYPORT_H
+
+#include <QObject>
+#include <QSocketNotifier>
+
+// Master side of pseudo-terminal. Slave side is seen by clients as ordinary serial port.
+class PtyPort : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PtyPort(QObject *parent = 0);
+    ~PtyPort();
+
+    bool open();
+    void close();
+    bool isOpen() const;
+
+    QString slaveName() const;
+    QString errorString() const;
+
+signals:
+    void dataReceived(QByteArray data);
+
+public slots:
+    void write(const QByteArray &data);
+
+private slots:
+    void onActivated();
+
+private:
+    int m_master;
+    int m_slave;
+    QString m_slaveName;
+    QString m_errorString;
+    QSocketNotifier *m_notifier;
+};
+
+#endif // PTYPORT_H
@@ -0,0 +1,164 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QTextStream>
+#include <algorithm>
+#include "serial/trafficlog.h"
+#include "replay.h"
+
+Replay::Replay(QObject *parent) : QObject(parent)
+{
+    m_streamer.setDevice(&m_device);
+
+    m_recordedBytes = 0;
+    m_sentIndex = 0;
+    m_processedCount = 0;
+    m_errors = 0;
+    m_lineCount = 0;
+    m_statusCount = 0;
+    m_result = 1;
+    m_streaming = false;
+    m_startTime = 0;
+    m_processTime = 0;
+
+    connect(&m_device, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    connect(&m_device, SIGNAL(finished()), this, SLOT(onFinished()));
+}
+
+void Replay::setBufferOptions(int bufferSize, bool plannerThrottle)
+{
+    m_streamer.setAutoBufferSize(bufferSize == 0);
+    m_streamer.setBufferSize(bufferSize > 0 ? bufferSize : GrblStreamer::DefaultBufferSize);
+    m_streamer.setPlannerThrottle(plannerThrottle);
+}
+
+void Replay::setSpeed(double speed)
+{
+    m_device.setSpeed(speed);
+}
+
+bool Replay::load(const QString &fileName)
+{
+    TrafficReader reader;
+    TrafficRecord record;
+
+    if (!reader.open(fileName)) return false;
+
+    // Commands are terminated by carriage return, several of them could be in one write.
+    // Single bytes are realtime commands.
+    while (reader.read(record)) {
+        if (record.direction != TrafficRecord::Sent) continue;
+
+        m_recordedBytes += record.data.length();
+        if (!record.data.endsWith('\r')) continue;
+
+        int start = 0;
+        int end;
+
+        while ((end = record.data.indexOf('\r', start)) != -1) {
+            m_commands.append(record.data.mid(start, end - start));
+            start = end + 1;
+        }
+    }
+
+    m_fileName = fileName;
+    m_readTimes.reserve(m_commands.count() * 2);
+
+    return true;
+}
+
+bool Replay::start()
+{
+    if (!m_device.open(m_fileName)) return false;
+
+    // Reset write starts playback
+    m_clock.start();
+    m_startTime = m_clock.nsecsElapsed();
+    m_streamer.reset(-1);
+
+    return true;
+}
+
+int Replay::result() const
+{
+    return m_result;
+}
+
+void Replay::onReadyRead()
+{
+    SerialResponse response;
+    bool dropQueue;
+    char line[256];
+    qint64 time = m_clock.nsecsElapsed();
+
+    // Same path as serial worker takes
+    while (m_device.canReadLine()) {
+        int length = m_device.readLine(line, sizeof(line));
+        if (length <= 0) continue;
+
+        m_lineCount++;
+
+        if (line[0] == '<') {
+            if (m_streamer.processStatus(line, length, m_state)) m_statusCount++;
+            continue;
+        }
+
+        QString data = QString::fromLatin1(line, length).trimmed();
+
+        if (!m_streamer.processLine(data, response, &dropQueue)) continue;
+        if (response.type != SerialResponse::Response) continue;
+
+        if (response.id == -1) {
+            m_streaming = true;
+        } else {
+            if (response.data.contains("error")) m_errors++;
+            m_processedCount++;
+        }
+    }
+
+    if (m_streaming) sendCommands();
+
+    qint64 elapsed = m_clock.nsecsElapsed() - time;
+    m_processTime += elapsed;
+    m_readTimes.append(elapsed / 1e3);
+}
+
+void Replay::onFinished()
+{
+    report(m_clock.nsecsElapsed());
+
+    m_result = 0;
+    emit finished(m_result);
+}
+
+void Replay::sendCommands()
+{
+    while (m_sentIndex < m_commands.count() && m_streamer.send(m_sentIndex, m_commands.at(m_sentIndex))) m_sentIndex++;
+
+    m_streamer.flush();
+}
+
+void Replay::report(qint64 endTime)
+{
+    QTextStream out(stdout);
+
+    double total = (endTime - m_startTime) / 1e9;
+
+    std::sort(m_readTimes.begin(), m_readTimes.end());
+
+    int count = m_readTimes.count();
+    double p50 = count ? m_readTimes.at(count * 50 / 100) : 0;
+    double p99 = count ? m_readTimes.at(qMin(count - 1, count * 99 / 100)) : 0;
+    double max = count ? m_readTimes.last() : 0;
+
+    out << "received lines: " << m_lineCount << " (" << m_statusCount << " status reports)\n";
+    out << "commands:       " << m_sentIndex << " of " << m_commands.count() << " sent, "
+        << m_processedCount << " answered (" << m_errors << " errors)\n";
+    out << "bytes written:  " << m_device.bytesWritten() << " (recorded " << m_recordedBytes << ")\n";
+    out << "total time:     " << QString::number(total, 'f', 3) << " s\n";
+    out << "read time:      " << QString::number(m_processTime / 1e6, 'f', 3) << " ms, "
+        << QString::number(m_lineCount ? m_processTime / 1e3 / m_lineCount : 0, 'f', 2) << " us/line\n";
+    out << "read call p50:  " << QString::number(p50, 'f', 2) << " us\n";
+    out << "read call p99:  " << QString::number(p99, 'f', 2) << " us\n";
+    out << "read call max:  " << QString::number(max, 'f', 2) << " us\n";
+}
@@ -0,0 +1,61 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <QObject>
+#include <QList>
+#include <QVector>
+#include <QElapsedTimer>
+
+#include "serial/grblstreamer.h"
+#include "serial/replaydevice.h"
+
+// Feeds recorded traffic log to streamer, resending recorded commands in original order,
+// and reports time spent on received data processing.
+class Replay : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Replay(QObject *parent = 0);
+
+    void setBufferOptions(int bufferSize, bool plannerThrottle);
+    void setSpeed(double speed);
+    bool load(const QString &fileName);
+    bool start();
+    int result() const;
+
+signals:
+    void finished(int result);
+
+private slots:
+    void onReadyRead();
+    void onFinished();
+
+private:
+    ReplayDevice m_device;
+    GrblStreamer m_streamer;
+    MachineState m_state;
+    QString m_fileName;
+
+    QList<QByteArray> m_commands;
+    qint64 m_recordedBytes;
+    int m_sentIndex;
+    int m_processedCount;
+    int m_errors;
+    int m_lineCount;
+    int m_statusCount;
+    int m_result;
+    bool m_streaming;
+
+    QElapsedTimer m_clock;
+    qint64 m_startTime;
+    qint64 m_processTime;
+    QVector<double> m_readTimes;
+
+    void sendCommands();
+    void report(qint64 endTime);
+};
+
+#endif // REPLAY_H
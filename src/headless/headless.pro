@@ -0,0 +1,52 @@
+#-------------------------------------------------
+#
+# Headless sender, streams program without GUI and OpenGL
+#
+#-------------------------------------------------
+
+QT       = core gui serialport
+
+TARGET = candle-headless
+TEMPLATE = app
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+INCLUDEPATH += ..
+
+SOURCES += main.cpp \
+    ../parser/arcproperties.cpp \
+    ../parser/gcodeparser.cpp \
+    ../parser/gcodepreprocessorutils.cpp \
+    ../parser/gcodeviewparse.cpp \
+    ../parser/heightmapcompensator.cpp \
+    ../parser/linesegment.cpp \
+    ../parser/modalstate.cpp \
+    ../parser/pointsegment.cpp \
+    ../serial/grblstatusparser.cpp \
+    ../serial/grblstreamer.cpp \
+    ../serial/serialportdevice.cpp \
+    ../serial/streamermetrics.cpp \
+    ../serial/streamjob.cpp \
+    ../serial/wirebuffer.cpp \
+    ../tables/heightmaptablemodel.cpp
+
+HEADERS += ../parser/arcproperties.h \
+    ../parser/gcodeparser.h \
+    ../parser/gcodepreprocessorutils.h \
+    ../parser/gcodeviewparse.h \
+    ../parser/heightmapcompensator.h \
+    ../parser/linesegment.h \
+    ../parser/modalstate.h \
+    ../parser/pointsegment.h \
+    ../serial/bytedevice.h \
+    ../serial/grblstatusparser.h \
+    ../serial/grblstreamer.h \
+    ../serial/machinestate.h \
+    ../serial/serialportdevice.h \
+    ../serial/streamermetrics.h \
+    ../serial/streamjob.h \
+    ../serial/wirebuffer.h \
+    ../tables/heightmaptablemodel.h \
+    ../utils/histogram.h \
+    ../utils/interpolation.h \
+    ../utils/spscqueue.h
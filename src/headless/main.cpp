@@ -0,0 +1,79 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+
+#include "serial/streamjob.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("candle-headless");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Candle headless sender");
+    parser.addHelpOption();
+
+    QCommandLineOption streamOption("stream", "Program file to stream.", "file");
+    QCommandLineOption portOption("port", "Serial port name.", "name");
+    QCommandLineOption baudOption("baud", "Serial port baud rate.", "rate", "115200");
+    QCommandLineOption heightMapOption("heightmap", "Heightmap file to apply to program.", "file");
+    QCommandLineOption arcDegreeOption("arc-degree", "Arc segment angle for heightmap, degrees.", "angle", "5");
+    QCommandLineOption arcLengthOption("arc-length", "Arc segment length for heightmap, mm. Overrides angle.", "length");
+    QCommandLineOption rxBufferOption("rx-buffer", "Controller receive buffer size, 0 to detect.", "size", "0");
+    QCommandLineOption plannerThrottleOption("planner-throttle", "Limit sender by free planner blocks.");
+    QCommandLineOption statusOption("status-interval", "Status query interval, ms.", "ms", "250");
+    QCommandLineOption reportOption("report-interval", "Progress report interval, ms.", "ms", "1000");
+    QCommandLineOption skipErrorsOption("skip-errors", "Keep streaming on error responses instead of aborting.");
+
+    parser.addOption(streamOption);
+    parser.addOption(portOption);
+    parser.addOption(baudOption);
+    parser.addOption(heightMapOption);
+    parser.addOption(arcDegreeOption);
+    parser.addOption(arcLengthOption);
+    parser.addOption(rxBufferOption);
+    parser.addOption(plannerThrottleOption);
+    parser.addOption(statusOption);
+    parser.addOption(reportOption);
+    parser.addOption(skipErrorsOption);
+    parser.process(a);
+
+    QTextStream err(stderr);
+
+    if (!parser.isSet(streamOption) || !parser.isSet(portOption)) {
+        err << "Program file and port should be given\n";
+        parser.showHelp(1);
+    }
+
+    StreamJob job;
+    job.setPort(parser.value(portOption), parser.value(baudOption).toInt());
+    job.setBufferOptions(parser.value(rxBufferOption).toInt(), parser.isSet(plannerThrottleOption));
+    job.setStatusInterval(parser.value(statusOption).toInt());
+    job.setReportInterval(parser.value(reportOption).toInt());
+    job.setSkipErrors(parser.isSet(skipErrorsOption));
+    job.setEcho(true);
+
+    if (parser.isSet(heightMapOption) && !job.loadHeightMap(parser.value(heightMapOption))) {
+        err << "Can't load heightmap: " << parser.value(heightMapOption) << "\n";
+        return 1;
+    }
+
+    bool arcDegreeMode = !parser.isSet(arcLengthOption);
+    double arcPrecision = arcDegreeMode ? parser.value(arcDegreeOption).toDouble() : parser.value(arcLengthOption).toDouble();
+
+    if (!job.load(parser.value(streamOption), arcPrecision, arcDegreeMode)) {
+        err << "Can't load file: " << parser.value(streamOption) << "\n";
+        return 1;
+    }
+
+    // Port error is printed by job
+    if (!job.start()) return 1;
+
+    QObject::connect(&job, SIGNAL(finished(int)), &a, SLOT(quit()));
+    a.exec();
+
+    return job.result();
+}
@@ -0,0 +1,186 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QHash>
+#include <QtNumeric>
+#include <cmath>
+#include "toolpathsimplifier.h"
+#include "traveloptimizer.h"
+#include "aircuteliminator.h"
+
+// Surface is checked along moves with this step, millimeters
+static const double surfaceStep = 1;
+static const int maxSurfacePoints = 1000;
+
+AirCutEliminator::AirCutEliminator()
+{
+    m_stockTop = 0;
+    m_clearance = 0.5;
+    m_surface = NULL;
+    m_feed = 0;
+    m_convertedMoves = 0;
+    m_convertedLength = 0;
+}
+
+void AirCutEliminator::setStockTop(double z)
+{
+    m_stockTop = z;
+}
+
+void AirCutEliminator::setClearance(double clearance)
+{
+    m_clearance = clearance;
+}
+
+void AirCutEliminator::setSurface(const HeightMapCompensator *surface)
+{
+    m_surface = surface;
+}
+
+void AirCutEliminator::setFeed(double feed)
+{
+    m_feed = feed;
+}
+
+void AirCutEliminator::addLine(const QString &command, const QStringList &args, int line, const ModalState &modal)
+{
+    Line item;
+
+    item.command = command;
+    item.args = args;
+    item.line = line;
+    item.modal = modal;
+
+    m_lines.append(item);
+}
+
+int AirCutEliminator::convertedMoves() const
+{
+    return m_convertedMoves;
+}
+
+double AirCutEliminator::convertedLength() const
+{
+    return m_convertedLength;
+}
+
+QList<int> AirCutEliminator::changedLines() const
+{
+    return m_changedLines;
+}
+
+QStringList AirCutEliminator::eliminate(const QList<LineSegment*> &segments)
+{
+    QStringList commands;
+
+    // Segments of lines, motion lines get new command number
+    QHash<int, QList<LineSegment*> > lineSegments;
+    foreach (LineSegment *segment, segments) lineSegments[segment->getLineNumber()].append(segment);
+
+    m_convertedMoves = 0;
+    m_convertedLength = 0;
+    m_changedLines.clear();
+
+    bool converted = false;
+    double feed = 0;
+    int previous = -1;
+
+    for (int i = 0; i < m_lines.count(); i++) {
+        const Line &line = m_lines.at(i);
+        QList<LineSegment*> lineSegmentList = line.line != previous ? lineSegments.value(line.line) : QList<LineSegment*>();
+        LineSegment *segment = lineSegmentList.count() == 1 ? lineSegmentList.first() : NULL;
+
+        previous = line.line;
+
+        bool air = segment && !segment->isArc() && !segment->isFastTraverse() && ToolpathSimplifier::isPlainMove(line.args)
+                && isAir(segment);
+
+        // Feed of move is higher already
+        if (air && m_feed > 0) {
+            feed = airFeed(line);
+            if (programFeed(line) >= feed) air = false;
+        }
+
+        if (air) {
+            commands << convert(line);
+            m_changedLines << commands.count() - 1;
+            m_convertedMoves++;
+            m_convertedLength += (segment->getEnd() - segment->getStart()).length();
+            converted = true;
+            continue;
+        }
+
+        // Next line gets motion and feed of original program
+        if (converted) {
+            ModalState state = line.modal;
+            state.motion = m_feed > 0 ? 1 : 0;
+            if (m_feed > 0) state.feed = feed;
+
+            QString modes = TravelOptimizer::modesCommand(state, line.modal);
+            if (!modes.isEmpty()) {
+                commands << modes;
+                m_changedLines << commands.count() - 1;
+            }
+            converted = false;
+        }
+
+        commands << line.command;
+    }
+
+    return commands;
+}
+
+bool AirCutEliminator::isAir(LineSegment *segment) const
+{
+    QVector3D start = segment->getStart();
+    QVector3D end = segment->getEnd();
+
+    if (qIsNaN(start.length()) || qIsNaN(end.length())) return false;
+
+    if (!m_surface) return qMin(start.z(), end.z()) >= m_stockTop + m_clearance - 1e-6;
+
+    QRectF border = m_surface->border();
+    int points = qBound(1, (int)ceil((end - start).toVector2D().length() / surfaceStep), maxSurfacePoints);
+
+    for (int i = 0; i <= points; i++) {
+        QVector3D point = start + (end - start) * i / points;
+
+        if (!border.contains(point.x(), point.y())) return false;
+        if (point.z() < m_stockTop + m_surface->height(point.x(), point.y()) + m_clearance - 1e-6) return false;
+    }
+
+    return true;
+}
+
+// Line words with other motion, F word is replaced when feed is given
+QString AirCutEliminator::convert(const Line &line) const
+{
+    QString numbers;
+    QString words;
+
+    foreach (const QString &arg, line.args) {
+        QChar letter = arg.at(0).toUpper();
+
+        if (letter == 'N') numbers += arg.toUpper();
+        else if (letter == 'G' || (letter == 'F' && m_feed > 0)) continue;
+        else words += arg.toUpper();
+    }
+
+    if (m_feed > 0) return numbers + "G1" + words + "F" + QString::number(airFeed(line));
+
+    return numbers + "G0" + words;
+}
+
+// Program units per minute, rounded as written
+double AirCutEliminator::airFeed(const Line &line) const
+{
+    return line.modal.metric ? qRound(m_feed) : qRound(m_feed / 25.4 * 10) / 10.0;
+}
+
+// Program units per minute
+double AirCutEliminator::programFeed(const Line &line) const
+{
+    foreach (const QString &arg, line.args) if (arg.at(0).toUpper() == 'F') return arg.mid(1).toDouble();
+
+    return line.modal.feed;
+}
@@ -0,0 +1,63 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef AIRCUTELIMINATOR_H
+#define AIRCUTELIMINATOR_H
+
+#include <QStringList>
+#include "linesegment.h"
+#include "modalstate.h"
+#include "heightmapcompensator.h"
+
+// Turns linear feed moves lying above stock into rapids, or into moves with higher
+// feed for machines where rapids aren't safe. Stock top is flat or follows probed
+// heightmap surface. Modal motion and feed are restored after converted moves.
+class AirCutEliminator
+{
+public:
+    AirCutEliminator();
+
+    // Millimeters
+    void setStockTop(double z);
+    void setClearance(double clearance);
+
+    // Surface heights are added to stock top, moves outside of heightmap are kept. NULL for flat stock.
+    void setSurface(const HeightMapCompensator *surface);
+
+    // Millimeters per minute, 0 for rapids
+    void setFeed(double feed);
+
+    // Program lines in order, line is parser command number of segments, modal is state at line start
+    void addLine(const QString &command, const QStringList &args, int line, const ModalState &modal);
+
+    QStringList eliminate(const QList<LineSegment*> &segments);
+
+    int convertedMoves() const;
+    double convertedLength() const;         // Millimeters
+    QList<int> changedLines() const;        // Indexes of result lines
+
+private:
+    struct Line {
+        QString command;
+        QStringList args;
+        int line;
+        ModalState modal;
+    };
+
+    QList<Line> m_lines;
+    double m_stockTop;
+    double m_clearance;
+    const HeightMapCompensator *m_surface;
+    double m_feed;
+
+    int m_convertedMoves;
+    double m_convertedLength;
+    QList<int> m_changedLines;
+
+    bool isAir(LineSegment *segment) const;
+    QString convert(const Line &line) const;
+    double airFeed(const Line &line) const;
+    double programFeed(const Line &line) const;
+};
+
+#endif // AIRCUTELIMINATOR_H
@@ -0,0 +1,302 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QHash>
+#include <QtNumeric>
+#include <cmath>
+#include "gcodepreprocessorutils.h"
+#include "toolpathsimplifier.h"
+#include "arcfitter.h"
+
+// Less chords aren't worth an arc
+static const int minChords = 3;
+
+// Nearly straight chains stay lines
+static const double maxRadius = 1000;
+
+ArcFitter::ArcFitter()
+{
+    m_tolerance = 0.01;
+    m_fittedArcs = 0;
+    m_removedLines = 0;
+}
+
+void ArcFitter::setTolerance(double tolerance)
+{
+    m_tolerance = tolerance;
+}
+
+void ArcFitter::addLine(const QString &command, const QStringList &args, int line)
+{
+    Line item;
+
+    item.command = command;
+    item.args = args;
+    item.line = line;
+
+    m_lines.append(item);
+}
+
+int ArcFitter::fittedArcs() const
+{
+    return m_fittedArcs;
+}
+
+int ArcFitter::removedLines() const
+{
+    return m_removedLines;
+}
+
+QStringList ArcFitter::fit(const QList<LineSegment*> &segments)
+{
+    QStringList commands;
+
+    // Single segment of line, NULL for lines giving none or several ones
+    QHash<int, LineSegment*> lineSegments;
+    QHash<int, int> segmentCounts;
+
+    foreach (LineSegment *segment, segments) {
+        lineSegments.insert(segment->getLineNumber(), segment);
+        segmentCounts[segment->getLineNumber()]++;
+    }
+
+    m_fittedArcs = 0;
+    m_removedLines = 0;
+
+    int i = 0;
+    while (i < m_lines.count()) {
+        // Collect run of candidate lines
+        int first = i;
+        LineSegment *firstSegment = NULL;
+
+        while (i < m_lines.count()) {
+            const Line &line = m_lines.at(i);
+            LineSegment *segment = segmentCounts.value(line.line) == 1 ? lineSegments.value(line.line) : NULL;
+
+            // Lines without own command number are kept between runs
+            if (i > 0 && m_lines.at(i - 1).line == line.line) break;
+
+            if (!segment || !ToolpathSimplifier::isPlainMove(line.args) || segment->isArc() || segment->isFastTraverse()
+                    || segment->isZMovement() || !segment->isAbsolute() || qIsNaN(segment->getEnd().length())) break;
+
+            if (!firstSegment) firstSegment = segment;
+            else if (segment->getSpeed() != firstSegment->getSpeed() || segment->isMetric() != firstSegment->isMetric()
+                     || segment->plane() != firstSegment->plane()) break;
+
+            i++;
+        }
+
+        if (i - first < minChords) {
+            // Not a run, line is kept
+            if (i == first) i++;
+            for (int j = first; j < i; j++) commands << m_lines.at(j).command;
+            continue;
+        }
+
+        PointSegment::planes plane = firstSegment->plane();
+        QVector<QVector3D> points;
+        QVector<QVector3D> planePoints;
+
+        points.append(firstSegment->getStart());
+        for (int j = first; j < i; j++) points.append(lineSegments.value(m_lines.at(j).line)->getEnd());
+        foreach (const QVector3D &point, points) planePoints.append(toPlane(point, plane));
+
+        // Arcs by first point index, each one is grown while it fits
+        QHash<int, Arc> arcs;
+        int start = 0;
+
+        while (start + minChords < points.count()) {
+            Arc arc;
+            Arc longer;
+
+            if (!fitArc(planePoints, start, start + minChords, plane, arc)) {
+                start++;
+                continue;
+            }
+
+            while (arc.last + 1 < points.count() && fitArc(planePoints, start, arc.last + 1, plane, longer)) arc = longer;
+
+            if (verifyArc(points, start, arc, plane)) {
+                arcs.insert(start, arc);
+                start = arc.last;
+            } else {
+                start++;
+            }
+        }
+
+        // Line after arc gets all coordinates and G1 back
+        bool rewrite = false;
+        int point = 0;
+
+        while (point < points.count() - 1) {
+            if (arcs.contains(point)) {
+                const Arc &arc = arcs[point];
+                QString feed;
+
+                for (int j = first + point; j < first + arc.last; j++) {
+                    QString lineFeed = ToolpathSimplifier::feedWord(m_lines.at(j).args);
+                    if (!lineFeed.isEmpty()) feed = lineFeed;
+                }
+
+                commands << arcCommand(points.at(point), arc, points.at(arc.last), plane, firstSegment->isMetric()) + feed;
+
+                m_fittedArcs++;
+                m_removedLines += arc.last - point - 1;
+                rewrite = true;
+                point = arc.last;
+                continue;
+            }
+
+            const Line &line = m_lines.at(first + point);
+
+            if (rewrite) commands << ToolpathSimplifier::moveCommand(lineSegments.value(line.line)) + ToolpathSimplifier::feedWord(line.args);
+            else commands << line.command;
+
+            rewrite = false;
+            point++;
+        }
+
+        // Next lines may rely on modal G1
+        if (rewrite) commands << "G1";
+    }
+
+    return commands;
+}
+
+// Circle through first, middle and last points, all chords should stay within tolerance
+bool ArcFitter::fitArc(const QVector<QVector3D> &points, int first, int last, PointSegment::planes plane, Arc &arc) const
+{
+    if (last - first < minChords) return false;
+
+    const QVector3D &a = points.at(first);
+    const QVector3D &b = points.at((first + last) / 2);
+    const QVector3D &c = points.at(last);
+
+    // Helical moves aren't fitted
+    for (int i = first + 1; i <= last; i++) if (fabs(points.at(i).z() - a.z()) > 1e-4) return false;
+
+    double d = 2 * ((double)a.x() * (b.y() - c.y()) + (double)b.x() * (c.y() - a.y()) + (double)c.x() * (a.y() - b.y()));
+    if (fabs(d) < 1e-9) return false;
+
+    double aa = (double)a.x() * a.x() + (double)a.y() * a.y();
+    double bb = (double)b.x() * b.x() + (double)b.y() * b.y();
+    double cc = (double)c.x() * c.x() + (double)c.y() * c.y();
+    double cx = (aa * (b.y() - c.y()) + bb * (c.y() - a.y()) + cc * (a.y() - b.y())) / d;
+    double cy = (aa * (c.x() - b.x()) + bb * (a.x() - c.x()) + cc * (b.x() - a.x())) / d;
+    double radius = hypot(a.x() - cx, a.y() - cy);
+
+    if (radius > maxRadius) return false;
+
+    bool clockwise = ((double)b.x() - a.x()) * ((double)c.y() - b.y()) - ((double)b.y() - a.y()) * ((double)c.x() - b.x()) < 0;
+    double sweep = 0;
+    double previousDeviation = 0;
+
+    for (int i = first; i < last; i++) {
+        double px = points.at(i).x() - cx;
+        double py = points.at(i).y() - cy;
+        double qx = points.at(i + 1).x() - cx;
+        double qy = points.at(i + 1).y() - cy;
+
+        // Points go one way round
+        double step = atan2(px * qy - py * qx, px * qx + py * qy);
+        if (clockwise ? step >= 0 : step <= 0) return false;
+        sweep += fabs(step);
+
+        double chord = hypot(qx - px, qy - py);
+        double sagitta = radius - sqrt(qMax(0.0, radius * radius - chord * chord / 4));
+        double deviation = fabs(hypot(qx, qy) - radius);
+
+        if (qMax(previousDeviation, deviation) + sagitta > m_tolerance) return false;
+        previousDeviation = deviation;
+    }
+
+    // Full circle would be ambiguous
+    if (sweep > 2 * M_PI - 0.01) return false;
+
+    arc.last = last;
+    arc.center = fromPlane(QVector3D(cx, cy, a.z()), plane);
+    arc.clockwise = clockwise;
+
+    return true;
+}
+
+// Arc expanded as visualizer does should follow original moves
+bool ArcFitter::verifyArc(const QVector<QVector3D> &points, int first, const Arc &arc, PointSegment::planes plane) const
+{
+    QVector3D start = toPlane(points.at(first), plane);
+    QVector3D center = toPlane(arc.center, plane);
+    double radius = hypot(start.x() - center.x(), start.y() - center.y());
+
+    QList<QVector3D> samples = GcodePreprocessorUtils::generatePointsAlongArcBDring(plane, points.at(first), points.at(arc.last),
+                                                                                   arc.center, arc.clockwise, radius, 0, 1, true);
+    if (samples.isEmpty()) return false;
+
+    foreach (const QVector3D &sample, samples) {
+        double minDistance = qInf();
+
+        for (int i = first; i < arc.last; i++) {
+            QVector3D ab = points.at(i + 1) - points.at(i);
+            QVector3D ap = sample - points.at(i);
+            double lengthSquared = ab.lengthSquared();
+            double t = lengthSquared > 0 ? qBound(0.0, (double)QVector3D::dotProduct(ap, ab) / lengthSquared, 1.0) : 0;
+
+            minDistance = qMin(minDistance, (double)(ap - ab * t).length());
+        }
+
+        // Float coordinates
+        if (minDistance > m_tolerance + 1e-4) return false;
+    }
+
+    return true;
+}
+
+QString ArcFitter::arcCommand(const QVector3D &start, const Arc &arc, const QVector3D &end, PointSegment::planes plane, bool metric)
+{
+    QVector3D point = end;
+    QVector3D offset = arc.center - start;
+    int decimals = metric ? 3 : 4;
+
+    if (!metric) {
+        point /= 25.4;
+        offset /= 25.4;
+    }
+
+    QString command = QString("%1X%2Y%3Z%4").arg(arc.clockwise ? "G2" : "G3").arg(point.x(), 0, 'f', decimals)
+            .arg(point.y(), 0, 'f', decimals).arg(point.z(), 0, 'f', decimals);
+
+    switch (plane) {
+    case PointSegment::XY:
+        return command + QString("I%1J%2").arg(offset.x(), 0, 'f', decimals).arg(offset.y(), 0, 'f', decimals);
+    case PointSegment::ZX:
+        return command + QString("I%1K%2").arg(offset.x(), 0, 'f', decimals).arg(offset.z(), 0, 'f', decimals);
+    case PointSegment::YZ:
+        return command + QString("J%1K%2").arg(offset.y(), 0, 'f', decimals).arg(offset.z(), 0, 'f', decimals);
+    }
+
+    return command;
+}
+
+// Plane axes as grbl takes them for arc direction: XY, ZX, YZ, third coordinate is normal
+QVector3D ArcFitter::toPlane(const QVector3D &point, PointSegment::planes plane)
+{
+    switch (plane) {
+    case PointSegment::ZX:
+        return QVector3D(point.z(), point.x(), point.y());
+    case PointSegment::YZ:
+        return QVector3D(point.y(), point.z(), point.x());
+    default:
+        return point;
+    }
+}
+
+QVector3D ArcFitter::fromPlane(const QVector3D &point, PointSegment::planes plane)
+{
+    switch (plane) {
+    case PointSegment::ZX:
+        return QVector3D(point.y(), point.z(), point.x());
+    case PointSegment::YZ:
+        return QVector3D(point.z(), point.x(), point.y());
+    default:
+        return point;
+    }
+}
@@ -0,0 +1,54 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef ARCFITTER_H
+#define ARCFITTER_H
+
+#include <QStringList>
+#include <QVector>
+#include "linesegment.h"
+
+// Replaces chains of short linear moves lying on circle by G2/G3 arcs. Runs are the
+// same as ones of toolpath simplifier, arcs are fitted in plane selected by program
+// and checked against original moves with arc expansion used by visualizer.
+class ArcFitter
+{
+public:
+    ArcFitter();
+
+    // Millimeters
+    void setTolerance(double tolerance);
+
+    // Program lines in order, line is parser command number of segments
+    void addLine(const QString &command, const QStringList &args, int line);
+
+    QStringList fit(const QList<LineSegment*> &segments);
+    int fittedArcs() const;
+    int removedLines() const;
+
+private:
+    struct Line {
+        QString command;
+        QStringList args;
+        int line;
+    };
+
+    struct Arc {
+        int last;                       // Point index of arc end
+        QVector3D center;
+        bool clockwise;
+    };
+
+    QList<Line> m_lines;
+    double m_tolerance;
+    int m_fittedArcs;
+    int m_removedLines;
+
+    bool fitArc(const QVector<QVector3D> &points, int first, int last, PointSegment::planes plane, Arc &arc) const;
+    bool verifyArc(const QVector<QVector3D> &points, int first, const Arc &arc, PointSegment::planes plane) const;
+    static QString arcCommand(const QVector3D &start, const Arc &arc, const QVector3D &end, PointSegment::planes plane, bool metric);
+    static QVector3D toPlane(const QVector3D &point, PointSegment::planes plane);
+    static QVector3D fromPlane(const QVector3D &point, PointSegment::planes plane);
+};
+
+#endif // ARCFITTER_H
@@ -0,0 +1,321 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QtNumeric>
+#include <cmath>
+#include "gcodepreprocessorutils.h"
+#include "gcodecompactor.h"
+
+static const char axisLetters[] = {'X', 'Y', 'Z'};
+
+static inline int axisIndex(char letter)
+{
+    return letter >= 'X' && letter <= 'Z' ? letter - 'X' : -1;
+}
+
+static inline int tenfold(double value)
+{
+    return qRound(value * 10);
+}
+
+// NaN means unknown, equal to unknown only
+static inline bool same(double a, double b)
+{
+    return a == b || (qIsNaN(a) && qIsNaN(b));
+}
+
+GcodeCompactor::GcodeCompactor()
+{
+    m_precision = -1;
+    m_bytesBefore = 0;
+    m_bytesAfter = 0;
+
+    reset();
+}
+
+void GcodeCompactor::setPrecision(int decimals)
+{
+    m_precision = decimals;
+}
+
+void GcodeCompactor::reset()
+{
+    m_state.motion = -1;
+    m_state.distance = -1;
+    m_state.feedMode = 94;              // Grbl default, G93 is set by programs only
+    m_state.feed = qQNaN();
+    m_state.spindleSpeed = qQNaN();
+    for (int i = 0; i < 3; i++) m_state.position[i] = qQNaN();
+}
+
+qint64 GcodeCompactor::bytesBefore() const
+{
+    return m_bytesBefore;
+}
+
+qint64 GcodeCompactor::bytesAfter() const
+{
+    return m_bytesAfter;
+}
+
+QString GcodeCompactor::compact(const QString &command)
+{
+    QString block = GcodePreprocessorUtils::removeAllWhitespace(GcodePreprocessorUtils::removeComment(command)).toUpper();
+    QList<Word> words;
+    QString result;
+
+    m_bytesBefore += command.trimmed().length() + 1;
+
+    // System commands and words not understood are sent without comments, state is lost
+    if (block.startsWith('$') || !split(block, words)) {
+        reset();
+        m_bytesAfter += block.length() + 1;
+        return block;
+    }
+
+    // Blocks with offsets, homing, units or probing aren't rewritten except numbers
+    if (isBarrier(words)) {
+        result = join(words);
+        evaluate(m_state, words, &m_state);
+        m_bytesAfter += result.length() + 1;
+        return result;
+    }
+
+    State next;
+    Effect original = evaluate(m_state, words, &next);
+    int motion = original.motion;
+    int distance = original.distance;
+    QList<Word> compacted;
+
+    foreach (const Word &word, words) {
+        int axis = axisIndex(word.letter);
+
+        switch (word.letter) {
+        case 'N':
+            continue;
+        case 'G':
+            if (tenfold(word.value) <= 30 && tenfold(word.value) % 10 == 0 && tenfold(word.value) == m_state.motion) continue;
+            break;
+        case 'F':
+            // Feed is unknown after mode change, so block of G93 doesn't make it droppable
+            if (m_state.feedMode == 94 && next.feedMode == 94 && !qIsNaN(m_state.feed) && word.value == m_state.feed) continue;
+            break;
+        case 'S':
+            if (word.value == m_state.spindleSpeed) continue;
+            break;
+        }
+
+        // Arcs keep all axis words, grbl needs ones of plane
+        if (axis != -1 && (motion == 0 || motion == 10)) {
+            if (distance == 900 && word.value == m_state.position[axis]) continue;
+            if (distance == 910 && word.value == 0) continue;
+        }
+
+        compacted.append(word);
+    }
+
+    if (evaluate(m_state, compacted, NULL) == original) result = join(compacted);
+    else result = join(words);
+
+    m_state = next;
+    m_bytesAfter += result.length() + 1;
+
+    return result;
+}
+
+bool GcodeCompactor::split(const QString &block, QList<Word> &words) const
+{
+    int i = 0;
+    int length = block.length();
+
+    while (i < length) {
+        char letter = block.at(i).toLatin1();
+        if (letter < 'A' || letter > 'Z') return false;
+
+        int start = ++i;
+        if (i < length && (block.at(i) == '-' || block.at(i) == '+')) i++;
+        while (i < length && (block.at(i).isDigit() || block.at(i) == '.')) i++;
+
+        Word word;
+        bool ok;
+
+        word.letter = letter;
+        word.text = block.mid(start, i - start);
+        word.value = word.text.toDouble(&ok);
+        if (!ok) return false;
+
+        if (axisIndex(letter) != -1 && m_precision >= 0) {
+            word.text = QString::number(word.value, 'f', m_precision);
+            word.value = word.text.toDouble();
+        }
+        word.text = shortest(word.text);
+
+        words.append(word);
+    }
+
+    return true;
+}
+
+// Same value with less characters: "+010.500" -> "10.5", "-0.250" -> "-.25", "-0.0" -> "0"
+QString GcodeCompactor::shortest(const QString &number)
+{
+    QString text = number;
+    bool negative = false;
+
+    if (text.startsWith('+')) text.remove(0, 1);
+    else if (text.startsWith('-')) {
+        negative = true;
+        text.remove(0, 1);
+    }
+
+    if (text.contains('.')) {
+        while (text.endsWith('0')) text.chop(1);
+        if (text.endsWith('.')) text.chop(1);
+    }
+    while (text.length() > 1 && text.startsWith('0')) text.remove(0, 1);
+
+    if (text.isEmpty() || text == "0" || text == ".") return "0";
+
+    return negative ? "-" + text : text;
+}
+
+bool GcodeCompactor::isBarrier(const QList<Word> &words)
+{
+    int letters = 0;
+
+    foreach (const Word &word, words) {
+        if (word.letter == 'G') {
+            int code = tenfold(word.value);
+
+            // Dwell, arc distance mode, plane, feed, distance and other modes don't move coordinates
+            if (code > 30 && code != 40 && code != 170 && code != 180 && code != 190 && code != 400 && code != 610
+                    && code != 900 && code != 910 && code != 911 && code != 930 && code != 940) return true;
+        } else if (word.letter != 'M') {
+            // Repeated words are grbl errors, sent as they are
+            int bit = 1 << (word.letter - 'A');
+            if (letters & bit) return true;
+            letters |= bit;
+        }
+    }
+
+    return false;
+}
+
+GcodeCompactor::Effect GcodeCompactor::evaluate(const State &state, const QList<Word> &words, State *next)
+{
+    Effect effect;
+    State result = state;
+    bool axisWords = false;
+    bool positionsLost = false;
+    bool programEnd = false;
+    bool feedWord = false;
+    bool unitsWord = false;
+
+    for (int i = 0; i < 3; i++) effect.target[i] = qQNaN();
+
+    foreach (const Word &word, words) {
+        int code = tenfold(word.value);
+
+        switch (word.letter) {
+        case 'G':
+            if (code <= 30 && code % 10 == 0) result.motion = code;
+            else if (code == 900 || code == 910) result.distance = code;
+            else if (code == 930 || code == 940) result.feedMode = code / 10;
+            else if (code == 800) result.motion = code;
+            else if (code == 200 || code == 210) {
+                unitsWord = true;
+                positionsLost = true;
+            }
+            else if (code >= 380 && code < 390) {
+                result.motion = -1;
+                positionsLost = true;
+            } else if (code != 40 && code != 170 && code != 180 && code != 190 && code != 400 && code != 610
+                       && code != 911 && code != 281 && code != 301) {
+                positionsLost = true;
+            }
+            // Motion and distance modes are compared as state
+            if (!(code <= 30 && code % 10 == 0) && code != 900 && code != 910) effect.words.append("G" + word.text);
+            break;
+        case 'M':
+            if (code == 20 || code == 300) programEnd = true;
+            effect.words.append("M" + word.text);
+            break;
+        case 'F':
+            result.feed = word.value;
+            feedWord = true;
+            break;
+        case 'S':
+            result.spindleSpeed = word.value;
+            break;
+        case 'N':
+            break;
+        default:
+            if (axisIndex(word.letter) != -1) axisWords = true;
+            else effect.words.append(word.letter + word.text);
+        }
+    }
+
+    // Grbl doesn't carry feed over feed mode change, feed is kept in mm/min over units change.
+    // Units aren't tracked, so any G20/G21 makes feed unknown.
+    if ((result.feedMode != state.feedMode || unitsWord) && !feedWord) result.feed = qQNaN();
+
+    // Modal values in effect after block, so dropped repeating words give the same
+    effect.motion = result.motion;
+    effect.distance = result.distance;
+    effect.feed = result.feed;
+    effect.spindleSpeed = result.spindleSpeed;
+
+    // Omitted axis keeps position: absolute target is previous one, delta is zero
+    for (int i = 0; i < 3; i++) {
+        double value = qQNaN();
+
+        foreach (const Word &word, words) if (word.letter == axisLetters[i]) value = word.value;
+
+        if (result.distance == 900) {
+            effect.target[i] = qIsNaN(value) ? state.position[i] : value;
+            result.position[i] = effect.target[i];
+        } else if (result.distance == 910) {
+            effect.target[i] = qIsNaN(value) ? 0 : value;
+            result.position[i] = state.position[i] + effect.target[i];
+        } else {
+            effect.target[i] = value;
+            result.position[i] = qQNaN();
+        }
+    }
+
+    // Axis words of non-modal commands don't move to them
+    if (positionsLost || (axisWords && (result.motion == -1 || result.motion == 800))) {
+        for (int i = 0; i < 3; i++) result.position[i] = qQNaN();
+    }
+
+    if (next) {
+        *next = result;
+        if (programEnd) {
+            next->motion = -1;
+            next->distance = -1;
+            if (next->feedMode != 94) next->feed = qQNaN();
+            next->feedMode = 94;
+        }
+    }
+
+    return effect;
+}
+
+QString GcodeCompactor::join(const QList<Word> &words)
+{
+    QString block;
+
+    foreach (const Word &word, words) {
+        if (word.letter != 'N') block += word.letter + word.text;
+    }
+
+    return block;
+}
+
+bool GcodeCompactor::Effect::operator==(const Effect &other) const
+{
+    for (int i = 0; i < 3; i++) if (!same(target[i], other.target[i])) return false;
+
+    return motion == other.motion && distance == other.distance && same(feed, other.feed)
+            && same(spindleSpeed, other.spindleSpeed) && words == other.words;
+}
@@ -0,0 +1,70 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef GCODECOMPACTOR_H
+#define GCODECOMPACTOR_H
+
+#include <QString>
+#include <QList>
+#include <QStringList>
+
+// Rewrites program lines to fewer bytes on the way to controller: comments, spaces,
+// line numbers and words repeating modal state are dropped, numbers are written
+// shortest. Every rewritten block is evaluated against original one from the same
+// state, block giving other target, feed or words is sent as original.
+class GcodeCompactor
+{
+public:
+    GcodeCompactor();
+
+    // Decimals of X, Y, Z values, -1 keeps values exact
+    void setPrecision(int decimals);
+
+    // State is unknown, as at program start
+    void reset();
+
+    QString compact(const QString &command);
+
+    qint64 bytesBefore() const;
+    qint64 bytesAfter() const;
+
+private:
+    struct Word {
+        char letter;
+        double value;
+        QString text;                   // Shortest form of value
+    };
+
+    struct State {
+        int motion;                     // Tenfold G code, -1 if unknown
+        int distance;                   // 90, 91, -1 if unknown
+        int feedMode;                   // 93, 94
+        double feed;                    // NaN if unknown
+        double spindleSpeed;
+        double position[3];             // Program units
+    };
+
+    // Values affecting machine, compared for original and rewritten blocks
+    struct Effect {
+        int motion;
+        int distance;
+        double feed;
+        double spindleSpeed;
+        double target[3];               // Deltas in G91
+        QStringList words;              // Other words as given
+        bool operator==(const Effect &other) const;
+    };
+
+    State m_state;
+    int m_precision;
+    qint64 m_bytesBefore;
+    qint64 m_bytesAfter;
+
+    bool split(const QString &block, QList<Word> &words) const;
+    static QString shortest(const QString &number);
+    static bool isBarrier(const QList<Word> &words);
+    static Effect evaluate(const State &state, const QList<Word> &words, State *next);
+    static QString join(const QList<Word> &words);
+};
+
+#endif // GCODECOMPACTOR_H
@@ -14,8 +14,14 @@ GcodeParser::GcodeParser(QObject *parent) : QObject(parent)
     m_isMetric = true;
     m_inAbsoluteMode = true;
     m_inAbsoluteIJKMode = false;
+    m_inverseFeed = false;
+    m_offsetsChanged = false;
     m_lastGcodeCommand = -1;
     m_commandNumber = 0;
+    m_coordinateSystem = 54;
+    m_spindle = 5;
+    m_coolant = 0;
+    m_tool = -1;
 
     // Settings
     m_speedOverride = -1;
@@ -216,6 +222,27 @@ int GcodeParser::getCommandNumber() const
     return m_commandNumber - 1;
 }
 
+ModalState GcodeParser::getModalState() const
+{
+    ModalState state;
+
+    state.position = m_currentPoint;
+    state.motion = m_lastGcodeCommand;
+    state.feed = m_isMetric ? m_lastSpeed : m_lastSpeed / 25.4;
+    state.spindleSpeed = m_lastSpindleSpeed;
+    state.tool = m_tool;
+    state.plane = m_currentPlane == PointSegment::XY ? 17 : m_currentPlane == PointSegment::ZX ? 18 : 19;
+    state.distance = m_inAbsoluteMode ? 90 : 91;
+    state.feedMode = m_inverseFeed ? 93 : 94;
+    state.coordinateSystem = m_coordinateSystem;
+    state.spindle = m_spindle;
+    state.coolant = m_coolant;
+    state.metric = m_isMetric;
+    state.offsetsChanged = m_offsetsChanged;
+
+    return state;
+}
+
 
 PointSegment *GcodeParser::processCommand(const QStringList &args)
 {
@@ -234,6 +261,15 @@ PointSegment *GcodeParser::processCommand(const QStringList &args)
     double dwell = GcodePreprocessorUtils::parseCoord(args, 'P');
     if (!qIsNaN(dwell)) this->m_points.last()->setDwell(dwell);
 
+    // Handle T code
+    double tool = GcodePreprocessorUtils::parseCoord(args, 'T');
+    if (!qIsNaN(tool)) this->m_tool = (int)tool;
+
+    // Handle M codes
+    foreach (float code, GcodePreprocessorUtils::parseCodes(args, 'M')) {
+        handleMCode(code, args);
+    }
+
     // handle G codes.
     gCodes = GcodePreprocessorUtils::parseCodes(args, 'G');
 
@@ -268,6 +304,7 @@ PointSegment *GcodeParser::addLinearPointSegment(const QVector3D &nextPoint, boo
     ps->setIsAbsolute(this->m_inAbsoluteMode);
     ps->setSpeed(fastTraverse ? this->m_traverseSpeed : this->m_lastSpeed);
     ps->setSpindleSpeed(this->m_lastSpindleSpeed);
+    ps->setPlane(m_currentPlane);
     this->m_points.append(ps);
 
     // Save off the endpoint.
@@ -323,6 +360,20 @@ void GcodeParser::handleMCode(float code, const QStringList &args)
 {
     double spindleSpeed = GcodePreprocessorUtils::parseCoord(args, 'S');
     if (!qIsNaN(spindleSpeed)) this->m_lastSpindleSpeed = spindleSpeed;
+
+    if (code == 3.0f || code == 4.0f || code == 5.0f) this->m_spindle = (int)code;
+    else if (code == 7.0f) this->m_coolant |= ModalState::Mist;
+    else if (code == 8.0f) this->m_coolant |= ModalState::Flood;
+    else if (code == 9.0f) this->m_coolant = 0;
+    else if (code == 2.0f || code == 30.0f) {
+        // Program end restores defaults
+        this->m_coordinateSystem = 54;
+        this->m_currentPlane = PointSegment::XY;
+        this->m_inAbsoluteMode = true;
+        this->m_inverseFeed = false;
+        this->m_spindle = 5;
+        this->m_coolant = 0;
+    }
 }
 
 PointSegment * GcodeParser::handleGCode(float code, const QStringList &args)
@@ -345,6 +396,10 @@ PointSegment * GcodeParser::handleGCode(float code, const QStringList &args)
     else if (code == 90.1f) this->m_inAbsoluteIJKMode = true;
     else if (code == 91.0f) this->m_inAbsoluteMode = false;
     else if (code == 91.1f) this->m_inAbsoluteIJKMode = false;
+    else if (code == 93.0f) this->m_inverseFeed = true;
+    else if (code == 94.0f) this->m_inverseFeed = false;
+    else if (code == 10.0f || code == 92.0f || code == 92.1f) this->m_offsetsChanged = true;
+    else if (code >= 54.0f && code <= 59.0f && code == (int)code) this->m_coordinateSystem = (int)code;
 
     if (code == 0 || code == 1 || code == 2 || code == 3 || code == 38.2) this->m_lastGcodeCommand = code;
 
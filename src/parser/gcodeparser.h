@@ -13,6 +13,7 @@
 #include <cmath>
 #include "pointsegment.h"
 #include "gcodepreprocessorutils.h"
+#include "modalstate.h"
 
 class GcodeParser : public QObject
 {
@@ -45,6 +46,7 @@ public:
     double getTraverseSpeed() const;
     void setTraverseSpeed(double traverseSpeed);
     int getCommandNumber() const;
+    ModalState getModalState() const;
 
 signals:
 
@@ -56,10 +58,16 @@ private:
     bool m_isMetric;
     bool m_inAbsoluteMode;
     bool m_inAbsoluteIJKMode;
+    bool m_inverseFeed;
+    bool m_offsetsChanged;
     float m_lastGcodeCommand;
     QVector3D m_currentPoint;
     int m_commandNumber;
     PointSegment::planes m_currentPlane;
+    int m_coordinateSystem;
+    int m_spindle;
+    int m_coolant;
+    int m_tool;
 
     // Settings
     double m_speedOverride;
@@ -0,0 +1,368 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QCoreApplication>
+#include <QtNumeric>
+#include <cmath>
+#include <cstring>
+#include "gcodevalidator.h"
+
+// Modal groups, bits of block mask
+enum Groups { GroupNonModal, GroupMotion, GroupPlane, GroupDistance, GroupArcDistance, GroupFeedMode, GroupUnits,
+              GroupCutterComp, GroupToolLength, GroupCoordinateSystem, GroupControl, GroupStopping, GroupSpindle,
+              GroupCoolant };
+
+// Group of G code given by tenfold number, -1 if grbl doesn't support it
+static int gGroup(int code)
+{
+    switch (code) {
+    case 0: case 10: case 20: case 30: case 382: case 383: case 384: case 385: case 800:
+        return GroupMotion;
+    case 170: case 180: case 190:
+        return GroupPlane;
+    case 900: case 910:
+        return GroupDistance;
+    case 911:
+        return GroupArcDistance;
+    case 930: case 940:
+        return GroupFeedMode;
+    case 200: case 210:
+        return GroupUnits;
+    case 400:
+        return GroupCutterComp;
+    case 431: case 490:
+        return GroupToolLength;
+    case 540: case 550: case 560: case 570: case 580: case 590:
+        return GroupCoordinateSystem;
+    case 610:
+        return GroupControl;
+    case 40: case 100: case 280: case 281: case 300: case 301: case 530: case 920: case 921:
+        return GroupNonModal;
+    }
+
+    return -1;
+}
+
+static int mGroup(int code)
+{
+    switch (code) {
+    case 0: case 1: case 2: case 30:
+        return GroupStopping;
+    case 3: case 4: case 5:
+        return GroupSpindle;
+    case 7: case 8: case 9:
+        return GroupCoolant;
+    }
+
+    return -1;
+}
+
+static inline int bit(char letter)
+{
+    return 1 << (letter - 'A');
+}
+
+static inline double value(const double *values, char letter)
+{
+    return values[letter - 'A'];
+}
+
+GcodeValidator::GcodeValidator()
+{
+    m_inverseFeed = false;
+    m_offsetChanged = false;
+    m_softLimits = false;
+    m_coordinateSystem = 54;
+}
+
+void GcodeValidator::setSoftLimits(const QVector3D &minimum, const QVector3D &maximum)
+{
+    m_softLimits = true;
+    m_minimum = minimum;
+    m_maximum = maximum;
+}
+
+void GcodeValidator::setWorkOffset(int coordinateSystem, const QVector3D &offset)
+{
+    m_coordinateSystem = coordinateSystem;
+    m_workOffset = offset;
+}
+
+void GcodeValidator::setState(const ModalState &state)
+{
+    m_state = state;
+    m_inverseFeed = state.feedMode == 93;
+    m_offsetChanged = state.offsetsChanged;
+}
+
+int GcodeValidator::checkLine(const QString &command, const QStringList &args)
+{
+    // System commands are checked by controller
+    if (args.isEmpty() || command.startsWith('$') || command.startsWith('%')) return NoError;
+
+    int groups = 0;
+    int words = 0;
+    double values[26];
+
+    int motion = -1;                    // Tenfold G codes given in block
+    int nonModal = -1;
+    int feedMode = -1;
+    int units = -1;
+    int plane = -1;
+    int distance = -1;
+    int coordinateSystem = -1;
+    int spindle = -1;
+    int coolant = -1;
+    bool programEnd = false;
+
+    foreach (const QString &arg, args) {
+        if (arg.isEmpty()) continue;
+
+        char letter = arg.at(0).toUpper().toLatin1();
+        if (letter < 'A' || letter > 'Z') return ExpectedCommandLetter;
+
+        bool ok;
+        double number = arg.midRef(1).toDouble(&ok);
+        if (!ok) return BadNumberFormat;
+
+        if (letter == 'G') {
+            int code = qRound(number * 10);
+            int group = gGroup(code);
+
+            if (group == -1) return UnsupportedCommand;
+            if (groups & (1 << group)) return ModalGroupViolation;
+            groups |= 1 << group;
+
+            switch (group) {
+            case GroupMotion: motion = code; break;
+            case GroupNonModal: nonModal = code; break;
+            case GroupFeedMode: feedMode = code; break;
+            case GroupUnits: units = code; break;
+            case GroupPlane: plane = code / 10; break;
+            case GroupDistance: distance = code / 10; break;
+            case GroupCoordinateSystem: coordinateSystem = code / 10; break;
+            }
+        } else if (letter == 'M') {
+            if (number != (int)number) return CommandValueNotInteger;
+
+            int code = (int)number;
+            int group = mGroup(code);
+
+            if (group == -1) return UnsupportedCommand;
+            if (groups & (1 << group)) return ModalGroupViolation;
+            groups |= 1 << group;
+
+            if (group == GroupSpindle) spindle = code;
+            else if (group == GroupCoolant) coolant = code;
+            else if (code == 2 || code == 30) programEnd = true;
+        } else {
+            if (!strchr("FIJKLNPRSTXYZ", letter)) return UnsupportedCommand;
+            if (words & bit(letter)) return WordRepeated;
+
+            words |= bit(letter);
+            values[letter - 'A'] = number;
+        }
+    }
+
+    // Value words
+    if ((words & bit('F') && value(values, 'F') < 0) || (words & bit('N') && value(values, 'N') < 0)
+            || (words & bit('P') && value(values, 'P') < 0) || (words & bit('S') && value(values, 'S') < 0)
+            || (words & bit('T') && value(values, 'T') < 0)) return NegativeValue;
+    if (words & bit('N') && value(values, 'N') > 9999999) return InvalidLineNumber;
+    if (words & bit('T')) {
+        if (value(values, 'T') != (int)value(values, 'T')) return CommandValueNotInteger;
+        if (value(values, 'T') > 255) return MaxValueExceeded;
+    }
+
+    bool inverseFeed = feedMode == -1 ? m_inverseFeed : feedMode == 930;
+    bool metric = units == -1 ? m_state.metric : units == 210;
+    bool absolute = distance == -1 ? m_state.distance == 90 : distance == 90;
+    int activePlane = plane == -1 ? m_state.plane : plane;
+    int activeCoordinateSystem = coordinateSystem == -1 ? m_state.coordinateSystem : coordinateSystem;
+    int axisWords = words & (bit('X') | bit('Y') | bit('Z'));
+
+    // Non-modal commands
+    if (nonModal == 40 && !(words & bit('P'))) return ValueWordMissing;
+    if (nonModal == 100 && (!(words & bit('L')) || !(words & bit('P')))) return ValueWordMissing;
+
+    bool axisCommand = nonModal == 100 || nonModal == 280 || nonModal == 300 || nonModal == 920;
+    if (axisCommand && motion != -1 && motion != 800) return AxisCommandConflict;
+
+    // Motion, grbl starts in G0 mode
+    int activeMotion = motion != -1 ? motion : m_state.motion < 0 ? 0 : qRound(m_state.motion * 10);
+    bool motionCommand = (motion != -1 && motion != 800) || (axisWords && !axisCommand);
+    bool arc = false;
+    QVector3D target = m_state.position;
+
+    if (motionCommand) {
+        if (activeMotion == 800) return AxisWordsExist;
+
+        if (inverseFeed) {
+            if (activeMotion != 0 && !(words & bit('F'))) return UndefinedFeedRate;
+        } else {
+            if (activeMotion != 0 && (words & bit('F') ? value(values, 'F') : m_state.feed) <= 0) return UndefinedFeedRate;
+        }
+
+        if (nonModal == 530 && activeMotion != 0 && activeMotion != 10) return G53InvalidMotionMode;
+        if (activeMotion >= 382 && !axisWords) return NoAxisWords;
+
+        for (int i = 0; i < 3; i++) {
+            char letter = 'X' + i;
+            if (words & bit(letter)) target[i] = absolute || nonModal == 530 ? value(values, letter)
+                                                                          : target[i] + value(values, letter);
+        }
+
+        if (activeMotion == 20 || activeMotion == 30) {
+            int error = checkArc(target, words, values, activePlane, metric);
+            if (error != NoError) return error;
+            arc = true;
+        }
+
+        if (axisWords && exceedsLimits(target, nonModal == 530 ? 0 : activeCoordinateSystem, metric)) return SoftLimit;
+    }
+
+    // Words left
+    if (!arc && (words & (bit('I') | bit('J') | bit('K') | bit('R')))) return UnusedWords;
+    if (nonModal != 40 && nonModal != 100 && (words & bit('P'))) return UnusedWords;
+    if (nonModal != 100 && (words & bit('L'))) return UnusedWords;
+
+    // Block is valid, update state
+    if (words & bit('F')) m_state.feed = value(values, 'F');
+    if (words & bit('S')) m_state.spindleSpeed = value(values, 'S');
+    if (words & bit('T')) m_state.tool = (short)value(values, 'T');
+    if (feedMode != -1) m_inverseFeed = inverseFeed;
+    if (units != -1) m_state.metric = metric;
+    if (plane != -1) m_state.plane = plane;
+    if (distance != -1) m_state.distance = distance;
+    if (coordinateSystem != -1) m_state.coordinateSystem = coordinateSystem;
+    if (motion != -1) m_state.motion = motion / 10.0f;
+    if (spindle != -1) m_state.spindle = spindle;
+    if (coolant == 7) m_state.coolant |= ModalState::Mist;
+    else if (coolant == 8) m_state.coolant |= ModalState::Flood;
+    else if (coolant == 9) m_state.coolant = 0;
+
+    if (motionCommand) {
+        // Work position after machine coordinates move is unknown
+        if (nonModal == 530) {
+            for (int i = 0; i < 3; i++) if (words & bit('X' + i)) target[i] = qQNaN();
+        }
+        m_state.position = target;
+    }
+
+    switch (nonModal) {
+    case 280: case 300:
+        m_state.position = QVector3D(qQNaN(), qQNaN(), qQNaN());
+        break;
+    case 920:
+        for (int i = 0; i < 3; i++) if (words & bit('X' + i)) m_state.position[i] = value(values, 'X' + i);
+        m_offsetChanged = true;
+        break;
+    case 100: case 921:
+        m_offsetChanged = true;
+        break;
+    }
+
+    if (programEnd) {
+        m_state.motion = 1;
+        m_state.plane = 17;
+        m_state.distance = 90;
+        m_state.coordinateSystem = 54;
+        m_state.spindle = 5;
+        m_state.coolant = 0;
+        m_inverseFeed = false;
+    }
+
+    return NoError;
+}
+
+int GcodeValidator::checkArc(const QVector3D &target, int words, const double *values, int plane, bool metric) const
+{
+    int axis0 = 0;
+    int axis1 = 1;
+
+    if (plane == 18) {
+        axis0 = 2;
+        axis1 = 0;
+    } else if (plane == 19) {
+        axis0 = 1;
+        axis1 = 2;
+    }
+
+    if (!(words & (bit('X' + axis0) | bit('X' + axis1)))) return NoAxisWordsInPlane;
+
+    // Start position could be unknown
+    double scale = metric ? 1 : 25.4;
+    double x = (target[axis0] - m_state.position[axis0]) * scale;
+    double y = (target[axis1] - m_state.position[axis1]) * scale;
+
+    if (words & bit('R')) {
+        if (words & (bit('I') | bit('J') | bit('K'))) return UnusedWords;
+        if (qIsNaN(x) || qIsNaN(y)) return NoError;
+        if (target == m_state.position) return InvalidTarget;
+
+        double r = value(values, 'R') * scale;
+        if (4 * r * r - x * x - y * y < 0) return ArcRadiusError;
+    } else {
+        if (!(words & (bit('I' + axis0) | bit('I' + axis1)))) return NoOffsetsInPlane;
+        if (qIsNaN(x) || qIsNaN(y)) return NoError;
+
+        // Same tolerance as grbl: 0.005 mm and 0.1% of radius, or 0.5 mm
+        double i = words & bit('I' + axis0) ? value(values, 'I' + axis0) * scale : 0;
+        double j = words & bit('I' + axis1) ? value(values, 'I' + axis1) * scale : 0;
+        double r = hypot(i, j);
+        double delta = fabs(hypot(x - i, y - j) - r);
+
+        if (delta > 0.005 && (delta > 0.5 || delta > 0.001 * r)) return InvalidTarget;
+    }
+
+    return NoError;
+}
+
+bool GcodeValidator::exceedsLimits(const QVector3D &target, int coordinateSystem, bool metric) const
+{
+    // Zero coordinate system is machine one
+    if (!m_softLimits || m_offsetChanged || (coordinateSystem != 0 && coordinateSystem != m_coordinateSystem)) return false;
+
+    double scale = metric ? 1 : 25.4;
+
+    for (int i = 0; i < 3; i++) {
+        if (qIsNaN(target[i])) continue;
+
+        double position = target[i] * scale + (coordinateSystem != 0 ? m_workOffset[i] : 0);
+        if (position < m_minimum[i] || position > m_maximum[i]) return true;
+    }
+
+    return false;
+}
+
+QString GcodeValidator::errorText(int code)
+{
+    const char *text;
+
+    switch (code) {
+    case ExpectedCommandLetter: text = QT_TRANSLATE_NOOP("GcodeValidator", "Expected command letter"); break;
+    case BadNumberFormat: text = QT_TRANSLATE_NOOP("GcodeValidator", "Bad number format"); break;
+    case NegativeValue: text = QT_TRANSLATE_NOOP("GcodeValidator", "Negative value"); break;
+    case UnsupportedCommand: text = QT_TRANSLATE_NOOP("GcodeValidator", "Unsupported command"); break;
+    case ModalGroupViolation: text = QT_TRANSLATE_NOOP("GcodeValidator", "Modal group violation"); break;
+    case UndefinedFeedRate: text = QT_TRANSLATE_NOOP("GcodeValidator", "Undefined feed rate"); break;
+    case CommandValueNotInteger: text = QT_TRANSLATE_NOOP("GcodeValidator", "Command value not integer"); break;
+    case AxisCommandConflict: text = QT_TRANSLATE_NOOP("GcodeValidator", "Axis command conflict"); break;
+    case WordRepeated: text = QT_TRANSLATE_NOOP("GcodeValidator", "Word repeated"); break;
+    case NoAxisWords: text = QT_TRANSLATE_NOOP("GcodeValidator", "No axis words"); break;
+    case InvalidLineNumber: text = QT_TRANSLATE_NOOP("GcodeValidator", "Invalid line number"); break;
+    case ValueWordMissing: text = QT_TRANSLATE_NOOP("GcodeValidator", "Value word missing"); break;
+    case G53InvalidMotionMode: text = QT_TRANSLATE_NOOP("GcodeValidator", "G53 invalid motion mode"); break;
+    case AxisWordsExist: text = QT_TRANSLATE_NOOP("GcodeValidator", "Axis words exist"); break;
+    case NoAxisWordsInPlane: text = QT_TRANSLATE_NOOP("GcodeValidator", "No axis words in plane"); break;
+    case InvalidTarget: text = QT_TRANSLATE_NOOP("GcodeValidator", "Invalid target"); break;
+    case ArcRadiusError: text = QT_TRANSLATE_NOOP("GcodeValidator", "Arc radius error"); break;
+    case NoOffsetsInPlane: text = QT_TRANSLATE_NOOP("GcodeValidator", "No offsets in plane"); break;
+    case UnusedWords: text = QT_TRANSLATE_NOOP("GcodeValidator", "Unused words"); break;
+    case MaxValueExceeded: text = QT_TRANSLATE_NOOP("GcodeValidator", "Max value exceeded"); break;
+    case SoftLimit: return QCoreApplication::translate("GcodeValidator", "Soft limit");
+    default: text = QT_TRANSLATE_NOOP("GcodeValidator", "Unknown error");
+    }
+
+    return QString("error:%1 ").arg(code) + QCoreApplication::translate("GcodeValidator", text);
+}
@@ -0,0 +1,75 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef GCODEVALIDATOR_H
+#define GCODEVALIDATOR_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector3D>
+#include "modalstate.h"
+
+// Checks program lines by grbl parser rules without streaming them in check mode.
+// Program is checked in independent chunks, each one starts from modal state
+// stored for its first line.
+class GcodeValidator
+{
+public:
+    // Grbl 1.1 error codes
+    enum Errors {
+        NoError = 0,
+        ExpectedCommandLetter = 1,
+        BadNumberFormat = 2,
+        NegativeValue = 4,
+        UnsupportedCommand = 20,
+        ModalGroupViolation = 21,
+        UndefinedFeedRate = 22,
+        CommandValueNotInteger = 23,
+        AxisCommandConflict = 24,
+        WordRepeated = 25,
+        NoAxisWords = 26,
+        InvalidLineNumber = 27,
+        ValueWordMissing = 28,
+        G53InvalidMotionMode = 30,
+        AxisWordsExist = 31,
+        NoAxisWordsInPlane = 32,
+        InvalidTarget = 33,
+        ArcRadiusError = 34,
+        NoOffsetsInPlane = 35,
+        UnusedWords = 36,
+        MaxValueExceeded = 38,
+        SoftLimit = 102                 // Alarm 2 while streaming
+    };
+
+    struct Error {
+        int row;
+        int code;
+    };
+
+    GcodeValidator();
+
+    // Machine coordinates, mm. Offset applies to given coordinate system only.
+    void setSoftLimits(const QVector3D &minimum, const QVector3D &maximum);
+    void setWorkOffset(int coordinateSystem, const QVector3D &offset);
+
+    void setState(const ModalState &state);
+    int checkLine(const QString &command, const QStringList &args);
+
+    static QString errorText(int code);
+
+private:
+    ModalState m_state;
+    bool m_inverseFeed;
+    bool m_offsetChanged;               // By G92 or G10, soft limits are not checked then
+
+    bool m_softLimits;
+    QVector3D m_minimum;
+    QVector3D m_maximum;
+    int m_coordinateSystem;
+    QVector3D m_workOffset;
+
+    int checkArc(const QVector3D &target, int words, const double *values, int plane, bool metric) const;
+    bool exceedsLimits(const QVector3D &target, int coordinateSystem, bool metric) const;
+};
+
+#endif // GCODEVALIDATOR_H
@@ -153,6 +153,7 @@ QList<LineSegment*> GcodeViewParse::getLinesFromParser(GcodeParser *gp, double a
             } else {
                 ls = new LineSegment(*start, *end, lineIndex++);
                 ls->setIsArc(ps->isArc());
+                ls->setPlane(ps->plane());
                 ls->setIsFastTraverse(ps->isFastTraverse());
                 ls->setIsZMovement(ps->isZMovement());
                 ls->setIsMetric(isMetric);
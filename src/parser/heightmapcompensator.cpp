@@ -0,0 +1,192 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include "utils/interpolation.h"
+#include "heightmapcompensator.h"
+
+HeightMapCompensator::HeightMapCompensator()
+{
+    m_points = NULL;
+    m_interpolationPointsX = 2;
+    m_interpolationPointsY = 2;
+
+    m_lines = NULL;
+    m_lastSegmentIndex = 0;
+    m_lastCommandIndex = -1;
+}
+
+void HeightMapCompensator::setHeightMap(const QRectF &border, QAbstractTableModel *points,
+                                        int interpolationPointsX, int interpolationPointsY)
+{
+    m_border = border;
+    m_points = points;
+    m_interpolationPointsX = interpolationPointsX;
+    m_interpolationPointsY = interpolationPointsY;
+}
+
+QRectF HeightMapCompensator::border() const
+{
+    return m_border;
+}
+
+double HeightMapCompensator::height(double x, double y) const
+{
+    return Interpolation::bicubicInterpolate(m_border, m_points, x, y);
+}
+
+QList<LineSegment*> HeightMapCompensator::subdivideSegment(LineSegment *segment) const
+{
+    QList<LineSegment*> list;
+
+    double interpolationStepX = m_border.width() / (m_interpolationPointsX - 1);
+    double interpolationStepY = m_border.height() / (m_interpolationPointsY - 1);
+
+    double length;
+
+    QVector3D vec = segment->getEnd() - segment->getStart();
+
+    if (qIsNaN(vec.length())) return QList<LineSegment*>();
+
+    if (fabs(vec.x()) / fabs(vec.y()) < interpolationStepX / interpolationStepY) length = interpolationStepY / (vec.y() / vec.length());
+    else length = interpolationStepX / (vec.x() / vec.length());
+
+    length = fabs(length);
+
+    if (qIsNaN(length)) return QList<LineSegment*>();
+
+    QVector3D seg = vec.normalized() * length;
+    int count = trunc(vec.length() / length);
+
+    if (count == 0) return QList<LineSegment*>();
+
+    for (int i = 0; i < count; i++) {
+        LineSegment* line = new LineSegment(segment);
+        line->setStart(i == 0 ? segment->getStart() : list[i - 1]->getEnd());
+        line->setEnd(line->getStart() + seg);
+        list.append(line);
+    }
+
+    if (list.count() > 0 && list.last()->getEnd() != segment->getEnd()) {
+        LineSegment* line = new LineSegment(segment);
+        line->setStart(list.last()->getEnd());
+        line->setEnd(segment->getEnd());
+        list.append(line);
+    }
+
+    return list;
+}
+
+void HeightMapCompensator::compensate(QList<LineSegment*> *lines) const
+{
+    for (int i = 0; i < lines->count(); i++) {
+        if (lines->at(i)->isZMovement()) continue;
+
+        QList<LineSegment*> subSegments = subdivideSegment(lines->at(i));
+
+        if (subSegments.count() > 0) {
+            delete lines->at(i);
+            lines->removeAt(i);
+            foreach (LineSegment* subSegment, subSegments) lines->insert(i++, subSegment);
+            i--;
+        }
+    }
+
+    for (int i = 0; i < lines->count(); i++) {
+        LineSegment *segment = lines->at(i);
+
+        if (i == 0) {
+            QVector3D start = segment->getStart();
+            segment->setStart(QVector3D(start.x(), start.y(), start.z() + height(start.x(), start.y())));
+        } else {
+            segment->setStart(lines->at(i - 1)->getEnd());
+        }
+
+        QVector3D end = segment->getEnd();
+        segment->setEnd(QVector3D(end.x(), end.y(), end.z() + height(end.x(), end.y())));
+    }
+}
+
+void HeightMapCompensator::startProgram(QList<LineSegment*> *lines)
+{
+    m_lines = lines;
+    m_lastSegmentIndex = 0;
+    m_lastCommandIndex = -1;
+    m_lastCode.clear();
+}
+
+QStringList HeightMapCompensator::programCommands(const QString &command, const QStringList &args, int line)
+{
+    QStringList commands;
+
+    // Search strings
+    static const QString coords("XxYyZzIiJjKkRr");
+    static const QString g("Gg");
+    static const QString m("Mm");
+
+    if (line < 0 || line == m_lastCommandIndex || m_lastSegmentIndex == m_lines->count() - 1) {
+        m_lastCommandIndex = line;
+        return commands << command;
+    }
+    m_lastCommandIndex = line;
+
+    QString newCommand;
+    bool isLinearMove = false;
+    bool hasCommand = false;
+
+    // Parse command args
+    foreach (const QString &arg, args) {                // arg examples: G1, G2, M3, X100...
+        char codeChar = arg.at(0).toLatin1();           // codeChar: G, M, X...
+        if (coords.contains(codeChar)) continue;        // Parameter
+
+        float codeNum = arg.mid(1).toDouble();          // Code number: G1 -> 1
+        if (g.contains(codeChar)) {                     // 'G'-command
+            // Store 'G0' & 'G1'
+            if (codeNum == 0.0f || codeNum == 1.0f) {
+                m_lastCode = arg;
+                isLinearMove = true;                    // Store linear move
+            }
+
+            // Replace 'G2' & 'G3' with 'G1'
+            if (codeNum == 2.0f || codeNum == 3.0f) {
+                newCommand.append("G1");
+                isLinearMove = true;
+            // Drop plane command for arcs
+            } else if (codeNum != 17.0f && codeNum != 18.0f && codeNum != 19.0f) {
+                newCommand.append(arg);
+            }
+
+            hasCommand = true;                          // Command has 'G'
+        } else {
+            if (m.contains(codeChar)) hasCommand = true;  // Command has 'M'
+            newCommand.append(arg);                     // Other commands
+        }
+    }
+
+    // Find first linesegment by command index
+    for (int j = m_lastSegmentIndex; j < m_lines->count(); j++) {
+        if (m_lines->at(j)->getLineNumber() != line) continue;
+
+        if (!qIsNaN(m_lines->at(j)->getEnd().length()) && (isLinearMove || (!hasCommand && !m_lastCode.isEmpty()))) {
+            // Create new commands for each linesegment with given command index
+            while ((j < m_lines->count()) && (m_lines->at(j)->getLineNumber() == line)) {
+                QVector3D point = m_lines->at(j)->getEnd();
+                if (!m_lines->at(j)->isAbsolute()) point -= m_lines->at(j)->getStart();
+                if (!m_lines->at(j)->isMetric()) point /= 25.4;
+
+                commands << newCommand + QString("X%1Y%2Z%3")
+                            .arg(point.x(), 0, 'f', 3).arg(point.y(), 0, 'f', 3).arg(point.z(), 0, 'f', 3);
+
+                if (!newCommand.isEmpty()) newCommand.clear();
+                j++;
+            }
+        // Copy original command if not G0 or G1
+        } else {
+            commands << command;
+        }
+
+        m_lastSegmentIndex = j;
+        break;
+    }
+
+    return commands;
+}
@@ -0,0 +1,47 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef HEIGHTMAPCOMPENSATOR_H
+#define HEIGHTMAPCOMPENSATOR_H
+
+#include <QRectF>
+#include <QStringList>
+#include <QAbstractTableModel>
+#include "linesegment.h"
+
+// Program modified by heightmap: moves are split by interpolation grid and Z of
+// their points is shifted by interpolated surface height. Used by heightmap mode
+// of main form and by headless sender.
+class HeightMapCompensator
+{
+public:
+    HeightMapCompensator();
+
+    // Probed heights are taken from model by Qt::UserRole. Interpolation is given
+    // by points count along axes.
+    void setHeightMap(const QRectF &border, QAbstractTableModel *points, int interpolationPointsX, int interpolationPointsY);
+
+    QRectF border() const;
+    double height(double x, double y) const;
+    QList<LineSegment*> subdivideSegment(LineSegment *segment) const;
+
+    // Subdivides and shifts whole list at once
+    void compensate(QList<LineSegment*> *lines) const;
+
+    // Program lines are taken in order, lines list should be compensated already
+    void startProgram(QList<LineSegment*> *lines);
+    QStringList programCommands(const QString &command, const QStringList &args, int line);
+
+private:
+    QRectF m_border;
+    QAbstractTableModel *m_points;
+    int m_interpolationPointsX;
+    int m_interpolationPointsY;
+
+    QList<LineSegment*> *m_lines;
+    int m_lastSegmentIndex;
+    int m_lastCommandIndex;
+    QString m_lastCode;
+};
+
+#endif // HEIGHTMAPCOMPENSATOR_H
@@ -19,6 +19,7 @@ LineSegment::LineSegment()
     m_isAbsolute = true;
     m_isHightlight = false;
     m_vertexIndex = -1;
+    m_plane = PointSegment::XY;
 }
 
 LineSegment::LineSegment(QVector3D a, QVector3D b, int num) : LineSegment()
@@ -48,6 +49,7 @@ LineSegment::LineSegment(LineSegment* initial)
     m_isAbsolute = initial->isAbsolute();
     m_isHightlight = initial->isHightlight();
     m_vertexIndex = initial->vertexIndex();
+    m_plane = initial->plane();
 }
 
 LineSegment::~LineSegment()
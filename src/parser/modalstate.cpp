@@ -0,0 +1,58 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QtNumeric>
+#include "modalstate.h"
+
+ModalState::ModalState()
+{
+    position = QVector3D(qQNaN(), qQNaN(), qQNaN());
+    motion = -1;
+    feed = 0;
+    spindleSpeed = 0;
+    tool = -1;
+    plane = 17;
+    distance = 90;
+    feedMode = 94;
+    coordinateSystem = 54;
+    spindle = 5;
+    coolant = 0;
+    metric = true;
+    offsetsChanged = false;
+}
+
+QStringList ModalState::commands() const
+{
+    QStringList commands;
+    int precision = metric ? 3 : 4;
+
+    // Moves to start are absolute
+    commands.append(QString("%1 G90 G94 G%2 G%3").arg(metric ? "G21" : "G20").arg((int)plane).arg((int)coordinateSystem));
+
+    if (tool != -1) commands.append(QString("T%1").arg(tool));
+
+    commands.append(spindle == 5 ? QString("M5") : QString("M%1 S%2").arg((int)spindle).arg(spindleSpeed));
+
+    if (coolant & Mist) commands.append("M7");
+    if (coolant & Flood) commands.append("M8");
+    if (coolant == 0) commands.append("M9");
+
+    // Rapid over the start, plunge with feed
+    if (!qIsNaN(position.x()) && !qIsNaN(position.y())) {
+        commands.append(QString("G0 X%1 Y%2").arg(position.x(), 0, 'f', precision).arg(position.y(), 0, 'f', precision));
+    }
+    if (!qIsNaN(position.z())) {
+        commands.append(feed > 0 ? QString("G1 Z%1 F%2").arg(position.z(), 0, 'f', precision).arg(feed)
+                                 : QString("G0 Z%1").arg(position.z(), 0, 'f', precision));
+    }
+
+    // Modes of line itself
+    QString modes = QString("G%1 G%2").arg((int)distance).arg((int)feedMode);
+
+    if (motion >= 0 && motion <= 3) modes += QString(" G%1").arg((int)motion);
+    // Inverse time moves have own feeds
+    if (feed > 0 && feedMode == 94) modes += QString(" F%1").arg(feed);
+    commands.append(modes);
+
+    return commands;
+}
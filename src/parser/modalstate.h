@@ -0,0 +1,37 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef MODALSTATE_H
+#define MODALSTATE_H
+
+#include <QVector3D>
+#include <QStringList>
+
+// Parser state at program line start, small enough to be stored for every line.
+// Resume from line sets machine to this state without walking program again.
+class ModalState
+{
+public:
+    enum Coolant { Mist = 1, Flood = 2 };
+
+    ModalState();
+
+    QVector3D position;                 // Program units, NaN for unknown axes
+    float motion;                       // Last motion G code, -1 if none
+    float feed;                         // Program units per minute, 0 if not set
+    float spindleSpeed;
+    short tool;                         // -1 if not set
+    char plane;                         // G17, G18, G19
+    char distance;                      // G90, G91
+    char feedMode;                      // G93, G94
+    char coordinateSystem;              // G54 - G59
+    char spindle;                       // M3, M4, M5
+    char coolant;
+    bool metric;
+    bool offsetsChanged;                // By G92 or G10 on previous lines
+
+    // Commands setting state and moving to line start
+    QStringList commands() const;
+};
+
+#endif // MODALSTATE_H
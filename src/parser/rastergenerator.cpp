@@ -0,0 +1,217 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <cmath>
+#include "rastergenerator.h"
+
+// Blank gaps inside row longer than this are passed by rapids, millimeters
+static const double maxBlankGap = 5;
+
+// Error diffusion weights, dx is mirrored on rows scanned backwards
+struct DiffusionWeight {
+    int dx;
+    int dy;
+    float weight;
+};
+
+static const DiffusionWeight floydSteinberg[] = {
+    {1, 0, 7 / 16.0f},
+    {-1, 1, 3 / 16.0f}, {0, 1, 5 / 16.0f}, {1, 1, 1 / 16.0f}
+};
+
+static const DiffusionWeight jarvis[] = {
+    {1, 0, 7 / 48.0f}, {2, 0, 5 / 48.0f},
+    {-2, 1, 3 / 48.0f}, {-1, 1, 5 / 48.0f}, {0, 1, 7 / 48.0f}, {1, 1, 5 / 48.0f}, {2, 1, 3 / 48.0f},
+    {-2, 2, 1 / 48.0f}, {-1, 2, 3 / 48.0f}, {0, 2, 5 / 48.0f}, {1, 2, 3 / 48.0f}, {2, 2, 1 / 48.0f}
+};
+
+// Error rows are padded to skip bounds checks
+static const int padding = 2;
+
+RasterGenerator::RasterGenerator()
+{
+    m_resolution = 254;
+    m_dithering = FloydSteinberg;
+    m_levels = 2;
+    m_powerMin = 0;
+    m_powerMax = 1000;
+    m_feed = 1000;
+    m_pixels = 0;
+    m_moves = 0;
+}
+
+void RasterGenerator::setImage(const QImage &image)
+{
+    m_image = image;
+}
+
+void RasterGenerator::setResolution(double dpi)
+{
+    m_resolution = dpi;
+}
+
+void RasterGenerator::setDithering(Dithering dithering)
+{
+    m_dithering = dithering;
+}
+
+void RasterGenerator::setLevels(int levels)
+{
+    m_levels = qBound(2, levels, 256);
+}
+
+void RasterGenerator::setPowerRange(int minimum, int maximum)
+{
+    m_powerMin = minimum;
+    m_powerMax = maximum;
+}
+
+void RasterGenerator::setFeed(double feed)
+{
+    m_feed = feed;
+}
+
+int RasterGenerator::pixels() const
+{
+    return m_pixels;
+}
+
+int RasterGenerator::moves() const
+{
+    return m_moves;
+}
+
+QStringList RasterGenerator::generate()
+{
+    QStringList commands;
+    QVector<uchar> levels = quantize();
+    int width = m_image.width();
+    int height = m_image.height();
+    double pitch = 25.4 / m_resolution;
+
+    m_pixels = 0;
+    m_moves = 0;
+
+    commands << "G21G90" << "M4S0";
+
+    bool forward = true;
+    bool feed = false;
+    int currentPower = 0;
+
+    // Bottom row first, at program origin
+    for (int y = height - 1; y >= 0; y--) {
+        const uchar *row = levels.constData() + y * width;
+        int first = 0;
+        int last = width - 1;
+
+        while (first < width && row[first] == 0) first++;
+        if (first == width) continue;
+        while (row[last] == 0) last--;
+
+        QString position = QString("Y%1").arg((height - 1 - y + 0.5) * pitch, 0, 'f', 3);
+        int step = forward ? 1 : -1;
+        int x = forward ? first : last;
+        int end = forward ? last + 1 : first - 1;
+
+        commands << QString("G0X%1").arg((forward ? first : last + 1) * pitch, 0, 'f', 3) + position;
+        bool rapid = true;
+
+        while (x != end) {
+            // Pixels of equal power
+            int runPower = row[x] == 0 ? 0 : power(row[x]);
+            int runLength = 0;
+
+            while (x != end && (row[x] == 0 ? 0 : power(row[x])) == runPower) {
+                if (row[x] != 0) m_pixels++;
+                runLength++;
+                x += step;
+            }
+
+            QString target = QString("X%1").arg((forward ? x : x + 1) * pitch, 0, 'f', 3);
+
+            if (runPower == 0 && runLength * pitch > maxBlankGap) {
+                commands << "G0" + target;
+                rapid = true;
+                continue;
+            }
+
+            QString command = rapid ? "G1" + target : target;
+            if (runPower != currentPower) command += QString("S%1").arg(runPower);
+            if (!feed) command += QString("F%1").arg(m_feed);
+
+            commands << command;
+            m_moves++;
+            currentPower = runPower;
+            feed = true;
+            rapid = false;
+        }
+
+        forward = !forward;
+    }
+
+    commands << "M5";
+
+    return commands;
+}
+
+// Darkness levels of pixels by rows, transparent pixels are blank
+QVector<uchar> RasterGenerator::quantize() const
+{
+    QImage image = m_image.convertToFormat(QImage::Format_ARGB32);
+    int width = image.width();
+    int height = image.height();
+    QVector<uchar> levels(width * height);
+
+    const DiffusionWeight *weights = NULL;
+    int weightCount = 0;
+
+    if (m_dithering == FloydSteinberg) {
+        weights = floydSteinberg;
+        weightCount = sizeof(floydSteinberg) / sizeof(DiffusionWeight);
+    } else if (m_dithering == Jarvis) {
+        weights = jarvis;
+        weightCount = sizeof(jarvis) / sizeof(DiffusionWeight);
+    }
+
+    // Errors of current and two next rows, ring indexed by row
+    QVector<float> errors[3];
+    for (int i = 0; i < 3; i++) errors[i].fill(0, width + 2 * padding);
+
+    int top = m_levels - 1;
+
+    for (int y = 0; y < height; y++) {
+        const QRgb *line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+        float *current = errors[y % 3].data() + padding;
+        float *next[3] = {current, errors[(y + 1) % 3].data() + padding, errors[(y + 2) % 3].data() + padding};
+        uchar *row = levels.data() + y * width;
+
+        // Serpentine order avoids drifting patterns
+        bool reverse = y % 2;
+        int mirror = reverse ? -1 : 1;
+
+        for (int i = 0; i < width; i++) {
+            int x = reverse ? width - 1 - i : i;
+            QRgb pixel = line[x];
+            float value = (255 - qGray(pixel)) * qAlpha(pixel) / (255.0f * 255.0f) + current[x];
+            int level = qBound(0, (int)floor(value * top + 0.5f), top);
+            float error = value - (float)level / top;
+
+            row[x] = level;
+
+            for (int j = 0; j < weightCount; j++) next[weights[j].dy][x + weights[j].dx * mirror] += error * weights[j].weight;
+        }
+
+        // Row is reused for third next one
+        errors[y % 3].fill(0);
+    }
+
+    return levels;
+}
+
+// Lightest burnt level goes at minimum power, on/off engraving at maximum one
+int RasterGenerator::power(int level) const
+{
+    if (m_levels == 2) return m_powerMax;
+
+    return qRound(m_powerMin + (double)(m_powerMax - m_powerMin) * (level - 1) / (m_levels - 2));
+}
@@ -0,0 +1,60 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef RASTERGENERATOR_H
+#define RASTERGENERATOR_H
+
+#include <QImage>
+#include <QStringList>
+#include <QVector>
+
+// Laser engraving program from image. Image is dithered or quantized to power levels,
+// rows are scanned both ways with M4 dynamic power, pixels of equal power are joined
+// into single moves and blank margins are skipped by rapids. Image bottom left corner
+// is at program origin.
+class RasterGenerator
+{
+public:
+    enum Dithering {
+        NoDithering,
+        FloydSteinberg,
+        Jarvis
+    };
+
+    RasterGenerator();
+
+    void setImage(const QImage &image);
+    void setResolution(double dpi);
+    void setDithering(Dithering dithering);
+
+    // Number of power levels including off one, 2 for on/off engraving, up to 256
+    void setLevels(int levels);
+
+    // S values of lightest and darkest levels
+    void setPowerRange(int minimum, int maximum);
+
+    // Millimeters per minute
+    void setFeed(double feed);
+
+    QStringList generate();
+
+    int pixels() const;                     // Engraved ones
+    int moves() const;
+
+private:
+    QImage m_image;
+    double m_resolution;
+    Dithering m_dithering;
+    int m_levels;
+    int m_powerMin;
+    int m_powerMax;
+    double m_feed;
+
+    int m_pixels;
+    int m_moves;
+
+    QVector<uchar> quantize() const;
+    int power(int level) const;
+};
+
+#endif // RASTERGENERATOR_H
@@ -0,0 +1,292 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QHash>
+#include <QtNumeric>
+#include <cmath>
+#include "retractoptimizer.h"
+
+// Grid is limited to this many cells, coarser ones are used for large programs
+static const int maxCells = 4000000;
+static const int maxSegmentPoints = 10000;
+
+RetractOptimizer::RetractOptimizer()
+{
+    m_stockTop = 0;
+    m_clearance = 0.5;
+    m_toolDiameter = 0;
+    m_surface = NULL;
+    m_retracts = 0;
+    m_loweredRetracts = 0;
+    m_zTravelBefore = 0;
+    m_zTravelAfter = 0;
+    m_cellSize = 1;
+    m_columns = 0;
+    m_rows = 0;
+}
+
+void RetractOptimizer::setStockTop(double z)
+{
+    m_stockTop = z;
+}
+
+void RetractOptimizer::setClearance(double clearance)
+{
+    m_clearance = clearance;
+}
+
+void RetractOptimizer::setToolDiameter(double diameter)
+{
+    m_toolDiameter = diameter;
+}
+
+void RetractOptimizer::setSurface(const HeightMapCompensator *surface)
+{
+    m_surface = surface;
+}
+
+void RetractOptimizer::addLine(const QString &command, const QStringList &args, int line)
+{
+    Line item;
+
+    item.command = command;
+    item.args = args;
+    item.line = line;
+
+    m_lines.append(item);
+}
+
+int RetractOptimizer::retracts() const
+{
+    return m_retracts;
+}
+
+int RetractOptimizer::loweredRetracts() const
+{
+    return m_loweredRetracts;
+}
+
+double RetractOptimizer::zTravelBefore() const
+{
+    return m_zTravelBefore;
+}
+
+double RetractOptimizer::zTravelAfter() const
+{
+    return m_zTravelAfter;
+}
+
+QStringList RetractOptimizer::optimize(const QList<LineSegment*> &segments)
+{
+    QStringList commands;
+
+    // Single segment of motion line, NULL for other lines
+    QVector<LineSegment*> lineSegments(m_lines.count(), NULL);
+    QHash<int, QList<LineSegment*> > numberSegments;
+    foreach (LineSegment *segment, segments) numberSegments[segment->getLineNumber()].append(segment);
+
+    int previous = -1;
+    for (int i = 0; i < m_lines.count(); i++) {
+        const Line &line = m_lines.at(i);
+        if (line.line != previous && numberSegments.value(line.line).count() == 1) lineSegments[i] = numberSegments.value(line.line).first();
+        previous = line.line;
+    }
+
+    buildGrid(segments);
+
+    m_retracts = 0;
+    m_loweredRetracts = 0;
+    m_zTravelBefore = 0;
+    m_zTravelAfter = 0;
+
+    int i = 0;
+    while (i < m_lines.count()) {
+        LineSegment *retract = lineSegments.at(i);
+
+        if (!retract || !isRapid(retract, m_lines.at(i).args, "Z") || retract->getEnd().z() <= retract->getStart().z()) {
+            commands << m_lines.at(i++).command;
+            continue;
+        }
+
+        // Rapids at retract height and comments up to descent
+        double height = retract->getEnd().z();
+        QList<int> travels;
+        int j = i + 1;
+
+        while (j < m_lines.count()) {
+            LineSegment *segment = lineSegments.at(j);
+
+            if (!segment && m_lines.at(j).args.isEmpty()) j++;
+            else if (segment && isRapid(segment, m_lines.at(j).args, "XYZ") && fabs(segment->getStart().z() - height) < 1e-4
+                     && fabs(segment->getEnd().z() - height) < 1e-4) travels << j++;
+            else break;
+        }
+
+        LineSegment *descent = j < m_lines.count() ? lineSegments.at(j) : NULL;
+
+        if (!descent || !isRapid(descent, m_lines.at(j).args, "Z") || fabs(descent->getStart().z() - height) > 1e-4
+                || descent->getEnd().z() >= height) {
+            commands << m_lines.at(i++).command;
+            continue;
+        }
+
+        QVector<QVector2D> path;
+        path.append(retract->getStart().toVector2D());
+        foreach (int travel, travels) path.append(lineSegments.at(travel)->getEnd().toVector2D());
+
+        double bottom = retract->getStart().z();
+        double target = descent->getEnd().z();
+        double lowered = qMax(pathHeight(path), qMax(bottom, target));
+
+        m_retracts++;
+        m_zTravelBefore += 2 * height - bottom - target;
+
+        if (lowered > height - 1e-3) {
+            m_zTravelAfter += 2 * height - bottom - target;
+            for (; i <= j; i++) commands << m_lines.at(i).command;
+            continue;
+        }
+
+        m_loweredRetracts++;
+        m_zTravelAfter += 2 * lowered - bottom - target;
+
+        bool metric = retract->isMetric();
+        int decimals = metric ? 3 : 4;
+        double scale = metric ? 1 : 25.4;
+
+        commands << numberWords(m_lines.at(i).args) + QString("G0Z%1").arg(lowered / scale, 0, 'f', decimals);
+
+        // Travels with Z words would go back up
+        for (i++; i < j; i++) {
+            const Line &line = m_lines.at(i);
+            bool z = false;
+
+            foreach (const QString &arg, line.args) if (arg.at(0).toUpper() == 'Z') z = true;
+
+            if (z) {
+                QVector3D end = lineSegments.at(i)->getEnd() / scale;
+                commands << numberWords(line.args) + QString("G0X%1Y%2").arg(end.x(), 0, 'f', decimals).arg(end.y(), 0, 'f', decimals);
+            } else {
+                commands << line.command;
+            }
+        }
+
+        commands << m_lines.at(j).command;
+        i = j + 1;
+    }
+
+    return commands;
+}
+
+void RetractOptimizer::buildGrid(const QList<LineSegment*> &segments)
+{
+    QVector2D minimum(qInf(), qInf());
+    QVector2D maximum(-qInf(), -qInf());
+
+    foreach (LineSegment *segment, segments) {
+        if (segment->isFastTraverse() || qIsNaN(segment->getStart().length()) || qIsNaN(segment->getEnd().length())) continue;
+
+        foreach (const QVector3D &point, QList<QVector3D>() << segment->getStart() << segment->getEnd()) {
+            minimum.setX(qMin(minimum.x(), point.x()));
+            minimum.setY(qMin(minimum.y(), point.y()));
+            maximum.setX(qMax(maximum.x(), point.x()));
+            maximum.setY(qMax(maximum.y(), point.y()));
+        }
+    }
+
+    m_cells.clear();
+    m_columns = 0;
+    m_rows = 0;
+
+    if (qIsInf(minimum.x())) return;
+
+    m_gridOrigin = minimum;
+    m_cellSize = qMax(1.0, m_toolDiameter / 2);
+
+    while ((maximum.x() - minimum.x()) / m_cellSize * (maximum.y() - minimum.y()) / m_cellSize > maxCells) m_cellSize *= 2;
+
+    m_columns = (int)((maximum.x() - minimum.x()) / m_cellSize) + 1;
+    m_rows = (int)((maximum.y() - minimum.y()) / m_cellSize) + 1;
+    m_cells.fill(-qInf(), m_columns * m_rows);
+
+    foreach (LineSegment *segment, segments) {
+        if (segment->isFastTraverse() || qIsNaN(segment->getStart().length()) || qIsNaN(segment->getEnd().length())) continue;
+
+        QVector3D start = segment->getStart();
+        QVector3D end = segment->getEnd();
+        int points = qBound(1, (int)ceil((end - start).toVector2D().length() / m_cellSize * 2), maxSegmentPoints);
+
+        for (int i = 0; i <= points; i++) {
+            QVector3D point = start + (end - start) * i / points;
+            int column = qBound(0, (int)((point.x() - m_gridOrigin.x()) / m_cellSize), m_columns - 1);
+            int row = qBound(0, (int)((point.y() - m_gridOrigin.y()) / m_cellSize), m_rows - 1);
+            float &cell = m_cells[row * m_columns + column];
+
+            cell = qMax(cell, point.z());
+        }
+    }
+}
+
+// Highest material or cut point under tool at given position, inf if unknown
+double RetractOptimizer::obstacle(const QVector2D &point) const
+{
+    double height = m_stockTop;
+
+    if (m_surface) {
+        if (!m_surface->border().contains(point.x(), point.y())) return qInf();
+        height += m_surface->height(point.x(), point.y());
+    }
+
+    if (m_cells.isEmpty()) return height;
+
+    // Cells touched by tool
+    double radius = m_toolDiameter / 2 + m_cellSize;
+    int left = qMax(0, (int)floor((point.x() - radius - m_gridOrigin.x()) / m_cellSize));
+    int right = qMin(m_columns - 1, (int)floor((point.x() + radius - m_gridOrigin.x()) / m_cellSize));
+    int bottom = qMax(0, (int)floor((point.y() - radius - m_gridOrigin.y()) / m_cellSize));
+    int top = qMin(m_rows - 1, (int)floor((point.y() + radius - m_gridOrigin.y()) / m_cellSize));
+
+    for (int row = bottom; row <= top; row++)
+        for (int column = left; column <= right; column++) height = qMax(height, (double)m_cells.at(row * m_columns + column));
+
+    return height;
+}
+
+double RetractOptimizer::pathHeight(const QVector<QVector2D> &path) const
+{
+    double height = obstacle(path.first());
+
+    for (int i = 1; i < path.count(); i++) {
+        int points = qBound(1, (int)ceil((path.at(i) - path.at(i - 1)).length() / m_cellSize * 2), maxSegmentPoints);
+        for (int j = 1; j <= points; j++) height = qMax(height, obstacle(path.at(i - 1) + (path.at(i) - path.at(i - 1)) * j / points));
+    }
+
+    return height + m_clearance;
+}
+
+// Single absolute rapid with given coordinate words only, Z ones move along Z only
+bool RetractOptimizer::isRapid(LineSegment *segment, const QStringList &args, const QString &letters)
+{
+    if (!segment->isFastTraverse() || segment->isArc() || !segment->isAbsolute()
+            || qIsNaN(segment->getStart().length()) || qIsNaN(segment->getEnd().length())) return false;
+
+    if (letters == "Z" && (segment->getEnd() - segment->getStart()).toVector2D().length() > 1e-4) return false;
+
+    foreach (const QString &arg, args) {
+        QChar letter = arg.at(0).toUpper();
+
+        if (letter == 'G' && arg.mid(1).toDouble() == 0) continue;
+        if (letter != 'N' && !letters.contains(letter)) return false;
+    }
+
+    return true;
+}
+
+QString RetractOptimizer::numberWords(const QStringList &args)
+{
+    QString words;
+
+    foreach (const QString &arg, args) if (arg.at(0).toUpper() == 'N') words += arg.toUpper();
+
+    return words;
+}
@@ -0,0 +1,73 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef RETRACTOPTIMIZER_H
+#define RETRACTOPTIMIZER_H
+
+#include <QStringList>
+#include <QVector>
+#include <QVector2D>
+#include "linesegment.h"
+#include "heightmapcompensator.h"
+
+// Lowers rapid retracts to the lowest safe height of following traverse. Traverse
+// is a Z-only rapid retract, rapids at retract height and a Z-only rapid descent.
+// Obstacles under traverse path are stock top and feed moves around it taken from
+// coarse grid of highest cut points.
+class RetractOptimizer
+{
+public:
+    RetractOptimizer();
+
+    // Millimeters
+    void setStockTop(double z);
+    void setClearance(double clearance);
+    void setToolDiameter(double diameter);
+
+    // Surface heights are added to stock top, traverses leaving heightmap are kept. NULL for flat stock.
+    void setSurface(const HeightMapCompensator *surface);
+
+    // Program lines in order, line is parser command number of segments
+    void addLine(const QString &command, const QStringList &args, int line);
+
+    QStringList optimize(const QList<LineSegment*> &segments);
+
+    int retracts() const;
+    int loweredRetracts() const;
+    double zTravelBefore() const;           // Millimeters
+    double zTravelAfter() const;
+
+private:
+    struct Line {
+        QString command;
+        QStringList args;
+        int line;
+    };
+
+    QList<Line> m_lines;
+    double m_stockTop;
+    double m_clearance;
+    double m_toolDiameter;
+    const HeightMapCompensator *m_surface;
+
+    int m_retracts;
+    int m_loweredRetracts;
+    double m_zTravelBefore;
+    double m_zTravelAfter;
+
+    // Highest feed move point of cells, -inf for empty ones
+    QVector2D m_gridOrigin;
+    double m_cellSize;
+    int m_columns;
+    int m_rows;
+    QVector<float> m_cells;
+
+    void buildGrid(const QList<LineSegment*> &segments);
+    double obstacle(const QVector2D &point) const;
+    double pathHeight(const QVector<QVector2D> &path) const;
+
+    static bool isRapid(LineSegment *segment, const QStringList &args, const QString &letters);
+    static QString numberWords(const QStringList &args);
+};
+
+#endif // RETRACTOPTIMIZER_H
@@ -0,0 +1,181 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QHash>
+#include <QPair>
+#include <QtNumeric>
+#include "toolpathsimplifier.h"
+
+ToolpathSimplifier::ToolpathSimplifier()
+{
+    m_tolerance = 0.01;
+    m_removedLines = 0;
+}
+
+void ToolpathSimplifier::setTolerance(double tolerance)
+{
+    m_tolerance = tolerance;
+}
+
+void ToolpathSimplifier::addLine(const QString &command, const QStringList &args, int line)
+{
+    Line item;
+
+    item.command = command;
+    item.args = args;
+    item.line = line;
+
+    m_lines.append(item);
+}
+
+int ToolpathSimplifier::removedLines() const
+{
+    return m_removedLines;
+}
+
+QStringList ToolpathSimplifier::simplify(const QList<LineSegment*> &segments)
+{
+    QStringList commands;
+
+    // Single segment of line, NULL for lines giving none or several ones
+    QHash<int, LineSegment*> lineSegments;
+    QHash<int, int> segmentCounts;
+
+    foreach (LineSegment *segment, segments) {
+        lineSegments.insert(segment->getLineNumber(), segment);
+        segmentCounts[segment->getLineNumber()]++;
+    }
+
+    m_removedLines = 0;
+
+    int i = 0;
+    while (i < m_lines.count()) {
+        // Collect run of candidate lines
+        int first = i;
+        LineSegment *firstSegment = NULL;
+
+        while (i < m_lines.count()) {
+            const Line &line = m_lines.at(i);
+            LineSegment *segment = segmentCounts.value(line.line) == 1 ? lineSegments.value(line.line) : NULL;
+
+            // Lines without own command number are kept between runs
+            if (i > 0 && m_lines.at(i - 1).line == line.line) break;
+
+            if (!segment || !isPlainMove(line.args) || segment->isArc() || segment->isFastTraverse()
+                    || segment->isZMovement() || !segment->isAbsolute() || qIsNaN(segment->getEnd().length())) break;
+
+            if (!firstSegment) firstSegment = segment;
+            else if (segment->getSpeed() != firstSegment->getSpeed() || segment->isMetric() != firstSegment->isMetric()) break;
+
+            i++;
+        }
+
+        if (i - first < 2) {
+            // Not a run, line is kept
+            if (i == first) i++;
+            for (int j = first; j < i; j++) commands << m_lines.at(j).command;
+            continue;
+        }
+
+        QVector<QVector3D> points;
+        points.append(firstSegment->getStart());
+        for (int j = first; j < i; j++) points.append(lineSegments.value(m_lines.at(j).line)->getEnd());
+
+        QVector<bool> keep = reduce(points);
+
+        // Lines after removed ones get all coordinates and carried feed word
+        bool removed = false;
+        QString feed;
+
+        for (int j = first; j < i; j++) {
+            const Line &line = m_lines.at(j);
+            QString lineFeed = feedWord(line.args);
+
+            if (!lineFeed.isEmpty()) feed = lineFeed;
+
+            if (!keep.at(j - first + 1)) {
+                removed = true;
+                m_removedLines++;
+                continue;
+            }
+
+            if (removed) commands << moveCommand(lineSegments.value(line.line)) + feed;
+            else commands << line.command;
+
+            removed = false;
+            feed.clear();
+        }
+    }
+
+    return commands;
+}
+
+// Linear feed move with coordinates and feed only
+bool ToolpathSimplifier::isPlainMove(const QStringList &args)
+{
+    foreach (const QString &arg, args) {
+        char letter = arg.at(0).toUpper().toLatin1();
+
+        if (letter == 'G' && arg.mid(1).toDouble() == 1) continue;
+        if (letter != 'X' && letter != 'Y' && letter != 'Z' && letter != 'F' && letter != 'N') return false;
+    }
+
+    return true;
+}
+
+QString ToolpathSimplifier::feedWord(const QStringList &args)
+{
+    foreach (const QString &arg, args) if (arg.at(0).toUpper() == 'F') return arg.toUpper();
+
+    return QString();
+}
+
+QString ToolpathSimplifier::moveCommand(LineSegment *segment)
+{
+    QVector3D point = segment->getEnd();
+    int decimals = segment->isMetric() ? 3 : 4;
+
+    if (!segment->isMetric()) point /= 25.4;
+
+    return QString("G1X%1Y%2Z%3").arg(point.x(), 0, 'f', decimals).arg(point.y(), 0, 'f', decimals)
+            .arg(point.z(), 0, 'f', decimals);
+}
+
+// Douglas-Peucker, iterative for long runs. End points are always kept.
+QVector<bool> ToolpathSimplifier::reduce(const QVector<QVector3D> &points) const
+{
+    QVector<bool> keep(points.count(), false);
+    QList<QPair<int, int> > stack;
+
+    keep[0] = true;
+    keep[points.count() - 1] = true;
+    stack.append(qMakePair(0, points.count() - 1));
+
+    while (!stack.isEmpty()) {
+        QPair<int, int> range = stack.takeLast();
+        const QVector3D &a = points.at(range.first);
+        QVector3D ab = points.at(range.second) - a;
+        double lengthSquared = ab.lengthSquared();
+        double maxDistance = 0;
+        int farthest = -1;
+
+        for (int i = range.first + 1; i < range.second; i++) {
+            QVector3D ap = points.at(i) - a;
+            double t = lengthSquared > 0 ? qBound(0.0, (double)QVector3D::dotProduct(ap, ab) / lengthSquared, 1.0) : 0;
+            double distance = (ap - ab * t).length();
+
+            if (distance > maxDistance) {
+                maxDistance = distance;
+                farthest = i;
+            }
+        }
+
+        if (farthest != -1 && maxDistance > m_tolerance) {
+            keep[farthest] = true;
+            stack.append(qMakePair(range.first, farthest));
+            stack.append(qMakePair(farthest, range.second));
+        }
+    }
+
+    return keep;
+}
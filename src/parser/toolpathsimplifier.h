@@ -0,0 +1,48 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef TOOLPATHSIMPLIFIER_H
+#define TOOLPATHSIMPLIFIER_H
+
+#include <QStringList>
+#include <QVector>
+#include "linesegment.h"
+
+// Removes nearly collinear short moves. Runs of consecutive linear feed moves with
+// the same feed and no other words are simplified by Douglas-Peucker algorithm, so
+// path stays within tolerance. Rapid, arc and Z-only moves and lines setting
+// spindle or other modes are kept as they are.
+class ToolpathSimplifier
+{
+public:
+    ToolpathSimplifier();
+
+    // Millimeters
+    void setTolerance(double tolerance);
+
+    // Program lines in order, line is parser command number of segments
+    void addLine(const QString &command, const QStringList &args, int line);
+
+    QStringList simplify(const QList<LineSegment*> &segments);
+    int removedLines() const;
+
+    // Also used by arc fitting for the same runs
+    static bool isPlainMove(const QStringList &args);
+    static QString feedWord(const QStringList &args);
+    static QString moveCommand(LineSegment *segment);
+
+private:
+    struct Line {
+        QString command;
+        QStringList args;
+        int line;
+    };
+
+    QList<Line> m_lines;
+    double m_tolerance;
+    int m_removedLines;
+
+    QVector<bool> reduce(const QVector<QVector3D> &points) const;
+};
+
+#endif // TOOLPATHSIMPLIFIER_H
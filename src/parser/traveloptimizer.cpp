@@ -0,0 +1,616 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QElapsedTimer>
+#include <QtNumeric>
+#include <cmath>
+#include "gcodepreprocessorutils.h"
+#include "toolpathsimplifier.h"
+#include "traveloptimizer.h"
+
+// Improvement passes stop on time for very long programs
+static const int maxPasses = 50;
+static const int maxTime = 5000;
+
+static inline double distance(const QVector2D &a, const QVector2D &b)
+{
+    return (a - b).length();
+}
+
+// Only G0/G1 with coordinates, except of given letters
+static bool hasOnly(const QStringList &args, const QString &letters)
+{
+    foreach (const QString &arg, args) {
+        QChar letter = arg.at(0).toUpper();
+
+        if (letter == 'G' && arg.mid(1).toDouble() <= 1) continue;
+        if (!letters.contains(letter)) return false;
+    }
+
+    return true;
+}
+
+static bool hasLetter(const QStringList &args, char letter)
+{
+    foreach (const QString &arg, args) if (arg.at(0).toUpper() == letter) return true;
+
+    return false;
+}
+
+TravelOptimizer::TravelOptimizer()
+{
+    m_safeHeight = qQNaN();
+    m_changeEntries = false;
+    m_islands = 0;
+    m_movedIslands = 0;
+    m_flexibleIslands = 0;
+    m_travelBefore = 0;
+    m_travelAfter = 0;
+}
+
+void TravelOptimizer::setSafeHeight(double height)
+{
+    m_safeHeight = height;
+}
+
+void TravelOptimizer::setChangeEntries(bool change)
+{
+    m_changeEntries = change;
+}
+
+double TravelOptimizer::findSafeHeight(const QList<LineSegment*> &segments)
+{
+    double maxFeedZ = -qInf();
+    double height = qInf();
+
+    foreach (LineSegment *segment, segments) {
+        if (segment->isFastTraverse()) continue;
+        if (!qIsNaN(segment->getStart().z())) maxFeedZ = qMax(maxFeedZ, (double)segment->getStart().z());
+        if (!qIsNaN(segment->getEnd().z())) maxFeedZ = qMax(maxFeedZ, (double)segment->getEnd().z());
+    }
+
+    foreach (LineSegment *segment, segments) {
+        if (segment->isFastTraverse() && segment->isZMovement() && segment->getEnd().z() > segment->getStart().z()
+                && segment->getEnd().z() >= maxFeedZ) height = qMin(height, (double)segment->getEnd().z());
+    }
+
+    return qIsInf(height) ? qQNaN() : height;
+}
+
+void TravelOptimizer::addLine(const QString &command, const QStringList &args, int line, const ModalState &modal)
+{
+    Line item;
+
+    item.command = command;
+    item.args = args;
+    item.line = line;
+    item.modal = modal;
+
+    m_lines.append(item);
+}
+
+int TravelOptimizer::islands() const
+{
+    return m_islands;
+}
+
+int TravelOptimizer::movedIslands() const
+{
+    return m_movedIslands;
+}
+
+int TravelOptimizer::flexibleIslands() const
+{
+    return m_flexibleIslands;
+}
+
+double TravelOptimizer::travelBefore() const
+{
+    return m_travelBefore;
+}
+
+double TravelOptimizer::travelAfter() const
+{
+    return m_travelAfter;
+}
+
+QStringList TravelOptimizer::optimize(const QList<LineSegment*> &segments)
+{
+    enum Kind { Fixed, Link, Comment, IslandLine };
+
+    QStringList commands;
+    int count = m_lines.count();
+
+    m_islands = 0;
+    m_movedIslands = 0;
+    m_flexibleIslands = 0;
+    m_travelBefore = 0;
+    m_travelAfter = 0;
+
+    // Segments of lines, motion lines get new command number
+    QHash<int, QList<LineSegment*> > lineSegments;
+    foreach (LineSegment *segment, segments) lineSegments[segment->getLineNumber()].append(segment);
+
+    QVector<QVector3D> positions(count + 1);    // Before line
+    QVector<bool> motion(count);
+    QVector3D position(qQNaN(), qQNaN(), qQNaN());
+    int previous = -1;
+
+    for (int i = 0; i < count; i++) {
+        positions[i] = position;
+        motion[i] = m_lines.at(i).line != previous && lineSegments.contains(m_lines.at(i).line);
+        previous = m_lines.at(i).line;
+        if (motion.at(i)) position = lineSegments.value(m_lines.at(i).line).last()->getEnd();
+    }
+    positions[count] = position;
+
+    // Islands go from leaving safe height to returning to it
+    QVector<int> kinds(count, Fixed);
+    QHash<int, Island> islands;                 // By first line
+
+    for (int i = 0; i < count; i++) {
+        const Line &line = m_lines.at(i);
+
+        if (line.args.isEmpty()) {
+            kinds[i] = Comment;
+        } else if (motion.at(i) && isSafe(positions.at(i)) && !isSafe(positions.at(i + 1))) {
+            int last = i;
+            while (last < count && !isSafe(positions.at(last + 1))) last++;
+            if (last == count) break;
+
+            Island island;
+            island.first = i;
+            island.last = last;
+            island.entry = positions.at(i).toVector2D();
+            island.exit = positions.at(last + 1).toVector2D();
+            island.orientation = 0;
+            island.vertex = 0;
+            findChain(island, positions, motion, lineSegments);
+
+            if (isMovable(island)) {
+                for (int j = i; j <= last; j++) kinds[j] = IslandLine;
+                islands.insert(i, island);
+                if (island.open || island.closed) m_flexibleIslands++;
+            }
+            i = last;
+        } else if (line.modal.distance == 90 && isSafe(positions.at(i)) && isSafe(positions.at(i + 1)) && hasOnly(line.args, "XYZN")) {
+            bool linear = true;
+            if (motion.at(i)) foreach (LineSegment *segment, lineSegments.value(line.line)) if (segment->isArc()) linear = false;
+            if (linear) kinds[i] = Link;
+        }
+    }
+
+    int i = 0;
+    while (i < count) {
+        if (kinds.at(i) == Fixed) {
+            commands << m_lines.at(i).command;
+            i++;
+            continue;
+        }
+
+        // Group of islands with travel between them
+        int end = i;
+        QList<Island> group;
+        QList<int> comments;
+        int trailing = i;
+
+        while (end < count && kinds.at(end) != Fixed) {
+            if (kinds.at(end) == Comment) comments << end;
+            if (kinds.at(end) == IslandLine) {
+                Island island = islands.value(end);
+                island.index = group.count();
+                island.comments = comments;
+                comments.clear();
+                group << island;
+                end = island.last;
+                trailing = end + 1;
+            }
+            end++;
+        }
+
+        QVector2D start = positions.at(i).toVector2D();
+        int from = i;
+
+        // Unknown start, first island stays first
+        if (!group.isEmpty() && (qIsNaN(start.x()) || qIsNaN(start.y()))) {
+            for (int j = i; j <= group.first().last; j++) commands << m_lines.at(j).command;
+            from = group.first().last + 1;
+            start = group.first().exit;
+            group.removeFirst();
+            for (int j = 0; j < group.count(); j++) group[j].index = j;
+        }
+
+        if (group.count() < 2) {
+            for (int j = from; j < end; j++) commands << m_lines.at(j).command;
+            i = end;
+            continue;
+        }
+
+        m_islands += group.count();
+        m_travelBefore += travel(group, start);
+
+        bool metric = m_lines.at(group.first().first).modal.metric;
+        QVector2D groupEnd = group.last().exit;
+        ModalState stream = m_lines.at(from).modal;
+        QVector2D point = start;
+
+        order(group, start);
+        rotate(group, start);
+
+        m_travelAfter += travel(group, start);
+
+        for (int j = 0; j < group.count(); j++) {
+            const Island &island = group.at(j);
+            QVector2D target = entry(island, island.orientation, island.vertex);
+
+            if (island.index != j || island.orientation || island.vertex) m_movedIslands++;
+
+            foreach (int comment, island.comments) commands << m_lines.at(comment).command;
+
+            if (distance(point, target) > 1e-4) {
+                commands << travelCommand(target, metric);
+                stream.motion = 0;
+            }
+
+            QString modes = modesCommand(stream, m_lines.at(island.first).modal);
+            if (!modes.isEmpty()) commands << modes;
+
+            emitIsland(island, commands);
+
+            stream = m_lines.at(island.last + 1).modal;
+            point = exit(island, island.orientation, island.vertex);
+        }
+
+        // Next lines start from the same point and state as in original program
+        const Line &next = m_lines.at(trailing);
+        bool positioned = next.modal.distance == 90 && hasOnly(next.args, "XYZFN") && hasLetter(next.args, 'X')
+                && hasLetter(next.args, 'Y');
+
+        if (!positioned && distance(point, groupEnd) > 1e-4) {
+            commands << travelCommand(groupEnd, metric);
+            stream.motion = 0;
+            m_travelAfter += distance(point, groupEnd);
+        }
+
+        QString modes = modesCommand(stream, next.modal);
+        if (!modes.isEmpty()) commands << modes;
+
+        for (int j = trailing; j < end; j++) commands << m_lines.at(j).command;
+        i = end;
+    }
+
+    return commands;
+}
+
+bool TravelOptimizer::isSafe(const QVector3D &point) const
+{
+    return !qIsNaN(point.z()) && point.z() >= m_safeHeight - 1e-3;
+}
+
+// Island doesn't change setup and has no commands tied to its place in program
+bool TravelOptimizer::isMovable(const Island &island) const
+{
+    static const QList<float> gCodes = QList<float>() << 0 << 1 << 2 << 3 << 4 << 17 << 18 << 19 << 40 << 61
+                                                      << 90 << 91.1f << 93 << 94;
+    static const QList<float> mCodes = QList<float>() << 3 << 4 << 5 << 7 << 8 << 9;
+
+    if (island.last + 1 >= m_lines.count()) return false;
+
+    for (int i = island.first; i <= island.last; i++) {
+        const QStringList &args = m_lines.at(i).args;
+
+        // Travel is written in absolute coordinates
+        if (m_lines.at(i).modal.distance != 90) return false;
+
+        if (hasLetter(args, 'T')) return false;
+        foreach (float code, GcodePreprocessorUtils::parseCodes(args, 'G')) if (!gCodes.contains(code)) return false;
+        foreach (float code, GcodePreprocessorUtils::parseCodes(args, 'M')) if (!mCodes.contains(code)) return false;
+    }
+
+    return sameSetup(m_lines.at(island.first).modal, m_lines.at(island.last + 1).modal);
+}
+
+// Z-only descent, flat chain of linear feed moves, Z-only ascent
+void TravelOptimizer::findChain(Island &island, const QVector<QVector3D> &positions, const QVector<bool> &motion,
+                                const QHash<int, QList<LineSegment*> > &lineSegments) const
+{
+    island.open = false;
+    island.closed = false;
+
+    int i = island.first;
+
+    for (int step = 0; step < 3; step++) {
+        int start = i;
+
+        while (i <= island.last) {
+            const Line &line = m_lines.at(i);
+            if (!motion.at(i) || lineSegments.value(line.line).count() != 1) break;
+
+            LineSegment *segment = lineSegments.value(line.line).first();
+            if (segment->isArc() || !segment->isAbsolute()) break;
+
+            if (step == 1) {
+                if (!ToolpathSimplifier::isPlainMove(line.args) || segment->isFastTraverse() || segment->isZMovement()
+                        || fabs(segment->getEnd().z() - positions.at(start).z()) > 1e-4) break;
+            } else if (!segment->isZMovement() || !hasOnly(line.args, "ZFN")) {
+                break;
+            }
+            i++;
+        }
+
+        if (i == start) return;
+        if (step == 0) island.chainFirst = i;
+        if (step == 1) island.chainLast = i - 1;
+    }
+
+    if (i <= island.last) return;
+
+    island.chain.clear();
+    for (int j = island.chainFirst; j <= island.chainLast + 1; j++) island.chain.append(positions.at(j));
+
+    island.chainFeed = m_lines.at(island.chainFirst + 1).modal.feed;
+    if (island.chainFeed <= 0 || m_lines.at(island.chainLast + 1).modal.feed != island.chainFeed) return;
+
+    if (island.chain.count() > 3 && distance(island.chain.first().toVector2D(), island.chain.last().toVector2D()) < 1e-3) {
+        island.closed = true;
+    } else {
+        island.open = true;
+    }
+}
+
+// Nearest neighbour, then 2-opt, Or-opt and single flips while travel gets shorter
+void TravelOptimizer::order(QList<Island> &islands, const QVector2D &start) const
+{
+    QList<Island> rest = islands;
+    QVector2D point = start;
+
+    islands.clear();
+
+    while (!rest.isEmpty()) {
+        int best = 0;
+        int bestOrientation = 0;
+        double bestDistance = qInf();
+
+        for (int i = 0; i < rest.count(); i++) {
+            for (int orientation = 0; orientation <= flipped(rest.at(i)); orientation++) {
+                double d = distance(point, entry(rest.at(i), orientation, 0));
+                if (d < bestDistance) {
+                    bestDistance = d;
+                    best = i;
+                    bestOrientation = orientation;
+                }
+            }
+        }
+
+        Island island = rest.takeAt(best);
+        island.orientation = bestOrientation;
+        point = exit(island, island.orientation, 0);
+        islands << island;
+    }
+
+    int count = islands.count();
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int pass = 0; pass < maxPasses && timer.elapsed() < maxTime; pass++) {
+        bool improved = false;
+
+        // 2-opt: reversed part goes in backward order, flexible islands are flipped
+        for (int i = 0; i < count - 1; i++) {
+            QVector2D previous = i == 0 ? start : exit(islands.at(i - 1), islands.at(i - 1).orientation, 0);
+            double forward = 0;
+            double backward = 0;
+
+            for (int j = i + 1; j < count; j++) {
+                const Island &a = islands.at(j - 1);
+                const Island &b = islands.at(j);
+
+                forward += distance(exit(a, a.orientation, 0), entry(b, b.orientation, 0));
+                backward += distance(exit(b, b.orientation ^ flipped(b), 0), entry(a, a.orientation ^ flipped(a), 0));
+
+                const Island &first = islands.at(i);
+                double before = distance(previous, entry(first, first.orientation, 0)) + forward;
+                double after = distance(previous, entry(b, b.orientation ^ flipped(b), 0)) + backward;
+
+                if (j + 1 < count) {
+                    QVector2D next = entry(islands.at(j + 1), islands.at(j + 1).orientation, 0);
+                    before += distance(exit(b, b.orientation, 0), next);
+                    after += distance(exit(first, first.orientation ^ flipped(first), 0), next);
+                }
+
+                if (after < before - 1e-6) {
+                    for (int k = 0; k < (j - i + 1) / 2; k++) islands.swap(i + k, j - k);
+                    for (int k = i; k <= j; k++) islands[k].orientation ^= flipped(islands.at(k));
+                    improved = true;
+                    break;
+                }
+            }
+        }
+
+        // Or-opt: chains of up to 3 islands are moved to other place
+        for (int length = 1; length <= 3; length++) {
+            for (int i = 0; i + length <= count; i++) {
+                const Island &head = islands.at(i);
+                const Island &tail = islands.at(i + length - 1);
+                QVector2D headEntry = entry(head, head.orientation, 0);
+                QVector2D tailExit = exit(tail, tail.orientation, 0);
+                QVector2D previous = i == 0 ? start : exit(islands.at(i - 1), islands.at(i - 1).orientation, 0);
+                double gain = distance(previous, headEntry);
+
+                if (i + length < count) {
+                    QVector2D next = entry(islands.at(i + length), islands.at(i + length).orientation, 0);
+                    gain += distance(tailExit, next) - distance(previous, next);
+                }
+
+                QList<Island> moved = islands.mid(i, length);
+                QList<Island> others = islands.mid(0, i) + islands.mid(i + length);
+                int bestGap = -1;
+                double bestCost = gain - 1e-6;
+
+                for (int gap = 0; gap <= others.count(); gap++) {
+                    if (gap == i) continue;
+
+                    QVector2D before = gap == 0 ? start : exit(others.at(gap - 1), others.at(gap - 1).orientation, 0);
+                    double cost = distance(before, headEntry);
+
+                    if (gap < others.count()) {
+                        QVector2D after = entry(others.at(gap), others.at(gap).orientation, 0);
+                        cost += distance(tailExit, after) - distance(before, after);
+                    }
+
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestGap = gap;
+                    }
+                }
+
+                if (bestGap != -1) {
+                    for (int k = 0; k < moved.count(); k++) others.insert(bestGap + k, moved.at(k));
+                    islands = others;
+                    improved = true;
+                }
+            }
+        }
+
+        // Single flips
+        for (int i = 0; i < count; i++) {
+            Island &island = islands[i];
+            if (!flipped(island)) continue;
+
+            QVector2D previous = i == 0 ? start : exit(islands.at(i - 1), islands.at(i - 1).orientation, 0);
+            double before = distance(previous, entry(island, island.orientation, 0));
+            double after = distance(previous, entry(island, island.orientation ^ 1, 0));
+
+            if (i + 1 < count) {
+                QVector2D next = entry(islands.at(i + 1), islands.at(i + 1).orientation, 0);
+                before += distance(exit(island, island.orientation, 0), next);
+                after += distance(exit(island, island.orientation ^ 1, 0), next);
+            }
+
+            if (after < before - 1e-6) {
+                island.orientation ^= 1;
+                improved = true;
+            }
+        }
+
+        if (!improved) break;
+    }
+}
+
+// Closed cuts start at vertex nearest to neighbours
+void TravelOptimizer::rotate(QList<Island> &islands, const QVector2D &start) const
+{
+    if (!m_changeEntries) return;
+
+    for (int i = 0; i < islands.count(); i++) {
+        Island &island = islands[i];
+        if (!island.closed) continue;
+
+        QVector2D previous = i == 0 ? start : exit(islands.at(i - 1), islands.at(i - 1).orientation, islands.at(i - 1).vertex);
+        double bestDistance = qInf();
+
+        for (int vertex = 0; vertex < island.chain.count() - 1; vertex++) {
+            QVector2D point = island.chain.at(vertex).toVector2D();
+            double d = distance(previous, point);
+
+            if (i + 1 < islands.count()) d += distance(point, entry(islands.at(i + 1), islands.at(i + 1).orientation, islands.at(i + 1).vertex));
+
+            if (d < bestDistance - 1e-6) {
+                bestDistance = d;
+                island.vertex = vertex;
+            }
+        }
+    }
+}
+
+int TravelOptimizer::flipped(const Island &island) const
+{
+    return m_changeEntries && island.open ? 1 : 0;
+}
+
+QVector2D TravelOptimizer::entry(const Island &island, int orientation, int vertex)
+{
+    if (island.closed && vertex) return island.chain.at(vertex).toVector2D();
+
+    return orientation ? island.chain.last().toVector2D() : island.entry;
+}
+
+QVector2D TravelOptimizer::exit(const Island &island, int orientation, int vertex)
+{
+    if (island.closed && vertex) return island.chain.at(vertex).toVector2D();
+
+    return orientation ? island.chain.first().toVector2D() : island.exit;
+}
+
+double TravelOptimizer::travel(const QList<Island> &islands, const QVector2D &start)
+{
+    QVector2D point = start;
+    double length = 0;
+
+    foreach (const Island &island, islands) {
+        length += distance(point, entry(island, island.orientation, island.vertex));
+        point = exit(island, island.orientation, island.vertex);
+    }
+
+    return length;
+}
+
+void TravelOptimizer::emitIsland(const Island &island, QStringList &commands) const
+{
+    if (!island.orientation && !island.vertex) {
+        for (int i = island.first; i <= island.last; i++) commands << m_lines.at(i).command;
+        return;
+    }
+
+    bool metric = m_lines.at(island.first).modal.metric;
+    QVector<QVector3D> points;
+    int last = island.chain.count() - 1;
+
+    if (island.orientation) {
+        for (int i = last - 1; i >= 0; i--) points << island.chain.at(i);
+    } else {
+        for (int i = island.vertex + 1; i <= last; i++) points << island.chain.at(i);
+        for (int i = 1; i <= island.vertex; i++) points << island.chain.at(i);
+    }
+
+    for (int i = island.first; i < island.chainFirst; i++) commands << m_lines.at(i).command;
+    for (int i = 0; i < points.count(); i++) {
+        commands << pointCommand(points.at(i), metric) + (i == 0 ? "F" + QString::number(island.chainFeed) : QString());
+    }
+    for (int i = island.chainLast + 1; i <= island.last; i++) commands << m_lines.at(i).command;
+}
+
+QString TravelOptimizer::travelCommand(const QVector2D &point, bool metric)
+{
+    QVector2D target = metric ? point : point / 25.4;
+    int decimals = metric ? 3 : 4;
+
+    return QString("G0X%1Y%2").arg(target.x(), 0, 'f', decimals).arg(target.y(), 0, 'f', decimals);
+}
+
+QString TravelOptimizer::pointCommand(const QVector3D &point, bool metric)
+{
+    QVector3D target = metric ? point : point / 25.4;
+    int decimals = metric ? 3 : 4;
+
+    return QString("G1X%1Y%2Z%3").arg(target.x(), 0, 'f', decimals).arg(target.y(), 0, 'f', decimals)
+            .arg(target.z(), 0, 'f', decimals);
+}
+
+// Motion mode and feed of original program at this place
+QString TravelOptimizer::modesCommand(const ModalState &from, const ModalState &to)
+{
+    QString command;
+
+    if (to.motion >= 0 && to.motion <= 3 && to.motion != from.motion) command += QString("G%1").arg((int)to.motion);
+    if (to.feed > 0 && to.feed != from.feed) command += QString("F%1").arg(to.feed);
+
+    return command;
+}
+
+bool TravelOptimizer::sameSetup(const ModalState &a, const ModalState &b)
+{
+    return a.tool == b.tool && a.spindle == b.spindle && a.spindleSpeed == b.spindleSpeed && a.coolant == b.coolant
+            && a.plane == b.plane && a.distance == b.distance && a.coordinateSystem == b.coordinateSystem
+            && a.feedMode == b.feedMode && a.metric == b.metric;
+}
@@ -0,0 +1,100 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef TRAVELOPTIMIZER_H
+#define TRAVELOPTIMIZER_H
+
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+#include <QVector2D>
+#include "linesegment.h"
+#include "modalstate.h"
+
+// Reorders cutting islands to shorten rapid travel. Island is a part of program
+// from leaving safe height to returning to it. Islands separated by travel only
+// are reordered by nearest neighbour and improved by 2-opt and Or-opt, lines
+// changing tool, spindle or other setup aren't crossed. Flat simple cuts may be
+// entered from other end (open ones) or other vertex (closed ones).
+class TravelOptimizer
+{
+public:
+    TravelOptimizer();
+
+    // Millimeters, travel at or above it is free of material
+    void setSafeHeight(double height);
+    void setChangeEntries(bool change);
+
+    // Lowest rapid retract above all feed moves, NaN if none
+    static double findSafeHeight(const QList<LineSegment*> &segments);
+
+    // Program lines in order, line is parser command number of segments, modal is state at line start
+    void addLine(const QString &command, const QStringList &args, int line, const ModalState &modal);
+
+    QStringList optimize(const QList<LineSegment*> &segments);
+
+    int islands() const;
+    int movedIslands() const;
+    int flexibleIslands() const;            // Ones which can change entry
+    double travelBefore() const;            // Millimeters
+    double travelAfter() const;
+
+    // Motion mode and feed words setting state "to" after state "from", also used by air move conversion
+    static QString modesCommand(const ModalState &from, const ModalState &to);
+
+private:
+    struct Line {
+        QString command;
+        QStringList args;
+        int line;
+        ModalState modal;
+    };
+
+    struct Island {
+        int index;                          // In original order
+        int first;                          // Line indexes
+        int last;
+        QList<int> comments;                // Comment lines before island, moved with it
+        QVector2D entry;
+        QVector2D exit;
+
+        // Flat simple cut between Z-only descent and ascent
+        bool open;
+        bool closed;
+        int chainFirst;
+        int chainLast;
+        QVector<QVector3D> chain;           // Points, first one is end of descent
+        double chainFeed;
+
+        int orientation;                    // 1 for open cut entered from end
+        int vertex;                         // Entry vertex of closed cut
+    };
+
+    QList<Line> m_lines;
+    double m_safeHeight;
+    bool m_changeEntries;
+    int m_islands;
+    int m_movedIslands;
+    int m_flexibleIslands;
+    double m_travelBefore;
+    double m_travelAfter;
+
+    bool isSafe(const QVector3D &point) const;
+    bool isMovable(const Island &island) const;
+    void findChain(Island &island, const QVector<QVector3D> &positions, const QVector<bool> &motion,
+                   const QHash<int, QList<LineSegment*> > &lineSegments) const;
+
+    void order(QList<Island> &islands, const QVector2D &start) const;
+    void rotate(QList<Island> &islands, const QVector2D &start) const;
+    int flipped(const Island &island) const;
+    static QVector2D entry(const Island &island, int orientation, int vertex);
+    static QVector2D exit(const Island &island, int orientation, int vertex);
+    static double travel(const QList<Island> &islands, const QVector2D &start);
+
+    void emitIsland(const Island &island, QStringList &commands) const;
+    static QString travelCommand(const QVector2D &point, bool metric);
+    static QString pointCommand(const QVector3D &point, bool metric);
+    static bool sameSetup(const ModalState &a, const ModalState &b);
+};
+
+#endif // TRAVELOPTIMIZER_H
@@ -0,0 +1,269 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QJsonDocument>
+#include <QJsonArray>
+#include "controlserver.h"
+
+// Same order as machine state statuses, not translated
+static const char *statusNames[] = {"Unknown", "Idle", "Alarm", "Run", "Home", "Hold", "Queue", "Check", "Door",
+                                    "Jog", "Sleep"};
+
+static QJsonArray vector(const double *values)
+{
+    QJsonArray array;
+    for (int i = 0; i < 3; i++) array.append(values[i]);
+
+    return array;
+}
+
+ControlServer::ControlServer(QObject *parent) : QObject(parent)
+{
+    m_nextClient = 1;
+
+    m_timerBroadcast.setInterval(MinInterval);
+    m_clock.start();
+
+    connect(&m_server, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+    connect(&m_timerBroadcast, SIGNAL(timeout()), this, SLOT(onTimerBroadcast()));
+}
+
+bool ControlServer::listen(const QString &name)
+{
+    close();
+
+    // Socket file of crashed instance is left behind
+    QLocalServer::removeServer(name);
+
+    // Machine is controlled by same user only
+    m_server.setSocketOptions(QLocalServer::UserAccessOption);
+
+    return m_server.listen(name);
+}
+
+void ControlServer::close()
+{
+    foreach (const Client &client, m_clients) {
+        client.socket->disconnect(this);
+        client.socket->abort();
+        client.socket->deleteLater();
+    }
+
+    m_clients.clear();
+    m_server.close();
+    updateTimer();
+}
+
+bool ControlServer::isListening() const
+{
+    return m_server.isListening();
+}
+
+QString ControlServer::serverName() const
+{
+    return m_server.serverName();
+}
+
+QString ControlServer::errorString() const
+{
+    return m_server.errorString();
+}
+
+void ControlServer::setState(const MachineState &state, const Job &job)
+{
+    QJsonObject object;
+    QJsonObject jobObject;
+
+    int status = state.status >= MachineState::Unknown && state.status <= MachineState::Sleep
+            ? state.status : MachineState::Unknown;
+
+    jobObject["file"] = job.fileName;
+    jobObject["processing"] = job.processing;
+    jobObject["line"] = job.processedLines;
+    jobObject["lines"] = job.totalLines;
+    jobObject["elapsed"] = job.elapsed;
+
+    object["event"] = QString("state");
+    object["status"] = QString(statusNames[status]);
+    object["mpos"] = vector(state.machinePosition);
+    object["wpos"] = vector(state.workPosition);
+    object["feed"] = state.feed;
+    object["spindle"] = state.spindleSpeed;
+    object["overrides"] = QJsonArray() << state.feedOverride << state.rapidOverride << state.spindleOverride;
+    object["planner"] = state.plannerBlocks;
+    object["rx"] = state.rxBytes;
+    object["pins"] = state.pins;
+    object["job"] = jobObject;
+
+    m_state = QJsonDocument(object).toJson(QJsonDocument::Compact) + '\n';
+}
+
+void ControlServer::setMetrics(const StreamerMetrics &metrics)
+{
+    QJsonObject object;
+    QJsonObject latency;
+
+    latency["p50"] = metrics.latency.percentile(0.5);
+    latency["p99"] = metrics.latency.percentile(0.99);
+    latency["max"] = metrics.latency.max();
+
+    object["event"] = QString("telemetry");
+    object["linesPerSecond"] = metrics.linesPerSecond;
+    object["bytesPerSecond"] = metrics.bytesPerSecond;
+    object["bufferLength"] = metrics.bufferLength;
+    object["bufferSize"] = metrics.bufferSize;
+    object["plannerBlocks"] = metrics.plannerBlocks;
+    object["linesSent"] = metrics.linesSent;
+    object["linesProcessed"] = metrics.linesProcessed;
+    object["errors"] = metrics.errors;
+    object["underruns"] = metrics.underruns;
+    object["latency"] = latency;
+    object["statusInterval"] = metrics.statusInterval.percentile(0.5);
+    object["statusJitter"] = metrics.statusJitter.percentile(0.99);
+
+    m_telemetry = QJsonDocument(object).toJson(QJsonDocument::Compact) + '\n';
+}
+
+void ControlServer::reply(int client, const QString &command, const QString &error)
+{
+    if (!m_clients.contains(client)) return;
+
+    QJsonObject object;
+    object["reply"] = command;
+    object["ok"] = error.isEmpty();
+    if (!error.isEmpty()) object["error"] = error;
+
+    write(m_clients[client], QJsonDocument(object).toJson(QJsonDocument::Compact) + '\n', false);
+}
+
+void ControlServer::onNewConnection()
+{
+    while (m_server.hasPendingConnections()) {
+        Client client;
+
+        client.socket = m_server.nextPendingConnection();
+        client.stateInterval = 0;
+        client.telemetryInterval = 0;
+        client.stateTime = 0;
+        client.telemetryTime = 0;
+
+        connect(client.socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+        connect(client.socket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+
+        m_clients.insert(m_nextClient++, client);
+    }
+}
+
+void ControlServer::onReadyRead()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket*>(sender());
+    int id = clientId(socket);
+
+    if (id == 0) return;
+
+    while (socket->canReadLine()) {
+        QJsonParseError error;
+        QJsonDocument document = QJsonDocument::fromJson(socket->readLine(MaxLineLength), &error);
+
+        if (error.error != QJsonParseError::NoError || !document.isObject()) {
+            reply(id, QString(), "Bad request");
+            continue;
+        }
+
+        processRequest(id, document.object());
+
+        // Client could be closed by request
+        if (!m_clients.contains(id)) return;
+    }
+
+    // Line without end is not a request
+    if (socket->bytesAvailable() > MaxLineLength) socket->abort();
+}
+
+void ControlServer::onDisconnected()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket*>(sender());
+
+    m_clients.remove(clientId(socket));
+    socket->deleteLater();
+
+    updateTimer();
+}
+
+void ControlServer::onTimerBroadcast()
+{
+    qint64 time = m_clock.elapsed();
+
+    for (QMap<int, Client>::iterator i = m_clients.begin(); i != m_clients.end(); ++i) {
+        Client &client = i.value();
+
+        if (client.stateInterval > 0 && !m_state.isEmpty() && time - client.stateTime >= client.stateInterval) {
+            write(client, m_state, true);
+            client.stateTime = time;
+        }
+
+        if (client.telemetryInterval > 0 && !m_telemetry.isEmpty() && time - client.telemetryTime >= client.telemetryInterval) {
+            write(client, m_telemetry, true);
+            client.telemetryTime = time;
+        }
+    }
+}
+
+int ControlServer::clientId(QLocalSocket *socket) const
+{
+    for (QMap<int, Client>::const_iterator i = m_clients.constBegin(); i != m_clients.constEnd(); ++i) {
+        if (i.value().socket == socket) return i.key();
+    }
+
+    return 0;
+}
+
+void ControlServer::processRequest(int id, const QJsonObject &request)
+{
+    Client &client = m_clients[id];
+    QString command = request["cmd"].toString();
+
+    if (command == "state" || command == "telemetry") {
+        QByteArray &snapshot = command == "state" ? m_state : m_telemetry;
+
+        if (snapshot.isEmpty()) reply(id, command, "No data");
+        else write(client, snapshot, false);
+    } else if (command == "subscribe" || command == "unsubscribe") {
+        QString topic = request["topic"].toString();
+        int interval = command == "subscribe" ? qMax<int>(MinInterval, request["interval"].toInt(1000)) : 0;
+
+        if (topic == "state") client.stateInterval = interval;
+        else if (topic == "telemetry") client.telemetryInterval = interval;
+        else {
+            reply(id, command, "Unknown topic");
+            return;
+        }
+
+        updateTimer();
+        reply(id, command);
+    } else if (command == "load" || command == "start" || command == "pause" || command == "resume" || command == "abort") {
+        emit requestReceived(id, command, request["file"].toString());
+    } else {
+        reply(id, command, "Unknown command");
+    }
+}
+
+void ControlServer::write(const Client &client, const QByteArray &line, bool event)
+{
+    // Events are dropped for clients not reading them
+    if (event && client.socket->bytesToWrite() > MaxPendingBytes) return;
+
+    client.socket->write(line);
+}
+
+void ControlServer::updateTimer()
+{
+    bool subscribed = false;
+
+    foreach (const Client &client, m_clients) {
+        if (client.stateInterval > 0 || client.telemetryInterval > 0) subscribed = true;
+    }
+
+    if (subscribed && !m_timerBroadcast.isActive()) m_timerBroadcast.start();
+    else if (!subscribed) m_timerBroadcast.stop();
+}
@@ -0,0 +1,86 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef CONTROLSERVER_H
+#define CONTROLSERVER_H
+
+#include <QObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QJsonObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QMap>
+
+#include "serial/machinestate.h"
+#include "serial/streamermetrics.h"
+
+// Local socket API for dashboards and job control on the same computer. Protocol is
+// JSON lines: requests {"cmd": ...}, replies {"reply": ..., "ok": ...} and events
+// {"event": "state" | "telemetry", ...} sent to subscribers at their own rate.
+// Serial thread is not involved: main form passes snapshots it has taken anyway,
+// server encodes last snapshot once and broadcasts it by own timer.
+class ControlServer : public QObject
+{
+    Q_OBJECT
+public:
+    struct Job {
+        QString fileName;
+        bool processing;
+        int processedLines;
+        int totalLines;
+        int elapsed;                    // ms
+    };
+
+    explicit ControlServer(QObject *parent = 0);
+
+    bool listen(const QString &name);
+    void close();
+    bool isListening() const;
+    QString serverName() const;
+    QString errorString() const;
+
+    void setState(const MachineState &state, const Job &job);
+    void setMetrics(const StreamerMetrics &metrics);
+
+    // Answer to job control request
+    void reply(int client, const QString &command, const QString &error = QString());
+
+signals:
+    // "load" with file name, "start", "pause", "resume", "abort"
+    void requestReceived(int client, const QString &command, const QString &argument);
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+    void onDisconnected();
+    void onTimerBroadcast();
+
+private:
+    enum { MaxLineLength = 4096, MaxPendingBytes = 65536, MinInterval = 10 };
+
+    struct Client {
+        QLocalSocket *socket;
+        int stateInterval;              // ms, 0 if not subscribed
+        int telemetryInterval;
+        qint64 stateTime;
+        qint64 telemetryTime;
+    };
+
+    QLocalServer m_server;
+    QMap<int, Client> m_clients;
+    int m_nextClient;
+
+    QByteArray m_state;                 // Last snapshots, encoded
+    QByteArray m_telemetry;
+
+    QTimer m_timerBroadcast;
+    QElapsedTimer m_clock;
+
+    int clientId(QLocalSocket *socket) const;
+    void processRequest(int id, const QJsonObject &request);
+    void write(const Client &client, const QByteArray &line, bool event);
+    void updateTimer();
+};
+
+#endif // CONTROLSERVER_H
@@ -0,0 +1,23 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef BYTEDEVICE_H
+#define BYTEDEVICE_H
+
+#include <QByteArray>
+
+// Line oriented byte stream to controller. Streamer works against this interface only,
+// so it can be driven by serial port as well as by fake device.
+class ByteDevice
+{
+public:
+    virtual ~ByteDevice() {}
+
+    virtual bool isOpen() const = 0;
+    virtual qint64 write(const QByteArray &data) = 0;
+    virtual bool canReadLine() const = 0;
+    virtual QByteArray readLine() = 0;
+    virtual qint64 readLine(char *data, qint64 maxSize) = 0;
+};
+
+#endif // BYTEDEVICE_H
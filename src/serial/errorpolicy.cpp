@@ -0,0 +1,70 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include "errorpolicy.h"
+
+// Commands refused only because of machine state: "$" command while not idle,
+// g-code locked out during alarm or jog. They have no effect and pass when machine stops.
+static const int BENIGNERRORS[] = { 8, 9 };
+
+ErrorPolicy::ErrorPolicy()
+{
+    m_policy = HoldAndAsk;
+}
+
+void ErrorPolicy::setPolicy(int policy)
+{
+    m_policy = policy;
+}
+
+int ErrorPolicy::policy() const
+{
+    return m_policy;
+}
+
+void ErrorPolicy::clear()
+{
+    m_retries.clear();
+}
+
+int ErrorPolicy::action(int line, const QString &response)
+{
+    switch (m_policy) {
+    case SkipAndLog:
+        return Skip;
+    case AbortJob:
+        return Abort;
+    case RetryBenign:
+        if (isBenign(errorCode(response)) && m_retries.value(line) < MaxRetries) {
+            m_retries[line]++;
+            return Retry;
+        }
+        break;
+    }
+
+    return Ask;
+}
+
+int ErrorPolicy::errorCode(const QString &response)
+{
+    int i = response.indexOf("error:", 0, Qt::CaseInsensitive);
+    if (i == -1) return -1;
+
+    int code = 0;
+    int digits = 0;
+
+    for (i += 6; i < response.length() && response.at(i).isDigit(); i++, digits++) {
+        code = code * 10 + response.at(i).digitValue();
+    }
+
+    return digits > 0 ? code : -1;
+}
+
+bool ErrorPolicy::isBenign(int code)
+{
+    for (unsigned int i = 0; i < sizeof(BENIGNERRORS) / sizeof(BENIGNERRORS[0]); i++) {
+        if (BENIGNERRORS[i] == code) return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,37 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef ERRORPOLICY_H
+#define ERRORPOLICY_H
+
+#include <QString>
+#include <QHash>
+
+// Decides what to do with error response to program line. Decision is taken at once,
+// so sender doesn't wait for user while serial data keeps coming.
+class ErrorPolicy
+{
+public:
+    enum Policies { HoldAndAsk, SkipAndLog, AbortJob, RetryBenign };
+    enum Actions { Ask, Skip, Abort, Retry };
+    enum { MaxRetries = 3 };
+
+    ErrorPolicy();
+
+    void setPolicy(int policy);
+    int policy() const;
+
+    // Retry counts are kept per program line until cleared
+    void clear();
+    int action(int line, const QString &response);
+
+    // Grbl 1.1 "error:N" code, -1 for text messages of older versions
+    static int errorCode(const QString &response);
+    static bool isBenign(int code);
+
+private:
+    int m_policy;
+    QHash<int, int> m_retries;
+};
+
+#endif // ERRORPOLICY_H
@@ -0,0 +1,108 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QtGlobal>
+#include <limits>
+#include "grbljog.h"
+
+// Move duration limits, seconds
+const double JOGMOVEMIN = 0.02;
+const double JOGMOVEMAX = 0.5;
+
+// Expected round trip until measured: serial, parser and UI update period
+const double JOGLATENCY = 0.03;
+
+GrblJog::GrblJog()
+{
+    m_active = false;
+    m_feed = 1000;
+    m_acceleration = 100;
+    m_firstId = std::numeric_limits<int>::max();
+    m_count = 0;
+    m_latency = JOGLATENCY;
+
+    m_clock.start();
+}
+
+void GrblJog::setFeed(double feed)
+{
+    m_feed = feed;
+}
+
+void GrblJog::setAcceleration(double acceleration)
+{
+    m_acceleration = acceleration;
+}
+
+QString GrblJog::stepCommand(const QVector3D &direction, double length) const
+{
+    QVector3D move = direction.normalized() * length;
+    QString command = "$J=G21G91";
+
+    if (move.x() != 0) command += "X" + QString::number(move.x(), 'f', 3);
+    if (move.y() != 0) command += "Y" + QString::number(move.y(), 'f', 3);
+    if (move.z() != 0) command += "Z" + QString::number(move.z(), 'f', 3);
+
+    return command + "F" + QString::number(m_feed, 'f', 0);
+}
+
+void GrblJog::start(const QVector3D &direction)
+{
+    m_direction = direction;
+    m_active = !direction.isNull();
+    m_firstId = std::numeric_limits<int>::max();
+    m_count = 0;
+}
+
+void GrblJog::stop()
+{
+    m_active = false;
+    m_count = 0;
+}
+
+bool GrblJog::isActive() const
+{
+    return m_active;
+}
+
+bool GrblJog::canSend() const
+{
+    return m_active && m_count < Moves;
+}
+
+QString GrblJog::command() const
+{
+    return stepCommand(m_direction, m_feed / 60 * moveTime());
+}
+
+void GrblJog::sent(int id)
+{
+    if (!m_active) return;
+
+    if (id < m_firstId) m_firstId = id;
+    m_sentTimes[m_count++] = m_clock.nsecsElapsed();
+}
+
+void GrblJog::processed(int id)
+{
+    if (!m_active || id < m_firstId || m_count == 0) return;
+
+    // Answers come in order, first time belongs to answered move
+    double latency = (m_clock.nsecsElapsed() - m_sentTimes[0]) / 1e9;
+    m_latency = m_latency * 0.75 + latency * 0.25;
+
+    for (int i = 1; i < m_count; i++) m_sentTimes[i - 1] = m_sentTimes[i];
+    m_count--;
+}
+
+double GrblJog::moveTime() const
+{
+    double v = m_feed / 60;
+
+    // Queued moves except executing one should cover deceleration distance v^2 / 2a,
+    // and last until next move arrives
+    double planner = v / (2 * m_acceleration * (Moves - 1));
+    double latency = m_latency / (Moves - 1);
+
+    return qBound(JOGMOVEMIN, qMax(planner, latency), JOGMOVEMAX);
+}
@@ -0,0 +1,53 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef GRBLJOG_H
+#define GRBLJOG_H
+
+#include <QString>
+#include <QVector3D>
+#include <QElapsedTimer>
+
+// Continuous grbl 1.1 jogging by short "$J=" moves while key is held. Only few moves
+// are queued, each long enough to keep planner from decelerating between them and
+// to cover response round trip, so jog cancel command stops machine at once.
+class GrblJog
+{
+public:
+    enum { Moves = 3, JogCancel = 0x85 };
+
+    GrblJog();
+
+    // Feed in mm/min, acceleration in mm/sec^2
+    void setFeed(double feed);
+    void setAcceleration(double acceleration);
+
+    // Single move of given length
+    QString stepCommand(const QVector3D &direction, double length) const;
+
+    void start(const QVector3D &direction);
+    void stop();
+    bool isActive() const;
+
+    bool canSend() const;
+    QString command() const;
+    void sent(int id);
+    void processed(int id);
+
+private:
+    QVector3D m_direction;
+    bool m_active;
+    double m_feed;
+    double m_acceleration;
+
+    int m_firstId;                      // Responses to previous jogs are ignored
+    int m_count;                        // Moves sent and not answered
+    qint64 m_sentTimes[Moves];
+    double m_latency;                   // Smoothed round trip, seconds
+
+    QElapsedTimer m_clock;
+
+    double moveTime() const;
+};
+
+#endif // GRBLJOG_H
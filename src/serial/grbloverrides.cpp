@@ -0,0 +1,125 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QtGlobal>
+#include "grbloverrides.h"
+
+// Grbl override limits
+const int OVERRIDEMIN = 10;
+const int OVERRIDEMAX = 200;
+
+// Status reports after last step to wait for "Ov:" value to settle
+const int OVERRIDEPENDING = 3;
+
+GrblOverrides::GrblOverrides()
+{
+    m_feed.target = -1;
+    m_rapid.target = -1;
+    m_spindle.target = -1;
+
+    reset();
+}
+
+void GrblOverrides::setTargets(int feed, int rapid, int spindle)
+{
+    m_feed.target = feed < 0 ? -1 : qBound(OVERRIDEMIN, feed, OVERRIDEMAX);
+    m_rapid.target = rapid < 0 ? -1 : rapid >= 100 ? 100 : rapid >= 50 ? 50 : 25;
+    m_spindle.target = spindle < 0 ? -1 : qBound(OVERRIDEMIN, spindle, OVERRIDEMAX);
+}
+
+void GrblOverrides::reset()
+{
+    m_feed.actual = 100;
+    m_feed.pending = 0;
+    m_rapid.actual = 100;
+    m_rapid.pending = 0;
+    m_spindle.actual = 100;
+    m_spindle.pending = 0;
+}
+
+void GrblOverrides::processStatus(const MachineState &state)
+{
+    bool received = state.fields & MachineState::OverridesField;
+
+    update(m_feed, state.feedOverride, received);
+    update(m_rapid, state.rapidOverride, received);
+    update(m_spindle, state.spindleOverride, received);
+}
+
+QByteArray GrblOverrides::commands()
+{
+    QByteArray commands;
+
+    appendSteps(commands, m_feed, FeedReset, FeedCoarsePlus, FeedCoarseMinus, FeedFinePlus, FeedFineMinus);
+    appendSteps(commands, m_spindle, SpindleReset, SpindleCoarsePlus, SpindleCoarseMinus,
+                SpindleFinePlus, SpindleFineMinus);
+
+    // Rapid override has fixed values
+    if (ready(m_rapid)) {
+        commands.append((char)(m_rapid.target == 100 ? RapidReset : m_rapid.target == 50 ? RapidMedium : RapidLow));
+        sent(m_rapid, m_rapid.target);
+    }
+
+    return commands;
+}
+
+bool GrblOverrides::isBusy() const
+{
+    return ready(m_feed) || ready(m_rapid) || ready(m_spindle);
+}
+
+void GrblOverrides::update(Override &value, int actual, bool received)
+{
+    // Reports right after steps could miss some of them
+    if (value.pending > 0) value.pending--;
+    else if (received) value.actual = actual;
+}
+
+bool GrblOverrides::ready(const Override &value)
+{
+    return value.target != -1 && value.actual != value.target;
+}
+
+void GrblOverrides::sent(Override &value, int actual)
+{
+    value.actual = qBound(OVERRIDEMIN, actual, OVERRIDEMAX);
+    value.pending = OVERRIDEPENDING;
+}
+
+void GrblOverrides::appendSteps(QByteArray &commands, Override &value, char reset, char coarsePlus, char coarseMinus,
+                                char finePlus, char fineMinus)
+{
+    if (!ready(value)) return;
+
+    int diff = value.target - value.actual;
+
+    // Reset is shorter way if target is closer to 100%
+    if (value.target == 100 || qAbs(value.target - 100) + 5 < qAbs(diff)) {
+        commands.append(reset);
+        sent(value, 100);
+        return;
+    }
+
+    // Coarse step of 10% if it brings closer, then fine step of 1% for the rest
+    int coarse = 0;
+
+    if (diff > 5) {
+        commands.append(coarsePlus);
+        coarse = 10;
+    } else if (diff < -5) {
+        commands.append(coarseMinus);
+        coarse = -10;
+    }
+
+    int fine = 0;
+
+    if (diff - coarse > 0) {
+        commands.append(finePlus);
+        fine = 1;
+    } else if (diff - coarse < 0) {
+        commands.append(fineMinus);
+        fine = -1;
+    }
+
+    sent(value, value.actual + coarse + fine);
+}
@@ -0,0 +1,65 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef GRBLOVERRIDES_H
+#define GRBLOVERRIDES_H
+
+#include <QByteArray>
+#include "machinestate.h"
+
+// Moves grbl 1.1 feed, rapid and spindle overrides to target values with realtime commands.
+// Grbl merges equal override commands received between main loop passes, so only one
+// coarse and one fine step are sent at once and commands() should be paced by short timer.
+// Values are tracked from sent steps, "Ov:" read back only corrects drift once settled.
+class GrblOverrides
+{
+public:
+    enum Commands {
+        FeedReset = 0x90,
+        FeedCoarsePlus = 0x91,
+        FeedCoarseMinus = 0x92,
+        FeedFinePlus = 0x93,
+        FeedFineMinus = 0x94,
+        RapidReset = 0x95,
+        RapidMedium = 0x96,
+        RapidLow = 0x97,
+        SpindleReset = 0x99,
+        SpindleCoarsePlus = 0x9A,
+        SpindleCoarseMinus = 0x9B,
+        SpindleFinePlus = 0x9C,
+        SpindleFineMinus = 0x9D
+    };
+
+    GrblOverrides();
+
+    // -1 leaves override untouched
+    void setTargets(int feed, int rapid, int spindle);
+
+    // Controller reset, all overrides are back to 100%
+    void reset();
+
+    void processStatus(const MachineState &state);
+    QByteArray commands();
+
+    // Steps are left to send
+    bool isBusy() const;
+
+private:
+    struct Override {
+        int target;
+        int actual;             // Estimated from sent steps
+        int pending;            // Status reports to wait before read back is trusted
+    };
+
+    Override m_feed;
+    Override m_rapid;
+    Override m_spindle;
+
+    static void update(Override &value, int actual, bool received);
+    static bool ready(const Override &value);
+    static void sent(Override &value, int actual);
+    static void appendSteps(QByteArray &commands, Override &value, char reset, char coarsePlus, char coarseMinus,
+                            char finePlus, char fineMinus);
+};
+
+#endif // GRBLOVERRIDES_H
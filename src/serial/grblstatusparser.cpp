@@ -0,0 +1,253 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <string.h>
+#include "grblstatusparser.h"
+
+bool GrblStatusParser::parse(const char *data, int length, MachineState &state)
+{
+    const char *p = data;
+    const char *end = data + length;
+
+    // Skip leading whitespace
+    while (p < end && (*p == ' ' || *p == '\r' || *p == '\n')) p++;
+    if (p == end || *p != '<') return false;
+    p++;
+
+    // Closing bracket limits report
+    const char *close = (const char*)memchr(p, '>', end - p);
+    if (close) end = close;
+
+    if (!parseStatus(p, end, state)) return false;
+
+    state.fields = 0;
+
+    if (p < end && *p == ',') {
+        parseLegacyFields(p, end, state);
+    } else {
+        while (p < end && *p == '|') {
+            p++;
+            if (!parseField(p, end, state)) {
+                // Unknown field, skip it
+                while (p < end && *p != '|') p++;
+            }
+        }
+
+        // Pins and accessories are reported only if active
+        if (!(state.fields & MachineState::PinsField)) state.pins = 0;
+        if (!(state.fields & MachineState::AccessoriesField)) state.accessories = 0;
+    }
+
+    // Restore missing position from work coordinate offset
+    bool mpos = state.fields & MachineState::MachinePositionField;
+    bool wpos = state.fields & MachineState::WorkPositionField;
+
+    for (int i = 0; i < 3; i++) {
+        if (mpos && wpos) state.workOffset[i] = state.machinePosition[i] - state.workPosition[i];
+        else if (mpos) state.workPosition[i] = state.machinePosition[i] - state.workOffset[i];
+        else if (wpos) state.machinePosition[i] = state.workPosition[i] + state.workOffset[i];
+    }
+
+    return true;
+}
+
+bool GrblStatusParser::parseStatus(const char *&p, const char *end, MachineState &state)
+{
+    static const struct {
+        const char *name;
+        int status;
+    } statuses[] = {
+        {"Idle", MachineState::Idle},
+        {"Run", MachineState::Run},
+        {"Hold", MachineState::Hold},
+        {"Jog", MachineState::Jog},
+        {"Alarm", MachineState::Alarm},
+        {"Door", MachineState::Door},
+        {"Check", MachineState::Check},
+        {"Home", MachineState::Home},
+        {"Sleep", MachineState::Sleep},
+        {"Queue", MachineState::Queue}
+    };
+
+    const char *start = p;
+    while (p < end && *p != '|' && *p != ',' && *p != ':') p++;
+    int length = p - start;
+
+    state.status = MachineState::Unknown;
+    for (unsigned int i = 0; i < sizeof(statuses) / sizeof(statuses[0]); i++) {
+        if ((int)strlen(statuses[i].name) == length && !strncmp(statuses[i].name, start, length)) {
+            state.status = statuses[i].status;
+            break;
+        }
+    }
+
+    // Sub-state, "Hold:0"
+    state.subState = 0;
+    if (p < end && *p == ':') {
+        p++;
+        state.subState = parseInt(p, end);
+    }
+
+    return length > 0;
+}
+
+bool GrblStatusParser::parseField(const char *&p, const char *end, MachineState &state)
+{
+    double values[3];
+
+    if (startsWith(p, end, "MPos:")) {
+        p += 5;
+        parseVector(p, end, state.machinePosition, 3);
+        state.fields |= MachineState::MachinePositionField;
+    } else if (startsWith(p, end, "WPos:")) {
+        p += 5;
+        parseVector(p, end, state.workPosition, 3);
+        state.fields |= MachineState::WorkPositionField;
+    } else if (startsWith(p, end, "WCO:")) {
+        p += 4;
+        parseVector(p, end, state.workOffset, 3);
+        state.fields |= MachineState::WorkOffsetField;
+    } else if (startsWith(p, end, "Bf:")) {
+        p += 3;
+        if (parseVector(p, end, values, 2) == 2) {
+            state.plannerBlocks = (int)values[0];
+            state.rxBytes = (int)values[1];
+        }
+        state.fields |= MachineState::BufferField;
+    } else if (startsWith(p, end, "FS:")) {
+        p += 3;
+        if (parseVector(p, end, values, 2) == 2) {
+            state.feed = values[0];
+            state.spindleSpeed = values[1];
+        }
+        state.fields |= MachineState::FeedField;
+    } else if (startsWith(p, end, "F:")) {
+        p += 2;
+        state.feed = parseDouble(p, end);
+        state.fields |= MachineState::FeedField;
+    } else if (startsWith(p, end, "Ov:")) {
+        p += 3;
+        if (parseVector(p, end, values, 3) == 3) {
+            state.feedOverride = (int)values[0];
+            state.rapidOverride = (int)values[1];
+            state.spindleOverride = (int)values[2];
+        }
+        state.fields |= MachineState::OverridesField;
+    } else if (startsWith(p, end, "Pn:")) {
+        p += 3;
+        state.pins = 0;
+        for (; p < end && *p != '|'; p++) {
+            switch (*p) {
+            case 'X': state.pins |= MachineState::PinX; break;
+            case 'Y': state.pins |= MachineState::PinY; break;
+            case 'Z': state.pins |= MachineState::PinZ; break;
+            case 'P': state.pins |= MachineState::PinProbe; break;
+            case 'D': state.pins |= MachineState::PinDoor; break;
+            case 'H': state.pins |= MachineState::PinHold; break;
+            case 'R': state.pins |= MachineState::PinReset; break;
+            case 'S': state.pins |= MachineState::PinStart; break;
+            }
+        }
+        state.fields |= MachineState::PinsField;
+    } else if (startsWith(p, end, "A:")) {
+        p += 2;
+        state.accessories = 0;
+        for (; p < end && *p != '|'; p++) {
+            switch (*p) {
+            case 'S': state.accessories |= MachineState::SpindleCW; break;
+            case 'C': state.accessories |= MachineState::SpindleCCW; break;
+            case 'F': state.accessories |= MachineState::Flood; break;
+            case 'M': state.accessories |= MachineState::Mist; break;
+            }
+        }
+        state.fields |= MachineState::AccessoriesField;
+    } else if (startsWith(p, end, "Ln:")) {
+        p += 3;
+        state.lineNumber = parseInt(p, end);
+        state.fields |= MachineState::LineNumberField;
+    } else {
+        return false;
+    }
+
+    // Skip rest of field, e.g. extra axes
+    while (p < end && *p != '|') p++;
+
+    return true;
+}
+
+void GrblStatusParser::parseLegacyFields(const char *&p, const char *end, MachineState &state)
+{
+    // "<Idle,MPos:0.000,0.000,0.000,WPos:0.000,0.000,0.000,Buf:0,RX:0>"
+    while (p < end) {
+        p++;
+
+        if (startsWith(p, end, "MPos:")) {
+            p += 5;
+            parseVector(p, end, state.machinePosition, 3);
+            state.fields |= MachineState::MachinePositionField;
+        } else if (startsWith(p, end, "WPos:")) {
+            p += 5;
+            parseVector(p, end, state.workPosition, 3);
+            state.fields |= MachineState::WorkPositionField;
+        } else {
+            // "Buf:" and "RX:" are used, not free counts, and buffer sizes are unknown
+            while (p < end && *p != ',') p++;
+        }
+    }
+}
+
+bool GrblStatusParser::startsWith(const char *p, const char *end, const char *word)
+{
+    while (*word) {
+        if (p == end || *p != *word) return false;
+        p++;
+        word++;
+    }
+
+    return true;
+}
+
+int GrblStatusParser::parseInt(const char *&p, const char *end)
+{
+    return (int)parseDouble(p, end);
+}
+
+double GrblStatusParser::parseDouble(const char *&p, const char *end)
+{
+    bool negative = false;
+    long long mantissa = 0;
+    long long divider = 1;
+
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    for (; p < end && *p >= '0' && *p <= '9'; p++) mantissa = mantissa * 10 + (*p - '0');
+
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+            // Enough precision for grbl output
+            if (divider < 1000000000LL) {
+                mantissa = mantissa * 10 + (*p - '0');
+                divider *= 10;
+            }
+        }
+    }
+
+    double value = (double)mantissa / divider;
+
+    return negative ? -value : value;
+}
+
+int GrblStatusParser::parseVector(const char *&p, const char *end, double *values, int count)
+{
+    int parsed = 0;
+
+    while (p < end && parsed < count) {
+        values[parsed++] = parseDouble(p, end);
+
+        // Value separator; field separators stop parsing
+        if (p < end && *p == ',' && parsed < count) p++;
+        else break;
+    }
+
+    return parsed;
+}
@@ -0,0 +1,28 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef GRBLSTATUSPARSER_H
+#define GRBLSTATUSPARSER_H
+
+#include "machinestate.h"
+
+// Parses grbl status report ("<Idle|MPos:...|FS:...>" or 0.9 "<Idle,MPos:...,WPos:...>")
+// right from received bytes. Fields missing in report keep previous values, so state
+// should live as long as connection. No heap allocations.
+class GrblStatusParser
+{
+public:
+    static bool parse(const char *data, int length, MachineState &state);
+
+private:
+    static bool parseStatus(const char *&p, const char *end, MachineState &state);
+    static bool parseField(const char *&p, const char *end, MachineState &state);
+    static void parseLegacyFields(const char *&p, const char *end, MachineState &state);
+
+    static bool startsWith(const char *p, const char *end, const char *word);
+    static int parseInt(const char *&p, const char *end);
+    static double parseDouble(const char *&p, const char *end);
+    static int parseVector(const char *&p, const char *end, double *values, int count);
+};
+
+#endif // GRBLSTATUSPARSER_H
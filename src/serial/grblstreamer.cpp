@@ -0,0 +1,400 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QDebug>
+#include <QRegExp>
+#include <QStringList>
+#include <cstring>
+#include "grblstreamer.h"
+#include "grblstatusparser.h"
+
+GrblStreamer::GrblStreamer(ByteDevice *device, int bufferSize)
+{
+    m_device = device;
+    m_metrics = NULL;
+    m_bufferSize = 0;
+    m_bufferLength = 0;
+    m_autoBufferSize = false;
+    m_plannerThrottle = false;
+    m_plannerBlocks = -1;
+    m_sentFirst = 0;
+    m_sentCount = 0;
+
+    m_reseting = false;
+    m_resetCompleted = true;
+    m_statusReceived = true;
+
+    setBufferSize(bufferSize);
+}
+
+ByteDevice *GrblStreamer::device() const
+{
+    return m_device;
+}
+
+void GrblStreamer::setDevice(ByteDevice *device)
+{
+    m_device = device;
+}
+
+StreamerMetrics *GrblStreamer::metrics() const
+{
+    return m_metrics;
+}
+
+void GrblStreamer::setMetrics(StreamerMetrics *metrics)
+{
+    m_metrics = metrics;
+}
+
+int GrblStreamer::bufferSize() const
+{
+    return m_bufferSize;
+}
+
+void GrblStreamer::setBufferSize(int bufferSize)
+{
+    m_bufferSize = bufferSize;
+
+    // Reserved capacity is kept when output is emptied
+    m_output.reserve(bufferSize + 1);
+
+    // Grow ring keeping commands order
+    if (m_sent.size() < bufferSize + 1) {
+        QVector<SentCommand> sent(bufferSize + 1);
+        for (int i = 0; i < m_sentCount; i++) sent[i] = m_sent.at((m_sentFirst + i) % m_sent.size());
+        m_sent = sent;
+        m_sentFirst = 0;
+    }
+}
+
+bool GrblStreamer::autoBufferSize() const
+{
+    return m_autoBufferSize;
+}
+
+void GrblStreamer::setAutoBufferSize(bool autoBufferSize)
+{
+    m_autoBufferSize = autoBufferSize;
+}
+
+bool GrblStreamer::plannerThrottle() const
+{
+    return m_plannerThrottle;
+}
+
+void GrblStreamer::setPlannerThrottle(bool plannerThrottle)
+{
+    m_plannerThrottle = plannerThrottle;
+}
+
+int GrblStreamer::bufferLength() const
+{
+    return m_bufferLength;
+}
+
+int GrblStreamer::commandsCount() const
+{
+    return m_sentCount;
+}
+
+bool GrblStreamer::canSend(int length) const
+{
+    if (!m_resetCompleted || m_bufferLength + length + 1 > m_bufferSize) return false;
+
+    // Commands waiting in receive buffer for planner block only delay realtime reaction.
+    // Commands in flight are limited by last reported free blocks, every answer frees a slot,
+    // one command is always allowed to keep planner filling.
+    if (m_plannerThrottle && m_plannerBlocks != -1 && m_sentCount >= qMax(1, m_plannerBlocks)) return false;
+
+    return true;
+}
+
+bool GrblStreamer::send(int id, const QByteArray &command)
+{
+    return send(id, command.constData(), command.length());
+}
+
+bool GrblStreamer::send(int id, const char *command, int length)
+{
+    if (!canSend(length)) return false;
+
+    SentCommand cmd;
+    cmd.id = id;
+    cmd.length = length + 1;
+    cmd.reset = false;
+    cmd.buildInfo = length == 2 && command[0] == '$' && command[1] == 'I';
+    cmd.programEnd = contains(command, length, "M2") || contains(command, length, "M30");
+    cmd.time = m_metrics ? m_metrics->timestamp() : 0;
+    appendSent(cmd);
+
+    if (m_metrics) m_metrics->commandSent(cmd.length, m_bufferLength, m_bufferSize);
+
+    m_output.append(command, length);
+    m_output.append('\r');
+
+    return true;
+}
+
+void GrblStreamer::flush()
+{
+    if (m_output.isEmpty()) return;
+
+    m_device->write(m_output);
+    m_output.resize(0);
+}
+
+void GrblStreamer::sendRealtime(char byte)
+{
+    m_device->write(QByteArray(1, byte));
+}
+
+void GrblStreamer::reset(int id)
+{
+    qDebug() << "grbl reset";
+
+    // Commands not written yet are dropped by clear()
+    m_device->write(QByteArray(1, (char)24));
+
+    m_reseting = true;
+    m_resetCompleted = false;
+    m_statusReceived = true;
+
+    // Drop all remaining commands in buffer
+    clear();
+
+    // Prepare reset response catch
+    SentCommand cmd;
+    cmd.id = id;
+    cmd.length = 9;                     // "[CTRL+X]" with terminator
+    cmd.reset = true;
+    cmd.buildInfo = false;
+    cmd.programEnd = false;
+    cmd.time = 0;
+    appendSent(cmd);
+}
+
+void GrblStreamer::clear()
+{
+    m_sentFirst = 0;
+    m_sentCount = 0;
+    m_bufferLength = 0;
+    m_plannerBlocks = -1;
+    m_response.clear();
+    m_output.resize(0);
+}
+
+bool GrblStreamer::queryStatus()
+{
+    if (m_device && m_device->isOpen() && m_resetCompleted && m_statusReceived) {
+        m_device->write(QByteArray(1, '?'));
+        m_statusReceived = false;
+        return true;
+    }
+
+    return false;
+}
+
+bool GrblStreamer::isReseting() const
+{
+    return m_reseting;
+}
+
+bool GrblStreamer::resetCompleted() const
+{
+    return m_resetCompleted;
+}
+
+bool GrblStreamer::processLine(const QString &data, SerialResponse &response, bool *dropQueue)
+{
+    *dropQueue = false;
+
+    // Filter prereset responses
+    if (m_reseting) {
+        qDebug() << "reseting filter:" << data;
+        if (!dataIsReset(data)) return false;
+        else m_reseting = false;
+    }
+
+    // Blank response
+    if (data.isEmpty()) return false;
+
+    // Status response
+    if (data[0] == '<') {
+        m_statusReceived = true;
+
+        response.type = SerialResponse::Status;
+        response.id = -1;
+        response.data = data;
+        return true;
+    }
+
+    // Processed commands
+    if (m_sentCount > 0 && !dataIsFloating(data)
+            && !(!m_sent.at(m_sentFirst).reset && dataIsReset(data))) {
+
+        const SentCommand &first = m_sent.at(m_sentFirst);
+
+        if ((!first.reset && dataIsEnd(data)) || (first.reset && dataIsReset(data))) {
+            m_response.append(data);
+
+            // Take command from buffer
+            SentCommand cmd = takeFirstSent();
+
+            // Reset complete
+            if (cmd.reset) m_resetCompleted = true;
+            else if (m_metrics) m_metrics->commandProcessed(cmd.time, data.contains("error"));
+
+            response.type = SerialResponse::Response;
+            response.id = cmd.id;
+            response.data = m_response;
+            m_response.clear();
+
+            // Build info, "[OPT:V,15,128]" gives planner blocks and receive buffer size
+            if (m_autoBufferSize && cmd.buildInfo) {
+                QRegExp rx("\\[OPT:[^,\\]]*,(\\d+),(\\d+)");
+                if (rx.indexIn(response.data) != -1) detectBufferSize(rx.cap(2).toInt());
+            }
+
+            // Clear command buffer on "M2" & "M30" command (old firmwares)
+            if (cmd.programEnd && response.data.contains("ok")
+                    && !response.data.contains("[Pgm End]")) {
+                clear();
+                *dropQueue = true;
+            }
+
+            return true;
+        } else {
+            m_response.append(data + "; ");
+            return false;
+        }
+    }
+
+    // Unprocessed responses
+    qDebug() << "floating response:" << data;
+
+    // Handle hardware reset
+    if (dataIsReset(data)) {
+        qDebug() << "hardware reset";
+
+        m_reseting = false;
+        m_statusReceived = true;
+
+        clear();
+        *dropQueue = true;
+    }
+
+    response.type = SerialResponse::Floating;
+    response.id = -1;
+    response.data = data;
+    return true;
+}
+
+bool GrblStreamer::processStatus(const char *data, int length, MachineState &state)
+{
+    // Filter prereset responses
+    if (m_reseting) return false;
+
+    m_statusReceived = true;
+
+    if (!GrblStatusParser::parse(data, length, state)) return false;
+
+    if (m_metrics) m_metrics->statusReceived(state, m_bufferLength, m_bufferSize);
+
+    if (state.fields & MachineState::BufferField) {
+        // Nothing sent is waiting in buffer, so all of it is free
+        if (m_autoBufferSize && m_sentCount == 0) detectBufferSize(state.rxBytes);
+
+        m_plannerBlocks = state.plannerBlocks;
+    }
+
+    return true;
+}
+
+void GrblStreamer::detectBufferSize(int rxBytes)
+{
+    // Grbl ring buffer keeps one byte free
+    if (rxBytes > 1 && rxBytes - 1 != m_bufferSize) {
+        qDebug() << "receive buffer size:" << rxBytes - 1;
+        setBufferSize(rxBytes - 1);
+    }
+}
+
+void GrblStreamer::appendSent(const SentCommand &command)
+{
+    m_sent[(m_sentFirst + m_sentCount) % m_sent.size()] = command;
+    m_sentCount++;
+    m_bufferLength += command.length;
+}
+
+GrblStreamer::SentCommand GrblStreamer::takeFirstSent()
+{
+    SentCommand cmd = m_sent.at(m_sentFirst);
+
+    m_sentFirst = (m_sentFirst + 1) % m_sent.size();
+    m_sentCount--;
+    m_bufferLength -= cmd.length;
+
+    return cmd;
+}
+
+bool GrblStreamer::contains(const char *data, int length, const char *text)
+{
+    int textLength = strlen(text);
+
+    for (int i = 0; i + textLength <= length; i++) {
+        if (memcmp(data + i, text, textLength) == 0) return true;
+    }
+
+    return false;
+}
+
+bool GrblStreamer::dataIsEnd(const QString &data) {
+    QStringList ends;
+
+    ends << "ok";
+    ends << "error";
+//    ends << "Reset to continue";
+//    ends << "'$' for help";
+//    ends << "'$H'|'$X' to unlock";
+//    ends << "Caution: Unlocked";
+//    ends << "Enabled";
+//    ends << "Disabled";
+//    ends << "Check Door";
+//    ends << "Pgm End";
+
+    foreach (QString str, ends) {
+        if (data.contains(str)) return true;
+    }
+
+    return false;
+}
+
+bool GrblStreamer::dataIsFloating(const QString &data) {
+    QStringList ends;
+
+    ends << "Reset to continue";
+    ends << "'$H'|'$X' to unlock";
+    ends << "ALARM: Soft limit";
+    ends << "ALARM: Hard limit";
+    ends << "Check Door";
+
+    foreach (QString str, ends) {
+        if (data.contains(str)) return true;
+    }
+
+    return false;
+}
+
+bool GrblStreamer::dataIsReset(const QString &data) {
+    return QRegExp("^GRBL|GCARVIN\\s\\d\\.\\d.").indexIn(data.toUpper()) != -1;
+}
+
+int GrblStreamer::firmwareVersion(const QString &data) {
+    // Version from welcome message, "Grbl 1.1f ['$' for help]" gives 0x0101
+    QRegExp rx("GRBL\\s(\\d+)\\.(\\d+)");
+
+    if (rx.indexIn(data.toUpper()) == -1) return -1;
+
+    return (rx.cap(1).toInt() << 8) | rx.cap(2).toInt();
+}
@@ -0,0 +1,113 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef GRBLSTREAMER_H
+#define GRBLSTREAMER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include "bytedevice.h"
+#include "machinestate.h"
+#include "streamermetrics.h"
+
+struct SerialResponse {
+    enum Types { Status, Response, Floating };
+
+    int type;
+    int id;
+    QString data;
+};
+
+// Character-counting sender for grbl. Tracks bytes in controller receive buffer
+// and matches responses with sent commands. No Qt event loop dependency.
+class GrblStreamer
+{
+public:
+    // Receive buffer of stock grbl, one byte of 128 byte ring is always free
+    enum { DefaultBufferSize = 127 };
+
+    explicit GrblStreamer(ByteDevice *device = NULL, int bufferSize = DefaultBufferSize);
+
+    ByteDevice *device() const;
+    void setDevice(ByteDevice *device);
+
+    // Optional, not owned
+    StreamerMetrics *metrics() const;
+    void setMetrics(StreamerMetrics *metrics);
+
+    int bufferSize() const;
+    void setBufferSize(int bufferSize);
+
+    // Take buffer size from "$I" response or "Bf:" status field when nothing is in buffer
+    bool autoBufferSize() const;
+    void setAutoBufferSize(bool autoBufferSize);
+
+    // Limit commands in buffer by free planner blocks too
+    bool plannerThrottle() const;
+    void setPlannerThrottle(bool plannerThrottle);
+
+    int bufferLength() const;
+    int commandsCount() const;
+    bool canSend(int length) const;
+
+    // Commands are collected and written at once by flush(), realtime ones are written at once
+    bool send(int id, const QByteArray &command);
+    bool send(int id, const char *command, int length);
+    void flush();
+    void sendRealtime(char byte);
+    void reset(int id);
+    void clear();
+
+    bool queryStatus();
+    bool isReseting() const;
+    bool resetCompleted() const;
+
+    bool processLine(const QString &data, SerialResponse &response, bool *dropQueue);
+    bool processStatus(const char *data, int length, MachineState &state);
+
+    static bool dataIsEnd(const QString &data);
+    static bool dataIsFloating(const QString &data);
+    static bool dataIsReset(const QString &data);
+    static int firmwareVersion(const QString &data);
+
+private:
+    static bool contains(const char *data, int length, const char *text);
+
+    struct SentCommand {
+        int id;
+        int length;
+        bool reset;
+        bool buildInfo;                 // "$I"
+        bool programEnd;                // "M2" or "M30"
+        qint64 time;
+    };
+
+    ByteDevice *m_device;
+    StreamerMetrics *m_metrics;
+    int m_bufferSize;
+    int m_bufferLength;
+    bool m_autoBufferSize;
+
+    bool m_plannerThrottle;
+    int m_plannerBlocks;                // Free planner blocks of last status report, -1 if unknown
+
+    // Commands in controller buffer. Every command takes at least one byte,
+    // so buffer size limits ring capacity.
+    QVector<SentCommand> m_sent;
+    int m_sentFirst;
+    int m_sentCount;
+
+    QByteArray m_output;                // Commands not written yet
+
+    QString m_response;
+    bool m_reseting;
+    bool m_resetCompleted;
+    bool m_statusReceived;
+
+    void detectBufferSize(int rxBytes);
+    void appendSent(const SentCommand &command);
+    SentCommand takeFirstSent();
+};
+
+#endif // GRBLSTREAMER_H
@@ -0,0 +1,75 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef MACHINESTATE_H
+#define MACHINESTATE_H
+
+// Machine state from grbl status reports. Plain data, copied between threads by value.
+struct MachineState {
+    // Same order as status captions in main form
+    enum Status { Unknown, Idle, Alarm, Run, Home, Hold, Queue, Check, Door, Jog, Sleep };
+
+    enum Fields {
+        MachinePositionField = 0x01,
+        WorkPositionField = 0x02,
+        WorkOffsetField = 0x04,
+        BufferField = 0x08,
+        FeedField = 0x10,
+        OverridesField = 0x20,
+        PinsField = 0x40,
+        AccessoriesField = 0x80,
+        LineNumberField = 0x100
+    };
+
+    enum Pins { PinX = 0x01, PinY = 0x02, PinZ = 0x04, PinProbe = 0x08, PinDoor = 0x10,
+                PinHold = 0x20, PinReset = 0x40, PinStart = 0x80 };
+
+    enum Accessories { SpindleCW = 0x01, SpindleCCW = 0x02, Flood = 0x04, Mist = 0x08 };
+
+    int status;
+    int subState;
+
+    double machinePosition[3];
+    double workPosition[3];
+    double workOffset[3];
+
+    int plannerBlocks;          // Free planner blocks, -1 if not reported
+    int rxBytes;                // Free receive buffer bytes, -1 if not reported
+
+    double feed;
+    double spindleSpeed;
+
+    int feedOverride;
+    int rapidOverride;
+    int spindleOverride;
+
+    int pins;
+    int accessories;
+    int lineNumber;
+
+    int fields;                 // Fields received in last report
+
+    MachineState()
+    {
+        status = Unknown;
+        subState = 0;
+        for (int i = 0; i < 3; i++) {
+            machinePosition[i] = 0;
+            workPosition[i] = 0;
+            workOffset[i] = 0;
+        }
+        plannerBlocks = -1;
+        rxBytes = -1;
+        feed = 0;
+        spindleSpeed = 0;
+        feedOverride = 100;
+        rapidOverride = 100;
+        spindleOverride = 100;
+        pins = 0;
+        accessories = 0;
+        lineNumber = -1;
+        fields = 0;
+    }
+};
+
+#endif // MACHINESTATE_H
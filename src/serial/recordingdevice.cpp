@@ -0,0 +1,65 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include "recordingdevice.h"
+
+RecordingDevice::RecordingDevice(ByteDevice *device, TrafficRecorder *recorder)
+{
+    m_device = device;
+    m_recorder = recorder;
+}
+
+ByteDevice *RecordingDevice::device() const
+{
+    return m_device;
+}
+
+void RecordingDevice::setDevice(ByteDevice *device)
+{
+    m_device = device;
+}
+
+TrafficRecorder *RecordingDevice::recorder() const
+{
+    return m_recorder;
+}
+
+void RecordingDevice::setRecorder(TrafficRecorder *recorder)
+{
+    m_recorder = recorder;
+}
+
+bool RecordingDevice::isOpen() const
+{
+    return m_device && m_device->isOpen();
+}
+
+qint64 RecordingDevice::write(const QByteArray &data)
+{
+    if (m_recorder) m_recorder->record(TrafficRecord::Sent, data.constData(), data.length());
+
+    return m_device->write(data);
+}
+
+bool RecordingDevice::canReadLine() const
+{
+    return m_device->canReadLine();
+}
+
+QByteArray RecordingDevice::readLine()
+{
+    QByteArray line = m_device->readLine();
+
+    if (m_recorder) m_recorder->record(TrafficRecord::Received, line.constData(), line.length());
+
+    return line;
+}
+
+qint64 RecordingDevice::readLine(char *data, qint64 maxSize)
+{
+    qint64 length = m_device->readLine(data, maxSize);
+
+    if (m_recorder && length > 0) m_recorder->record(TrafficRecord::Received, data, length);
+
+    return length;
+}
@@ -0,0 +1,33 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef RECORDINGDEVICE_H
+#define RECORDINGDEVICE_H
+
+#include "bytedevice.h"
+#include "trafficlog.h"
+
+// Passes traffic to underlying device, writing it to recorder when one is open
+class RecordingDevice : public ByteDevice
+{
+public:
+    explicit RecordingDevice(ByteDevice *device = NULL, TrafficRecorder *recorder = NULL);
+
+    ByteDevice *device() const;
+    void setDevice(ByteDevice *device);
+
+    TrafficRecorder *recorder() const;
+    void setRecorder(TrafficRecorder *recorder);
+
+    bool isOpen() const;
+    qint64 write(const QByteArray &data);
+    bool canReadLine() const;
+    QByteArray readLine();
+    qint64 readLine(char *data, qint64 maxSize);
+
+private:
+    ByteDevice *m_device;
+    TrafficRecorder *m_recorder;
+};
+
+#endif // RECORDINGDEVICE_H
@@ -0,0 +1,167 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <cstring>
+#include "replaydevice.h"
+
+ReplayDevice::ReplayDevice(QObject *parent) : QObject(parent)
+{
+    m_hasRecord = false;
+    m_open = false;
+    m_started = false;
+    m_speed = 1;
+    m_bytesWritten = 0;
+    m_bufferPosition = 0;
+
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(onTimer()));
+}
+
+bool ReplayDevice::open(const QString &fileName)
+{
+    close();
+
+    if (!m_reader.open(fileName)) return false;
+
+    m_open = true;
+    m_started = false;
+    m_bytesWritten = 0;
+    m_hasRecord = readReceived();
+
+    return true;
+}
+
+void ReplayDevice::close()
+{
+    m_timer.stop();
+    m_reader.close();
+
+    m_open = false;
+    m_started = false;
+    m_hasRecord = false;
+    m_buffer.clear();
+    m_bufferPosition = 0;
+}
+
+double ReplayDevice::speed() const
+{
+    return m_speed;
+}
+
+void ReplayDevice::setSpeed(double speed)
+{
+    m_speed = speed;
+}
+
+qint64 ReplayDevice::bytesWritten() const
+{
+    return m_bytesWritten;
+}
+
+bool ReplayDevice::isOpen() const
+{
+    return m_open;
+}
+
+qint64 ReplayDevice::write(const QByteArray &data)
+{
+    if (!m_open) return -1;
+
+    m_bytesWritten += data.length();
+
+    // Log is recorded from port opening, first write is usually reset
+    if (!m_started) {
+        m_started = true;
+        m_clock.start();
+        scheduleNext();
+    }
+
+    return data.length();
+}
+
+bool ReplayDevice::canReadLine() const
+{
+    return m_buffer.indexOf('\n', m_bufferPosition) != -1;
+}
+
+QByteArray ReplayDevice::readLine()
+{
+    int end = m_buffer.indexOf('\n', m_bufferPosition);
+    int length = (end == -1 ? m_buffer.length() : end + 1) - m_bufferPosition;
+    QByteArray line = m_buffer.mid(m_bufferPosition, length);
+
+    m_bufferPosition += length;
+    if (m_bufferPosition == m_buffer.length()) {
+        m_buffer.clear();
+        m_bufferPosition = 0;
+    }
+
+    return line;
+}
+
+qint64 ReplayDevice::readLine(char *data, qint64 maxSize)
+{
+    // Same semantics as QIODevice: terminating zero is appended, line is cut at maxSize - 1
+    int end = m_buffer.indexOf('\n', m_bufferPosition);
+    int length = (end == -1 ? m_buffer.length() : end + 1) - m_bufferPosition;
+
+    if (maxSize < 2) return -1;
+    length = qMin<qint64>(length, maxSize - 1);
+
+    memcpy(data, m_buffer.constData() + m_bufferPosition, length);
+    data[length] = 0;
+
+    m_bufferPosition += length;
+    if (m_bufferPosition == m_buffer.length()) {
+        m_buffer.clear();
+        m_bufferPosition = 0;
+    }
+
+    return length;
+}
+
+void ReplayDevice::onTimer()
+{
+    qint64 time = m_clock.nsecsElapsed() / 1000;
+    bool received = false;
+
+    while (m_hasRecord && (m_speed > 0 ? m_record.time / m_speed <= time : !received)) {
+        m_buffer.append(m_record.data);
+        m_hasRecord = readReceived();
+        received = true;
+    }
+
+    if (received) emit readyRead();
+
+    // Could be closed by readyRead() receiver
+    if (!m_open) return;
+
+    if (m_hasRecord) {
+        scheduleNext();
+    } else {
+        // Receiver closes device with its port state
+        emit finished();
+        if (m_open) close();
+    }
+}
+
+bool ReplayDevice::readReceived()
+{
+    while (m_reader.read(m_record)) {
+        if (m_record.direction == TrafficRecord::Received) return true;
+    }
+
+    return false;
+}
+
+void ReplayDevice::scheduleNext()
+{
+    qint64 delay = 0;
+
+    if (m_speed > 0 && m_hasRecord) {
+        delay = (qint64)(m_record.time / m_speed / 1000) - m_clock.elapsed();
+    }
+
+    m_timer.start(qMax<qint64>(0, delay));
+}
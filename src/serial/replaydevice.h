@@ -0,0 +1,63 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef REPLAYDEVICE_H
+#define REPLAYDEVICE_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include "bytedevice.h"
+#include "trafficlog.h"
+
+// Feeds received part of traffic log back with original timing divided by speed factor.
+// Written bytes are dropped, controller answers are taken from log only.
+// Playback starts on first write.
+class ReplayDevice : public QObject, public ByteDevice
+{
+    Q_OBJECT
+public:
+    explicit ReplayDevice(QObject *parent = 0);
+
+    bool open(const QString &fileName);
+    void close();
+
+    // Zero speed delivers one record per event loop pass, without delays
+    double speed() const;
+    void setSpeed(double speed);
+
+    qint64 bytesWritten() const;
+
+    bool isOpen() const;
+    qint64 write(const QByteArray &data);
+    bool canReadLine() const;
+    QByteArray readLine();
+    qint64 readLine(char *data, qint64 maxSize);
+
+signals:
+    void readyRead();
+    void finished();
+
+private slots:
+    void onTimer();
+
+private:
+    TrafficReader m_reader;
+    TrafficRecord m_record;
+    bool m_hasRecord;
+    bool m_open;
+    bool m_started;
+    double m_speed;
+    qint64 m_bytesWritten;
+
+    QByteArray m_buffer;
+    int m_bufferPosition;
+
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+
+    bool readReceived();
+    void scheduleNext();
+};
+
+#endif // REPLAYDEVICE_H
@@ -0,0 +1,34 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include "serialportdevice.h"
+
+SerialPortDevice::SerialPortDevice(QSerialPort *port)
+{
+    m_port = port;
+}
+
+bool SerialPortDevice::isOpen() const
+{
+    return m_port->isOpen();
+}
+
+qint64 SerialPortDevice::write(const QByteArray &data)
+{
+    return m_port->write(data);
+}
+
+bool SerialPortDevice::canReadLine() const
+{
+    return m_port->canReadLine();
+}
+
+QByteArray SerialPortDevice::readLine()
+{
+    return m_port->readLine();
+}
+
+qint64 SerialPortDevice::readLine(char *data, qint64 maxSize)
+{
+    return m_port->readLine(data, maxSize);
+}
@@ -0,0 +1,25 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef SERIALPORTDEVICE_H
+#define SERIALPORTDEVICE_H
+
+#include <QtSerialPort/QSerialPort>
+#include "bytedevice.h"
+
+class SerialPortDevice : public ByteDevice
+{
+public:
+    explicit SerialPortDevice(QSerialPort *port);
+
+    bool isOpen() const;
+    qint64 write(const QByteArray &data);
+    bool canReadLine() const;
+    QByteArray readLine();
+    qint64 readLine(char *data, qint64 maxSize);
+
+private:
+    QSerialPort *m_port;
+};
+
+#endif // SERIALPORTDEVICE_H
@@ -0,0 +1,539 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QDebug>
+#include <QThread>
+#include <QFile>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QDateTime>
+#include <cstring>
+#include "serialworker.h"
+#include "grbljog.h"
+
+// Metrics are sampled every second and exported every 10 seconds
+const int METRICSINTERVAL = 1000;
+const int METRICSEXPORTPERIOD = 10;
+
+// Override steps are paced to let grbl main loop take each of them, milliseconds
+const int OVERRIDEINTERVAL = 5;
+
+SerialWorker::SerialWorker(QObject *parent) : QObject(parent),
+    m_interactiveQueue(256), m_programQueue(4096), m_realtimeQueue(64), m_responseQueue(4096), m_statusQueue(16), m_metricsQueue(4)
+{
+    m_serialPort = NULL;
+    m_portDevice = NULL;
+    m_replayDevice = NULL;
+    m_device.setRecorder(&m_recorder);
+    m_timerStateQuery = NULL;
+    m_timerMetrics = NULL;
+    m_timerOverrides = NULL;
+
+    m_statusInterval = 250;
+    m_bufferSize = 0;
+    m_metricsSamples = 0;
+
+    m_open.store(false);
+    m_wakeRequested.store(false);
+    m_resetRequests.store(0);
+    m_programDropId.store(-1);
+    m_bufferLength.store(0);
+    m_feedOverride.store(-1);
+    m_rapidOverride.store(-1);
+    m_spindleOverride.store(-1);
+    m_nextId = 0;
+
+    m_baudRate = 115200;
+}
+
+SerialWorker::~SerialWorker()
+{
+    delete m_portDevice;
+}
+
+void SerialWorker::initialize()
+{
+    // Objects should be created in worker thread
+    m_serialPort = new QSerialPort(this);
+    m_serialPort->setParity(QSerialPort::NoParity);
+    m_serialPort->setDataBits(QSerialPort::Data8);
+    m_serialPort->setFlowControl(QSerialPort::NoFlowControl);
+    m_serialPort->setStopBits(QSerialPort::OneStop);
+
+    connect(m_serialPort, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    connect(m_serialPort, SIGNAL(error(QSerialPort::SerialPortError)), this, SLOT(onError(QSerialPort::SerialPortError)));
+
+    m_portDevice = new SerialPortDevice(m_serialPort);
+    m_device.setDevice(m_portDevice);
+    m_streamer.setDevice(&m_device);
+
+    m_replayDevice = new ReplayDevice(this);
+    connect(m_replayDevice, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    connect(m_replayDevice, SIGNAL(finished()), this, SLOT(onReplayFinished()));
+
+    m_timerStateQuery = new QTimer(this);
+    m_timerStateQuery->setTimerType(Qt::PreciseTimer);
+    connect(m_timerStateQuery, SIGNAL(timeout()), this, SLOT(onTimerStateQuery()));
+
+    m_streamer.setMetrics(&m_metrics);
+
+    m_timerMetrics = new QTimer(this);
+    connect(m_timerMetrics, SIGNAL(timeout()), this, SLOT(onTimerMetrics()));
+    m_timerMetrics->start(METRICSINTERVAL);
+
+    m_timerOverrides = new QTimer(this);
+    m_timerOverrides->setTimerType(Qt::PreciseTimer);
+    m_timerOverrides->setInterval(OVERRIDEINTERVAL);
+    connect(m_timerOverrides, SIGNAL(timeout()), this, SLOT(onTimerOverrides()));
+}
+
+void SerialWorker::setPort(const QString &portName, int baudRate)
+{
+    m_portName = portName;
+    m_baudRate = baudRate;
+}
+
+QString SerialWorker::portName() const
+{
+    return m_portName;
+}
+
+int SerialWorker::baudRate() const
+{
+    return m_baudRate;
+}
+
+void SerialWorker::openPort()
+{
+    if (m_replayDevice->isOpen()) closePort();
+    if (m_serialPort->isOpen()) m_serialPort->close();
+
+    m_device.setDevice(m_portDevice);
+
+    m_serialPort->setPortName(m_portName);
+    m_serialPort->setBaudRate(m_baudRate);
+
+    // Other controller could be connected
+    if (m_bufferSize == 0) m_streamer.setBufferSize(GrblStreamer::DefaultBufferSize);
+
+    if (m_serialPort->open(QIODevice::ReadWrite)) {
+        // New log for every connection
+        if (!m_trafficFile.isEmpty()
+                && !m_recorder.open(m_trafficFile + QDateTime::currentDateTime().toString("-yyyyMMdd-hhmmss") + ".trf")) {
+            emit portError(tr("Can't create traffic log ") + m_trafficFile);
+        }
+
+        m_open.store(true);
+        m_metrics.clear();
+        m_timerStateQuery->start(m_statusInterval);
+        emit portOpened();
+    }
+}
+
+void SerialWorker::closePort()
+{
+    if (m_timerStateQuery) m_timerStateQuery->stop();
+
+    // Replay device could be closed already
+    if (m_open.load()) {
+        if (m_device.device() == m_replayDevice) m_replayDevice->close(); else m_serialPort->close();
+        m_recorder.close();
+        m_open.store(false);
+
+        m_streamer.clear();
+        clearCommandQueue();
+        m_bufferLength.store(0);
+
+        emit portClosed();
+    }
+}
+
+void SerialWorker::setStatusInterval(int interval)
+{
+    m_statusInterval = interval;
+    if (m_timerStateQuery && m_timerStateQuery->isActive()) m_timerStateQuery->setInterval(interval);
+}
+
+void SerialWorker::setBufferOptions(int bufferSize, bool plannerThrottle)
+{
+    // Fixed size, or default one until detected
+    if (bufferSize != m_bufferSize) {
+        m_bufferSize = bufferSize;
+        m_streamer.setBufferSize(bufferSize > 0 ? bufferSize : GrblStreamer::DefaultBufferSize);
+    }
+
+    m_streamer.setAutoBufferSize(bufferSize == 0);
+    m_streamer.setPlannerThrottle(plannerThrottle);
+}
+
+void SerialWorker::setMetricsFile(const QString &fileName)
+{
+    m_metricsFile = fileName;
+}
+
+void SerialWorker::setTrafficFile(const QString &fileName)
+{
+    m_trafficFile = fileName;
+}
+
+void SerialWorker::openReplay(const QString &fileName, double speed)
+{
+    closePort();
+
+    m_replayDevice->setSpeed(speed);
+    if (!m_replayDevice->open(fileName)) {
+        emit portError(tr("Can't open traffic log ") + fileName);
+        return;
+    }
+
+    m_device.setDevice(m_replayDevice);
+    if (m_bufferSize == 0) m_streamer.setBufferSize(GrblStreamer::DefaultBufferSize);
+
+    // Status queries are dropped, reports come from log
+    m_open.store(true);
+    m_metrics.clear();
+    m_timerStateQuery->start(m_statusInterval);
+    emit portOpened();
+}
+
+bool SerialWorker::isOpen() const
+{
+    return m_open.load();
+}
+
+int SerialWorker::bufferLength() const
+{
+    return m_bufferLength.load();
+}
+
+int SerialWorker::queueLength() const
+{
+    return m_interactiveQueue.count() + m_programQueue.count();
+}
+
+int SerialWorker::programQueueLength() const
+{
+    return m_programQueue.count();
+}
+
+int SerialWorker::sendCommand(const QString &command, int lane)
+{
+    SpscQueue<SerialCommand> &queue = lane == SerialCommand::Program ? m_programQueue : m_interactiveQueue;
+    SerialCommand sc;
+
+    sc.id = m_nextId;
+    sc.type = SerialCommand::Command;
+    sc.data = command.toLatin1();
+    sc.offset = 0;
+    sc.length = sc.data.length();
+
+    if (!queue.push(sc)) return -1;
+    m_nextId++;
+    wake();
+
+    return sc.id;
+}
+
+int SerialWorker::sendCommand(const QByteArray &buffer, int offset, int length)
+{
+    SerialCommand sc;
+
+    // Buffer is shared, not copied
+    sc.id = m_nextId;
+    sc.type = SerialCommand::Command;
+    sc.data = buffer;
+    sc.offset = offset;
+    sc.length = length;
+
+    if (!m_programQueue.push(sc)) return -1;
+    m_nextId++;
+    wake();
+
+    return sc.id;
+}
+
+int SerialWorker::reset()
+{
+    SerialCommand sc;
+
+    sc.id = m_nextId++;
+    sc.type = SerialCommand::Reset;
+    sc.offset = 0;
+    sc.length = 0;
+
+    // Reset marker is pushed in order, worker drops all commands queued before it
+    m_resetRequests.fetch_add(1);
+    while (!m_interactiveQueue.push(sc)) QThread::yieldCurrentThread();
+    wake();
+
+    return sc.id;
+}
+
+int SerialWorker::dropProgramCommands()
+{
+    // Consumer side of program queue is worker, so it drops lines by id
+    int id = m_nextId++;
+
+    m_programDropId.store(id);
+    wake();
+
+    return id;
+}
+
+void SerialWorker::sendRealtime(char byte)
+{
+    m_realtimeQueue.push(byte);
+    wake();
+}
+
+void SerialWorker::setOverrides(int feed, int rapid, int spindle)
+{
+    m_feedOverride.store(feed);
+    m_rapidOverride.store(rapid);
+    m_spindleOverride.store(spindle);
+    wake();
+}
+
+bool SerialWorker::takeResponse(SerialResponse &response)
+{
+    return m_responseQueue.pop(response);
+}
+
+bool SerialWorker::takeStatus(MachineState &state)
+{
+    return m_statusQueue.pop(state);
+}
+
+bool SerialWorker::takeMetrics(StreamerMetrics &metrics)
+{
+    return m_metricsQueue.pop(metrics);
+}
+
+void SerialWorker::wake()
+{
+    // Coalesce wake-ups, one queued call is enough to drain all queues
+    if (!m_wakeRequested.exchange(true)) QMetaObject::invokeMethod(this, "processQueues", Qt::QueuedConnection);
+}
+
+void SerialWorker::processQueues()
+{
+    m_wakeRequested.store(false);
+
+    if (!m_device.isOpen()) {
+        m_realtimeQueue.clear();
+        clearCommandQueue();
+        return;
+    }
+
+    // Realtime commands bypass buffer
+    char byte;
+    while (m_realtimeQueue.pop(byte)) {
+        m_streamer.sendRealtime(byte);
+        if (byte == (char)GrblJog::JogCancel) dropJogCommands();
+    }
+
+    // Reset
+    if (m_resetRequests.load() > 0) {
+        SerialCommand sc;
+        int id = -1;
+
+        while (m_resetRequests.load() > 0 && m_interactiveQueue.pop(sc)) {
+            if (sc.type == SerialCommand::Reset) {
+                id = sc.id;
+                m_resetRequests.fetch_sub(1);
+            }
+        }
+        if (id != -1) {
+            // Ids are taken in order, so program lines older than marker are known
+            SerialCommand *next;
+            while ((next = m_programQueue.peek()) && next->id < id) m_programQueue.pop(sc);
+
+            m_streamer.reset(id);
+            m_overrides.reset();
+        }
+    }
+
+    // Program lines queued before drop request
+    int dropId = m_programDropId.exchange(-1);
+    if (dropId != -1) {
+        SerialCommand *next;
+        SerialCommand sc;
+        while ((next = m_programQueue.peek()) && next->id < dropId) m_programQueue.pop(sc);
+    }
+
+    // Overrides
+    m_overrides.setTargets(m_feedOverride.load(), m_rapidOverride.load(), m_spindleOverride.load());
+
+    if (m_overrides.isBusy() && !m_timerOverrides->isActive()) m_timerOverrides->start();
+
+    // Send commands while they fit in controller buffer, with one write.
+    // Program lines wait while interactive command doesn't fit, else they would take all freed space.
+    SerialCommand *next;
+    SerialCommand sc;
+
+    while ((next = m_interactiveQueue.peek()) && next->type == SerialCommand::Command
+           && m_streamer.send(next->id, next->data.constData() + next->offset, next->length)) {
+        m_interactiveQueue.pop(sc);
+    }
+
+    if (!m_interactiveQueue.peek()) {
+        while ((next = m_programQueue.peek()) && m_streamer.send(next->id, next->data.constData() + next->offset, next->length)) {
+            m_programQueue.pop(sc);
+        }
+    }
+
+    m_streamer.flush();
+
+    m_bufferLength.store(m_streamer.bufferLength());
+}
+
+void SerialWorker::dropJogCommands()
+{
+    SerialCommand *next;
+
+    // Jog moves waiting for buffer space would start motion again after cancel
+    while ((next = m_interactiveQueue.peek()) && next->type == SerialCommand::Command
+           && next->length >= 3 && memcmp(next->data.constData() + next->offset, "$J=", 3) == 0) {
+        SerialCommand sc;
+        m_interactiveQueue.pop(sc);
+    }
+}
+
+void SerialWorker::clearCommandQueue()
+{
+    SerialCommand sc;
+
+    while (m_interactiveQueue.pop(sc)) {
+        if (sc.type == SerialCommand::Reset) m_resetRequests.fetch_sub(1);
+    }
+    m_programQueue.clear();
+}
+
+void SerialWorker::postResponse(int type, int id, const QString &data)
+{
+    SerialResponse response;
+
+    response.type = type;
+    response.id = id;
+    response.data = data;
+
+    // Keep order if UI thread falls behind
+    while (!m_pendingResponses.isEmpty() && m_responseQueue.push(m_pendingResponses.first())) m_pendingResponses.removeFirst();
+    if (!m_pendingResponses.isEmpty() || !m_responseQueue.push(response)) m_pendingResponses.append(response);
+}
+
+void SerialWorker::onReadyRead()
+{
+    SerialResponse response;
+    bool dropQueue;
+    char line[256];
+
+    while (m_device.canReadLine()) {
+        int length = m_device.readLine(line, sizeof(line));
+        if (length <= 0) continue;
+
+        // Status reports are parsed right from received bytes
+        if (line[0] == '<') {
+            if (m_streamer.processStatus(line, length, m_machineState)) {
+                m_overrides.processStatus(m_machineState);
+                m_statusQueue.push(m_machineState);
+            }
+            continue;
+        }
+
+        QString data = QString::fromLatin1(line, length).trimmed();
+        bool reseting = m_streamer.isReseting();
+
+        bool received = m_streamer.processLine(data, response, &dropQueue);
+
+        // Restore state query interval after reset
+        if (reseting && !m_streamer.isReseting()) m_timerStateQuery->setInterval(m_statusInterval);
+
+        // Unsent commands are obsolete on program end or hardware reset
+        // Grbl restores overrides too
+        if (dropQueue) {
+            clearCommandQueue();
+            m_overrides.reset();
+        }
+
+        if (!received) continue;
+
+        postResponse(response.type, response.id, response.data);
+    }
+
+    // Buffer space could be freed
+    processQueues();
+}
+
+void SerialWorker::onError(QSerialPort::SerialPortError error)
+{
+    static QSerialPort::SerialPortError previousError;
+
+    if (error != QSerialPort::NoError && error != previousError) {
+        previousError = error;
+        emit portError(tr("Serial port error ") + QString::number(error) + ": " + m_serialPort->errorString());
+        closePort();
+    }
+}
+
+void SerialWorker::onTimerStateQuery()
+{
+    m_streamer.queryStatus();
+
+    // Retry responses delayed by full queue
+    if (!m_pendingResponses.isEmpty()) {
+        while (!m_pendingResponses.isEmpty() && m_responseQueue.push(m_pendingResponses.first())) m_pendingResponses.removeFirst();
+    }
+}
+
+void SerialWorker::onTimerOverrides()
+{
+    if (m_open.load() && m_streamer.resetCompleted()) {
+        QByteArray overrides = m_overrides.commands();
+        for (int i = 0; i < overrides.length(); i++) m_streamer.sendRealtime(overrides.at(i));
+    }
+
+    if (!m_open.load() || !m_overrides.isBusy()) m_timerOverrides->stop();
+}
+
+void SerialWorker::onReplayFinished()
+{
+    closePort();
+    emit replayFinished();
+}
+
+void SerialWorker::onTimerMetrics()
+{
+    m_recorder.flush();
+
+    m_metrics.sample();
+    m_metricsQueue.push(m_metrics);
+
+    if (!m_open.load() || m_metricsFile.isEmpty()) return;
+
+    if (++m_metricsSamples >= METRICSEXPORTPERIOD) {
+        m_metricsSamples = 0;
+        exportMetrics();
+    }
+}
+
+void SerialWorker::exportMetrics()
+{
+    // CSV keeps history
+    QFile csv(m_metricsFile + ".csv");
+    bool header = csv.size() == 0;
+
+    if (csv.open(QIODevice::Append | QIODevice::Text)) {
+        QTextStream stream(&csv);
+        if (header) stream << StreamerMetrics::csvHeader() << "\n";
+        stream << m_metrics.csv(QDateTime::currentDateTime().toString(Qt::ISODate)) << "\n";
+    }
+
+    // Prometheus text file holds current values, replaced at once for textfile collectors
+    QSaveFile prometheus(m_metricsFile + ".prom");
+
+    if (prometheus.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        prometheus.write(m_metrics.prometheus().toUtf8());
+        prometheus.commit();
+    }
+}
@@ -0,0 +1,140 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef SERIALWORKER_H
+#define SERIALWORKER_H
+
+#include <QObject>
+#include <QtSerialPort/QSerialPort>
+#include <QTimer>
+#include <QList>
+#include <atomic>
+
+#include "utils/spscqueue.h"
+#include "grblstreamer.h"
+#include "grbloverrides.h"
+#include "serialportdevice.h"
+#include "recordingdevice.h"
+#include "replaydevice.h"
+
+struct SerialCommand {
+    enum Types { Command, Reset };
+    enum Lanes { Interactive, Program };
+
+    int id;
+    int type;
+    QByteArray data;                    // Command or shared program buffer
+    int offset;
+    int length;
+};
+
+// Owns serial port and character-counting sender. Lives in its own thread,
+// talks to UI thread through single-producer/single-consumer queues only.
+// Commands go by priority lanes: realtime bytes bypass everything, interactive
+// commands go ahead of next program line, program lines use remaining buffer space.
+class SerialWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SerialWorker(QObject *parent = 0);
+    ~SerialWorker();
+
+    // Called from UI thread, -1 is returned if queue is full
+    int sendCommand(const QString &command, int lane = SerialCommand::Interactive);
+    int sendCommand(const QByteArray &buffer, int offset, int length);  // Program lane
+    int reset();
+    int dropProgramCommands();          // Returns id of first program line sent after it
+    void sendRealtime(char byte);
+    void setOverrides(int feed, int rapid, int spindle);
+    bool takeResponse(SerialResponse &response);
+    bool takeStatus(MachineState &state);
+    bool takeMetrics(StreamerMetrics &metrics);
+
+    bool isOpen() const;
+    int bufferLength() const;
+    int queueLength() const;
+    int programQueueLength() const;
+
+    void setPort(const QString &portName, int baudRate);
+    QString portName() const;
+    int baudRate() const;
+
+signals:
+    void portOpened();
+    void portClosed();
+    void portError(QString message);
+    void replayFinished();
+
+public slots:
+    void initialize();
+    void openPort();
+    void closePort();
+    void setStatusInterval(int interval);
+    void setBufferOptions(int bufferSize, bool plannerThrottle);
+    void setMetricsFile(const QString &fileName);
+    void setTrafficFile(const QString &fileName);
+    void openReplay(const QString &fileName, double speed);
+
+private slots:
+    void onReadyRead();
+    void onError(QSerialPort::SerialPortError error);
+    void onTimerStateQuery();
+    void onTimerMetrics();
+    void onTimerOverrides();
+    void onReplayFinished();
+    void processQueues();
+
+private:
+    QSerialPort *m_serialPort;
+    SerialPortDevice *m_portDevice;
+    ReplayDevice *m_replayDevice;
+    RecordingDevice m_device;           // Active device, serial port or replay
+    TrafficRecorder m_recorder;
+    GrblStreamer m_streamer;
+    GrblOverrides m_overrides;
+    QTimer *m_timerStateQuery;
+    QTimer *m_timerMetrics;
+    QTimer *m_timerOverrides;
+
+    // UI -> worker
+    SpscQueue<SerialCommand> m_interactiveQueue;   // Also holds reset markers
+    SpscQueue<SerialCommand> m_programQueue;
+    SpscQueue<char> m_realtimeQueue;
+
+    // Worker -> UI
+    SpscQueue<SerialResponse> m_responseQueue;
+    SpscQueue<MachineState> m_statusQueue;
+    SpscQueue<StreamerMetrics> m_metricsQueue;
+    QList<SerialResponse> m_pendingResponses;
+
+    // Worker thread state
+    int m_statusInterval;
+    int m_bufferSize;                   // Zero to detect from status reports
+    MachineState m_machineState;
+    StreamerMetrics m_metrics;
+    QString m_metricsFile;              // Base name of .csv and .prom files, empty to disable export
+    int m_metricsSamples;
+    QString m_trafficFile;              // Base name of traffic logs, empty to disable recording
+
+    // Shared state
+    std::atomic<bool> m_open;
+    std::atomic<bool> m_wakeRequested;
+    std::atomic<int> m_resetRequests;
+    std::atomic<int> m_programDropId;   // Queued program lines older than it are dropped, -1 if none
+    std::atomic<int> m_bufferLength;
+    std::atomic<int> m_feedOverride;
+    std::atomic<int> m_rapidOverride;
+    std::atomic<int> m_spindleOverride;
+    int m_nextId;                       // UI thread only
+
+    QString m_portName;                 // Written by UI thread before port opening
+    int m_baudRate;
+
+    void wake();
+    void clearCommandQueue();
+    void dropJogCommands();
+    void postResponse(int type, int id, const QString &data);
+    void exportMetrics();
+};
+
+#endif // SERIALWORKER_H
@@ -0,0 +1,201 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QStringList>
+#include "streamermetrics.h"
+
+static QVector<double> latencyBounds()
+{
+    return QVector<double>() << 1 << 2 << 5 << 10 << 20 << 50 << 100 << 200 << 500 << 1000 << 2000 << 5000;
+}
+
+static QVector<double> fillBounds()
+{
+    return QVector<double>() << 10 << 20 << 30 << 40 << 50 << 60 << 70 << 80 << 90 << 100;
+}
+
+static QVector<double> intervalBounds()
+{
+    return QVector<double>() << 10 << 20 << 50 << 100 << 200 << 300 << 500 << 1000 << 2000;
+}
+
+static QVector<double> jitterBounds()
+{
+    return QVector<double>() << 1 << 2 << 5 << 10 << 20 << 50 << 100 << 200 << 500;
+}
+
+// Prometheus histogram in seconds or plain units
+static void appendHistogram(QStringList &lines, const QString &name, const QString &help,
+                            const Histogram &histogram, double scale)
+{
+    lines << QString("# HELP %1 %2").arg(name).arg(help);
+    lines << QString("# TYPE %1 histogram").arg(name);
+
+    int cumulative = 0;
+
+    for (int i = 0; i < histogram.bounds().count(); i++) {
+        cumulative += histogram.bucket(i);
+        lines << QString("%1_bucket{le=\"%2\"} %3").arg(name).arg(histogram.bounds().at(i) * scale).arg(cumulative);
+    }
+
+    lines << QString("%1_bucket{le=\"+Inf\"} %2").arg(name).arg(histogram.count());
+    lines << QString("%1_sum %2").arg(name).arg(histogram.sum() * scale);
+    lines << QString("%1_count %2").arg(name).arg(histogram.count());
+}
+
+static void appendValue(QStringList &lines, const QString &name, const QString &type, const QString &help, double value)
+{
+    lines << QString("# HELP %1 %2").arg(name).arg(help);
+    lines << QString("# TYPE %1 %2").arg(name).arg(type);
+    lines << QString("%1 %2").arg(name).arg(value, 0, 'g', 12);
+}
+
+StreamerMetrics::StreamerMetrics() :
+    latency(latencyBounds()), bufferFill(fillBounds()), statusInterval(intervalBounds()), statusJitter(jitterBounds())
+{
+    m_clock.start();
+
+    clear();
+}
+
+void StreamerMetrics::clear()
+{
+    linesSent = 0;
+    bytesSent = 0;
+    linesProcessed = 0;
+    errors = 0;
+    statusReports = 0;
+    underruns = 0;
+
+    linesPerSecond = 0;
+    bytesPerSecond = 0;
+
+    bufferLength = 0;
+    bufferSize = 0;
+    plannerBlocks = -1;
+
+    latency.clear();
+    bufferFill.clear();
+    statusInterval.clear();
+    statusJitter.clear();
+
+    m_statusTime = 0;
+    m_statusPeriod = 0;
+    m_plannerSize = 0;
+    m_plannerEmpty = false;
+
+    m_sampleTime = m_clock.nsecsElapsed();
+    m_sampleLines = 0;
+    m_sampleBytes = 0;
+}
+
+qint64 StreamerMetrics::timestamp() const
+{
+    return m_clock.nsecsElapsed();
+}
+
+void StreamerMetrics::commandSent(int bytes, int length, int size)
+{
+    linesSent++;
+    bytesSent += bytes;
+
+    bufferLength = length;
+    bufferSize = size;
+}
+
+void StreamerMetrics::commandProcessed(qint64 sentTime, bool error)
+{
+    linesProcessed++;
+    if (error) errors++;
+
+    latency.add((m_clock.nsecsElapsed() - sentTime) / 1e6);
+}
+
+void StreamerMetrics::statusReceived(const MachineState &state, int length, int size)
+{
+    qint64 time = m_clock.nsecsElapsed();
+
+    statusReports++;
+
+    // Intervals
+    if (m_statusTime > 0) {
+        qint64 period = time - m_statusTime;
+
+        statusInterval.add(period / 1e6);
+        if (m_statusPeriod > 0) statusJitter.add(qAbs(period - m_statusPeriod) / 1e6);
+
+        m_statusPeriod = period;
+    }
+    m_statusTime = time;
+
+    // Buffer
+    bufferLength = length;
+    bufferSize = size;
+    if (size > 0) bufferFill.add(100.0 * length / size);
+
+    // Planner, all blocks are free on idle
+    if (state.fields & MachineState::BufferField) {
+        plannerBlocks = state.plannerBlocks;
+        if (state.status == MachineState::Idle && plannerBlocks > m_plannerSize) m_plannerSize = plannerBlocks;
+
+        bool empty = state.status == MachineState::Run && m_plannerSize > 0 && plannerBlocks == m_plannerSize;
+        if (empty && !m_plannerEmpty) underruns++;
+        m_plannerEmpty = empty;
+    }
+}
+
+void StreamerMetrics::sample()
+{
+    qint64 time = m_clock.nsecsElapsed();
+    double seconds = (time - m_sampleTime) / 1e9;
+
+    if (seconds <= 0) return;
+
+    linesPerSecond = (linesProcessed - m_sampleLines) / seconds;
+    bytesPerSecond = (bytesSent - m_sampleBytes) / seconds;
+
+    m_sampleTime = time;
+    m_sampleLines = linesProcessed;
+    m_sampleBytes = bytesSent;
+}
+
+QString StreamerMetrics::prometheus() const
+{
+    QStringList lines;
+
+    appendValue(lines, "candle_lines_sent_total", "counter", "Commands sent to controller.", linesSent);
+    appendValue(lines, "candle_bytes_sent_total", "counter", "Command bytes sent to controller.", bytesSent);
+    appendValue(lines, "candle_lines_processed_total", "counter", "Commands answered by controller.", linesProcessed);
+    appendValue(lines, "candle_errors_total", "counter", "Commands answered with error.", errors);
+    appendValue(lines, "candle_status_reports_total", "counter", "Status reports received.", statusReports);
+    appendValue(lines, "candle_planner_underruns_total", "counter", "Planner emptied while running.", underruns);
+    appendValue(lines, "candle_lines_per_second", "gauge", "Commands answered per second.", linesPerSecond);
+    appendValue(lines, "candle_bytes_per_second", "gauge", "Command bytes sent per second.", bytesPerSecond);
+    appendValue(lines, "candle_rx_buffer_bytes", "gauge", "Bytes in controller receive buffer.", bufferLength);
+    appendValue(lines, "candle_rx_buffer_size_bytes", "gauge", "Controller receive buffer size.", bufferSize);
+    appendValue(lines, "candle_planner_free_blocks", "gauge", "Free planner blocks.", plannerBlocks);
+
+    appendHistogram(lines, "candle_command_latency_seconds", "Command round trip time.", latency, 0.001);
+    appendHistogram(lines, "candle_rx_buffer_fill_percent", "Receive buffer fill at status reports.", bufferFill, 1);
+    appendHistogram(lines, "candle_status_interval_seconds", "Time between status reports.", statusInterval, 0.001);
+    appendHistogram(lines, "candle_status_jitter_seconds", "Change of time between status reports.", statusJitter, 0.001);
+
+    return lines.join("\n") + "\n";
+}
+
+QString StreamerMetrics::csvHeader()
+{
+    return "time,lines_sent,bytes_sent,lines_processed,errors,underruns,lines_per_second,bytes_per_second,"
+           "rx_buffer_bytes,rx_buffer_size,planner_free_blocks,latency_p50_ms,latency_p99_ms,latency_max_ms,"
+           "status_interval_p50_ms,status_jitter_p99_ms";
+}
+
+QString StreamerMetrics::csv(const QString &time) const
+{
+    return QString("%1,%2,%3,%4,%5,%6,%7,%8,%9,%10,%11,%12,%13,%14,%15,%16").arg(time)
+            .arg(linesSent).arg(bytesSent).arg(linesProcessed).arg(errors).arg(underruns)
+            .arg(linesPerSecond, 0, 'f', 1).arg(bytesPerSecond, 0, 'f', 1)
+            .arg(bufferLength).arg(bufferSize).arg(plannerBlocks)
+            .arg(latency.percentile(0.5), 0, 'f', 1).arg(latency.percentile(0.99), 0, 'f', 1).arg(latency.max(), 0, 'f', 1)
+            .arg(statusInterval.percentile(0.5), 0, 'f', 1).arg(statusJitter.percentile(0.99), 0, 'f', 1);
+}
@@ -0,0 +1,67 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef STREAMERMETRICS_H
+#define STREAMERMETRICS_H
+
+#include <QString>
+#include <QElapsedTimer>
+#include "utils/histogram.h"
+#include "machinestate.h"
+
+// Counters and histograms of streaming, filled by sender. Copied by value
+// to show or export, times are in milliseconds.
+class StreamerMetrics
+{
+public:
+    StreamerMetrics();
+
+    void clear();
+
+    // Monotonic time for sent commands, nanoseconds
+    qint64 timestamp() const;
+
+    void commandSent(int bytes, int length, int size);
+    void commandProcessed(qint64 sentTime, bool error);
+    void statusReceived(const MachineState &state, int length, int size);
+
+    // Update rates since previous sample
+    void sample();
+
+    QString prometheus() const;
+    QString csv(const QString &time) const;
+    static QString csvHeader();
+
+    qint64 linesSent;
+    qint64 bytesSent;
+    qint64 linesProcessed;
+    qint64 errors;
+    qint64 statusReports;
+    qint64 underruns;               // Planner emptied while running
+
+    double linesPerSecond;
+    double bytesPerSecond;
+
+    int bufferLength;
+    int bufferSize;
+    int plannerBlocks;              // Free planner blocks, -1 if not reported
+
+    Histogram latency;              // Command "ok" round trip
+    Histogram bufferFill;           // Receive buffer fill at status reports, percents
+    Histogram statusInterval;
+    Histogram statusJitter;         // Difference of consecutive status intervals
+
+private:
+    QElapsedTimer m_clock;
+
+    qint64 m_statusTime;
+    qint64 m_statusPeriod;
+    int m_plannerSize;
+    bool m_plannerEmpty;
+
+    qint64 m_sampleTime;
+    qint64 m_sampleLines;
+    qint64 m_sampleBytes;
+};
+
+#endif // STREAMERMETRICS_H
@@ -0,0 +1,443 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include <QFile>
+#include <QTextStream>
+#include "parser/gcodeparser.h"
+#include "parser/gcodeviewparse.h"
+#include "parser/gcodepreprocessorutils.h"
+#include "streamjob.h"
+
+// Same order as machine state statuses
+static const char *statusCaptions[] = {"Unknown", "Idle", "Alarm", "Run", "Home", "Hold", "Queue", "Check", "Door",
+                                       "Jog", "Sleep"};
+
+StreamJob::StreamJob(QObject *parent) : QObject(parent), m_port(this), m_timerStatus(this), m_statusQueue(16)
+{
+    // Port and timer are children to follow job to its thread
+    m_port.setParity(QSerialPort::NoParity);
+    m_port.setDataBits(QSerialPort::Data8);
+    m_port.setFlowControl(QSerialPort::NoFlowControl);
+    m_port.setStopBits(QSerialPort::OneStop);
+
+    m_portDevice = new SerialPortDevice(&m_port);
+    m_streamer.setDevice(m_portDevice);
+    m_streamer.setMetrics(&m_metrics);
+
+    m_useHeightMap = false;
+    m_sentIndex = 0;
+    m_processedCount = 0;
+    m_errors = 0;
+    m_result = 1;
+    m_skipErrors = false;
+    m_echo = false;
+    m_streaming = false;
+    m_transferCompleted = false;
+    m_aborting = false;
+    m_finished = false;
+    m_startTime = 0;
+    m_reportInterval = 1000;
+    m_reportTime = 0;
+    m_running = false;
+    m_processedLines.store(0);
+    m_programLines.store(0);
+
+    for (int i = 0; i < 3; i++) m_holdPosition[i] = qQNaN();
+
+    m_timerStatus.setInterval(250);
+
+    connect(&m_port, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    connect(&m_port, SIGNAL(error(QSerialPort::SerialPortError)), this, SLOT(onPortError(QSerialPort::SerialPortError)));
+    connect(&m_timerStatus, SIGNAL(timeout()), this, SLOT(onTimerStatus()));
+}
+
+StreamJob::~StreamJob()
+{
+    delete m_portDevice;
+}
+
+void StreamJob::setPort(const QString &portName, int baudRate)
+{
+    m_port.setPortName(portName);
+    m_port.setBaudRate(baudRate);
+}
+
+void StreamJob::setBufferOptions(int bufferSize, bool plannerThrottle)
+{
+    // Zero size means detection, as in Candle
+    m_streamer.setAutoBufferSize(bufferSize == 0);
+    m_streamer.setBufferSize(bufferSize > 0 ? bufferSize : GrblStreamer::DefaultBufferSize);
+    m_streamer.setPlannerThrottle(plannerThrottle);
+}
+
+void StreamJob::setStatusInterval(int interval)
+{
+    m_timerStatus.setInterval(interval);
+}
+
+void StreamJob::setReportInterval(int interval)
+{
+    m_reportInterval = interval;
+}
+
+void StreamJob::setSkipErrors(bool skip)
+{
+    m_skipErrors = skip;
+}
+
+void StreamJob::setEcho(bool echo)
+{
+    m_echo = echo;
+}
+
+bool StreamJob::loadHeightMap(const QString &fileName)
+{
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    QTextStream textStream(&file);
+
+    // Border, grid and interpolation settings as saved by Candle, then heights by rows
+    QStringList border = textStream.readLine().split(";");
+    QStringList grid = textStream.readLine().split(";");
+    QStringList interpolation = textStream.readLine().split(";");
+
+    if (border.count() < 4 || grid.count() < 2 || interpolation.count() < 3) return false;
+
+    int pointsX = grid.at(0).toDouble();
+    int pointsY = grid.at(1).toDouble();
+
+    if (pointsX < 2 || pointsY < 2) return false;
+
+    m_heightMap.resize(pointsX, pointsY);
+
+    for (int i = 0; i < pointsY; i++) {
+        QStringList row = textStream.readLine().split(";");
+        if (row.count() < pointsX) return false;
+
+        for (int j = 0; j < pointsX; j++) m_heightMap.setData(m_heightMap.index(i, j), row.at(j).toDouble(), Qt::UserRole);
+    }
+
+    m_compensator.setHeightMap(QRectF(border.at(0).toDouble(), border.at(1).toDouble(),
+                                      border.at(2).toDouble(), border.at(3).toDouble()),
+                               &m_heightMap, interpolation.at(1).toDouble(), interpolation.at(2).toDouble());
+    m_useHeightMap = true;
+
+    return true;
+}
+
+bool StreamJob::load(const QString &fileName, double arcPrecision, bool arcDegreeMode)
+{
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    QTextStream textStream(&file);
+
+    // Lines are sent as they are, parser is needed for heightmap only
+    if (!m_useHeightMap) {
+        while (!textStream.atEnd()) {
+            QString trimmed = textStream.readLine().trimmed();
+            if (!trimmed.isEmpty()) m_program.append(trimmed);
+        }
+
+        return m_program.count() > 0;
+    }
+
+    GcodeParser gp;
+    QStringList commands;
+    QList<QStringList> args;
+    QList<int> lines;
+
+    while (!textStream.atEnd()) {
+        QString trimmed = textStream.readLine().trimmed();
+        if (trimmed.isEmpty()) continue;
+
+        QStringList arguments = GcodePreprocessorUtils::splitCommand(GcodePreprocessorUtils::removeComment(trimmed));
+        gp.addCommand(arguments);
+
+        commands.append(trimmed);
+        args.append(arguments);
+        lines.append(gp.getCommandNumber());
+    }
+
+    GcodeViewParse viewParser;
+    viewParser.getLinesFromParser(&gp, arcPrecision, arcDegreeMode);
+
+    m_compensator.compensate(viewParser.getLines());
+    m_compensator.startProgram(viewParser.getLines());
+
+    for (int i = 0; i < commands.count(); i++) {
+        foreach (const QString &command, m_compensator.programCommands(commands.at(i), args.at(i), lines.at(i))) {
+            m_program.append(command);
+        }
+    }
+
+    return m_program.count() > 0;
+}
+
+void StreamJob::setProgram(const WireBuffer &program)
+{
+    m_program = program;
+}
+
+bool StreamJob::start()
+{
+    if (m_running) return false;
+
+    if (!m_port.open(QIODevice::ReadWrite)) {
+        print(QString("Can't open port %1: %2").arg(m_port.portName()).arg(m_port.errorString()));
+        m_result = 1;
+        emit finished(m_result);
+        return false;
+    }
+
+    print(QString("Streaming %1 lines to %2").arg(m_program.count()).arg(m_port.portName()));
+
+    // Job could be started again on same port
+    m_state = MachineState();
+    m_sentIndex = 0;
+    m_processedCount = 0;
+    m_errors = 0;
+    m_streaming = false;
+    m_transferCompleted = false;
+    m_aborting = false;
+    m_finished = false;
+    m_startTime = 0;
+    m_reportTime = 0;
+    for (int i = 0; i < 3; i++) m_holdPosition[i] = qQNaN();
+
+    m_processedLines.store(0);
+    m_programLines.store(m_program.count());
+    m_running = true;
+
+    m_clock.start();
+    m_streamer.reset(ResetId);
+    m_timerStatus.start();
+
+    return true;
+}
+
+int StreamJob::result() const
+{
+    return m_result;
+}
+
+int StreamJob::processedLines() const
+{
+    return m_processedLines.load();
+}
+
+int StreamJob::programLines() const
+{
+    return m_programLines.load();
+}
+
+bool StreamJob::takeStatus(MachineState &state)
+{
+    return m_statusQueue.pop(state);
+}
+
+void StreamJob::pause()
+{
+    if (m_running) m_streamer.sendRealtime('!');
+}
+
+void StreamJob::resume()
+{
+    if (m_running) m_streamer.sendRealtime('~');
+}
+
+void StreamJob::onReadyRead()
+{
+    SerialResponse response;
+    bool dropQueue;
+    bool programEnd = false;
+
+    while (!m_finished && m_portDevice->canReadLine()) {
+        QByteArray line = m_portDevice->readLine();
+
+        if (line.startsWith('<')) {
+            if (m_streamer.processStatus(line.constData(), line.length(), m_state)) {
+                m_statusQueue.push(m_state);
+                processStatus();
+            }
+            continue;
+        }
+
+        QString data = QString::fromLatin1(line).trimmed();
+
+        if (!m_streamer.processLine(data, response, &dropQueue)) continue;
+        if (dropQueue) programEnd = true;
+
+        if (response.type == SerialResponse::Floating) {
+            print(data);
+            continue;
+        }
+        if (response.type != SerialResponse::Response) continue;
+
+        switch (response.id) {
+        case ResetId:
+        case BuildInfoId:
+            // Build info gives buffer size
+            if (response.id == ResetId && m_streamer.autoBufferSize()) {
+                m_streamer.send(BuildInfoId, "$I");
+                m_streamer.flush();
+            } else {
+                m_startTime = m_clock.nsecsElapsed();
+                m_streaming = true;
+            }
+            break;
+        case AbortId:
+            print("Job aborted");
+            finish(1);
+            break;
+        default:
+            m_processedCount++;
+            m_processedLines.store(m_processedCount);
+
+            if (response.data.contains("error")) {
+                m_errors++;
+                print(QString("Line %1: %2 < %3").arg(response.id + 1).arg(m_program.command(response.id)).arg(response.data));
+                if (!m_skipErrors) abort();
+            }
+        }
+    }
+
+    if (!m_streaming || m_aborting) return;
+
+    // Commands after program end are dropped
+    if (m_processedCount == m_program.count() || programEnd) {
+        m_streaming = false;
+        m_transferCompleted = true;
+    } else {
+        sendCommands();
+    }
+}
+
+void StreamJob::onTimerStatus()
+{
+    m_streamer.queryStatus();
+
+    if (m_reportInterval > 0 && m_clock.elapsed() - m_reportTime >= m_reportInterval) {
+        m_reportTime = m_clock.elapsed();
+        printProgress();
+    }
+}
+
+void StreamJob::onPortError(QSerialPort::SerialPortError error)
+{
+    if (error == QSerialPort::NoError || m_finished) return;
+
+    print("Serial port error: " + m_port.errorString());
+
+    finish(1);
+}
+
+void StreamJob::sendCommands()
+{
+    const QByteArray &data = m_program.data();
+
+    while (m_sentIndex < m_program.count()) {
+        const WireBuffer::Line &line = m_program.line(m_sentIndex);
+        if (!m_streamer.send(m_sentIndex, data.constData() + line.offset, line.length)) break;
+
+        m_sentIndex++;
+    }
+
+    m_streamer.flush();
+}
+
+void StreamJob::processStatus()
+{
+    if (m_state.status == MachineState::Alarm && (m_streaming || m_transferCompleted || m_aborting)) {
+        print("Alarm, streaming stopped");
+        finish(1);
+        return;
+    }
+
+    // Reset after machine stops on hold, as main form does on abort
+    if (m_aborting) {
+        if (m_streamer.isReseting()) return;
+
+        bool stopped = true;
+        for (int i = 0; i < 3; i++) {
+            if (m_state.machinePosition[i] != m_holdPosition[i]) stopped = false;
+            m_holdPosition[i] = m_state.machinePosition[i];
+        }
+
+        if (m_state.status == MachineState::Idle || (m_state.status == MachineState::Hold && stopped)) {
+            m_streamer.reset(AbortId);
+        }
+        return;
+    }
+
+    if (m_transferCompleted && m_state.status == MachineState::Idle) {
+        printProgress();
+        finish(m_errors > 0 ? 1 : 0);
+    }
+}
+
+void StreamJob::abort()
+{
+    if (!m_running || m_aborting) return;
+
+    print("Aborting job");
+
+    m_aborting = true;
+    m_streaming = false;
+    m_streamer.sendRealtime('!');
+}
+
+void StreamJob::printProgress()
+{
+    m_metrics.sample();
+
+    int status = m_state.status >= MachineState::Unknown && m_state.status <= MachineState::Sleep
+            ? m_state.status : MachineState::Unknown;
+    double elapsed = m_startTime > 0 ? (m_clock.nsecsElapsed() - m_startTime) / 1e9 : 0;
+    double percents = m_program.count() > 0 ? m_processedCount * 100.0 / m_program.count() : 0;
+
+    print(QString("%1 s  %2/%3 (%4%)  %5  X%6 Y%7 Z%8  F%9 S%10  buffer %11/%12  %13 lines/s  latency %14/%15 ms")
+           .arg(elapsed, 0, 'f', 1).arg(m_processedCount).arg(m_program.count()).arg(percents, 0, 'f', 1)
+           .arg(statusCaptions[status])
+           .arg(m_state.workPosition[0], 0, 'f', 3).arg(m_state.workPosition[1], 0, 'f', 3)
+           .arg(m_state.workPosition[2], 0, 'f', 3)
+           .arg(m_state.feed, 0, 'f', 0).arg(m_state.spindleSpeed, 0, 'f', 0)
+           .arg(m_metrics.bufferLength).arg(m_metrics.bufferSize)
+           .arg(m_metrics.linesPerSecond, 0, 'f', 1)
+           .arg(m_metrics.latency.percentile(0.5), 0, 'f', 0).arg(m_metrics.latency.percentile(0.99), 0, 'f', 0));
+}
+
+void StreamJob::print(const QString &text)
+{
+    if (m_echo) {
+        QTextStream out(stdout);
+        out << text << "\n";
+    }
+
+    emit message(text);
+}
+
+void StreamJob::finish(int result)
+{
+    if (m_finished) return;
+
+    double elapsed = m_startTime > 0 ? (m_clock.nsecsElapsed() - m_startTime) / 1e9 : 0;
+
+    print(QString("Lines: %1 of %2, errors: %3, underruns: %4, time: %5 s").arg(m_processedCount).arg(m_program.count())
+          .arg(m_errors).arg(m_metrics.underruns).arg(elapsed, 0, 'f', 1));
+
+    m_finished = true;
+    m_timerStatus.stop();
+
+    if (m_port.isOpen()) {
+        m_port.waitForBytesWritten(100);
+        m_port.close();
+    }
+
+    m_result = result;
+    m_running = false;
+    emit finished(m_result);
+}
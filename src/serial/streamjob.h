@@ -0,0 +1,110 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef STREAMJOB_H
+#define STREAMJOB_H
+
+#include <QObject>
+#include <QtSerialPort/QSerialPort>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <atomic>
+
+#include "serial/grblstreamer.h"
+#include "serial/serialportdevice.h"
+#include "serial/streamermetrics.h"
+#include "serial/wirebuffer.h"
+#include "parser/heightmapcompensator.h"
+#include "tables/heightmaptablemodel.h"
+#include "utils/spscqueue.h"
+
+// Streams program to grbl without main form. Program goes through the same
+// parser, heightmap compensation and character-counting sender as in Candle.
+// Used by headless sender and for additional machines of main form, then job
+// lives in its own thread: setters are called while job is not running, slots
+// including setup ones are invoked queued, status is taken by polling.
+class StreamJob : public QObject
+{
+    Q_OBJECT
+public:
+    explicit StreamJob(QObject *parent = 0);
+    ~StreamJob();
+
+    void setReportInterval(int interval);
+    void setSkipErrors(bool skip);
+    void setEcho(bool echo);
+
+    bool loadHeightMap(const QString &fileName);
+    bool load(const QString &fileName, double arcPrecision, bool arcDegreeMode);
+    int result() const;
+
+    // Any thread
+    int processedLines() const;
+    int programLines() const;
+    bool takeStatus(MachineState &state);
+
+signals:
+    void message(QString text);
+    void finished(int result);
+
+public slots:
+    void setPort(const QString &portName, int baudRate);
+    void setBufferOptions(int bufferSize, bool plannerThrottle);
+    void setStatusInterval(int interval);
+    void setProgram(const WireBuffer &program);
+    bool start();
+    void pause();
+    void resume();
+    void abort();
+
+private slots:
+    void onReadyRead();
+    void onTimerStatus();
+    void onPortError(QSerialPort::SerialPortError error);
+
+private:
+    enum { ResetId = -1, BuildInfoId = -2, AbortId = -3 };
+
+    QSerialPort m_port;
+    SerialPortDevice *m_portDevice;
+    GrblStreamer m_streamer;
+    StreamerMetrics m_metrics;
+    MachineState m_state;
+    WireBuffer m_program;               // Shares data with program it was set from
+
+    HeightMapTableModel m_heightMap;
+    HeightMapCompensator m_compensator;
+    bool m_useHeightMap;
+
+    int m_sentIndex;
+    int m_processedCount;
+    int m_errors;
+    int m_result;
+    bool m_skipErrors;
+    bool m_echo;                        // Messages go to stdout too
+    bool m_streaming;
+    bool m_transferCompleted;
+    bool m_aborting;
+    bool m_finished;
+    bool m_running;
+    double m_holdPosition[3];           // Machine stops on hold before reset
+
+    QTimer m_timerStatus;
+    QElapsedTimer m_clock;
+    qint64 m_startTime;
+    int m_reportInterval;
+    qint64 m_reportTime;
+
+    // Job thread -> other threads
+    SpscQueue<MachineState> m_statusQueue;
+    std::atomic<int> m_processedLines;
+    std::atomic<int> m_programLines;
+
+    void sendCommands();
+    void processStatus();
+    void printProgress();
+    void print(const QString &text);
+    void finish(int result);
+};
+
+#endif // STREAMJOB_H
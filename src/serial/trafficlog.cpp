@@ -0,0 +1,160 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include "trafficlog.h"
+
+static const char TRAFFICMAGIC[] = "CNDLTRF";
+const char TRAFFICVERSION = 1;
+
+static int writeVarint(char *buffer, quint64 value)
+{
+    int length = 0;
+
+    while (value >= 0x80) {
+        buffer[length++] = (char)((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    buffer[length++] = (char)value;
+
+    return length;
+}
+
+TrafficRecorder::TrafficRecorder()
+{
+    m_time = 0;
+}
+
+TrafficRecorder::~TrafficRecorder()
+{
+    close();
+}
+
+bool TrafficRecorder::open(const QString &fileName)
+{
+    close();
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+
+    m_file.write(TRAFFICMAGIC, sizeof(TRAFFICMAGIC) - 1);
+    m_file.write(&TRAFFICVERSION, 1);
+
+    m_clock.start();
+    m_time = 0;
+
+    return true;
+}
+
+void TrafficRecorder::close()
+{
+    if (m_file.isOpen()) m_file.close();
+}
+
+void TrafficRecorder::flush()
+{
+    if (m_file.isOpen()) m_file.flush();
+}
+
+bool TrafficRecorder::isOpen() const
+{
+    return m_file.isOpen();
+}
+
+void TrafficRecorder::record(int direction, const char *data, int length)
+{
+    if (!m_file.isOpen() || length <= 0) return;
+
+    qint64 time = m_clock.nsecsElapsed() / 1000;
+
+    // Header is built on stack, file buffers writes
+    char header[21];
+    int headerLength = 0;
+
+    header[headerLength++] = (char)direction;
+    headerLength += writeVarint(header + headerLength, time - m_time);
+    headerLength += writeVarint(header + headerLength, length);
+
+    m_file.write(header, headerLength);
+    m_file.write(data, length);
+
+    m_time = time;
+}
+
+TrafficReader::TrafficReader()
+{
+    m_position = 0;
+    m_time = 0;
+}
+
+bool TrafficReader::open(const QString &fileName)
+{
+    QFile file(fileName);
+
+    close();
+
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    m_data = file.readAll();
+    if (!m_data.startsWith(QByteArray(TRAFFICMAGIC) + TRAFFICVERSION)) {
+        m_data.clear();
+        return false;
+    }
+
+    m_position = sizeof(TRAFFICMAGIC);
+
+    return true;
+}
+
+void TrafficReader::close()
+{
+    m_data.clear();
+    m_position = 0;
+    m_time = 0;
+}
+
+bool TrafficReader::read(TrafficRecord &record)
+{
+    quint64 delta;
+    quint64 length;
+    int position = m_position;
+
+    if (atEnd()) return false;
+
+    record.direction = m_data.at(m_position++);
+
+    // Truncated record, log was not closed
+    if (!readVarint(delta) || !readVarint(length) || length > (quint64)(m_data.length() - m_position)) {
+        m_position = position;
+        m_data.truncate(position);
+        return false;
+    }
+
+    m_time += delta;
+    record.time = m_time;
+    record.data = m_data.mid(m_position, length);
+    m_position += length;
+
+    return true;
+}
+
+bool TrafficReader::atEnd() const
+{
+    return m_position >= m_data.length();
+}
+
+bool TrafficReader::readVarint(quint64 &value)
+{
+    int shift = 0;
+
+    value = 0;
+
+    while (m_position < m_data.length() && shift < 64) {
+        char byte = m_data.at(m_position++);
+
+        value |= (quint64)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+        shift += 7;
+    }
+
+    return false;
+}
@@ -0,0 +1,62 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef TRAFFICLOG_H
+#define TRAFFICLOG_H
+
+#include <QFile>
+#include <QByteArray>
+#include <QElapsedTimer>
+
+// Binary log of serial traffic. File starts with "CNDLTRF" and version byte,
+// then goes records of direction byte, time delta in microseconds and data length
+// as varints, and data bytes.
+struct TrafficRecord {
+    enum Directions { Sent, Received };
+
+    int direction;
+    qint64 time;                        // Microseconds since log start
+    QByteArray data;
+};
+
+class TrafficRecorder
+{
+public:
+    TrafficRecorder();
+    ~TrafficRecorder();
+
+    bool open(const QString &fileName);
+    void close();
+    void flush();
+    bool isOpen() const;
+
+    // Time is taken from monotonic clock
+    void record(int direction, const char *data, int length);
+
+private:
+    QFile m_file;
+    QElapsedTimer m_clock;
+    qint64 m_time;
+};
+
+class TrafficReader
+{
+public:
+    TrafficReader();
+
+    // Whole log is loaded to memory
+    bool open(const QString &fileName);
+    void close();
+
+    bool read(TrafficRecord &record);
+    bool atEnd() const;
+
+private:
+    QByteArray m_data;
+    int m_position;
+    qint64 m_time;
+
+    bool readVarint(quint64 &value);
+};
+
+#endif // TRAFFICLOG_H
@@ -0,0 +1,91 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#include "wirebuffer.h"
+
+static bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+void WireBuffer::clear()
+{
+    m_data.clear();
+    m_lines.clear();
+}
+
+void WireBuffer::reserve(int lines, int bytes)
+{
+    m_lines.reserve(lines);
+    m_data.reserve(bytes);
+}
+
+void WireBuffer::append(const QString &command)
+{
+    QByteArray bytes = command.toUpper().toLatin1();
+    const char *data = bytes.constData();
+    int length = bytes.length();
+
+    Line line;
+    line.offset = m_data.length();
+    line.length = length;
+    line.flags = 0;
+    line.spindleSpeed = 0;
+    line.feedRate = 0;
+
+    // Same words as "S0*(\d+)", "F([0-9.]+)" and "M0*2|M30" patterns match, first ones only
+    for (int i = 0; i < length; i++) {
+        int j = i + 1;
+
+        switch (data[i]) {
+        case 'S':
+            if (line.flags & SpindleSpeed) break;
+            while (j < length && isDigit(data[j])) j++;
+            if (j > i + 1) {
+                line.flags |= SpindleSpeed;
+                line.spindleSpeed = bytes.mid(i + 1, j - i - 1).toInt();
+            }
+            break;
+        case 'F':
+            if (line.flags & FeedRate) break;
+            while (j < length && (isDigit(data[j]) || data[j] == '.')) j++;
+            if (j > i + 1) {
+                line.flags |= FeedRate;
+                line.feedRate = bytes.mid(i + 1, j - i - 1).toDouble();
+            }
+            break;
+        case 'M':
+            while (j < length && data[j] == '0') j++;
+            if ((j < length && data[j] == '2') || (i + 2 < length && data[i + 1] == '3' && data[i + 2] == '0')) {
+                line.flags |= ProgramEnd;
+            }
+            break;
+        }
+    }
+
+    m_data.append(bytes);
+    m_data.append('\r');
+    m_lines.append(line);
+}
+
+int WireBuffer::count() const
+{
+    return m_lines.count();
+}
+
+const QByteArray &WireBuffer::data() const
+{
+    return m_data;
+}
+
+const WireBuffer::Line &WireBuffer::line(int index) const
+{
+    return m_lines.at(index);
+}
+
+QString WireBuffer::command(int index) const
+{
+    const Line &line = m_lines.at(index);
+
+    return QString::fromLatin1(m_data.constData() + line.offset, line.length);
+}
@@ -0,0 +1,41 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef WIREBUFFER_H
+#define WIREBUFFER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+
+// Program converted once to bytes as they go to controller: upper case lines
+// terminated by carriage return, stored contiguously. Words the sender reacts to
+// are found at conversion, so lines are not scanned again while streaming.
+class WireBuffer
+{
+public:
+    enum Flags { SpindleSpeed = 1, FeedRate = 2, ProgramEnd = 4 };
+
+    struct Line {
+        int offset;
+        int length;                     // Without terminator
+        int flags;
+        int spindleSpeed;
+        double feedRate;
+    };
+
+    void clear();
+    void reserve(int lines, int bytes);
+    void append(const QString &command);
+
+    int count() const;
+    const QByteArray &data() const;
+    const Line &line(int index) const;
+    QString command(int index) const;
+
+private:
+    QByteArray m_data;
+    QVector<Line> m_lines;
+};
+
+#endif // WIREBUFFER_H
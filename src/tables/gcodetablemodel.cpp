@@ -1,6 +1,7 @@
 // This file is a part of "Candle" application.
 // Copyright 2015-2016 Hayrullin Denis Ravilevich
 
+#include <QColor>
 #include "gcodetablemodel.h"
 
 GCodeTableModel::GCodeTableModel(QObject *parent) :
@@ -35,6 +36,8 @@ QVariant GCodeTableModel::data(const QModelIndex &index, int role) const
         }
     }
 
+    if (role == Qt::BackgroundRole && m_highlightedRows.contains(index.row())) return QColor(255, 200, 0, 64);
+
     if (role == Qt::TextAlignmentRole) {
         switch (index.column()) {
         case 0: return Qt::AlignCenter;
@@ -98,9 +101,22 @@ void GCodeTableModel::clear()
 //    foreach (GCodeItem* item, m_data) delete item;
 
     m_data.clear();
+    m_highlightedRows.clear();
     endResetModel();
 }
 
+void GCodeTableModel::resetStates(int skippedRows)
+{
+    // Last row is blank
+    for (int i = 0; i < m_data.count() - 1; i++) {
+        m_data[i].state = i < skippedRows ? GCodeItem::Skipped : GCodeItem::InQueue;
+        m_data[i].response = QString();
+    }
+
+    // Views are notified once
+    if (m_data.count() > 1) emit dataChanged(index(0, 2), index(m_data.count() - 2, 3));
+}
+
 int GCodeTableModel::rowCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent)
@@ -133,3 +149,10 @@ QList<GCodeItem> &GCodeTableModel::data()
 {
     return m_data;
 }
+
+void GCodeTableModel::setHighlightedRows(const QSet<int> &rows)
+{
+    m_highlightedRows = rows;
+
+    if (m_data.count() > 0) emit dataChanged(index(0, 0), index(m_data.count() - 1, columnCount() - 1));
+}
@@ -6,6 +6,8 @@
 
 #include <QAbstractTableModel>
 #include <QString>
+#include <QSet>
+#include "parser/modalstate.h"
 
 struct GCodeItem
 {
@@ -16,6 +18,7 @@ struct GCodeItem
     QString response;
     int line;
     QStringList args;
+    ModalState modal;                   // Parser state at line start
 };
 
 class GCodeTableModel : public QAbstractTableModel
@@ -30,6 +33,7 @@ public:
     bool removeRow(int row, const QModelIndex &parent = QModelIndex());
     bool removeRows(int row, int count, const QModelIndex &parent = QModelIndex());
     void clear();
+    void resetStates(int skippedRows);
 
     int rowCount(const QModelIndex &parent = QModelIndex()) const;
     int columnCount(const QModelIndex &parent = QModelIndex()) const;
@@ -39,6 +43,9 @@ public:
 
     QList<GCodeItem> &data();
 
+    // Rows changed by program transform, shown with background
+    void setHighlightedRows(const QSet<int> &rows);
+
 signals:
 
 public slots:
@@ -46,6 +53,7 @@ public slots:
 private:
     QList<GCodeItem> m_data;
     QStringList m_headers;
+    QSet<int> m_highlightedRows;
 };
 
 #endif // GCODETABLEMODEL_H
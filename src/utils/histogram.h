@@ -0,0 +1,91 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef HISTOGRAM
+#define HISTOGRAM
+
+#include <QVector>
+
+// Histogram with fixed bucket upper bounds, last bucket counts values above all bounds.
+// Adding value doesn't allocate.
+class Histogram
+{
+public:
+    explicit Histogram(const QVector<double> &bounds = QVector<double>())
+    {
+        m_bounds = bounds;
+        m_counts.fill(0, bounds.count() + 1);
+        m_count = 0;
+        m_sum = 0;
+        m_max = 0;
+    }
+
+    void add(double value)
+    {
+        int i = 0;
+        while (i < m_bounds.count() && value > m_bounds.at(i)) i++;
+
+        m_counts[i]++;
+        m_count++;
+        m_sum += value;
+        if (value > m_max) m_max = value;
+    }
+
+    void clear()
+    {
+        m_counts.fill(0);
+        m_count = 0;
+        m_sum = 0;
+        m_max = 0;
+    }
+
+    const QVector<double> &bounds() const
+    {
+        return m_bounds;
+    }
+
+    // Values in bucket, not cumulative
+    int bucket(int index) const
+    {
+        return m_counts.at(index);
+    }
+
+    int count() const
+    {
+        return m_count;
+    }
+
+    double sum() const
+    {
+        return m_sum;
+    }
+
+    double max() const
+    {
+        return m_max;
+    }
+
+    // Upper bound of bucket with given part of values, maximum for last bucket
+    double percentile(double part) const
+    {
+        if (m_count == 0) return 0;
+
+        int cumulative = 0;
+
+        for (int i = 0; i < m_bounds.count(); i++) {
+            cumulative += m_counts.at(i);
+            if (cumulative >= part * m_count) return qMin(m_bounds.at(i), m_max);
+        }
+
+        return m_max;
+    }
+
+private:
+    QVector<double> m_bounds;
+    QVector<int> m_counts;
+    int m_count;
+    double m_sum;
+    double m_max;
+};
+
+#endif // HISTOGRAM
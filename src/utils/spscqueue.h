@@ -0,0 +1,90 @@
+// This file is a part of "Candle" application.
+// Copyright 2015-2016 Hayrullin Denis Ravilevich
+
+#ifndef SPSCQUEUE
+#define SPSCQUEUE
+
+#include <QVector>
+#include <atomic>
+
+// Fixed size ring buffer for exactly one producer thread and one consumer thread.
+// Producer only moves head, consumer only moves tail, so no locks are needed.
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(int capacity = 1024)
+    {
+        int size = 1;
+        while (size < capacity) size <<= 1;
+
+        m_items.resize(size);
+        m_data = m_items.data();    // Detach once, slots are accessed by raw pointer from both threads
+        m_mask = size - 1;
+        m_head.store(0);
+        m_tail.store(0);
+    }
+
+    // Producer side
+    bool push(const T &item)
+    {
+        unsigned int head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) > (unsigned int)m_mask) return false;
+
+        m_data[head & m_mask] = item;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool pop(T &item)
+    {
+        unsigned int tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) return false;
+
+        item = m_data[tail & m_mask];
+        m_data[tail & m_mask] = T();   // Release shared data in consumer thread
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    T *peek()
+    {
+        unsigned int tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) return NULL;
+
+        return &m_data[tail & m_mask];
+    }
+
+    // Consumer side
+    void clear()
+    {
+        T item;
+        while (pop(item));
+    }
+
+    bool isEmpty() const
+    {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+    int count() const
+    {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+
+    int capacity() const
+    {
+        return m_mask + 1;
+    }
+
+private:
+    QVector<T> m_items;
+    T *m_data;
+    int m_mask;
+    std::atomic<unsigned int> m_head;
+    std::atomic<unsigned int> m_tail;
+};
+
+#endif // SPSCQUEUE
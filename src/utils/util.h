@@ -7,7 +7,9 @@
 #include <QColor>
 #include <QIcon>
 #include <QImage>
+#ifdef QT_WIDGETS_LIB
 #include <QAbstractButton>
+#endif
 #include <QVector3D>
 #include <QEventLoop>
 #include <QTimer>
@@ -52,10 +54,12 @@ public:
         return QIcon(QPixmap::fromImage(img));
     }
 
+#ifdef QT_WIDGETS_LIB
     static void invertButtonIconColors(QAbstractButton *button)
     {
         button->setIcon(invertIconColors(button->icon()));
     }
+#endif
 };
 
 #endif // UTIL